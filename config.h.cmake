@@ -65,4 +65,5 @@
 #cmakedefine HAVE_CLOCK_GETTIME 1
 #cmakedefine HAVE_GETTIMEOFDAY 1
 #cmakedefine HAVE_RINT 1
+#cmakedefine HAVE_PTHREAD 1
 
@@ -37,7 +37,8 @@ static const char *_CONFIG_VAR[]=
       "MINC_MAX_MEMORY_KB",
       "MINC_FILE_CACHE_MB",
       "MINC_CHECKSUM",
-      "MINC_PREFER_V2_API"
+      "MINC_PREFER_V2_API",
+      "MINC_MAX_THREADS"
   };
 
 enum {
@@ -12,6 +12,7 @@ enum MINC_CONFIG {
   MICFG_MINC_FILE_CACHE,
   MICFG_MINC_CHECKSUM,
   MICFG_MINC_PREFER_V2_API,
+  MICFG_MAX_THREADS,
   MICFG_COUNT
 };
 
@@ -0,0 +1,170 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+#include <stdlib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "minc_common_defs.h"
+#include "minc_config.h"
+#include "minc_parallel.h"
+
+/* Number of chunks handed out per thread, so that uneven chunks
+   still balance out between workers */
+#define MIPARALLEL_CHUNKS_PER_THREAD 4
+
+#ifdef HAVE_PTHREAD
+
+/* Shared state of one miparallel_for() call */
+typedef struct {
+  pthread_mutex_t lock;
+  long next;              /* First item not yet handed out */
+  long n_items;
+  long chunk;
+  miparallel_func func;
+  void *data;
+  int status;
+} miparallel_job;
+
+typedef struct {
+  miparallel_job *job;
+  int thread;
+} miparallel_worker;
+
+/* Set in worker threads so that nested loops run serially */
+static pthread_key_t _miparallel_key;
+static pthread_once_t _miparallel_once = PTHREAD_ONCE_INIT;
+
+static void miparallel_init_key(void)
+{
+  pthread_key_create(&_miparallel_key, NULL);
+}
+
+static void *miparallel_run(void *arg)
+{
+  miparallel_worker *worker = (miparallel_worker *) arg;
+  miparallel_job *job = worker->job;
+  long first, last;
+  int status;
+
+  pthread_setspecific(_miparallel_key, job);
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    first = job->next;
+    last = first + job->chunk;
+    if (last > job->n_items)
+      last = job->n_items;
+    job->next = last;
+    status = job->status;
+    pthread_mutex_unlock(&job->lock);
+
+    if (first >= last || status != MI_NOERROR)
+      break;
+
+    if ((*job->func)(first, last, worker->thread, job->data) != MI_NOERROR) {
+      pthread_mutex_lock(&job->lock);
+      job->status = MI_ERROR;
+      pthread_mutex_unlock(&job->lock);
+    }
+  }
+
+  pthread_setspecific(_miparallel_key, NULL);
+  return NULL;
+}
+
+#endif /*HAVE_PTHREAD*/
+
+int miget_parallel_threads(void)
+{
+#ifdef HAVE_PTHREAD
+  int n_threads = 1;
+
+  pthread_once(&_miparallel_once, miparallel_init_key);
+  if (pthread_getspecific(_miparallel_key) != NULL)
+    return 1;
+
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+  n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (miget_cfg_present(MICFG_MAX_THREADS) &&
+      miget_cfg_int(MICFG_MAX_THREADS) > 0) {
+    n_threads = miget_cfg_int(MICFG_MAX_THREADS);
+  }
+  return (n_threads < 1) ? 1 : n_threads;
+#else
+  return 1;
+#endif
+}
+
+int miparallel_for(long n_items, long grain, miparallel_func func, void *data)
+{
+#ifdef HAVE_PTHREAD
+  miparallel_job job;
+  miparallel_worker *workers;
+  pthread_t *threads;
+  int n_threads;
+  int n_started;
+  int i;
+#endif
+
+  if (n_items <= 0)
+    return MI_NOERROR;
+  if (grain < 1)
+    grain = 1;
+
+#ifdef HAVE_PTHREAD
+  n_threads = miget_parallel_threads();
+  if ((long) n_threads > n_items / grain)
+    n_threads = (int) (n_items / grain);
+
+  if (n_threads > 1) {
+    workers = (miparallel_worker *) malloc(n_threads * sizeof(*workers));
+    threads = (pthread_t *) malloc(n_threads * sizeof(*threads));
+
+    if (workers != NULL && threads != NULL) {
+      pthread_mutex_init(&job.lock, NULL);
+      job.next = 0;
+      job.n_items = n_items;
+      job.chunk = n_items / ((long) n_threads * MIPARALLEL_CHUNKS_PER_THREAD);
+      if (job.chunk < grain)
+        job.chunk = grain;
+      job.func = func;
+      job.data = data;
+      job.status = MI_NOERROR;
+
+      /* The calling thread is worker 0 */
+      n_started = 1;
+      for (i = 1; i < n_threads; i++) {
+        workers[i].job = &job;
+        workers[i].thread = i;
+        if (pthread_create(&threads[i], NULL, miparallel_run, &workers[i]) != 0)
+          break;
+        n_started++;
+      }
+      workers[0].job = &job;
+      workers[0].thread = 0;
+      miparallel_run(&workers[0]);
+
+      for (i = 1; i < n_started; i++)
+        pthread_join(threads[i], NULL);
+
+      pthread_mutex_destroy(&job.lock);
+      free(workers);
+      free(threads);
+      return job.status;
+    }
+    free(workers);
+    free(threads);
+  }
+#endif /*HAVE_PTHREAD*/
+
+  return (*func)(0, n_items, 0, data);
+}
@@ -0,0 +1,30 @@
+/*
+ * \file minc_parallel.h
+ * \brief Minimal parallel loop helper shared by the MINC libraries.
+ */
+#ifndef MINC_PARALLEL_H
+#define MINC_PARALLEL_H
+
+/** Function called by miparallel_for() for the items [first, last).
+ *  thread is the index of the calling worker, in the range
+ *  0 .. miget_parallel_threads()-1, so that callers can keep per-thread
+ *  scratch space. Should return MI_NOERROR or MI_ERROR.
+ */
+typedef int (*miparallel_func)(long first, long last, int thread, void *data);
+
+/** Returns the maximum number of threads miparallel_for() will use.
+ *  This is the number of online processors, unless the MINC_MAX_THREADS
+ *  configuration variable is set. It is 1 when the library was built
+ *  without thread support or when called from inside a parallel loop.
+ */
+int miget_parallel_threads(void);
+
+/** Calls func over the items 0 .. n_items-1, split into chunks of at
+ *  least grain items which are handed out to worker threads as they
+ *  become free. Falls back to a single call on the current thread when
+ *  there is not enough work for more than one chunk.
+ *  Returns MI_ERROR if any call to func failed.
+ */
+int miparallel_for(long n_items, long grain, miparallel_func func, void *data);
+
+#endif /*MINC_PARALLEL_H*/
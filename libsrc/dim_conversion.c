@@ -15,6 +15,9 @@
                  MI_icv_get_dim_conversion
                  MI_icv_dimconvert
                  MI_icv_dimconv_init
+                 MI_icv_dimconv_fast_ok
+                 MI_icv_dimconvert_fast
+                 MI_icv_dimconvert_rows
 @CREATED    : September 9, 1992. (Peter Neelin)
 @MODIFIED   :
  * $Log: dim_conversion.c,v $
@@ -93,6 +96,71 @@
 #include "minc_private.h"
 #include <math.h>
 #include <type_limits.h>
+#include "minc_parallel.h"
+
+/* Approximate number of input pixels given to each thread by the fast
+   dimension conversion path */
+#define MI_DIMCONV_GRAIN_PIXELS 65536
+
+/* Typed row kernels for the fast dimension conversion path. A row is n
+   values separated by step bytes (step may be negative for flipped user
+   buffers). */
+typedef void (*mi_dimconv_load_func)(long n, const char *ptr, long step,
+                                     double *dvalues);
+typedef void (*mi_dimconv_store_func)(long n, double *dvalues,
+                                      char *ptr, long step);
+
+#define MI_DIMCONV_LOAD(name, type) \
+PRIVATE void MI_dimconv_load_##name(long n, const char *ptr, long step, \
+                                    double *dvalues) \
+{ \
+   long i; \
+   for (i = 0; i < n; i++) \
+      dvalues[i] = (double) *((const type *) (ptr + i * step)); \
+}
+
+#define MI_DIMCONV_STORE(name, type, STORE) \
+PRIVATE void MI_dimconv_store_##name(long n, double *dvalues, \
+                                     char *ptr, long step) \
+{ \
+   long i; \
+   double dvalue; \
+   for (i = 0; i < n; i++) { \
+      dvalue = dvalues[i]; \
+      STORE(dvalue, (type *) (ptr + i * step)) \
+   } \
+}
+
+MI_DIMCONV_LOAD(uchar,  unsigned char)
+MI_DIMCONV_LOAD(schar,  signed char)
+MI_DIMCONV_LOAD(ushort, unsigned short)
+MI_DIMCONV_LOAD(sshort, signed short)
+MI_DIMCONV_LOAD(uint,   unsigned int)
+MI_DIMCONV_LOAD(sint,   signed int)
+MI_DIMCONV_LOAD(float,  float)
+MI_DIMCONV_LOAD(double, double)
+
+MI_DIMCONV_STORE(uchar,  unsigned char,  MI_STORE_UCHAR)
+MI_DIMCONV_STORE(schar,  signed char,    MI_STORE_SCHAR)
+MI_DIMCONV_STORE(ushort, unsigned short, MI_STORE_USHORT)
+MI_DIMCONV_STORE(sshort, signed short,   MI_STORE_SSHORT)
+MI_DIMCONV_STORE(uint,   unsigned int,   MI_STORE_UINT)
+MI_DIMCONV_STORE(sint,   signed int,     MI_STORE_SINT)
+MI_DIMCONV_STORE(float,  float,          MI_STORE_FLOAT)
+MI_DIMCONV_STORE(double, double,         MI_STORE_DOUBLE)
+
+/* Structure for passing values to MI_icv_dimconvert_rows */
+typedef struct {
+   mi_icv_type *icvp;
+   mi_icv_dimconv_type *dcp;
+   mi_dimconv_load_func load;
+   mi_dimconv_store_func store;
+   int fastdim;
+   long ncols;                  /* Output pixels per row */
+   double dmin, dmax;           /* Range limits for fillvalue checking */
+   double *dscratch;            /* 2*ncols doubles per thread */
+   char *oscratch;              /* ncols out-of-range flags per thread */
+} mi_icv_dimconv_fast_type;
 
 /* Private functions */
 PRIVATE int MI_icv_get_dim(mi_icv_type *icvp, int cdfid, int varid);
@@ -108,6 +176,12 @@ PRIVATE int MI_icv_dimconv_init(int operation, mi_icv_type *icvp,
                               mi_icv_dimconv_type *dcp,
                               long start[], long count[], void *values,
                               long bufstart[], long bufcount[], void *buffer);
+PRIVATE int MI_icv_dimconv_fast_ok(int operation, mi_icv_type *icvp,
+                                  mi_icv_dimconv_type *dcp);
+PRIVATE int MI_icv_dimconvert_fast(mi_icv_type *icvp,
+                                   mi_icv_dimconv_type *dcp);
+PRIVATE int MI_icv_dimconvert_rows(long first, long last, int thread,
+                                   void *caller_data);
 
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -641,6 +715,11 @@ PRIVATE int MI_icv_dimconvert(int operation, mi_icv_type *icvp,
    {MI_CHK_ERR(MI_icv_dimconv_init(operation, icvp, dcp, start, count, values,
                                    bufstart, bufcount, buffer))}
 
+   /* Use the typed row kernels if the geometry allows it */
+   if (dcp->do_fast && (MI_icv_dimconvert_fast(icvp, dcp) == MI_NOERROR)) {
+      MI_RETURN(MI_NOERROR);
+   }
+
    /* Initialize local variables */
    iptr    = dcp->istart;
    optr    = dcp->ostart;
@@ -1038,5 +1117,269 @@ PRIVATE int MI_icv_dimconv_init(int operation, mi_icv_type *icvp,
       dcp->istart = (void *) ((char *) values + values_off);
    }                   /* if PUT */
 
+   /* Check whether the fast path can be used for this buffer */
+   dcp->do_fast = MI_icv_dimconv_fast_ok(operation, icvp, dcp);
+
    MI_RETURN(MI_NOERROR);
 }
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_dimconv_fast_ok
+@INPUT      : operation  - MI_PRIV_GET or MI_PRIV_PUT
+              icvp       - icv structure pointer
+              dcp        - dimconvert structure pointer (set up by
+                           MI_icv_dimconv_init)
+@OUTPUT     : (none)
+@RETURNS    : TRUE if MI_icv_dimconvert_fast can be used
+@DESCRIPTION: Decides whether a buffer can be converted with the typed row
+              kernels. This covers reads with pure flips (no resizing) and
+              with integer down-sampling, as long as every averaged block
+              lies completely within the variable buffer, so that no
+              per-pixel bounds checks or partial sums from a previous
+              buffer are needed. Expansion and writes use the generic loop.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : October 19, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+PRIVATE int MI_icv_dimconv_fast_ok(int operation, mi_icv_type *icvp,
+                                  mi_icv_dimconv_type *dcp)
+{
+   int fastdim;
+   int idim;
+   long ipix;
+   long min_off, max_off, extent;
+   int typelen;
+
+   if ((operation != MI_PRIV_GET) || dcp->do_expand)
+      return FALSE;
+
+   if ((MI_convert_index(dcp->intype, dcp->insign) == MI_ERROR) ||
+       (MI_convert_index(dcp->outtype, dcp->outsign) == MI_ERROR))
+      return FALSE;
+
+   fastdim = icvp->derv_dimconv_fastdim;
+   if (fastdim < 0)
+      return FALSE;
+
+   extent = 0;
+   for (idim = 0; idim <= fastdim; idim++) {
+      if ((dcp->end[idim] <= 0) || (dcp->istep[idim] < 0))
+         return FALSE;
+      extent += (dcp->end[idim] - 1) * dcp->istep[idim];
+   }
+
+   /* Every averaged block must be inside the buffer */
+   if (dcp->do_compress) {
+      if (dcp->in_pix_num <= 0)
+         return FALSE;
+      min_off = max_off = dcp->in_pix_off[0];
+      for (ipix = 1; ipix < dcp->in_pix_num; ipix++) {
+         min_off = MIN(min_off, dcp->in_pix_off[ipix]);
+         max_off = MAX(max_off, dcp->in_pix_off[ipix]);
+      }
+      typelen = nctypelen(dcp->intype);
+      if (((char *) dcp->istart + min_off < (char *) dcp->in_pix_first) ||
+          ((char *) dcp->istart + extent + max_off + typelen - 1 >
+           (char *) dcp->in_pix_last))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_dimconvert_fast
+@INPUT      : icvp       - icv structure pointer
+              dcp        - dimconvert structure pointer
+@OUTPUT     : (none)
+@RETURNS    : MI_ERROR if the fast path could not be run
+@DESCRIPTION: Converts a buffer row by row with typed load and store
+              kernels, splitting the rows between threads. The values
+              produced are the same as those of the generic loop in
+              MI_icv_dimconvert.
+@METHOD     :
+@GLOBALS    :
+@CALLS      : miparallel_for
+@CREATED    : October 19, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+PRIVATE int MI_icv_dimconvert_fast(mi_icv_type *icvp,
+                                   mi_icv_dimconv_type *dcp)
+{
+   mi_icv_dimconv_fast_type fast;
+   int fastdim;
+   int idim;
+   int nthreads;
+   long nrows;
+   long grain;
+   double epsilon;
+   int status;
+
+   fastdim = icvp->derv_dimconv_fastdim;
+
+   fast.icvp = icvp;
+   fast.dcp = dcp;
+   fast.fastdim = fastdim;
+   fast.ncols = dcp->end[fastdim];
+   fast.load = NULL;
+   fast.store = NULL;
+
+   switch (MI_convert_index(dcp->intype, dcp->insign)) {
+   case 0: fast.load = MI_dimconv_load_uchar; break;
+   case 1: fast.load = MI_dimconv_load_schar; break;
+   case 2: fast.load = MI_dimconv_load_ushort; break;
+   case 3: fast.load = MI_dimconv_load_sshort; break;
+   case 4: fast.load = MI_dimconv_load_uint; break;
+   case 5: fast.load = MI_dimconv_load_sint; break;
+   case 6: fast.load = MI_dimconv_load_float; break;
+   case 7: fast.load = MI_dimconv_load_double; break;
+   }
+   switch (MI_convert_index(dcp->outtype, dcp->outsign)) {
+   case 0: fast.store = MI_dimconv_store_uchar; break;
+   case 1: fast.store = MI_dimconv_store_schar; break;
+   case 2: fast.store = MI_dimconv_store_ushort; break;
+   case 3: fast.store = MI_dimconv_store_sshort; break;
+   case 4: fast.store = MI_dimconv_store_uint; break;
+   case 5: fast.store = MI_dimconv_store_sint; break;
+   case 6: fast.store = MI_dimconv_store_float; break;
+   case 7: fast.store = MI_dimconv_store_double; break;
+   }
+   if ((fast.load == NULL) || (fast.store == NULL))
+      return MI_ERROR;
+
+   fast.dmax = icvp->fill_valid_max;
+   fast.dmin = icvp->fill_valid_min;
+   epsilon = (fast.dmax - fast.dmin) * FILLVALUE_EPSILON;
+   epsilon = fabs(epsilon);
+   fast.dmax += epsilon;
+   fast.dmin -= epsilon;
+
+   /* Number of rows over all of the slower dimensions */
+   nrows = 1;
+   for (idim = 0; idim < fastdim; idim++)
+      nrows *= dcp->end[idim];
+
+   /* Allocate scratch rows for every thread */
+   nthreads = miget_parallel_threads();
+   fast.dscratch = MALLOC(2 * fast.ncols * nthreads, double);
+   fast.oscratch = MALLOC(fast.ncols * nthreads, char);
+   if ((fast.dscratch == NULL) || (fast.oscratch == NULL)) {
+      if (fast.dscratch != NULL) FREE(fast.dscratch);
+      if (fast.oscratch != NULL) FREE(fast.oscratch);
+      return MI_ERROR;
+   }
+
+   grain = MI_DIMCONV_GRAIN_PIXELS /
+      (fast.ncols * (dcp->do_compress ? dcp->in_pix_num : 1));
+   status = miparallel_for(nrows, MAX(1, grain),
+                           MI_icv_dimconvert_rows, &fast);
+
+   FREE(fast.dscratch);
+   FREE(fast.oscratch);
+
+   return status;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_dimconvert_rows
+@INPUT      : first       - first row to convert
+              last        - one past the last row to convert
+              thread      - index of the calling thread
+              caller_data - pointer to mi_icv_dimconv_fast_type
+@OUTPUT     : (none)
+@RETURNS    : MI_NOERROR
+@DESCRIPTION: Worker for MI_icv_dimconvert_fast. Converts rows of the
+              fastest varying dimension, averaging the pixels given by
+              in_pix_off when compressing.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : October 19, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+PRIVATE int MI_icv_dimconvert_rows(long first, long last, int thread,
+                                   void *caller_data)
+{
+   mi_icv_dimconv_fast_type *fast = (mi_icv_dimconv_fast_type *) caller_data;
+   mi_icv_type *icvp = fast->icvp;
+   mi_icv_dimconv_type *dcp = fast->dcp;
+   int fastdim = fast->fastdim;
+   long ncols = fast->ncols;
+   double *dvalues = fast->dscratch + 2 * ncols * thread;
+   double *sums = dvalues + ncols;
+   char *out_of_range = fast->oscratch + ncols * thread;
+   double dmin = fast->dmin;
+   double dmax = fast->dmax;
+   int do_fillvalue = icvp->do_fillvalue;
+   int do_scale = icvp->do_scale;
+   double scale = icvp->scale;
+   double offset = icvp->offset;
+   double fillvalue = icvp->user_fillvalue;
+   double npix;
+   char *iptr, *optr;
+   long irow, index, icol, ipix;
+   int idim;
+
+   for (irow = first; irow < last; irow++) {
+
+      /* Find the start of the row from its index */
+      iptr = (char *) dcp->istart;
+      optr = (char *) dcp->ostart;
+      index = irow;
+      for (idim = fastdim - 1; idim >= 0; idim--) {
+         iptr += (index % dcp->end[idim]) * dcp->istep[idim];
+         optr += (index % dcp->end[idim]) * dcp->ostep[idim];
+         index /= dcp->end[idim];
+      }
+
+      if (!dcp->do_compress) {
+         (*fast->load)(ncols, iptr, dcp->istep[fastdim], dvalues);
+         for (icol = 0; icol < ncols; icol++) {
+            if (do_fillvalue &&
+                ((dvalues[icol] < dmin) || (dvalues[icol] > dmax)))
+               dvalues[icol] = fillvalue;
+            else if (do_scale)
+               dvalues[icol] = scale * dvalues[icol] + offset;
+         }
+      }
+      else {
+         /* Sum the pixels of each block in the same order as the
+            generic loop so that the averages are identical */
+         for (icol = 0; icol < ncols; icol++) {
+            sums[icol] = 0.0;
+            out_of_range[icol] = FALSE;
+         }
+         for (ipix = 0; ipix < dcp->in_pix_num; ipix++) {
+            (*fast->load)(ncols, iptr + dcp->in_pix_off[ipix],
+                          dcp->istep[fastdim], dvalues);
+            if (do_fillvalue) {
+               for (icol = 0; icol < ncols; icol++) {
+                  if ((dvalues[icol] < dmin) || (dvalues[icol] > dmax))
+                     out_of_range[icol] = TRUE;
+                  else
+                     sums[icol] += dvalues[icol];
+               }
+            }
+            else {
+               for (icol = 0; icol < ncols; icol++)
+                  sums[icol] += dvalues[icol];
+            }
+         }
+         npix = (double) dcp->in_pix_num;
+         for (icol = 0; icol < ncols; icol++) {
+            if (out_of_range[icol])
+               dvalues[icol] = fillvalue;
+            else if (do_scale)
+               dvalues[icol] = scale * (sums[icol] / npix) + offset;
+            else
+               dvalues[icol] = sums[icol] / npix;
+         }
+      }
+
+      (*fast->store)(ncols, dvalues, optr, dcp->ostep[fastdim]);
+   }
+
+   return MI_NOERROR;
+}
@@ -2074,6 +2074,93 @@ hdf_varsize(int fd, int varid, long *size_ptr)
     return (MI_NOERROR);
 }
 
+/* Get the chunk shape and deflate level of a variable whose chunks can be
+ * compressed by the caller and written with hdf_write_chunk(). This is
+ * only the case for chunked variables with the deflate filter alone, and
+ * whose file type is the native type, so that the bytes in memory are
+ * the bytes of the file. Returns MI_ERROR otherwise.
+ */
+int
+hdf_var_deflate_chunks(int fd, int varid, long *chunk_ptr, int *level_ptr)
+{
+#if H5_VERSION_GE(1,10,3)
+    struct m2_file *file;
+    struct m2_var *var;
+    hid_t prp_id;
+    hsize_t chkdims[MAX_VAR_DIMS];
+    unsigned int flags;
+    unsigned int cd_values[1];
+    size_t cd_nelmts = 1;
+    int status = MI_ERROR;
+    int i;
+
+    if ((file = hdf_id_check(fd)) == NULL) {
+        return (MI_ERROR);
+    }
+    if ((var = hdf_var_byid(file, varid)) == NULL) {
+        return (MI_ERROR);
+    }
+    if (var->ndims < 1 || var->ndims > MAX_VAR_DIMS || var->is_cmpd ||
+        H5Tequal(var->ftyp_id, var->mtyp_id) <= 0) {
+        return (MI_ERROR);
+    }
+
+    prp_id = H5Dget_create_plist(var->dset_id);
+    if (prp_id < 0) {
+        return (MI_ERROR);
+    }
+    if (H5Pget_layout(prp_id) == H5D_CHUNKED &&
+        H5Pget_chunk(prp_id, var->ndims, chkdims) == var->ndims &&
+        H5Pget_nfilters(prp_id) == 1 &&
+        H5Pget_filter2(prp_id, 0, &flags, &cd_nelmts, cd_values,
+                       0, NULL, NULL) == H5Z_FILTER_DEFLATE) {
+        for (i = 0; i < var->ndims; i++) {
+            chunk_ptr[i] = (long) chkdims[i];
+        }
+        *level_ptr = (cd_nelmts > 0) ? (int) cd_values[0] : 6;
+        status = MI_NOERROR;
+    }
+    H5Pclose(prp_id);
+    return (status);
+#else
+    return (MI_ERROR);
+#endif
+}
+
+/* Write one chunk of a variable that has already been compressed with
+ * the variable's filter. offset_ptr gives the coordinates of the first
+ * voxel of the chunk.
+ */
+int
+hdf_write_chunk(int fd, int varid, const long *offset_ptr,
+                const void *val_ptr, size_t size)
+{
+#if H5_VERSION_GE(1,10,3)
+    struct m2_file *file;
+    struct m2_var *var;
+    hsize_t offset[MAX_VAR_DIMS];
+    int i;
+
+    if ((file = hdf_id_check(fd)) == NULL) {
+        return (MI_ERROR);
+    }
+    if ((var = hdf_var_byid(file, varid)) == NULL ||
+        var->ndims > MAX_VAR_DIMS) {
+        return (MI_ERROR);
+    }
+    for (i = 0; i < var->ndims; i++) {
+        offset[i] = (hsize_t) offset_ptr[i];
+    }
+    if (H5Dwrite_chunk(var->dset_id, H5P_DEFAULT, 0, offset,
+                       size, val_ptr) < 0) {
+        return (MI_ERROR);
+    }
+    return (MI_NOERROR);
+#else
+    return (MI_ERROR);
+#endif
+}
+
 herr_t hdf_copy_attr(hid_t in_id, const char *attr_name, void *op_data)
 {
    hid_t out_id = *((hid_t*) op_data);
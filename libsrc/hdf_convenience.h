@@ -40,6 +40,10 @@ extern int hdf_varputg(int fd, int varid, const long *startp,
 		       const long *imapp, const void *valp);
 
 extern int hdf_varsize(int fd, int varid, long *size_ptr);
+extern int hdf_var_deflate_chunks(int fd, int varid, long *chunk_ptr,
+                                  int *level_ptr);
+extern int hdf_write_chunk(int fd, int varid, const long *offset_ptr,
+                           const void *val_ptr, size_t size);
 
 extern int hdf_dimrename(int fd, int dimid, const char *new_name);
 
@@ -172,6 +172,7 @@
 
 #include "minc_private.h"
 #include "type_limits.h"
+#include "nd_loop.h"
 
 /* Private functions */
 PRIVATE int MI_icv_get_type(mi_icv_type *icvp, int cdfid, int varid);
@@ -1342,14 +1343,12 @@ PRIVATE int MI_icv_access(int operation, mi_icv_type *icvp, long start[],
    int *bufsize_step;                /* Pointer to array giving increments
                                         for allocating variable buffer
                                         (NULL if we don't care) */
+   nd_tile_loop loop;                /* Loop over the chunks */
    long chunk_count[MAX_VAR_DIMS];   /* Number of elements to get for chunk */
-   long chunk_start[MAX_VAR_DIMS];   /* Starting index for getting a chunk */
    long chunk_size;                  /* Size of chunk in bytes */
    void *chunk_values;               /* Pointer to next chunk to get */
    long var_start[MAX_VAR_DIMS];     /* Coordinates of first var element */
    long var_count[MAX_VAR_DIMS];     /* Edge lengths in variable */
-   long var_end[MAX_VAR_DIMS];       /* Coordinates of last var element */
-   int firstdim;
    int idim, ndims;
 
    MI_SAVE_ROUTINE_NAME("MI_icv_access");
@@ -1393,10 +1392,6 @@ PRIVATE int MI_icv_access(int operation, mi_icv_type *icvp, long start[],
       we can get in one call is determined by the subscripts of MIimagemax
       and MIimagemin. These must be constant over the chunk that we get if
       we are doing normalization. */
-   for (idim=0; idim<icvp->var_ndims; idim++) {
-      chunk_start[idim] = var_start[idim];
-      var_end[idim]=var_start[idim]+var_count[idim];
-   }
    (void) miset_coords(icvp->var_ndims, 1L, chunk_count);
    /* Get size of chunk in user's buffer. Dimension conversion routines
       don't need the buffer pointer incremented - they do it themselves */
@@ -1408,11 +1403,12 @@ PRIVATE int MI_icv_access(int operation, mi_icv_type *icvp, long start[],
       chunk_count[idim]=var_count[idim];
       chunk_size *= chunk_count[idim];
    }
-   firstdim = MAX(icvp->derv_firstdim, 0);
 
    /* Loop through variable */
    chunk_values = values;
-   while (chunk_start[0] < var_end[0]) {
+   nd_begin_tile_loop(&loop, icvp->var_ndims, var_start, var_count, NULL,
+                      chunk_count);
+   while (nd_next_tile(&loop)) {
 
       /* Set the do_fillvalue flag if the user wants it and we are doing
          a get. We must do it inside the loop since the scale factor
@@ -1425,29 +1421,19 @@ PRIVATE int MI_icv_access(int operation, mi_icv_type *icvp, long start[],
 
       /* Calculate scale factor */
       if (icvp->do_scale) {
-          if (MI_icv_calc_scale(operation, icvp, chunk_start) < 0) {
+          if (MI_icv_calc_scale(operation, icvp, loop.current) < 0) {
               MI_RETURN(MI_ERROR);
           }
       }
 
-// fprintf(stderr, "Getting values at %p\n", chunk_start);
-
       /* Get the values */
       if (MI_varaccess(operation, icvp->cdfid, icvp->varid,
-                       chunk_start, chunk_count,
+                       loop.current, loop.count,
                        icvp->user_type, icvp->user_sign,
                        chunk_values, bufsize_step, icvp) < 0) {
           MI_RETURN(MI_ERROR);
       }
 
-      /* Increment the start counter */
-      chunk_start[firstdim] += chunk_count[firstdim];
-      for (idim=firstdim;
-           (idim>0) && (chunk_start[idim]>=var_end[idim]); idim--) {
-         chunk_start[idim]=var_start[idim];
-         chunk_start[idim-1]++;
-      }
-
       /* Increment the pointer to values */
       chunk_values = (void *) ((char *) chunk_values + (size_t) chunk_size);
 
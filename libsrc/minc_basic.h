@@ -209,6 +209,33 @@
       break; \
    }
 
+/* Macros for storing a double through a typed pointer with the same
+   clamping and rounding as MI_FROM_DOUBLE. These are used by the typed
+   conversion kernels, where the type is known outside of the loop.
+   dvalue is modified. */
+#define MI_STORE_UCHAR(dvalue, optr) \
+   dvalue = MAX(0, dvalue); dvalue = MIN(UCHAR_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_SCHAR(dvalue, optr) \
+   dvalue = MAX(SCHAR_MIN, dvalue); dvalue = MIN(SCHAR_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_USHORT(dvalue, optr) \
+   dvalue = MAX(0, dvalue); dvalue = MIN(USHRT_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_SSHORT(dvalue, optr) \
+   dvalue = MAX(SHRT_MIN, dvalue); dvalue = MIN(SHRT_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_UINT(dvalue, optr) \
+   dvalue = MAX(0, dvalue); dvalue = MIN(UINT_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_SINT(dvalue, optr) \
+   dvalue = MAX(INT_MIN, dvalue); dvalue = MIN(INT_MAX, dvalue); \
+   *(optr) = ROUND(dvalue);
+#define MI_STORE_FLOAT(dvalue, optr) \
+   dvalue = MAX(-FLT_MAX, dvalue); *(optr) = MIN(FLT_MAX, dvalue);
+#define MI_STORE_DOUBLE(dvalue, optr) \
+   *(optr) = dvalue;
+
 /**/
 #define _(x) x			/* For future gettext */
 
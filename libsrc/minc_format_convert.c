@@ -20,17 +20,265 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <minc.h>
+#include <zlib.h>
+#include "minc_private.h"
+#include "hdf_convenience.h"
+#include "minc_parallel.h"
 
+/* Largest slab of the image read from the input file at once, unless a
+   single row of chunks is larger */
+#define MI_CONVERT_SLAB_BYTES (64 * 1024 * 1024)
+
+/* State for streaming the image variable into deflated chunks */
+typedef struct {
+   int ndims;
+   long dims[MAX_VAR_DIMS];      /* Image dimension lengths */
+   long chunk[MAX_VAR_DIMS];     /* Chunk shape of the output */
+   long nchunks[MAX_VAR_DIMS];   /* Number of chunks along each dimension */
+   long chunks_per_row;          /* Chunks for each chunk along dims[0] */
+   int level;                    /* Deflate level */
+   size_t typelen;
+   size_t chunk_bytes;           /* Uncompressed size of one chunk */
+   long slab_rows;               /* Length of the slab along dims[0] */
+   long slab_count;              /* Rows actually in the current slab */
+   char *slab;                   /* Current slab of the input image */
+   unsigned char *scratch;       /* One chunk_bytes buffer per thread */
+   unsigned char *zbuf;          /* One zbound buffer per chunk of the slab */
+   uLongf zbound;                /* Largest compressed chunk size */
+   uLongf *zsize;                /* Compressed size of each chunk */
+} mi_convert_type;
+
+/* Chunk coordinates of chunk item of the current slab */
+static void miconvert_chunk_coords(mi_convert_type *cvt, long item,
+                                   long coords[])
+{
+   int idim;
+
+   for (idim = cvt->ndims - 1; idim > 0; idim--) {
+      coords[idim] = item % cvt->nchunks[idim];
+      item /= cvt->nchunks[idim];
+   }
+   coords[0] = item;
+}
+
+/* Worker for miparallel_for: gathers each chunk of the slab into a
+   contiguous buffer, padded with zeros at the edges as HDF5 stores it,
+   and compresses it */
+static int miconvert_compress_chunks(long first, long last, int thread,
+                                     void *data)
+{
+   mi_convert_type *cvt = data;
+   unsigned char *buffer = cvt->scratch + (size_t) thread * cvt->chunk_bytes;
+   long coords[MAX_VAR_DIMS];
+   long origin[MAX_VAR_DIMS];
+   long extent[MAX_VAR_DIMS];
+   long index[MAX_VAR_DIMS];
+   long slab_dims[MAX_VAR_DIMS];
+   size_t src_stride[MAX_VAR_DIMS];
+   size_t dst_stride[MAX_VAR_DIMS];
+   size_t src_off, dst_off;
+   size_t row_bytes;
+   int ndims = cvt->ndims;
+   int partial;
+   int idim;
+   long item;
+
+   for (idim = 0; idim < ndims; idim++) {
+      slab_dims[idim] = (idim == 0) ? cvt->slab_count : cvt->dims[idim];
+   }
+   src_stride[ndims - 1] = cvt->typelen;
+   dst_stride[ndims - 1] = cvt->typelen;
+   for (idim = ndims - 2; idim >= 0; idim--) {
+      src_stride[idim] = src_stride[idim + 1] * slab_dims[idim + 1];
+      dst_stride[idim] = dst_stride[idim + 1] * cvt->chunk[idim + 1];
+   }
+
+   for (item = first; item < last; item++) {
+      miconvert_chunk_coords(cvt, item, coords);
+      partial = FALSE;
+      for (idim = 0; idim < ndims; idim++) {
+         origin[idim] = coords[idim] * cvt->chunk[idim];
+         extent[idim] = MIN(cvt->chunk[idim], slab_dims[idim] - origin[idim]);
+         if (extent[idim] < cvt->chunk[idim]) partial = TRUE;
+         index[idim] = 0;
+      }
+      if (partial) {
+         memset(buffer, 0, cvt->chunk_bytes);
+      }
+
+      /* Copy the chunk one row of the fastest dimension at a time */
+      row_bytes = extent[ndims - 1] * cvt->typelen;
+      while (index[0] < extent[0]) {
+         src_off = 0;
+         dst_off = 0;
+         for (idim = 0; idim < ndims - 1; idim++) {
+            src_off += (origin[idim] + index[idim]) * src_stride[idim];
+            dst_off += index[idim] * dst_stride[idim];
+         }
+         src_off += origin[ndims - 1] * cvt->typelen;
+         memcpy(buffer + dst_off, cvt->slab + src_off, row_bytes);
+
+         for (idim = ndims - 2; idim > 0; idim--) {
+            if (++index[idim] < extent[idim]) break;
+            index[idim] = 0;
+         }
+         if (idim == 0) index[0]++;
+         if (ndims == 1) break;
+      }
+
+      cvt->zsize[item] = cvt->zbound;
+      if (compress2(cvt->zbuf + (size_t) item * cvt->zbound,
+                    &cvt->zsize[item], buffer, cvt->chunk_bytes,
+                    cvt->level) != Z_OK) {
+         return MI_ERROR;
+      }
+   }
+   return MI_NOERROR;
+}
+
+/* Copy the image variable from a MINC 1 file into a MINC 2 variable
+   stored as deflated chunks. The image is read a slab of whole chunk rows
+   at a time, the chunks of the slab are compressed in parallel and then
+   written directly, bypassing the HDF5 filter pipeline. Returns MI_ERROR
+   before writing anything if the output is not stored in a way that allows
+   this, and MI_ERROR after a partial write if reading, compressing or
+   writing a slab fails; either way the caller then copies the whole image
+   through the usual path, overwriting any chunks written here */
+static int miconvert_image(int old_fd, int old_var, int new_fd, int new_var)
+{
+   mi_convert_type cvt;
+   nc_type old_type, new_type;
+   int dimids[MAX_VAR_DIMS];
+   long start[MAX_VAR_DIMS];
+   long count[MAX_VAR_DIMS];
+   long coords[MAX_VAR_DIMS];
+   long row_bytes;
+   long chunk_rows;
+   long nitems;
+   long item;
+   int nthreads;
+   int idim;
+   int status = MI_NOERROR;
+
+   memset(&cvt, 0, sizeof(cvt));
+   if (ncvarinq(old_fd, old_var, NULL, &old_type, &cvt.ndims, dimids,
+                NULL) == MI_ERROR ||
+       ncvarinq(new_fd, new_var, NULL, &new_type, NULL, NULL,
+                NULL) == MI_ERROR ||
+       old_type != new_type || cvt.ndims < 1 ||
+       hdf_var_deflate_chunks(new_fd, new_var, cvt.chunk,
+                              &cvt.level) == MI_ERROR) {
+      return MI_ERROR;
+   }
+
+   cvt.typelen = nctypelen(old_type);
+   cvt.chunk_bytes = cvt.typelen;
+   cvt.chunks_per_row = 1;
+   row_bytes = cvt.typelen;
+   for (idim = 0; idim < cvt.ndims; idim++) {
+      if (ncdiminq(old_fd, dimids[idim], NULL, &cvt.dims[idim]) == MI_ERROR) {
+         return MI_ERROR;
+      }
+      cvt.nchunks[idim] = (cvt.dims[idim] + cvt.chunk[idim] - 1) /
+         cvt.chunk[idim];
+      cvt.chunk_bytes *= cvt.chunk[idim];
+      if (idim > 0) {
+         cvt.chunks_per_row *= cvt.nchunks[idim];
+         row_bytes *= cvt.dims[idim];
+      }
+   }
+
+   /* Read enough rows of chunks for every thread to have work, as long as
+      the slab stays within bounds */
+   nthreads = miget_parallel_threads();
+   chunk_rows = (2 * nthreads + cvt.chunks_per_row - 1) / cvt.chunks_per_row;
+   chunk_rows = MIN(chunk_rows,
+                    MI_CONVERT_SLAB_BYTES / (row_bytes * cvt.chunk[0]));
+   chunk_rows = MIN(MAX(chunk_rows, 1), cvt.nchunks[0]);
+   cvt.slab_rows = chunk_rows * cvt.chunk[0];
+   nitems = chunk_rows * cvt.chunks_per_row;
+
+   cvt.zbound = compressBound(cvt.chunk_bytes);
+   cvt.slab = malloc(row_bytes * cvt.slab_rows);
+   cvt.scratch = malloc(cvt.chunk_bytes * nthreads);
+   cvt.zbuf = malloc(cvt.zbound * nitems);
+   cvt.zsize = malloc(sizeof(*cvt.zsize) * nitems);
+   if (cvt.slab == NULL || cvt.scratch == NULL || cvt.zbuf == NULL ||
+       cvt.zsize == NULL) {
+      MI_LOG_ERROR(MI_MSG_OUTOFMEM, row_bytes * cvt.slab_rows);
+      status = MI_ERROR;
+   }
+
+   for (idim = 0; idim < cvt.ndims; idim++) {
+      start[idim] = 0;
+      count[idim] = cvt.dims[idim];
+   }
+   while (status == MI_NOERROR && start[0] < cvt.dims[0]) {
+      cvt.slab_count = MIN(cvt.slab_rows, cvt.dims[0] - start[0]);
+      count[0] = cvt.slab_count;
+      if (ncvarget(old_fd, old_var, start, count, cvt.slab) == MI_ERROR) {
+         status = MI_ERROR;
+         break;
+      }
+
+      nitems = ((cvt.slab_count + cvt.chunk[0] - 1) / cvt.chunk[0]) *
+         cvt.chunks_per_row;
+      if (miparallel_for(nitems, 1, miconvert_compress_chunks,
+                         &cvt) == MI_ERROR) {
+         status = MI_ERROR;
+         break;
+      }
+
+      /* HDF5 writes must stay on this thread */
+      for (item = 0; item < nitems && status == MI_NOERROR; item++) {
+         miconvert_chunk_coords(&cvt, item, coords);
+         for (idim = 0; idim < cvt.ndims; idim++) {
+            coords[idim] *= cvt.chunk[idim];
+         }
+         coords[0] += start[0];
+         status = hdf_write_chunk(new_fd, new_var, coords,
+                                  cvt.zbuf + (size_t) item * cvt.zbound,
+                                  cvt.zsize[item]);
+      }
+      start[0] += cvt.slab_count;
+   }
+
+   free(cvt.slab);
+   free(cvt.scratch);
+   free(cvt.zbuf);
+   free(cvt.zsize);
+   return status;
+}
 
 static int micopy(int old_fd, int new_fd)
 {
+    int old_img, new_img;
+
     /* Copy all variable definitions (and global attributes).
      */
     micopy_all_var_defs(old_fd, new_fd, 0, NULL);
     ncendef(new_fd);
-    micopy_all_var_values(old_fd, new_fd, 0, NULL);
-    return MI_NOERROR;
+
+    push_ncopts(0);
+    old_img = ncvarid(old_fd, MIimage);
+    new_img = ncvarid(new_fd, MIimage);
+    pop_ncopts();
+    if (old_img < 0 || new_img < 0) {
+        return micopy_all_var_values(old_fd, new_fd, 0, NULL);
+    }
+
+    /* Everything but the image is small, including image-min and
+     * image-max, which are each copied with a single hyperslab. The
+     * image is streamed through the chunk compressor when the output
+     * allows it.
+     */
+    if (micopy_all_var_values(old_fd, new_fd, 1, &old_img) == MI_ERROR) {
+        return MI_ERROR;
+    }
+    if (miconvert_image(old_fd, old_img, new_fd, new_img) == MI_NOERROR) {
+        return MI_NOERROR;
+    }
+    return micopy_var_values(old_fd, old_img, new_fd, new_img);
 }
 
 MNCAPI int minc_format_convert(const char *input,const char *output)
@@ -38,6 +286,7 @@ MNCAPI int minc_format_convert(const char *input,const char *output)
     int old_fd;
     int new_fd;
     int flags;
+    int status;
     struct mi2opts opts;
 
     old_fd = miopen(input, NC_NOWRITE);
@@ -48,19 +297,25 @@ MNCAPI int minc_format_convert(const char *input,const char *output)
 
     flags = NC_CLOBBER|MI2_CREATE_V2;
 
+    /* Take compression and chunking from MINC_COMPRESS and
+     * MINC_CHUNKING */
     memset(&opts,0,sizeof(struct mi2opts));
     opts.struct_version = MI2_OPTS_V1;
+    opts.comp_type = MI2_COMP_UNKNOWN;
+    opts.chunk_type = MI2_CHUNK_UNKNOWN;
+    opts.checksum = miget_cfg_bool(MICFG_MINC_CHECKSUM);
 
     new_fd = micreatex(output, flags, &opts);
     if (new_fd < 0) {
         perror(output);
-        exit MI_ERROR;
+        miclose(old_fd);
+        return MI_ERROR;
     }
 
-    micopy(old_fd, new_fd);
+    status = micopy(old_fd, new_fd);
 
     miclose(old_fd);
     miclose(new_fd);
 
-    return MI_NOERROR;
+    return status;
 }
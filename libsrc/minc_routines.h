@@ -84,6 +84,7 @@ SEMIPRIVATE int MI_convert_type(long number_of_values,
                                 nc_type intype,  int insign,  void *invalues,
                                 nc_type outtype, int outsign, void *outvalues,
                                 mi_icv_type *icvp);
+SEMIPRIVATE int MI_convert_index(nc_type datatype, int sign);
 
 /* From image_conversion.c */
 SEMIPRIVATE mi_icv_type *MI_icv_chkid(int icvid);
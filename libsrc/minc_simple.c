@@ -38,8 +38,10 @@
 #include "minc_private.h"
 #include <math.h>               /* for sqrt */
 #include <float.h>              /* for DBL_MAX */
+#include <limits.h>
 #include "minc_simple.h"
 #include "restructure.h"
+#include "minc_parallel.h"
 
 /* Trivial MINC interface */
 
@@ -323,6 +325,12 @@ minc_load_data(char *path, void *dataptr, int datatype,
     minc_simple_to_nc_type(datatype, &nctype, &signstr);
     miicv_setint(icv, MI_ICV_TYPE, nctype);
     miicv_setstr(icv, MI_ICV_SIGN, signstr);
+    /* Floating point data should come back as real values, which needs
+     * the per-slice image-min and image-max of the file.
+     */
+    if (datatype == MINC_TYPE_FLOAT || datatype == MINC_TYPE_DOUBLE) {
+        miicv_setint(icv, MI_ICV_DO_NORM, TRUE);
+    }
     miicv_attach(icv, fd, var_id);
 
     for (i = 0; i < var_ndims; i++) {
@@ -394,8 +402,18 @@ minc_load_data(char *path, void *dataptr, int datatype,
         }
     }
 
-    restructure_array(var_ndims, dataptr, ucount, nctypelen(nctype),
-                      map, dir);
+    /* The file is usually already stored in t, z, y, x order with
+     * positive steps, in which case there is nothing to restructure.
+     */
+    for (i = 0; i < var_ndims; i++) {
+        if (map[i] != i || dir[i] < 0) {
+            break;
+        }
+    }
+    if (i < var_ndims) {
+        restructure_array(var_ndims, dataptr, ucount, nctypelen(nctype),
+                          map, dir);
+    }
 
     miicv_detach(icv);
     miicv_free(icv);
@@ -655,130 +673,423 @@ minc_save_start(char *path,     /* Path to the file */
     return fd;
 }
 
-/* Internal function */
+/* Work items smaller than this are not worth handing to another thread */
+#define MI_S_SCAN_GRAIN 65536
+
+/* Minimum and maximum of count values of one type, kept in the native
+ * type so that the loop can be vectorized by the compiler.  The
+ * accumulators start at the limits of the type, so an empty range (or
+ * one holding nothing but NaNs) leaves vmin > vmax.
+ */
+#define MI_S_MINMAX(ctype, lo, hi) {                                    \
+        const ctype *ptr = (const ctype *) dataptr + first;             \
+        ctype vmin = (hi);                                              \
+        ctype vmax = (lo);                                              \
+        long n;                                                         \
+        for (n = 0; n < count; n++) {                                   \
+            vmin = (ptr[n] < vmin) ? ptr[n] : vmin;                     \
+            vmax = (ptr[n] > vmax) ? ptr[n] : vmax;                     \
+        }                                                               \
+        dmin = vmin;                                                    \
+        dmax = vmax;                                                    \
+    }
+
+/* The same, also counting each value in a table of every value of the
+ * type, for the types with few enough values (8 and 16 bit) that such a
+ * table is cheaper than binning.
+ */
+#define MI_S_MINMAX_COUNT(ctype, lo, hi) {                              \
+        const ctype *ptr = (const ctype *) dataptr + first;             \
+        ctype vmin = (hi);                                              \
+        ctype vmax = (lo);                                              \
+        long n;                                                         \
+        for (n = 0; n < count; n++) {                                   \
+            vmin = (ptr[n] < vmin) ? ptr[n] : vmin;                     \
+            vmax = (ptr[n] > vmax) ? ptr[n] : vmax;                     \
+            counts[(long) ptr[n] - (lo)]++;                             \
+        }                                                               \
+        dmin = vmin;                                                    \
+        dmax = vmax;                                                    \
+    }
+
+/* Internal function: the counts of each value are added to counts, when
+ * it is not NULL, for the types that have a table of counts (see
+ * value_table_size()).
+ */
 static void
-find_minmax(void *dataptr, long datacount, int datatype, double *min,
-            double *max)
+find_range_minmax(const void *dataptr, long first, long count,
+                  int datatype, long *counts, double *min, double *max)
 {
-    *min = DBL_MAX;
-    *max = -DBL_MAX;
+    double dmin = DBL_MAX;
+    double dmax = -DBL_MAX;
 
     switch (datatype) {
     case MINC_TYPE_CHAR:
-        {
-            char *c_ptr = dataptr;
-            while (datacount--) {
-                if (*c_ptr > *max) {
-                    *max = *c_ptr;
-                }
-                if (*c_ptr < *min) {
-                    *min = *c_ptr;
-                }
-                c_ptr++;
-            }
-        }
+        if (counts != NULL)
+            MI_S_MINMAX_COUNT(signed char, SCHAR_MIN, SCHAR_MAX)
+        else
+            MI_S_MINMAX(signed char, SCHAR_MIN, SCHAR_MAX)
         break;
     case MINC_TYPE_UCHAR:
-        {
-            unsigned char *c_ptr = dataptr;
-            while (datacount--) {
-                if (*c_ptr > *max) {
-                    *max = *c_ptr;
-                }
-                if (*c_ptr < *min) {
-                    *min = *c_ptr;
-                }
-                c_ptr++;
-            }
-        }
+        if (counts != NULL)
+            MI_S_MINMAX_COUNT(unsigned char, 0, UCHAR_MAX)
+        else
+            MI_S_MINMAX(unsigned char, 0, UCHAR_MAX)
         break;
     case MINC_TYPE_SHORT:
-        {
-            short *s_ptr = dataptr;
-            while (datacount--) {
-                if (*s_ptr > *max) {
-                    *max = *s_ptr;
-                }
-                if (*s_ptr < *min) {
-                    *min = *s_ptr;
-                }
-                s_ptr++;
-            }
-        }
+        if (counts != NULL)
+            MI_S_MINMAX_COUNT(short, SHRT_MIN, SHRT_MAX)
+        else
+            MI_S_MINMAX(short, SHRT_MIN, SHRT_MAX)
         break;
     case MINC_TYPE_USHORT:
-        {
-            unsigned short *s_ptr = dataptr;
-            while (datacount--) {
-                if (*s_ptr > *max) {
-                    *max = *s_ptr;
-                }
-                if (*s_ptr < *min) {
-                    *min = *s_ptr;
-                }
-                s_ptr++;
-            }
-        }
+        if (counts != NULL)
+            MI_S_MINMAX_COUNT(unsigned short, 0, USHRT_MAX)
+        else
+            MI_S_MINMAX(unsigned short, 0, USHRT_MAX)
         break;
     case MINC_TYPE_INT:
-        {
-            int *i_ptr = dataptr;
-            while (datacount--) {
-                if (*i_ptr > *max) {
-                    *max = *i_ptr;
-                }
-                if (*i_ptr < *min) {
-                    *min = *i_ptr;
-                }
-                i_ptr++;
-            }
-        }
+        MI_S_MINMAX(int, INT_MIN, INT_MAX);
         break;
     case MINC_TYPE_UINT:
-        {
-            unsigned int *i_ptr = dataptr;
-            while (datacount--) {
-                if (*i_ptr > *max) {
-                    *max = *i_ptr;
-                }
-                if (*i_ptr < *min) {
-                    *min = *i_ptr;
-                }
-                i_ptr++;
-            }
-        }
+        MI_S_MINMAX(unsigned int, 0, UINT_MAX);
         break;
     case MINC_TYPE_FLOAT:
-        {
-            float *f_ptr = dataptr;
-            while (datacount--) {
-                if (*f_ptr > *max) {
-                    *max = *f_ptr;
-                }
-                if (*f_ptr < *min) {
-                    *min = *f_ptr;
-                }
-                f_ptr++;
-            }
-        }
+        MI_S_MINMAX(float, -HUGE_VALF, HUGE_VALF);
         break;
     case MINC_TYPE_DOUBLE:
-        {
-            double *d_ptr = dataptr;
-            while (datacount--) {
-                if (*d_ptr > *max) {
-                    *max = *d_ptr;
-                }
-                if (*d_ptr < *min) {
-                    *min = *d_ptr;
+        MI_S_MINMAX(double, -HUGE_VAL, HUGE_VAL);
+        break;
+    default:
+        break;
+    }
+
+    if (count <= 0 || dmin > dmax) {
+        dmin = DBL_MAX;
+        dmax = -DBL_MAX;
+    }
+    *min = dmin;
+    *max = dmax;
+}
+
+/* Internal function: the length of the table of counts of each value of
+ * a type, with the lowest value in *value_min, or 0 for the types that
+ * are binned as they are read.  Returns MINC_STATUS_ERROR for an unknown
+ * type.
+ */
+static long
+value_table_size(int datatype, long *value_min)
+{
+    switch (datatype) {
+    case MINC_TYPE_CHAR:
+        *value_min = SCHAR_MIN;
+        return (UCHAR_MAX + 1);
+    case MINC_TYPE_UCHAR:
+        *value_min = 0;
+        return (UCHAR_MAX + 1);
+    case MINC_TYPE_SHORT:
+        *value_min = SHRT_MIN;
+        return (USHRT_MAX + 1);
+    case MINC_TYPE_USHORT:
+        *value_min = 0;
+        return (USHRT_MAX + 1);
+    case MINC_TYPE_INT:
+    case MINC_TYPE_UINT:
+    case MINC_TYPE_FLOAT:
+    case MINC_TYPE_DOUBLE:
+        *value_min = 0;
+        return (0);
+    default:
+        return (MINC_STATUS_ERROR);
+    }
+}
+
+/* State shared by the threads of a per-slice min/max scan.  Each slice
+ * is split into nparts work items of part_size values.
+ */
+struct minmax_scan {
+    const void *dataptr;
+    int datatype;
+    long slice_size;
+    long part_size;
+    long nparts;
+    double *part_min;           /* One result per work item */
+    double *part_max;
+    long ntable;                /* Length of the count table per thread */
+    long *counts;               /* ntable counts for each thread, or NULL */
+};
+
+/* Internal function */
+static int
+minmax_scan_items(long first, long last, int thread, void *data)
+{
+    struct minmax_scan *scan = data;
+    long *counts = NULL;
+    long item;
+    long slice, offset, count;
+
+    if (scan->counts != NULL) {
+        counts = scan->counts + thread * scan->ntable;
+    }
+    for (item = first; item < last; item++) {
+        slice = item / scan->nparts;
+        offset = (item % scan->nparts) * scan->part_size;
+        count = MIN(scan->part_size, scan->slice_size - offset);
+        find_range_minmax(scan->dataptr, slice * scan->slice_size + offset,
+                          count, scan->datatype, counts,
+                          &scan->part_min[item], &scan->part_max[item]);
+    }
+    return (MI_NOERROR);
+}
+
+/* Internal function: finds the minimum and maximum of each of nslices
+ * consecutive slices of slice_size values in a single parallel pass.
+ * Slices are split so that there is enough work for every thread even
+ * when there are only a few of them.  If counts is not NULL, each thread
+ * also counts the values it reads in its own table of ntable counts.
+ */
+static int
+find_slice_minmax(const void *dataptr, long nslices, long slice_size,
+                  int datatype, long *counts, long ntable,
+                  double *min, double *max)
+{
+    struct minmax_scan scan;
+    long nthreads;
+    long i, j;
+    int r;
+
+    nthreads = miget_parallel_threads();
+
+    scan.dataptr = dataptr;
+    scan.datatype = datatype;
+    scan.slice_size = slice_size;
+    scan.ntable = ntable;
+    scan.counts = counts;
+    scan.nparts = 1;
+    if (nslices < nthreads && slice_size >= 2 * MI_S_SCAN_GRAIN) {
+        scan.nparts = MIN((nthreads + nslices - 1) / nslices,
+                          slice_size / MI_S_SCAN_GRAIN);
+    }
+    scan.part_size = (slice_size + scan.nparts - 1) / scan.nparts;
+
+    if (scan.nparts == 1) {
+        scan.part_min = min;
+        scan.part_max = max;
+    }
+    else {
+        scan.part_min = malloc(2 * nslices * scan.nparts * sizeof(double));
+        if (scan.part_min == NULL) {
+            return (MINC_STATUS_ERROR);
+        }
+        scan.part_max = scan.part_min + nslices * scan.nparts;
+    }
+
+    r = miparallel_for(nslices * scan.nparts,
+                       MAX(1, MI_S_SCAN_GRAIN / MAX(1, scan.part_size)),
+                       minmax_scan_items, &scan);
+
+    if (scan.nparts > 1) {
+        if (r == MI_NOERROR) {
+            for (i = 0; i < nslices; i++) {
+                min[i] = DBL_MAX;
+                max[i] = -DBL_MAX;
+                for (j = i * scan.nparts; j < (i + 1) * scan.nparts; j++) {
+                    min[i] = MIN(min[i], scan.part_min[j]);
+                    max[i] = MAX(max[i], scan.part_max[j]);
                 }
-                d_ptr++;
             }
         }
+        free(scan.part_min);
+    }
+    return ((r == MI_NOERROR) ? MINC_STATUS_OK : MINC_STATUS_ERROR);
+}
+
+/* Binning of each value of a type into nbins equal bins over
+ * [min, max].  Values outside that range are not counted.
+ */
+#define MI_S_BIN_VALUES(ctype) {                                        \
+        const ctype *ptr = (const ctype *) scan->dataptr;               \
+        for (i = first; i < last; i++) {                                \
+            if (ptr[i] >= scan->min && ptr[i] <= scan->max) {           \
+                counts[histogram_bin(ptr[i], scan)]++;                  \
+            }                                                           \
+        }                                                               \
+    }
+
+/* State shared by the threads of a histogram binning scan */
+struct histogram_scan {
+    const void *dataptr;
+    int datatype;
+    int nbins;
+    double min;
+    double max;
+    double scale;               /* nbins / (max - min) */
+    long *counts;               /* nbins counts for each thread */
+};
+
+/* Internal function */
+static int
+histogram_bin(double value, const struct histogram_scan *scan)
+{
+    int bin = (int) ((value - scan->min) * scan->scale);
+
+    return ((bin >= scan->nbins) ? scan->nbins - 1 : bin);
+}
+
+/* Internal function */
+static int
+histogram_scan_items(long first, long last, int thread, void *data)
+{
+    struct histogram_scan *scan = data;
+    long *counts = scan->counts + thread * scan->nbins;
+    long i;
+
+    switch (scan->datatype) {
+    case MINC_TYPE_CHAR:
+        MI_S_BIN_VALUES(signed char);
+        break;
+    case MINC_TYPE_UCHAR:
+        MI_S_BIN_VALUES(unsigned char);
+        break;
+    case MINC_TYPE_SHORT:
+        MI_S_BIN_VALUES(short);
+        break;
+    case MINC_TYPE_USHORT:
+        MI_S_BIN_VALUES(unsigned short);
+        break;
+    case MINC_TYPE_INT:
+        MI_S_BIN_VALUES(int);
+        break;
+    case MINC_TYPE_UINT:
+        MI_S_BIN_VALUES(unsigned int);
+        break;
+    case MINC_TYPE_FLOAT:
+        MI_S_BIN_VALUES(float);
+        break;
+    case MINC_TYPE_DOUBLE:
+        MI_S_BIN_VALUES(double);
         break;
     default:
-        return;
+        return (MI_ERROR);
     }
+    return (MI_NOERROR);
+}
+
+/* Internal function: finds the minimum and maximum of each slice, as
+ * find_slice_minmax() does, and a histogram of nbins equal bins over the
+ * range of all of them.  8 and 16 bit values are counted exactly in that
+ * same pass and the counts are binned afterwards.  Wider types are binned
+ * in a second pass, once the range is known.
+ */
+static int
+find_slice_histogram(const void *dataptr, long nslices, long slice_size,
+                     int datatype, double *slice_min, double *slice_max,
+                     int nbins, long *counts, double *min, double *max)
+{
+    struct histogram_scan scan;
+    double vmin, vmax;
+    long value_min;
+    long ntable;
+    long nthreads;
+    long *table;
+    long i;
+    int t;
+
+    ntable = value_table_size(datatype, &value_min);
+    if (ntable < 0) {
+        return (MINC_STATUS_ERROR);
+    }
+    if (nslices * slice_size < ntable) {
+        ntable = 0;             /* Fewer values than the table holds */
+    }
+
+    nthreads = miget_parallel_threads();
+    table = NULL;
+    if (ntable > 0) {
+        table = calloc(nthreads * ntable, sizeof(long));
+        if (table == NULL) {
+            return (MINC_STATUS_ERROR);
+        }
+    }
+
+    if (find_slice_minmax(dataptr, nslices, slice_size, datatype,
+                          table, ntable, slice_min,
+                          slice_max) != MINC_STATUS_OK) {
+        free(table);
+        return (MINC_STATUS_ERROR);
+    }
+
+    vmin = DBL_MAX;
+    vmax = -DBL_MAX;
+    for (i = 0; i < nslices; i++) {
+        vmin = MIN(vmin, slice_min[i]);
+        vmax = MAX(vmax, slice_max[i]);
+    }
+    *min = vmin;
+    *max = vmax;
+
+    for (i = 0; i < nbins; i++) {
+        counts[i] = 0;
+    }
+    if (vmin > vmax) {
+        free(table);
+        return (MINC_STATUS_OK);    /* No values */
+    }
+
+    scan.dataptr = dataptr;
+    scan.datatype = datatype;
+    scan.nbins = nbins;
+    scan.min = vmin;
+    scan.max = vmax;
+    scan.scale = (vmax > vmin) ? nbins / (vmax - vmin) : 0.0;
+
+    if (table != NULL) {
+        /* Gather the per-thread tables and bin the counts */
+        for (t = 1; t < nthreads; t++) {
+            for (i = 0; i < ntable; i++) {
+                table[i] += table[t * ntable + i];
+            }
+        }
+        for (i = 0; i < ntable; i++) {
+            if (table[i] != 0) {
+                counts[histogram_bin((double) (i + value_min), &scan)] +=
+                    table[i];
+            }
+        }
+        free(table);
+        return (MINC_STATUS_OK);
+    }
+
+    scan.counts = calloc(nthreads * nbins, sizeof(long));
+    if (scan.counts == NULL) {
+        return (MINC_STATUS_ERROR);
+    }
+    if (miparallel_for(nslices * slice_size, MI_S_SCAN_GRAIN,
+                       histogram_scan_items, &scan) != MI_NOERROR) {
+        free(scan.counts);
+        return (MINC_STATUS_ERROR);
+    }
+    for (t = 0; t < nthreads; t++) {
+        for (i = 0; i < nbins; i++) {
+            counts[i] += scan.counts[t * nbins + i];
+        }
+    }
+    free(scan.counts);
+    return (MINC_STATUS_OK);
+}
+
+MNCAPI int
+minc_histogram(void *dataptr, int datatype, long datacount,
+               int nbins, long *counts, double *min, double *max)
+{
+    double vmin, vmax;
+
+    if (nbins < 1 || datacount < 0) {
+        return (MINC_STATUS_ERROR);
+    }
+
+    return (find_slice_histogram(dataptr, 1, datacount, datatype,
+                                 &vmin, &vmax, nbins, counts, min, max));
 }
 
 
@@ -786,6 +1097,17 @@ MNCAPI int
 minc_save_data(int fd, void *dataptr, int datatype,
                long st, long sz, long sy, long sx,
                long ct, long cz, long cy, long cx)
+{
+    return (minc_save_data_histogram(fd, dataptr, datatype,
+                                     st, sz, sy, sx, ct, cz, cy, cx,
+                                     0, NULL, NULL, NULL));
+}
+
+MNCAPI int
+minc_save_data_histogram(int fd, void *dataptr, int datatype,
+                         long st, long sz, long sy, long sx,
+                         long ct, long cz, long cy, long cx,
+                         int nbins, long *counts, double *min, double *max)
 {
     nc_type nctype;
     char *signstr;
@@ -798,10 +1120,10 @@ minc_save_data(int fd, void *dataptr, int datatype,
     long count[MI_S_NDIMS];
     int old_ncopts;
     int r;
-    double min, max;
+    double *p_min, *p_max;      /* Per-slice image-min and image-max */
+    long nslices;
     long slice_size;
     long index;
-    int dtbytes;                /* Length of datatype in bytes */
 
     old_ncopts =get_ncopts();
     set_ncopts(0);
@@ -821,37 +1143,57 @@ minc_save_data(int fd, void *dataptr, int datatype,
         return (MINC_STATUS_ERROR);
     }
 
-    dtbytes = nctypelen(nctype);
+    if (counts != NULL && nbins < 1) {
+        return (MINC_STATUS_ERROR);
+    }
 
-    /* Update the image-min and image-max values */
+    /* Update the image-min and image-max values.  All of the slices are
+     * scanned in one parallel pass, which also finds the histogram if one
+     * is wanted, and written with a single call each.
+     */
     if (ct > 0) {
+        nslices = ct;
         slice_size = cz * cy * cx;
         index = st;
-
-        for (i = 0; i < ct; i++) {
-            find_minmax((char *) dataptr + (dtbytes * slice_size * i),
-                        slice_size, datatype, &min, &max);
-
-            mivarput1(fd, ncvarid(fd, MIimagemin), &index,
-                      NC_DOUBLE, MI_SIGNED, &min);
-            mivarput1(fd, ncvarid(fd, MIimagemax), &index,
-                      NC_DOUBLE, MI_SIGNED, &max);
-            index++;
-        }
     }
     else {
+        nslices = cz;
         slice_size = cy * cx;
         index = sz;
+    }
 
-        for (i = 0; i < cz; i++) {
-            find_minmax((char *) dataptr + (dtbytes * slice_size * i),
-                        slice_size, datatype, &min, &max);
-            mivarput1(fd, ncvarid(fd, MIimagemin), &index,
-                      NC_DOUBLE, MI_SIGNED, &min);
-            mivarput1(fd, ncvarid(fd, MIimagemax), &index,
-                      NC_DOUBLE, MI_SIGNED, &max);
-            index++;
+    if (nslices > 0) {
+        p_min = malloc(2 * nslices * sizeof(double));
+        if (p_min == NULL) {
+            return (MINC_STATUS_ERROR);
+        }
+        p_max = p_min + nslices;
+
+        if (counts != NULL) {
+            r = find_slice_histogram(dataptr, nslices, slice_size, datatype,
+                                     p_min, p_max, nbins, counts, min, max);
+        }
+        else {
+            r = find_slice_minmax(dataptr, nslices, slice_size, datatype,
+                                  NULL, 0, p_min, p_max);
+        }
+        if (r == MINC_STATUS_OK) {
+            mivarput(fd, ncvarid(fd, MIimagemin), &index, &nslices,
+                     NC_DOUBLE, MI_SIGNED, p_min);
+            mivarput(fd, ncvarid(fd, MIimagemax), &index, &nslices,
+                     NC_DOUBLE, MI_SIGNED, p_max);
+        }
+        free(p_min);
+        if (r != MINC_STATUS_OK) {
+            return (MINC_STATUS_ERROR);
+        }
+    }
+    else if (counts != NULL) {
+        for (i = 0; i < nbins; i++) {
+            counts[i] = 0;
         }
+        *min = DBL_MAX;
+        *max = -DBL_MAX;
     }
 
     /* We want the data to wind up in t, x, y, z order. */
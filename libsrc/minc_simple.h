@@ -70,6 +70,30 @@ minc_save_data(int handle,    /* Handle returned by minc_save_start */
                long cy,
                long cx);
 
+/* Write data to file as minc_save_data() does, and return the range and a
+ * histogram of nbins equal bins over that range of the data written, as
+ * minc_histogram() does.  The histogram is found in the same pass as the
+ * image-min and image-max of each slice (with a second pass for types
+ * wider than 16 bits).  Return value is MINC_STATUS_OK or
+ * MINC_STATUS_ERROR.
+ */
+MNCAPI int
+minc_save_data_histogram(int handle, /* Handle returned by minc_save_start */
+                         void *dataptr, /* Data to write */
+                         int datatype, /* Type of data in memory */
+                         long st,  /* Start position of 4D hyperslab */
+                         long sz,
+                         long sy,
+                         long sx,
+                         long ct,  /* Size of 4D hyperslab */
+                         long cz,
+                         long cy,
+                         long cx,
+                         int nbins, /* Number of histogram bins */
+                         long *counts, /* Returned counts, nbins long */
+                         double *min, /* Returned minimum value */
+                         double *max); /* Returned maximum value */
+
 /* Called when a particular file is complete.
  */
 MNCAPI int
@@ -86,3 +110,18 @@ minc_get_world_transform(int handle, double transform[4][4], int spatial_axes[3]
 MNCAPI void
 minc_transform_to_world(const long voxel[], const int spatial_axes[3],
                         double transform[4][4], double world[3]);
+
+/* Compute the range and a histogram of nbins equal bins over that range
+ * for datacount values of the given type, in as few parallel passes as
+ * possible (one for 8 and 16 bit types, two for wider types).  The last
+ * bin includes the maximum.  Return value is MINC_STATUS_OK or
+ * MINC_STATUS_ERROR.
+ */
+MNCAPI int
+minc_histogram(void *dataptr,   /* Data to scan */
+               int datatype,    /* Type of data in memory */
+               long datacount,  /* Number of values */
+               int nbins,       /* Number of histogram bins */
+               long *counts,    /* Returned counts, nbins long */
+               double *min,     /* Returned minimum value */
+               double *max);    /* Returned maximum value */
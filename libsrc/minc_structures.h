@@ -201,6 +201,8 @@ typedef struct {
    long usr_step[MAX_VAR_DIMS];
    long *istep, *ostep;
    void *istart, *ostart;       /* Beginning of buffers */
+   int do_fast;                 /* Use the row kernels of
+                                   MI_icv_dimconvert_fast */
 } mi_icv_dimconv_type;
 
 #endif
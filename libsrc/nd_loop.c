@@ -170,3 +170,213 @@ MNCAPI void nd_increment_loop(long current[],
 
 }
 
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nd_tile_shape
+@INPUT      : ndims - number of dimensions
+              count - vector of edge lengths of the region
+              value_size - size of one value, in bytes
+              max_bytes - largest tile wanted, in bytes
+              step - if not NULL, the tile length along the first
+                 dimension that is only partly covered is kept a
+                 multiple of step for that dimension, when possible
+@OUTPUT     : tile - vector giving the tile shape
+@RETURNS    : (none)
+@DESCRIPTION: Chooses the largest tile that fits in max_bytes by covering
+              whole fastest-varying dimensions first. Dimension 0 is never
+              considered to fit entirely, as in MI_var_loop.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+MNCAPI void nd_tile_shape(int ndims, const long count[], long value_size,
+                          long max_bytes, const long step[], long tile[])
+{
+   long nvalues, newnvalues;
+   long ntimes;
+   int firstdim;
+   int idim;
+
+   if (ndims <= 0) return;
+
+   nvalues = newnvalues = 1;
+   for (firstdim = ndims-1; firstdim >= 1; firstdim--) {
+      newnvalues *= count[firstdim];
+      if (newnvalues * value_size > max_bytes) break;
+      nvalues = newnvalues;
+   }
+   ntimes = MAX(1, MIN(max_bytes / (nvalues * value_size), count[firstdim]));
+   if ((ntimes != count[firstdim]) && (step != NULL)) {
+      ntimes = MAX(1, ntimes - (ntimes % step[firstdim]));
+   }
+
+   for (idim = 0; idim < ndims; idim++) {
+      tile[idim] = (idim > firstdim)  ? count[idim] :
+                   (idim == firstdim) ? ntimes : 1;
+   }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nd_begin_tile_loop
+@INPUT      : ndims - number of dimensions
+              start - vector of indices of the first subscript of the region
+              count - vector of edge lengths of the region
+              size - vector of lengths of the array holding the region,
+                 or NULL if the region is a packed array of its own
+              tile - vector giving the tile shape
+@OUTPUT     : loop - tile loop structure
+@RETURNS    : (none)
+@DESCRIPTION: Sets up a loop over the tiles of a region. Tiles are visited
+              in array order and are clipped at the end of the region.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+MNCAPI void nd_begin_tile_loop(nd_tile_loop *loop, int ndims,
+                               const long start[], const long count[],
+                               const long size[], const long tile[])
+{
+   int idim;
+
+   loop->ndims = MAX(ndims, 0);
+   loop->started = FALSE;
+   for (idim = 0; idim < loop->ndims; idim++) {
+      loop->start[idim] = start[idim];
+      loop->end[idim] = start[idim] + count[idim];
+      loop->size[idim] = (size != NULL) ? size[idim] : count[idim];
+      loop->tile[idim] = MAX(tile[idim], 1);
+      loop->current[idim] = start[idim];
+      loop->count[idim] = 0;
+   }
+   loop->nvalues = 0;
+   loop->run_length = 0;
+   loop->nruns = 0;
+   loop->run_dim = 0;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nd_next_tile
+@INPUT      : loop - tile loop structure
+@OUTPUT     : loop - current, count, nvalues, run_length, nruns and run_dim
+                 describe the next tile
+@RETURNS    : TRUE if there is another tile, FALSE at the end of the loop.
+@DESCRIPTION: Advances a tile loop. A run is the longest stretch of the
+              tile that is contiguous in the array: it covers the fastest
+              dimension and carries on into slower ones for as long as the
+              faster ones are covered entirely.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+MNCAPI int nd_next_tile(nd_tile_loop *loop)
+{
+   int ndims = loop->ndims;
+   int idim;
+
+   if (!loop->started) {
+      loop->started = TRUE;
+      if (ndims == 0) {
+         /* A scalar is a single tile of one value */
+         loop->nvalues = loop->run_length = loop->nruns = 1;
+         return TRUE;
+      }
+   }
+   else {
+      if (ndims == 0) return FALSE;
+      idim = ndims-1;
+      loop->current[idim] += loop->tile[idim];
+      while ((idim > 0) && (loop->current[idim] >= loop->end[idim])) {
+         loop->current[idim] = loop->start[idim];
+         idim--;
+         loop->current[idim] += loop->tile[idim];
+      }
+   }
+   if (loop->current[0] >= loop->end[0]) return FALSE;
+
+   loop->nvalues = 1;
+   for (idim = 0; idim < ndims; idim++) {
+      loop->count[idim] = MIN(loop->tile[idim],
+                              loop->end[idim] - loop->current[idim]);
+      loop->nvalues *= loop->count[idim];
+   }
+
+   idim = ndims-1;
+   loop->run_length = loop->count[idim];
+   while ((idim > 0) && (loop->count[idim] == loop->size[idim])) {
+      idim--;
+      loop->run_length *= loop->count[idim];
+   }
+   loop->run_dim = idim;
+   loop->nruns = (loop->run_length > 0) ?
+      loop->nvalues / loop->run_length : 0;
+
+   return TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nd_copy_tile
+@INPUT      : loop - tile loop structure, positioned on a tile
+              value_size - size of one value, in bytes
+              array - pointer to the first value of the whole array
+              buffer - pointer to a packed buffer for the tile
+              to_buffer - TRUE to copy from array to buffer, FALSE to copy
+                 from buffer to array
+@OUTPUT     : (none)
+@RETURNS    : (none)
+@DESCRIPTION: Copies the current tile between the array and a packed
+              buffer with one memcpy per contiguous run.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+MNCAPI void nd_copy_tile(const nd_tile_loop *loop, long value_size,
+                         void *array, void *buffer, int to_buffer)
+{
+   long stride[MAX_VAR_DIMS];
+   long index[MAX_VAR_DIMS];
+   size_t run_bytes;
+   size_t offset;
+   char *packed = buffer;
+   long irun;
+   int ndims = loop->ndims;
+   int idim;
+
+   if (ndims == 0) {
+      if (to_buffer) memcpy(buffer, array, value_size);
+      else           memcpy(array, buffer, value_size);
+      return;
+   }
+
+   stride[ndims-1] = value_size;
+   for (idim = ndims-2; idim >= 0; idim--) {
+      stride[idim] = stride[idim+1] * loop->size[idim+1];
+   }
+   for (idim = 0; idim < ndims; idim++) {
+      index[idim] = 0;
+   }
+   run_bytes = (size_t) loop->run_length * value_size;
+
+   for (irun = 0; irun < loop->nruns; irun++) {
+      offset = 0;
+      for (idim = 0; idim < ndims; idim++) {
+         offset += (loop->current[idim] + index[idim]) * stride[idim];
+      }
+      if (to_buffer) memcpy(packed, (char *) array + offset, run_bytes);
+      else           memcpy((char *) array + offset, packed, run_bytes);
+      packed += run_bytes;
+
+      /* Step to the next run over the dimensions slower than a run */
+      for (idim = loop->run_dim-1; idim >= 0; idim--) {
+         if (++index[idim] < loop->count[idim]) break;
+         index[idim] = 0;
+      }
+   }
+}
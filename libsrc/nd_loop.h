@@ -15,6 +15,20 @@
       nd_increment_loop(current, start, increment, end, ndims);
    }
 
+   For hot loops, the tile loop visits the same hyperslabs with the
+   bookkeeping kept in one structure, and describes each tile as
+   contiguous runs of the array it is taken from:
+
+   nd_tile_shape(ndims, count, value_size, max_bytes, NULL, tile);
+   nd_begin_tile_loop(&loop, ndims, start, count, size, tile);
+   while (nd_next_tile(&loop)) {
+
+      Use loop.current and loop.count to work on the hyperslab, or
+      copy it with nd_copy_tile, loop.nruns runs of loop.run_length
+      values at a time;
+
+   }
+
 @GLOBALS    :
 @CREATED    : December 2, 1994 (Peter Neelin)
 @MODIFIED   :
@@ -62,12 +76,31 @@
               express or implied warranty.
 ---------------------------------------------------------------------------- */
 
+#ifndef MINC_ND_LOOP_H
+#define MINC_ND_LOOP_H
+
 #include "minc.h"
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+/* State of a loop over the tiles of an N-d region */
+typedef struct {
+   int ndims;
+   int started;
+   long start[MAX_VAR_DIMS];     /* First subscript of the region */
+   long end[MAX_VAR_DIMS];       /* Last subscript of the region plus one */
+   long size[MAX_VAR_DIMS];      /* Lengths of the whole array */
+   long tile[MAX_VAR_DIMS];      /* Tile shape */
+   long current[MAX_VAR_DIMS];   /* First subscript of the current tile */
+   long count[MAX_VAR_DIMS];     /* Shape of the current tile */
+   long nvalues;                 /* Number of values in the current tile */
+   long run_length;              /* Values per contiguous run in the array */
+   long nruns;                   /* Number of runs in the current tile */
+   int run_dim;                  /* Slowest dimension spanned by a run */
+} nd_tile_loop;
+
 MNCAPI void nd_begin_looping(long start[], long current[], int ndims);
 MNCAPI int nd_end_of_loop(long current[], long end[], int ndims);
 MNCAPI void nd_update_current_count(long current[],
@@ -78,6 +111,17 @@ MNCAPI void nd_increment_loop(long current[],
                               long start[], long increment[], long end[],
                               int ndims);
 
+MNCAPI void nd_tile_shape(int ndims, const long count[], long value_size,
+                          long max_bytes, const long step[], long tile[]);
+MNCAPI void nd_begin_tile_loop(nd_tile_loop *loop, int ndims,
+                               const long start[], const long count[],
+                               const long size[], const long tile[]);
+MNCAPI int nd_next_tile(nd_tile_loop *loop);
+MNCAPI void nd_copy_tile(const nd_tile_loop *loop, long value_size,
+                         void *array, void *buffer, int to_buffer);
+
 #if defined(__cplusplus)
 }
 #endif
+
+#endif /* MINC_ND_LOOP_H */
@@ -8,9 +8,11 @@
                  MI_var_loop
                  MI_get_sign_from_string
                  MI_convert_type
+                 MI_convert_index
               private :
                  MI_get_sign
                  MI_var_action
+                 MI_convert_<in>_to_<out> (conversion kernels)
 @CREATED    : July 27, 1992. (Peter Neelin, Montreal Neurological Institute)
 @MODIFIED   :
  * $Log: value_conversion.c,v $
@@ -98,12 +100,115 @@
 #include "minc_private.h"
 #include <math.h>
 #include "type_limits.h"
+#include "nd_loop.h"
 
 /* Private functions */
 PRIVATE int MI_var_action(int ndims, long var_start[], long var_count[],
                           long nvalues, void *var_buffer, void *caller_data);
 PRIVATE int MI_get_sign(nc_type datatype, int sign);
 
+/* Parameters shared by all conversion kernels. These are filled in once
+   per call to MI_convert_type so that the kernels only have to loop */
+typedef struct {
+   int    do_scale;        /* Apply outvalue = scale * invalue + offset */
+   double scale;
+   double offset;
+   int    do_fillvalue;    /* Replace values outside [dmin, dmax] */
+   double fillvalue;
+   double dmin;
+   double dmax;
+} mi_convert_params;
+
+typedef void (*mi_convert_func)(long number_of_values,
+                                const void *invalues, void *outvalues,
+                                const mi_convert_params *params);
+
+/* Macro defining one conversion kernel. The scale/fillvalue decision is
+   taken once outside of the loops, and each loop body is a simple
+   unit-stride load, arithmetic, clamp and store so that the compiler
+   can vectorize it. */
+#define MI_CONVERT_KERNEL(inname, intype, outname, outtype, STORE) \
+PRIVATE void MI_convert_##inname##_to_##outname(long number_of_values, \
+                                  const void *invalues, void *outvalues, \
+                                  const mi_convert_params *params) \
+{ \
+   const intype *iptr = (const intype *) invalues; \
+   outtype *optr = (outtype *) outvalues; \
+   double scale = params->scale; \
+   double offset = params->offset; \
+   double dmin = params->dmin; \
+   double dmax = params->dmax; \
+   double fillvalue = params->fillvalue; \
+   double dvalue; \
+   long i; \
+   if (params->do_fillvalue) { \
+      int do_scale = params->do_scale; \
+      for (i = 0; i < number_of_values; i++) { \
+         dvalue = (double) iptr[i]; \
+         if ((dvalue < dmin) || (dvalue > dmax)) \
+            dvalue = fillvalue; \
+         else if (do_scale) \
+            dvalue = scale * dvalue + offset; \
+         STORE(dvalue, &optr[i]) \
+      } \
+   } \
+   else if (params->do_scale) { \
+      for (i = 0; i < number_of_values; i++) { \
+         dvalue = scale * (double) iptr[i] + offset; \
+         STORE(dvalue, &optr[i]) \
+      } \
+   } \
+   else { \
+      for (i = 0; i < number_of_values; i++) { \
+         dvalue = (double) iptr[i]; \
+         STORE(dvalue, &optr[i]) \
+      } \
+   } \
+}
+
+/* Define the kernels from one input type to every output type */
+#define MI_CONVERT_KERNELS_FROM(inname, intype) \
+   MI_CONVERT_KERNEL(inname, intype, uchar,  unsigned char,  MI_STORE_UCHAR) \
+   MI_CONVERT_KERNEL(inname, intype, schar,  signed char,    MI_STORE_SCHAR) \
+   MI_CONVERT_KERNEL(inname, intype, ushort, unsigned short, MI_STORE_USHORT) \
+   MI_CONVERT_KERNEL(inname, intype, sshort, signed short,   MI_STORE_SSHORT) \
+   MI_CONVERT_KERNEL(inname, intype, uint,   unsigned int,   MI_STORE_UINT) \
+   MI_CONVERT_KERNEL(inname, intype, sint,   signed int,     MI_STORE_SINT) \
+   MI_CONVERT_KERNEL(inname, intype, float,  float,          MI_STORE_FLOAT) \
+   MI_CONVERT_KERNEL(inname, intype, double, double,         MI_STORE_DOUBLE)
+
+MI_CONVERT_KERNELS_FROM(uchar,  unsigned char)
+MI_CONVERT_KERNELS_FROM(schar,  signed char)
+MI_CONVERT_KERNELS_FROM(ushort, unsigned short)
+MI_CONVERT_KERNELS_FROM(sshort, signed short)
+MI_CONVERT_KERNELS_FROM(uint,   unsigned int)
+MI_CONVERT_KERNELS_FROM(sint,   signed int)
+MI_CONVERT_KERNELS_FROM(float,  float)
+MI_CONVERT_KERNELS_FROM(double, double)
+
+/* Number of distinct (type, sign) combinations handled by the kernels */
+#define MI_CONVERT_NTYPES 8
+
+#define MI_CONVERT_TABLE_ROW(inname) \
+   { MI_convert_##inname##_to_uchar,  MI_convert_##inname##_to_schar, \
+     MI_convert_##inname##_to_ushort, MI_convert_##inname##_to_sshort, \
+     MI_convert_##inname##_to_uint,   MI_convert_##inname##_to_sint, \
+     MI_convert_##inname##_to_float,  MI_convert_##inname##_to_double }
+
+/* Table of kernels indexed by [input index][output index], where the
+   index is given by MI_convert_index */
+PRIVATE const mi_convert_func
+MI_convert_table[MI_CONVERT_NTYPES][MI_CONVERT_NTYPES] = {
+   MI_CONVERT_TABLE_ROW(uchar),
+   MI_CONVERT_TABLE_ROW(schar),
+   MI_CONVERT_TABLE_ROW(ushort),
+   MI_CONVERT_TABLE_ROW(sshort),
+   MI_CONVERT_TABLE_ROW(uint),
+   MI_CONVERT_TABLE_ROW(sint),
+   MI_CONVERT_TABLE_ROW(float),
+   MI_CONVERT_TABLE_ROW(double)
+};
+
 
 
 
@@ -369,91 +474,43 @@ SEMIPRIVATE int MI_var_loop(int ndims, long start[], long count[],
                             int (*action_func) (int, long [], long [],
                                                 long, void *, void *))
 {
-   long nvalues, newnvalues;  /* Number of values in fastest varying dims.
-                                 Note that any dimensional subscript variables
-                                 should be long */
-   int firstdim;              /* First dimension that doesn't fit in buffer */
-   long ntimes;               /* Number of firstdim elements that fit in buf */
+   nd_tile_loop loop;         /* Loop over the hyperslabs that fit */
+   long tile[MAX_VAR_DIMS];   /* Shape of the buffer */
+   long step[MAX_VAR_DIMS];   /* Buffer size steps wanted by caller */
+   long nvalues;              /* Number of values in the buffer */
    void *var_buffer;          /* Pointer to buffer for variable data */
-   long var_count[MAX_VAR_DIMS];   /* Count, start and end coordinate */
-   long var_start[MAX_VAR_DIMS];   /* vectors for getting buffers */
-   long var_end[MAX_VAR_DIMS];
-   int i;                     /* Looping variable - only used for dimension
-                                 number, not dimension subscript */
+   int i;
 
    MI_SAVE_ROUTINE_NAME("MI_var_loop");
 
-   /* Find out how much space we need and then allocate a buffer.
-      To do this we find out how many dimensions will fit in our
-      maximum buffer size. firstdim is the index of the first dimension
-      that won't fit. nvalues is the number of values in the first dimensions
-      that do fit in the buffer. ntimes is the number of times that the first
-      dimensions fit in the buffer. To make things simpler, dimension 0 is
-      always considered to not fit, even if it does. */
-   nvalues=newnvalues=1;
-   for (firstdim=ndims-1; firstdim>=1; firstdim--) {
-      newnvalues *= count[firstdim];
-      if (newnvalues*value_size > max_buffer_size) break;
-      nvalues = newnvalues;
+   /* Find the largest hyperslab that fits in our maximum buffer size,
+      covering whole fastest varying dimensions first, then allocate a
+      buffer for it. A 0-dim variable is a single value. */
+   for (i=0; (bufsize_step != NULL) && (i<ndims); i++) {
+      step[i] = bufsize_step[i];
    }
-   if (firstdim<0) {               /* Check for 0-dim variable */
-      firstdim=0;
-      ntimes=1;
-   }
-   else {
-      ntimes = MIN(MI_MAX_VAR_BUFFER_SIZE/(nvalues*value_size),
-                   count[firstdim]);
-      /* Try to make ntimes an convenient multiple for the caller */
-      if ((ntimes != count[firstdim]) && (bufsize_step != NULL)) {
-         ntimes = MAX(1, ntimes - (ntimes % bufsize_step[firstdim]));
-      }
+   nd_tile_shape(ndims, count, value_size, max_buffer_size,
+                 (bufsize_step != NULL) ? step : NULL, tile);
+   nvalues = 1;
+   for (i=0; i<ndims; i++) {
+      nvalues *= tile[i];
    }
 
    /* Allocate space for variable values */
-   if ((var_buffer = MALLOC(ntimes*nvalues*value_size, char))
-                                     == NULL) {
+   if ((var_buffer = MALLOC(nvalues*value_size, char)) == NULL) {
       MI_LOG_ERROR(MI_MSG_OUTOFMEM);
       MI_RETURN(MI_ERROR);
    }
 
-   /* Create a count variable for the var buffer, with 1s for dimensions
-      that vary slower than firstdim and count[i] for dimensions that
-      vary faster. Set a start variable for the var buffer, equal to start.
-      Set an end variable for the var buffer. */
-   if (ndims <= 0) {             /* Handle zero-dimension variable */
-      var_start[0]=0; var_end[0]=1; var_count[0]=1;
-   }
-   for (i=0; i<ndims; i++) {
-      var_count[i] = (i>firstdim)  ? count[i] :
-                     (i==firstdim) ? ntimes : 1;
-      var_start[i] = start[i];
-      var_end[i] = start[i] + count[i];
-   }
-
-   /* Loop through the dimensions, copying buffers, etc.
-      Exit when the slowest varying dimension reaches its limit. */
-
-   while (var_start[0] < var_end[0]) {
-      var_count[firstdim] =
-         MIN(ntimes, var_end[firstdim] - var_start[firstdim]);
-
-      /* Do the stuff on the buffer */
-      if ((*action_func)(ndims, var_start, var_count,
-                         var_count[firstdim]*nvalues, var_buffer,
+   /* Loop through the hyperslabs, doing the stuff on each buffer */
+   nd_begin_tile_loop(&loop, ndims, start, count, NULL, tile);
+   while (nd_next_tile(&loop)) {
+      if ((*action_func)(ndims, loop.current, loop.count,
+                         loop.nvalues, var_buffer,
                          caller_data) == MI_ERROR) {
          FREE(var_buffer);
          MI_RETURN_ERROR(MI_ERROR);
       }
-
-      /* Increment the start counters */
-      var_start[firstdim] += var_count[firstdim];
-      i=firstdim;
-      while ( (i>0) && (var_start[i] >= var_end[i])) {
-         var_start[i] = start[i];
-         i--;
-         var_start[i]++;
-      }
-
    }
 
    /* Free the buffer and return */
@@ -526,6 +583,43 @@ PRIVATE int MI_get_sign(nc_type datatype, int sign)
                                                   MI_PRIV_SIGNED );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_convert_index
+@INPUT      : datatype - type of value
+              sign     - sign of value (MI_PRIV_SIGNED or MI_PRIV_UNSIGNED,
+                 as returned by MI_get_sign)
+@OUTPUT     : (none)
+@RETURNS    : index into MI_convert_table or MI_ERROR for non-numeric types
+@DESCRIPTION: Maps a type and sign onto the row/column of the conversion
+              kernel table. The order is unsigned byte, signed byte,
+              unsigned short, signed short, unsigned int, signed int,
+              float, double.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : October 19, 2026
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+SEMIPRIVATE int MI_convert_index(nc_type datatype, int sign)
+{
+   int unsigned_value = (sign == MI_PRIV_UNSIGNED);
+
+   switch (datatype) {
+   case NC_BYTE:
+      return (unsigned_value ? 0 : 1);
+   case NC_SHORT:
+      return (unsigned_value ? 2 : 3);
+   case NC_INT:
+      return (unsigned_value ? 4 : 5);
+   case NC_FLOAT:
+      return 6;
+   case NC_DOUBLE:
+      return 7;
+   default:
+      return MI_ERROR;
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : MI_convert_type
 @INPUT      : number_of_values  - number of values to copy
@@ -557,48 +651,50 @@ PRIVATE int MI_get_sign(nc_type datatype, int sign)
               Note that if a conversion must take place, then all input
               values are converted to double. Values can be scaled through
               icvp->scale and icvp->offset by setting icvp->do_scale to TRUE.
-@METHOD     :
+@METHOD     : The conversion kernel for the (type, sign) pair is looked up
+              once in MI_convert_table and then run over the whole buffer.
 @GLOBALS    :
 @CALLS      :
 @CREATED    : July 27, 1992 (Peter Neelin)
 @MODIFIED   : August 28, 1992 (P.N.)
                  - replaced type conversions with macros
+              October 19, 2026
+                 - replaced per-value switch with a table of typed kernels
 ---------------------------------------------------------------------------- */
 SEMIPRIVATE int MI_convert_type(long number_of_values,
                                 nc_type intype,  int insign,  void *invalues,
                                 nc_type outtype, int outsign, void *outvalues,
                                 mi_icv_type *icvp)
 {
-   int inincr, outincr;    /* Pointer increments for arrays */
+   int inincr, outincr;    /* Sizes of input and output values */
    int insgn, outsgn;      /* Signs for input and output */
-   long i;
-   double dvalue=0.0;      /* Temporary double for conversion */
-   void *inptr, *outptr;   /* Pointers to input and output values */
-   int do_scale;           /* Should scaling be done? */
-   int do_fillvalue;       /* Should fillvalue checking be done? */
-   double fillvalue;       /* Value to fill with */
-   double dmax, dmin;      /* Range of legal values */
+   int inindex, outindex;  /* Indices into the kernel table */
+   mi_convert_params params; /* Scaling and fillvalue parameters */
    double epsilon;         /* Epsilon for legal values comparisons */
 
    MI_SAVE_ROUTINE_NAME("MI_convert_type");
 
    /* Check to see if icv structure was passed and set variables needed */
    if (icvp == NULL) {
-      do_scale=FALSE;
-      do_fillvalue = FALSE;
-      dmax = dmin = 0.0;
-      fillvalue = 0.0;
+      params.do_scale = FALSE;
+      params.scale = 1.0;
+      params.offset = 0.0;
+      params.do_fillvalue = FALSE;
+      params.dmax = params.dmin = 0.0;
+      params.fillvalue = 0.0;
    }
    else {
-      do_scale=icvp->do_scale;
-      do_fillvalue=icvp->do_fillvalue;
-      fillvalue = icvp->user_fillvalue;
-      dmax = icvp->fill_valid_max;
-      dmin = icvp->fill_valid_min;
-      epsilon = (dmax - dmin) * FILLVALUE_EPSILON;
+      params.do_scale = icvp->do_scale;
+      params.scale = icvp->scale;
+      params.offset = icvp->offset;
+      params.do_fillvalue = icvp->do_fillvalue;
+      params.fillvalue = icvp->user_fillvalue;
+      params.dmax = icvp->fill_valid_max;
+      params.dmin = icvp->fill_valid_min;
+      epsilon = (params.dmax - params.dmin) * FILLVALUE_EPSILON;
       epsilon = fabs(epsilon);
-      dmax += epsilon;
-      dmin -= epsilon;
+      params.dmax += epsilon;
+      params.dmin -= epsilon;
    }
 
    /* Check the types and get their size */
@@ -617,39 +713,24 @@ SEMIPRIVATE int MI_convert_type(long number_of_values,
 
    /* Check to see if a conversion needs to be made.
       If not, just copy the memory */
-   if ((intype==outtype) && (insgn==outsgn) && !do_scale && !do_fillvalue) {
+   if ((intype==outtype) && (insgn==outsgn) &&
+       !params.do_scale && !params.do_fillvalue) {
          (void) memcpy(outvalues, invalues,
                        (size_t) number_of_values*inincr);
    }
 
-   /* Otherwise, loop through */
+   /* Otherwise, pick the kernel for this pair of types and run it */
    else {
-
-      /* Step through values  */
-      inptr=invalues;
-      outptr=outvalues;
-      for (i=0 ; i<number_of_values; i++) {
-
-         /* Convert the input value */
-         {MI_TO_DOUBLE(dvalue, intype, insgn, inptr)}
-
-         /* Check the value for range and scale the value if necessary */
-         if (do_fillvalue && ((dvalue < dmin) || (dvalue > dmax))) {
-            dvalue = fillvalue;
-         }
-         else if (do_scale) {
-            dvalue = icvp->scale * dvalue + icvp->offset;
-         }
-
-         /* Truncate if necessary and assign the value */
-         {MI_FROM_DOUBLE(dvalue, outtype, outsgn, outptr)}
-
-         inptr  = (void *) ((char *)inptr  + inincr);
-         outptr = (void *) ((char *)outptr + outincr);
-
-      }           /* End of for loop */
-
-   }              /* End of else */
+      inindex  = MI_convert_index(intype,  insgn);
+      outindex = MI_convert_index(outtype, outsgn);
+      if ((inindex == MI_ERROR) || (outindex == MI_ERROR)) {
+         MI_LOG_PKG_ERROR2(MI_ERR_NONNUMERIC,
+                           "Attempt to convert non-numeric value");
+         MI_RETURN(MI_ERROR);
+      }
+      (*MI_convert_table[inindex][outindex])(number_of_values,
+                                             invalues, outvalues, &params);
+   }
 
    MI_RETURN(MI_NOERROR);
 
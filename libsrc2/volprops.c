@@ -115,7 +115,7 @@ int miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
   if (hdf_plist < 0) {
     return (MI_ERROR);
   }
-  handle = (mivolumeprops_t)malloc(sizeof(struct mivolprops));
+  handle = (mivolumeprops_t)calloc(1, sizeof(struct mivolprops));
   if (handle == NULL) {
     return (MI_ERROR);
   }
@@ -0,0 +1,318 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : bspline_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Checks cubic B-spline interpolation of volumes with
+              precomputed coefficients: the B-spline must pass through the
+              voxel values, reproduce a quadratic and its derivatives inside
+              the volume, have derivatives consistent with its values up to
+              the edges, give way to the interpolating spline after a
+              write until the coefficients are recomputed, and interpolate
+              each component of a vector volume separately.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#define N0 40
+#define N1 33
+#define N2 36
+
+static VIO_STR xyz_names[] = { MIxspace, MIyspace, MIzspace };
+
+static VIO_Volume make_volume(nc_type type, VIO_Real (*func)(int, int, int))
+{
+   int sizes[VIO_MAX_DIMENSIONS] = { N0, N1, N2, 0, 0 };
+   VIO_Volume volume;
+   int i, j, k;
+
+   volume = create_volume(3, xyz_names, type, TRUE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   alloc_volume_data(volume);
+   if (type != NC_DOUBLE) {
+      set_volume_voxel_range(volume, -32000.0, 32000.0);
+      set_volume_real_range(volume, -100.0, 1100.0);
+   }
+
+   for (i = 0; i < N0; i++)
+      for (j = 0; j < N1; j++)
+         for (k = 0; k < N2; k++)
+            set_volume_real_value(volume, i, j, k, 0, 0, func(i, j, k));
+   return volume;
+}
+
+static VIO_Real quadratic(int i, int j, int k)
+{
+   return 0.5 * i * i + i * j - 0.25 * k * k + 3.0;
+}
+
+static VIO_Real noise(int i, int j, int k)
+{
+   return (VIO_Real) ((i * 7919 + j * 104729 + k * 1299709) % 1000);
+}
+
+static VIO_Real cubic(VIO_Volume volume, VIO_Real x, VIO_Real y, VIO_Real z,
+                      VIO_Real derivs[3], VIO_Real second[3][3])
+{
+   VIO_Real voxel[VIO_MAX_DIMENSIONS] = { x, y, z, 0.0, 0.0 };
+   VIO_Real value, *first_deriv[1], **second_deriv[1];
+   VIO_Real *rows[3];
+
+   first_deriv[0] = derivs;
+   rows[0] = second[0];
+   rows[1] = second[1];
+   rows[2] = second[2];
+   second_deriv[0] = rows;
+
+   evaluate_volume(volume, voxel, NULL, 2, FALSE, 0.0, &value,
+                   derivs ? first_deriv : NULL,
+                   second ? second_deriv : NULL);
+   return value;
+}
+
+static int check_voxel_values(VIO_Volume volume, VIO_Real tolerance,
+                              const char *what)
+{
+   int i, j, k;
+   int errors = 0;
+   VIO_Real value, expected;
+
+   for (i = 0; i < N0; i += 3)
+      for (j = 0; j < N1; j += 2)
+         for (k = 0; k < N2; k += 5) {
+            value = cubic(volume, i, j, k, NULL, NULL);
+            expected = get_volume_real_value(volume, i, j, k, 0, 0);
+            if (fabs(value - expected) > tolerance) {
+               if (errors < 5)
+                  fprintf(stderr, "%s: value at voxel %d %d %d is %g, "
+                          "expected %g\n", what, i, j, k, value, expected);
+               errors++;
+            }
+         }
+   return errors;
+}
+
+static int check_quadratic(void)
+{
+   VIO_Volume volume;
+   VIO_Real x, y, z, value, derivs[3], second[3][3];
+   VIO_Real expected_second[3][3] = { { 1.0, 1.0, 0.0 },
+                                      { 1.0, 0.0, 0.0 },
+                                      { 0.0, 0.0, -0.5 } };
+   int p, a, b;
+   int errors = 0;
+
+   volume = make_volume(NC_DOUBLE, quadratic);
+   if (set_volume_bspline_interpolation(volume, VIO_DOUBLE) != VIO_OK) {
+      fprintf(stderr, "set_volume_bspline_interpolation failed\n");
+      return 1;
+   }
+
+   errors += check_voxel_values(volume, 1e-9, "quadratic");
+
+   /* Far enough from the edges for the mirror boundaries not to matter */
+   for (p = 0; p < 200; p++) {
+      x = 17.0 + 5.0 * rand() / (VIO_Real) RAND_MAX;
+      y = 14.0 + 4.0 * rand() / (VIO_Real) RAND_MAX;
+      z = 15.0 + 5.0 * rand() / (VIO_Real) RAND_MAX;
+
+      value = cubic(volume, x, y, z, derivs, second);
+
+      /* an interpolating cubic spline reproduces a quadratic exactly */
+      if (fabs(value - (0.5 * x * x + x * y - 0.25 * z * z + 3.0)) > 1e-5 ||
+          fabs(derivs[0] - (x + y)) > 1e-5 ||
+          fabs(derivs[1] - x) > 1e-5 ||
+          fabs(derivs[2] + 0.5 * z) > 1e-5) {
+         if (errors < 5)
+            fprintf(stderr, "quadratic: wrong value %g or derivatives "
+                    "%g %g %g at %g %g %g\n", value, derivs[0], derivs[1],
+                    derivs[2], x, y, z);
+         errors++;
+      }
+      for (a = 0; a < 3; a++)
+         for (b = 0; b < 3; b++)
+            if (fabs(second[a][b] - expected_second[a][b]) > 1e-5) {
+               if (errors < 5)
+                  fprintf(stderr, "quadratic: second derivative %d %d is %g "
+                          "at %g %g %g\n", a, b, second[a][b], x, y, z);
+               errors++;
+            }
+   }
+
+   delete_volume(volume);
+   return errors;
+}
+
+static int check_noise(VIO_Data_types coefficient_type, VIO_Real tolerance)
+{
+   VIO_Volume volume, reference;
+   VIO_Real voxel[VIO_MAX_DIMENSIONS];
+   VIO_Real value, expected, plus, minus, derivs[3], h = 1e-4;
+   int p, d;
+   int errors = 0;
+
+   volume = make_volume(NC_SHORT, noise);
+   reference = make_volume(NC_SHORT, noise);
+   if (set_volume_bspline_interpolation(volume, coefficient_type) != VIO_OK) {
+      fprintf(stderr, "set_volume_bspline_interpolation failed\n");
+      return 1;
+   }
+   if (get_volume_bspline_interpolation(volume) != coefficient_type) {
+      fprintf(stderr, "get_volume_bspline_interpolation is wrong\n");
+      errors++;
+   }
+
+   errors += check_voxel_values(volume, tolerance, "noise");
+
+   /* Derivatives against central differences, all the way to the edges */
+   for (p = 0; p < 300; p++) {
+      voxel[0] = h + (N0 - 1 - 2 * h) * rand() / (VIO_Real) RAND_MAX;
+      voxel[1] = h + (N1 - 1 - 2 * h) * rand() / (VIO_Real) RAND_MAX;
+      voxel[2] = h + (N2 - 1 - 2 * h) * rand() / (VIO_Real) RAND_MAX;
+      if (p < 3)
+         voxel[p] = h;
+
+      cubic(volume, voxel[0], voxel[1], voxel[2], derivs, NULL);
+      for (d = 0; d < 3; d++) {
+         voxel[d] += h;
+         plus = cubic(volume, voxel[0], voxel[1], voxel[2], NULL, NULL);
+         voxel[d] -= 2.0 * h;
+         minus = cubic(volume, voxel[0], voxel[1], voxel[2], NULL, NULL);
+         voxel[d] += h;
+         if (fabs((plus - minus) / (2.0 * h) - derivs[d]) >
+             1e-3 * (1.0 + fabs(derivs[d]))) {
+            if (errors < 5)
+               fprintf(stderr, "noise: derivative %d is %g, difference %g\n",
+                       d, derivs[d], (plus - minus) / (2.0 * h));
+            errors++;
+         }
+      }
+   }
+
+   /* Points outside the volume are evaluated as without the B-spline */
+   value = cubic(volume, -0.5, 3.0, 4.0, NULL, NULL);
+   expected = cubic(reference, -0.5, 3.0, 4.0, NULL, NULL);
+   if (value != expected) {
+      fprintf(stderr, "noise: outside value %g, expected %g\n",
+              value, expected);
+      errors++;
+   }
+
+   /* After a write, evaluation leaves the coefficients out of date and
+      uses the interpolating spline until they are recomputed */
+   set_volume_real_value(volume, 5, 6, 7, 0, 0, 1000.0);
+   set_volume_real_value(reference, 5, 6, 7, 0, 0, 1000.0);
+   value = cubic(volume, 5.4, 6.3, 7.8, NULL, NULL);
+   expected = cubic(reference, 5.4, 6.3, 7.8, NULL, NULL);
+   if (value != expected || volume->bspline_coefficients_uptodate) {
+      fprintf(stderr, "noise: value %g after write, expected %g\n",
+              value, expected);
+      errors++;
+   }
+
+   if (set_volume_bspline_interpolation(volume, coefficient_type) != VIO_OK) {
+      fprintf(stderr, "set_volume_bspline_interpolation failed\n");
+      return errors + 1;
+   }
+   value = cubic(volume, 5.0, 6.0, 7.0, NULL, NULL);
+   expected = get_volume_real_value(volume, 5, 6, 7, 0, 0);
+   if (fabs(value - expected) > tolerance ||
+       cubic(volume, 5.4, 6.3, 7.8, NULL, NULL) ==
+       cubic(reference, 5.4, 6.3, 7.8, NULL, NULL)) {
+      fprintf(stderr, "noise: value %g after update, expected %g\n",
+              value, expected);
+      errors++;
+   }
+
+   /* Turning the B-spline off restores the interpolating spline */
+   set_volume_bspline_interpolation(volume, VIO_NO_DATA_TYPE);
+   set_volume_real_value(volume, 5, 6, 7, 0, 0, noise(5, 6, 7));
+   set_volume_real_value(reference, 5, 6, 7, 0, 0, noise(5, 6, 7));
+   if (cubic(volume, 10.3, 11.6, 12.2, NULL, NULL) !=
+       cubic(reference, 10.3, 11.6, 12.2, NULL, NULL)) {
+      fprintf(stderr, "noise: B-spline not turned off\n");
+      errors++;
+   }
+
+   delete_volume(reference);
+   delete_volume(volume);
+   return errors;
+}
+
+/* A vector volume laid out like a grid transform, where each component
+   is interpolated separately */
+static int check_vector_volume(void)
+{
+   static VIO_STR names[] = { MIzspace, MIyspace, MIxspace,
+                              MIvector_dimension };
+   int sizes[VIO_MAX_DIMENSIONS] = { 9, 10, 11, 3, 0 };
+   VIO_BOOL spatial[VIO_MAX_DIMENSIONS] = { TRUE, TRUE, TRUE, FALSE, FALSE };
+   VIO_Real voxel[VIO_MAX_DIMENSIONS] = { 4.0, 7.0, 2.0, 0.0, 0.0 };
+   VIO_Real values[3];
+   VIO_Volume volume;
+   int i, j, k, c, n_values;
+   int errors = 0;
+
+   volume = create_volume(4, names, NC_FLOAT, TRUE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   alloc_volume_data(volume);
+   for (i = 0; i < sizes[0]; i++)
+      for (j = 0; j < sizes[1]; j++)
+         for (k = 0; k < sizes[2]; k++)
+            for (c = 0; c < 3; c++)
+               set_volume_real_value(volume, i, j, k, c, 0,
+                                     noise(i, j, k) * (c + 1));
+
+   if (set_volume_bspline_interpolation(volume, VIO_FLOAT) != VIO_OK) {
+      fprintf(stderr, "set_volume_bspline_interpolation failed\n");
+      return 1;
+   }
+
+   n_values = evaluate_volume(volume, voxel, spatial, 2, FALSE, 0.0, values,
+                              NULL, NULL);
+   if (n_values != 3) {
+      fprintf(stderr, "vector: %d values, expected 3\n", n_values);
+      errors++;
+   }
+   else {
+      for (c = 0; c < 3; c++) {
+         if (fabs(values[c] - noise(4, 7, 2) * (c + 1)) > 1e-2) {
+            fprintf(stderr, "vector: component %d is %g, expected %g\n",
+                    c, values[c], noise(4, 7, 2) * (c + 1));
+            errors++;
+         }
+      }
+   }
+
+   delete_volume(volume);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   int errors = 0;
+
+   srand(4321);
+
+   errors += check_quadratic();
+   errors += check_noise(VIO_DOUBLE, 1e-6);
+   errors += check_noise(VIO_FLOAT, 1e-2);
+   errors += check_vector_volume();
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,452 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : deformation_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Checks the Jacobians found by general_transform_point_with_jacobian()
+              for linear, grid, thin plate spline, user and concatenated
+              transforms against central differences and against each other
+              for an inverse, and maps the Jacobian determinant, the
+              Jacobian and the displacement length of a transform over
+              volumes with compute_deformation_volume(), checking each voxel
+              and the statistics, also for a transform that fails at some
+              voxels.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 200
+#define STEP 1e-4
+
+static const test_grid grid_spec = {
+   NC_FLOAT, FALSE, { 12, 14, 13 }, { -44.0, -52.0, -48.0 }, { 8.0, 8.0, 8.0 },
+   3.0, { 0.35, 0.2, 0.3, 0.25 }, 0.0, FALSE };
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+
+static VIO_Real random_real(VIO_Real low, VIO_Real high)
+{
+   return low + (high - low) * rand() / (VIO_Real) RAND_MAX;
+}
+
+static void scale_point(void *user_data, VIO_Real x, VIO_Real y, VIO_Real z,
+                        VIO_Real *x_trans, VIO_Real *y_trans,
+                        VIO_Real *z_trans)
+{
+   *x_trans = 1.1 * x + 0.01 * y * y;
+   *y_trans = 0.9 * y;
+   *z_trans = z + 0.02 * x * z;
+}
+
+static VIO_Real determinant(VIO_Real j[][VIO_N_DIMENSIONS])
+{
+   return j[0][0] * (j[1][1] * j[2][2] - j[1][2] * j[2][1]) -
+          j[0][1] * (j[1][0] * j[2][2] - j[1][2] * j[2][0]) +
+          j[0][2] * (j[1][0] * j[2][1] - j[1][1] * j[2][0]);
+}
+
+/* Compares the Jacobian at each point with central differences of
+   general_transform_point() */
+static int check_jacobian(VIO_General_transform *transform,
+                          VIO_Real tolerance, const char *what)
+{
+   VIO_Real jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+   VIO_Real pos[VIO_N_DIMENSIONS], plus[VIO_N_DIMENSIONS];
+   VIO_Real minus[VIO_N_DIMENSIONS], out[VIO_N_DIMENSIONS];
+   VIO_Real expected[VIO_N_DIMENSIONS], diff;
+   int p, c, d;
+   int errors = 0;
+
+   for (p = 0; p < N_POINTS; p++) {
+      if (general_transform_point_with_jacobian(transform, points[p][0],
+                                                points[p][1], points[p][2],
+                                                &out[0], &out[1], &out[2],
+                                                jacobian) != VIO_OK) {
+         fprintf(stderr, "%s: point %d failed\n", what, p);
+         return errors + 1;
+      }
+      general_transform_point(transform, points[p][0], points[p][1],
+                              points[p][2], &expected[0], &expected[1],
+                              &expected[2]);
+      for (c = 0; c < 3; c++) {
+         if (fabs(out[c] - expected[c]) > 1e-9) {
+            if (errors < 5)
+               fprintf(stderr, "%s: point %d component %d is %.17g, "
+                       "expected %.17g\n", what, p, c, out[c], expected[c]);
+            errors++;
+         }
+      }
+
+      for (d = 0; d < 3; d++) {
+         for (c = 0; c < 3; c++)
+            pos[c] = points[p][c];
+         pos[d] += STEP;
+         general_transform_point(transform, pos[0], pos[1], pos[2],
+                                 &plus[0], &plus[1], &plus[2]);
+         pos[d] -= 2.0 * STEP;
+         general_transform_point(transform, pos[0], pos[1], pos[2],
+                                 &minus[0], &minus[1], &minus[2]);
+         for (c = 0; c < 3; c++) {
+            diff = (plus[c] - minus[c]) / (2.0 * STEP);
+            if (fabs(jacobian[c][d] - diff) > tolerance) {
+               if (errors < 5)
+                  fprintf(stderr, "%s: point %d derivative %d %d is %g, "
+                          "central difference %g\n", what, p, c, d,
+                          jacobian[c][d], diff);
+               errors++;
+            }
+         }
+      }
+   }
+   return errors;
+}
+
+/* The Jacobian of the inverse at a point times that of the transform at
+   the inverse point is the identity, up to the tolerance of the iterative
+   inverses within a concatenation */
+static int check_inverse_jacobian(VIO_General_transform *transform,
+                                  VIO_Real tolerance, const char *what)
+{
+   VIO_General_transform inverse;
+   VIO_Real inverse_jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+   VIO_Real jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+   VIO_Real x, y, z, fx, fy, fz, sum;
+   int p, c, d, i;
+   int errors = 0;
+
+   create_inverse_general_transform(transform, &inverse);
+
+   for (p = 0; p < N_POINTS; p++) {
+      if (general_transform_point_with_jacobian(&inverse, points[p][0],
+                                                points[p][1], points[p][2],
+                                                &x, &y, &z,
+                                                inverse_jacobian) != VIO_OK ||
+          general_transform_point_with_jacobian(transform, x, y, z,
+                                                &fx, &fy, &fz,
+                                                jacobian) != VIO_OK) {
+         fprintf(stderr, "%s: point %d failed\n", what, p);
+         errors++;
+         break;
+      }
+      for (c = 0; c < 3; c++) {
+         for (d = 0; d < 3; d++) {
+            sum = 0.0;
+            for (i = 0; i < 3; i++)
+               sum += jacobian[c][i] * inverse_jacobian[i][d];
+            if (fabs(sum - (c == d ? 1.0 : 0.0)) > tolerance) {
+               if (errors < 5)
+                  fprintf(stderr, "%s: point %d product %d %d is %g\n",
+                          what, p, c, d, sum);
+               errors++;
+            }
+         }
+      }
+   }
+
+   delete_general_transform(&inverse);
+   return errors;
+}
+
+static VIO_Volume make_volume(VIO_BOOL matrix)
+{
+   static VIO_STR names[] = { MIzspace, MIyspace, MIxspace,
+                              MIvector_dimension };
+   int sizes[VIO_MAX_DIMENSIONS] = { 9, 11, 10, 9, 0 };
+   VIO_Real starts[VIO_MAX_DIMENSIONS] = { -30.0, -35.0, -32.0, 0.0, 0.0 };
+   VIO_Real steps[VIO_MAX_DIMENSIONS] = { 7.0, 6.5, 7.5, 1.0, 0.0 };
+   VIO_Volume volume;
+
+   volume = create_volume(matrix ? 4 : 3, names, NC_FLOAT, FALSE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   set_volume_starts(volume, starts);
+   set_volume_separations(volume, steps);
+   return volume;
+}
+
+/* Maps each quantity over a volume and checks every voxel and the
+   statistics */
+static int check_volumes(VIO_General_transform *transform, const char *what)
+{
+   VIO_Volume volume, matrix;
+   VIO_Real jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+   VIO_Real voxel[VIO_MAX_DIMENSIONS], x, y, z, tx, ty, tz, value, expected;
+   VIO_Real min_value, max_value, mean_value, low, high, sum;
+   VIO_Deformation_quantity quantity;
+   int sizes[VIO_MAX_DIMENSIONS];
+   int i, j, k, c, d, n;
+   int errors = 0;
+
+   for (quantity = JACOBIAN_DETERMINANT; quantity <= DISPLACEMENT_MAGNITUDE;
+        quantity++) {
+      volume = make_volume(FALSE);
+      matrix = make_volume(TRUE);
+
+      if (compute_deformation_volume(transform, quantity,
+                                     quantity == JACOBIAN_MATRIX ? matrix :
+                                     volume, &min_value, &max_value,
+                                     &mean_value) != VIO_OK) {
+         fprintf(stderr, "%s: quantity %d failed\n", what, (int) quantity);
+         errors++;
+         delete_volume(volume);
+         delete_volume(matrix);
+         continue;
+      }
+
+      get_volume_sizes(volume, sizes);
+      low = high = sum = 0.0;
+      n = 0;
+      for (i = 0; i < sizes[0]; i++) {
+         for (j = 0; j < sizes[1]; j++) {
+            for (k = 0; k < sizes[2]; k++) {
+               voxel[0] = i;
+               voxel[1] = j;
+               voxel[2] = k;
+               voxel[3] = 0.0;
+               convert_voxel_to_world(volume, voxel, &x, &y, &z);
+               general_transform_point_with_jacobian(transform, x, y, z,
+                                                     &tx, &ty, &tz, jacobian);
+
+               if (quantity == DISPLACEMENT_MAGNITUDE) {
+                  general_transform_point(transform, x, y, z, &tx, &ty, &tz);
+                  expected = sqrt((tx - x) * (tx - x) + (ty - y) * (ty - y) +
+                                  (tz - z) * (tz - z));
+               }
+               else
+                  expected = determinant(jacobian);
+
+               if (quantity == JACOBIAN_MATRIX) {
+                  for (c = 0; c < 3; c++) {
+                     for (d = 0; d < 3; d++) {
+                        value = get_volume_real_value(matrix, i, j, k,
+                                                      3 * c + d, 0);
+                        if (fabs(value - jacobian[c][d]) > 1e-5) {
+                           if (errors < 5)
+                              fprintf(stderr, "%s: voxel %d %d %d Jacobian "
+                                      "%d %d is %g, expected %g\n", what, i,
+                                      j, k, c, d, value, jacobian[c][d]);
+                           errors++;
+                        }
+                     }
+                  }
+               }
+               else {
+                  value = get_volume_real_value(volume, i, j, k, 0, 0);
+                  if (fabs(value - expected) > 1e-5 * (1.0 + fabs(expected))) {
+                     if (errors < 5)
+                        fprintf(stderr, "%s: quantity %d voxel %d %d %d is "
+                                "%g, expected %g\n", what, (int) quantity,
+                                i, j, k, value, expected);
+                     errors++;
+                  }
+               }
+
+               if (n == 0 || expected < low)
+                  low = expected;
+               if (n == 0 || expected > high)
+                  high = expected;
+               sum += expected;
+               n++;
+            }
+         }
+      }
+
+      if (fabs(min_value - low) > 1e-9 || fabs(max_value - high) > 1e-9 ||
+          fabs(mean_value - sum / n) > 1e-9) {
+         fprintf(stderr, "%s: quantity %d statistics %g %g %g, expected "
+                 "%g %g %g\n", what, (int) quantity, min_value, max_value,
+                 mean_value, low, high, sum / n);
+         errors++;
+      }
+
+      delete_volume(volume);
+      delete_volume(matrix);
+   }
+
+   return errors;
+}
+
+/* Maps the displacement length of a transform which fails at some voxels,
+   which must be zero and left out of the statistics, the others being
+   filled in as usual */
+static int check_failed_displacements(VIO_General_transform *transform,
+                                      const char *what)
+{
+   VIO_Volume volume;
+   VIO_Real voxel[VIO_MAX_DIMENSIONS], x, y, z, tx, ty, tz, value, expected;
+   VIO_Real min_value, max_value, mean_value, low, high, sum;
+   int sizes[VIO_MAX_DIMENSIONS];
+   int i, j, k, n, n_failed;
+   int errors = 0;
+
+   volume = make_volume(FALSE);
+   if (compute_deformation_volume(transform, DISPLACEMENT_MAGNITUDE, volume,
+                                  &min_value, &max_value, &mean_value) !=
+       VIO_ERROR) {
+      fprintf(stderr, "%s: did not fail\n", what);
+      errors++;
+   }
+
+   get_volume_sizes(volume, sizes);
+   low = high = sum = 0.0;
+   n = 0;
+   n_failed = 0;
+   for (i = 0; i < sizes[0]; i++) {
+      for (j = 0; j < sizes[1]; j++) {
+         for (k = 0; k < sizes[2]; k++) {
+            voxel[0] = i;
+            voxel[1] = j;
+            voxel[2] = k;
+            convert_voxel_to_world(volume, voxel, &x, &y, &z);
+            if (general_transform_point(transform, x, y, z, &tx, &ty, &tz) !=
+                VIO_OK) {
+               expected = 0.0;
+               n_failed++;
+            }
+            else {
+               expected = sqrt((tx - x) * (tx - x) + (ty - y) * (ty - y) +
+                               (tz - z) * (tz - z));
+               if (n == 0 || expected < low)
+                  low = expected;
+               if (n == 0 || expected > high)
+                  high = expected;
+               sum += expected;
+               n++;
+            }
+
+            value = get_volume_real_value(volume, i, j, k, 0, 0);
+            if (fabs(value - expected) > 1e-5 * (1.0 + fabs(expected))) {
+               if (errors < 5)
+                  fprintf(stderr, "%s: voxel %d %d %d is %g, expected %g\n",
+                          what, i, j, k, value, expected);
+               errors++;
+            }
+         }
+      }
+   }
+
+   if (n_failed == 0 || n == 0) {
+      fprintf(stderr, "%s: %d voxels failed and %d did not\n", what,
+              n_failed, n);
+      errors++;
+   }
+   else if (fabs(min_value - low) > 1e-9 || fabs(max_value - high) > 1e-9 ||
+            fabs(mean_value - sum / n) > 1e-9) {
+      fprintf(stderr, "%s: statistics %g %g %g, expected %g %g %g\n", what,
+              min_value, max_value, mean_value, low, high, sum / n);
+      errors++;
+   }
+
+   delete_volume(volume);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_Transform matrix;
+   VIO_General_transform linear, grid, tps, user, first, all;
+   VIO_General_transform folded, unfolded;
+   VIO_Real jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS], x, y, z, det;
+   VIO_Volume volume;
+   int p, c, d;
+   int errors = 0;
+
+   srand(9753);
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         points[p][d] = random_real(-25.0, 25.0);
+
+   make_identity_transform(&matrix);
+   Transform_elem(matrix, 0, 0) = 1.2 * cos(0.3);
+   Transform_elem(matrix, 0, 1) = -sin(0.3);
+   Transform_elem(matrix, 1, 0) = sin(0.3);
+   Transform_elem(matrix, 1, 1) = 0.9 * cos(0.3);
+   Transform_elem(matrix, 0, 3) = 2.5;
+   Transform_elem(matrix, 2, 3) = -1.25;
+   create_linear_transform(&linear, &matrix);
+
+   make_test_grid_transform(&grid, &grid_spec);
+   make_test_thin_plate_transform(&tps, 6, 0.02, 0.05);
+   create_user_transform(&user, &x, sizeof(x), scale_point, scale_point);
+
+   /* a linear transform's Jacobian is its matrix */
+   general_transform_point_with_jacobian(&linear, 1.0, 2.0, 3.0,
+                                         &x, &y, &z, jacobian);
+   for (c = 0; c < 3; c++)
+      for (d = 0; d < 3; d++)
+         if (jacobian[c][d] != Transform_elem(matrix, c, d)) {
+            fprintf(stderr, "linear: Jacobian %d %d is %g\n", c, d,
+                    jacobian[c][d]);
+            errors++;
+         }
+
+   errors += check_jacobian(&linear, 1e-6, "linear");
+   errors += check_jacobian(&grid, 1e-4, "grid");
+   errors += check_jacobian(&tps, 1e-4, "thin plate spline");
+   errors += check_jacobian(&user, 1e-4, "user");
+
+   concat_general_transforms(&linear, &grid, &first);
+   concat_general_transforms(&first, &tps, &all);
+   delete_general_transform(&first);
+   errors += check_jacobian(&all, 1e-4, "concatenated");
+
+   errors += check_inverse_jacobian(&grid, 1e-9, "inverse grid");
+   errors += check_inverse_jacobian(&tps, 1e-9, "inverse thin plate spline");
+   errors += check_inverse_jacobian(&all, 1e-3, "inverse concatenated");
+
+   errors += check_volumes(&grid, "grid volumes");
+   errors += check_volumes(&all, "concatenated volumes");
+
+   /* the inverse of a spline folding over part of the volume */
+   make_test_thin_plate_transform(&folded, 6, 1.0, 0.0);
+   create_inverse_general_transform(&folded, &unfolded);
+   errors += check_failed_displacements(&unfolded, "folded displacements");
+   delete_general_transform(&unfolded);
+   delete_general_transform(&folded);
+
+   /* a linear transform has the same determinant everywhere */
+   for (c = 0; c < 3; c++)
+      for (d = 0; d < 3; d++)
+         jacobian[c][d] = Transform_elem(matrix, c, d);
+   det = determinant(jacobian);
+   volume = make_volume(FALSE);
+   if (compute_deformation_volume(&linear, JACOBIAN_DETERMINANT, volume,
+                                  &x, &y, &z) != VIO_OK ||
+       fabs(x - det) > 1e-9 || fabs(y - det) > 1e-9 ||
+       fabs(z - det) > 1e-9) {
+      fprintf(stderr, "linear: determinants %g to %g, mean %g\n", x, y, z);
+      errors++;
+   }
+
+   /* the Jacobian matrix needs a volume with a dimension of size 9 */
+   if (compute_deformation_volume(&linear, JACOBIAN_MATRIX, volume,
+                                  NULL, NULL, NULL) != VIO_ERROR) {
+      fprintf(stderr, "a 3D volume accepted for the Jacobian matrix\n");
+      errors++;
+   }
+   delete_volume(volume);
+
+   delete_general_transform(&all);
+   delete_general_transform(&user);
+   delete_general_transform(&tps);
+   delete_general_transform(&grid);
+   delete_general_transform(&linear);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,170 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_points_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Evaluates volumes of every data type at many points, inside,
+              on the edge of and outside the volume, with
+              evaluate_volume_points() and checks that the values are those
+              given by evaluate_volume() one point at a time.  Trilinear
+              interpolation must match exactly; cubic and nearest neighbour
+              interpolation and a 4D volume go through the general path.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <volume_io.h>
+
+#define NX 23
+#define NY 17
+#define NZ 12
+#define NT 3
+
+#define N_POINTS 2003
+
+static VIO_Real coords[N_POINTS][VIO_MAX_DIMENSIONS];
+static VIO_Real values[N_POINTS * NT];
+static VIO_Real expected[NT];
+
+static VIO_STR type_names[] = { "", "unsigned byte", "signed byte",
+                                "unsigned short", "signed short",
+                                "unsigned int", "signed int",
+                                "float", "double" };
+
+static VIO_Volume make_volume(int n_dims, nc_type nc_data_type,
+                              VIO_BOOL signed_flag, VIO_Real vmin,
+                              VIO_Real vmax)
+{
+   static VIO_STR dim_names[] = { MIxspace, MIyspace, MIzspace, MItime };
+   int sizes[VIO_MAX_DIMENSIONS] = { NX, NY, NZ, NT, 0 };
+   VIO_Volume volume;
+   int i, j, k, t;
+
+   volume = create_volume(n_dims, dim_names, nc_data_type, signed_flag,
+                          vmin, vmax);
+   set_volume_sizes(volume, sizes);
+   alloc_volume_data(volume);
+   set_volume_real_range(volume, -50.0, 250.0);
+
+   for (i = 0; i < NX; i++)
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NZ; k++)
+            for (t = 0; t < (n_dims == 4 ? NT : 1); t++)
+               set_volume_voxel_value(volume, i, j, k, t, 0,
+                                      vmin + (vmax - vmin) *
+                                      (VIO_Real) ((i * 7919 + j * 104729 +
+                                                   k * 1299709 + t * 31) %
+                                                  1000) / 999.0);
+   return volume;
+}
+
+/* Positions spread over and around the volume, with some points exactly on
+   voxel centres and on the last voxel in each dimension */
+static void make_points(void)
+{
+   int p, d;
+   int sizes[3] = { NX, NY, NZ };
+
+   srand(12345);
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < 3; d++) {
+         if (p % 17 == 0)
+            coords[p][d] = (VIO_Real) (rand() % sizes[d]);
+         else if (p % 23 == 0)
+            coords[p][d] = (VIO_Real) (sizes[d] - 1);
+         else
+            coords[p][d] = -1.5 + (sizes[d] + 2.0) *
+               (VIO_Real) rand() / (VIO_Real) RAND_MAX;
+      }
+      coords[p][3] = (VIO_Real) (p % NT);
+      coords[p][4] = 0.0;
+   }
+}
+
+static int compare(VIO_Volume volume, VIO_BOOL interpolating[],
+                   int degrees, VIO_BOOL use_linear_at_edge,
+                   const char *what)
+{
+   int p, v, n_values, n_expected;
+   int errors = 0;
+
+   n_values = evaluate_volume_points(volume, N_POINTS, coords, interpolating,
+                                     degrees, use_linear_at_edge, -7.0,
+                                     values);
+
+   for (p = 0; p < N_POINTS; p++) {
+      n_expected = evaluate_volume(volume, coords[p], interpolating, degrees,
+                                   use_linear_at_edge, -7.0, expected,
+                                   NULL, NULL);
+      if (n_expected != n_values) {
+         fprintf(stderr, "%s: %d values per point, expected %d\n",
+                 what, n_values, n_expected);
+         return 1;
+      }
+      for (v = 0; v < n_values; v++) {
+         if (values[p * n_values + v] != expected[v]) {
+            if (errors < 10)
+               fprintf(stderr, "%s: point %d (%g %g %g) value %d is %.17g, "
+                       "expected %.17g\n", what, p, coords[p][0],
+                       coords[p][1], coords[p][2], v,
+                       values[p * n_values + v], expected[v]);
+            errors++;
+         }
+      }
+   }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   static struct {
+      nc_type type;
+      VIO_BOOL signed_flag;
+      VIO_Real vmin, vmax;
+   } types[] = { { NC_BYTE,   FALSE, 0.0,     255.0 },
+                 { NC_BYTE,   TRUE,  -128.0,  127.0 },
+                 { NC_SHORT,  FALSE, 0.0,     65535.0 },
+                 { NC_SHORT,  TRUE,  -32768.0, 32767.0 },
+                 { NC_INT,    FALSE, 0.0,     4.0e9 },
+                 { NC_INT,    TRUE,  -2.0e9,  2.0e9 },
+                 { NC_FLOAT,  FALSE, -1.0,    1.0 },
+                 { NC_DOUBLE, FALSE, -1.0,    1.0 } };
+   VIO_BOOL spatial[VIO_MAX_DIMENSIONS] = { TRUE, TRUE, TRUE, FALSE, FALSE };
+   VIO_Volume volume;
+   int t;
+   int errors = 0;
+
+   make_points();
+
+   for (t = 0; t < (int) (sizeof(types) / sizeof(types[0])); t++) {
+      volume = make_volume(3, types[t].type, types[t].signed_flag,
+                           types[t].vmin, types[t].vmax);
+
+      errors += compare(volume, NULL, 0, FALSE,
+                        type_names[get_volume_data_type(volume)]);
+      errors += compare(volume, NULL, -1, FALSE, "nearest neighbour");
+      errors += compare(volume, NULL, 2, TRUE, "cubic");
+
+      delete_volume(volume);
+   }
+
+   volume = make_volume(4, NC_SHORT, TRUE, -32768.0, 32767.0);
+   errors += compare(volume, NULL, 0, FALSE, "4D trilinear");
+   errors += compare(volume, spatial, 2, FALSE, "4D cubic");
+   delete_volume(volume);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
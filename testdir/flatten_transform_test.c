@@ -0,0 +1,289 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : flatten_transform_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Simplifies a chain of linear, grid and thin plate spline
+              transforms, with nested, inverted and identity members, with
+              simplify_general_transform(), checking the stages left and
+              that the result transforms points as the chain does, then
+              flattens the chain into one grid with
+              flatten_general_transform() and checks it against the chain
+              and the error it reports.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 300
+
+static const test_grid grid_spec = {
+   NC_FLOAT, FALSE, { 12, 13, 14 }, { -44.0, -48.0, -52.0 }, { 8.0, 8.0, 8.0 },
+   1.5, { 0.3, 0.4, 0.25, 0.2 }, 0.0, FALSE };
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+
+static void make_linear(VIO_General_transform *transform, VIO_Real angle,
+                        VIO_Real shift)
+{
+   VIO_Transform matrix;
+
+   make_identity_transform(&matrix);
+   Transform_elem(matrix, 1, 1) = cos(angle);
+   Transform_elem(matrix, 1, 2) = -sin(angle);
+   Transform_elem(matrix, 2, 1) = sin(angle);
+   Transform_elem(matrix, 2, 2) = cos(angle);
+   Transform_elem(matrix, 0, 0) = 1.0 + angle;
+   Transform_elem(matrix, 0, 3) = shift;
+   Transform_elem(matrix, 2, 3) = -0.5 * shift;
+   create_linear_transform(transform, &matrix);
+}
+
+/* The largest distance between where the two transforms, or their
+   inverses, take the points */
+static VIO_Real max_difference(VIO_General_transform *first,
+                               VIO_General_transform *second,
+                               VIO_BOOL inverse)
+{
+   VIO_Real x1, y1, z1, x2, y2, z2, diff, max_diff = 0.0;
+   int p;
+
+   for (p = 0; p < N_POINTS; p++) {
+      if (inverse) {
+         general_inverse_transform_point(first, points[p][0], points[p][1],
+                                         points[p][2], &x1, &y1, &z1);
+         general_inverse_transform_point(second, points[p][0], points[p][1],
+                                         points[p][2], &x2, &y2, &z2);
+      }
+      else {
+         general_transform_point(first, points[p][0], points[p][1],
+                                 points[p][2], &x1, &y1, &z1);
+         general_transform_point(second, points[p][0], points[p][1],
+                                 points[p][2], &x2, &y2, &z2);
+      }
+      diff = sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) +
+                  (z1 - z2) * (z1 - z2));
+      if (diff > max_diff)
+         max_diff = diff;
+   }
+   return max_diff;
+}
+
+/* A concatenation of copies of the members, as it is, whereas
+   concat_general_transforms() would expand and join some of them */
+static void make_concatenation(VIO_General_transform *transform,
+                               int n_members,
+                               VIO_General_transform *members[])
+{
+   int i;
+
+   transform->type = CONCATENATED_TRANSFORM;
+   transform->inverse_flag = FALSE;
+   transform->n_transforms = n_members;
+   ALLOC(transform->transforms, n_members);
+   for (i = 0; i < n_members; i++)
+      copy_general_transform(members[i], &transform->transforms[i]);
+}
+
+static int check_types(VIO_General_transform *transform,
+                       int n_expected, VIO_Transform_types expected[],
+                       const char *what)
+{
+   int i;
+
+   if (n_expected == 1) {
+      if (get_transform_type(transform) != expected[0]) {
+         fprintf(stderr, "%s: simplified to type %d, expected %d\n", what,
+                 get_transform_type(transform), expected[0]);
+         return 1;
+      }
+      return 0;
+   }
+
+   if (get_transform_type(transform) != CONCATENATED_TRANSFORM ||
+       get_n_concated_transforms(transform) != n_expected) {
+      fprintf(stderr, "%s: simplified to %d stages, expected %d\n", what,
+              get_n_concated_transforms(transform), n_expected);
+      return 1;
+   }
+   for (i = 0; i < n_expected; i++) {
+      if (get_transform_type(get_nth_general_transform(transform, i)) !=
+          expected[i]) {
+         fprintf(stderr, "%s: stage %d has type %d, expected %d\n", what, i,
+                 get_transform_type(get_nth_general_transform(transform, i)),
+                 expected[i]);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform lin1, lin2, lin3, lin4, lin5, grid, tps, identity;
+   VIO_General_transform inner, inverted, last, chain, simplified, flattened;
+   VIO_General_transform *members[6];
+   VIO_Transform identity_matrix;
+   VIO_Transform_types chain_types[] = { LINEAR, THIN_PLATE_SPLINE, LINEAR,
+                                         GRID_TRANSFORM, LINEAR };
+   VIO_Transform_types single_linear[] = { LINEAR };
+   VIO_Transform_types single_grid[] = { GRID_TRANSFORM };
+   int sizes[VIO_N_DIMENSIONS] = { 31, 29, 27 };
+   VIO_Real starts[VIO_N_DIMENSIONS] = { -30.0, -28.0, -26.0 };
+   VIO_Real steps[VIO_N_DIMENSIONS] = { 2.0, 2.0, 2.0 };
+   int bad_sizes[VIO_N_DIMENSIONS] = { 31, 1, 27 };
+   VIO_Real max_error, diff;
+   int p, d, i;
+   int errors = 0;
+
+   srand(97531);
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         points[p][d] = -24.0 + 48.0 * rand() / (VIO_Real) RAND_MAX;
+
+   make_linear(&lin1, 0.1, 1.0);
+   make_linear(&lin2, -0.05, 2.0);
+   make_linear(&lin3, 0.2, -1.5);
+   make_linear(&lin4, -0.15, 0.5);
+   make_linear(&lin5, 0.05, 3.0);
+   make_identity_transform(&identity_matrix);
+   create_linear_transform(&identity, &identity_matrix);
+   make_test_grid_transform(&grid, &grid_spec);
+   make_test_thin_plate_transform(&tps, 4, 0.01, 0.0);
+
+   /* lin1 lin2 inverse(tps lin4) identity (lin3 grid) lin5, which is
+      lin1*lin2*inverse(lin4) inverse(tps) lin3 grid lin5 */
+   members[0] = &tps;
+   members[1] = &lin4;
+   make_concatenation(&inner, 2, members);
+   create_inverse_general_transform(&inner, &inverted);
+   delete_general_transform(&inner);
+
+   members[0] = &lin3;
+   members[1] = &grid;
+   make_concatenation(&last, 2, members);
+
+   members[0] = &lin1;
+   members[1] = &lin2;
+   members[2] = &inverted;
+   members[3] = &identity;
+   members[4] = &last;
+   members[5] = &lin5;
+   make_concatenation(&chain, 6, members);
+
+   simplify_general_transform(&chain, &simplified);
+   errors += check_types(&simplified, 5, chain_types, "chain");
+   diff = max_difference(&chain, &simplified, FALSE);
+   if (diff > 1e-9) {
+      fprintf(stderr, "chain: simplified transform is %g away\n", diff);
+      errors++;
+   }
+   diff = max_difference(&chain, &simplified, TRUE);
+   if (diff > 0.01) {
+      fprintf(stderr, "chain: simplified inverse is %g away\n", diff);
+      errors++;
+   }
+   delete_general_transform(&simplified);
+
+   /* the inverse of the chain */
+   create_inverse_general_transform(&chain, &inner);
+   simplify_general_transform(&inner, &simplified);
+   diff = max_difference(&inner, &simplified, FALSE);
+   if (diff > 0.01) {
+      fprintf(stderr, "inverted chain: simplified transform is %g away\n",
+              diff);
+      errors++;
+   }
+   delete_general_transform(&simplified);
+   delete_general_transform(&inner);
+
+   /* only identities */
+   members[0] = &identity;
+   members[1] = &identity;
+   make_concatenation(&inner, 2, members);
+   simplify_general_transform(&inner, &simplified);
+   errors += check_types(&simplified, 1, single_linear, "identities");
+   for (i = 0; i < 16; i++) {
+      if (Transform_elem(*get_linear_transform_ptr(&simplified), i / 4, i % 4)
+          != Transform_elem(identity_matrix, i / 4, i % 4)) {
+         fprintf(stderr, "identities: not simplified to the identity\n");
+         errors++;
+         break;
+      }
+   }
+   delete_general_transform(&simplified);
+   delete_general_transform(&inner);
+
+   /* a single grid left */
+   members[1] = &grid;
+   make_concatenation(&inner, 2, members);
+   simplify_general_transform(&inner, &simplified);
+   errors += check_types(&simplified, 1, single_grid, "grid");
+   if (max_difference(&grid, &simplified, FALSE) != 0.0) {
+      fprintf(stderr, "grid: simplified transform differs\n");
+      errors++;
+   }
+   delete_general_transform(&simplified);
+   delete_general_transform(&inner);
+
+   /* the whole chain as one grid */
+   if (flatten_general_transform(&chain, sizes, starts, steps, &flattened,
+                                 &max_error) != VIO_OK) {
+      fprintf(stderr, "flatten_general_transform failed\n");
+      errors++;
+   }
+   else {
+      if (get_transform_type(&flattened) != GRID_TRANSFORM) {
+         fprintf(stderr, "flattened: not a grid transform\n");
+         errors++;
+      }
+      if (max_error <= 0.0 || max_error > 0.05) {
+         fprintf(stderr, "flattened: max error %g\n", max_error);
+         errors++;
+      }
+
+      diff = max_difference(&chain, &flattened, FALSE);
+      if (diff > 2.0 * max_error) {
+         fprintf(stderr, "flattened: transform is %g away, max error %g\n",
+                 diff, max_error);
+         errors++;
+      }
+      delete_general_transform(&flattened);
+   }
+
+   if (flatten_general_transform(&chain, bad_sizes, starts, steps,
+                                 &flattened, NULL) != VIO_ERROR) {
+      fprintf(stderr, "flattened: a grid one node thick was accepted\n");
+      errors++;
+   }
+
+   delete_general_transform(&chain);
+   delete_general_transform(&last);
+   delete_general_transform(&inverted);
+   delete_general_transform(&identity);
+   delete_general_transform(&tps);
+   delete_general_transform(&grid);
+   delete_general_transform(&lin5);
+   delete_general_transform(&lin4);
+   delete_general_transform(&lin3);
+   delete_general_transform(&lin2);
+   delete_general_transform(&lin1);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
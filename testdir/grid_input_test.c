@@ -0,0 +1,160 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_input_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Writes a grid transform whose displacement volume is double with
+              the vector dimension first, inputs it as it is, as float, as a
+              cached volume and as both, and checks the type, layout and
+              caching of the volumes and that they transform points alike.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 500
+
+static const test_grid grid_spec = {
+   NC_DOUBLE, TRUE, { 10, 12, 11 }, { -20.0, -27.0, -25.0 }, { 4.0, 5.0, 4.5 },
+   2.5, { 0.4, 0.3, 0.35, 0.2 }, 0.0, FALSE };
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real expected[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real expected_inverse[N_POINTS][VIO_N_DIMENSIONS];
+
+/* Inputs the transform with the given options and compares it with the
+   transform as written */
+static int check_input(const char *filename, VIO_BOOL float_input,
+                       VIO_BOOL cached_input, const char *what)
+{
+   VIO_General_transform transform;
+   VIO_Volume volume;
+   VIO_STR *dim_names;
+   VIO_Real x, y, z, error, tolerance;
+   VIO_Data_types type;
+   int p, vector_dim;
+   int errors = 0;
+
+   set_grid_transform_float_input(float_input);
+   set_grid_transform_cached_input(cached_input);
+
+   if (input_transform_file(filename, &transform) != VIO_OK) {
+      fprintf(stderr, "%s: cannot input %s\n", what, filename);
+      return 1;
+   }
+
+   if (get_n_bytes_cache_threshold() != -1) {
+      fprintf(stderr, "%s: cache threshold changed to %d\n", what,
+              get_n_bytes_cache_threshold());
+      errors++;
+   }
+
+   volume = (VIO_Volume) transform.displacement_volume;
+   dim_names = get_volume_dimension_names(volume);
+   vector_dim = equal_strings(dim_names[0], MIvector_dimension) ? 0 : 3;
+   type = get_volume_data_type(volume);
+   if (!equal_strings(dim_names[vector_dim], MIvector_dimension) ||
+       (float_input && (type != VIO_FLOAT || vector_dim != 3)) ||
+       (!float_input && (type != VIO_DOUBLE || vector_dim != 0)) ||
+       volume->is_cached_volume != cached_input) {
+      fprintf(stderr, "%s: type %d, vector dimension %d, %s\n", what,
+              (int) type, vector_dim,
+              volume->is_cached_volume ? "cached" : "not cached");
+      errors++;
+   }
+   delete_dimension_names(volume, dim_names);
+
+   /* the displacements rounded to float */
+   tolerance = float_input ? 1e-4 : 1e-9;
+
+   for (p = 0; p < N_POINTS; p++) {
+      general_transform_point(&transform, points[p][0], points[p][1],
+                              points[p][2], &x, &y, &z);
+      error = fabs(x - expected[p][0]) + fabs(y - expected[p][1]) +
+              fabs(z - expected[p][2]);
+      general_inverse_transform_point(&transform, points[p][0], points[p][1],
+                                      points[p][2], &x, &y, &z);
+      error += fabs(x - expected_inverse[p][0]) +
+               fabs(y - expected_inverse[p][1]) +
+               fabs(z - expected_inverse[p][2]);
+      if (error > tolerance) {
+         if (errors < 5)
+            fprintf(stderr, "%s: point %d differs by %g\n", what, p, error);
+         errors++;
+      }
+   }
+
+   delete_general_transform(&transform);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform grid;
+   char filename[256], volume_filename[256];
+   int p, d;
+   int errors = 0;
+
+   srand(1357);
+
+   snprintf(filename, sizeof(filename), "test_grid_input-%d.xfm", getpid());
+   snprintf(volume_filename, sizeof(volume_filename),
+            "test_grid_input-%d_grid_0.mnc", getpid());
+
+   make_test_grid_transform(&grid, &grid_spec);
+   if (output_transform_file(filename, NULL, &grid) != VIO_OK) {
+      fprintf(stderr, "cannot output %s\n", filename);
+      return 1;
+   }
+   delete_general_transform(&grid);
+
+   /* inside the grid and a little outside */
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         points[p][d] = -30.0 + 80.0 * rand() / (VIO_Real) RAND_MAX;
+
+   if (input_transform_file(filename, &grid) != VIO_OK) {
+      fprintf(stderr, "cannot input %s\n", filename);
+      errors++;
+   }
+   else {
+      for (p = 0; p < N_POINTS; p++) {
+         general_transform_point(&grid, points[p][0], points[p][1],
+                                 points[p][2], &expected[p][0],
+                                 &expected[p][1], &expected[p][2]);
+         general_inverse_transform_point(&grid, points[p][0], points[p][1],
+                                         points[p][2],
+                                         &expected_inverse[p][0],
+                                         &expected_inverse[p][1],
+                                         &expected_inverse[p][2]);
+      }
+      delete_general_transform(&grid);
+
+      errors += check_input(filename, FALSE, FALSE, "original");
+      errors += check_input(filename, TRUE, FALSE, "float");
+      errors += check_input(filename, FALSE, TRUE, "cached");
+      errors += check_input(filename, TRUE, TRUE, "cached float");
+   }
+
+   unlink(filename);
+   unlink(volume_filename);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,143 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Precomputes the inverse displacements of a smooth grid
+              transform and checks that the inverse found from them maps
+              back through the forward transform, agrees with the iterative
+              inverse, survives copying and concatenation, and that
+              deleting them restores the iterative inverse.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 500
+
+/* Displacements that vanish at the edges of the grid */
+static const test_grid grid_spec = {
+   NC_SHORT, FALSE, { 12, 14, 13 }, { -44.0, -52.0, -48.0 }, { 8.0, 8.0, 8.0 },
+   3.0, { 0.35, 0.2, 0.3, 0.25 }, 0.0, TRUE };
+
+static VIO_Real points[N_POINTS][3];
+static VIO_Real iterative[N_POINTS][3];
+
+/* Checks the inverse at each point maps back through the forward transform
+   and is close to the iterative inverse */
+static int check_inverse(VIO_General_transform *transform, VIO_Real tolerance,
+                         const char *what)
+{
+   VIO_Real x, y, z, fx, fy, fz, error;
+   int p;
+   int errors = 0;
+
+   for (p = 0; p < N_POINTS; p++) {
+      general_inverse_transform_point(transform, points[p][0], points[p][1],
+                                      points[p][2], &x, &y, &z);
+      general_transform_point(transform, x, y, z, &fx, &fy, &fz);
+
+      error = fabs(fx - points[p][0]) + fabs(fy - points[p][1]) +
+              fabs(fz - points[p][2]);
+      if (error > tolerance ||
+          fabs(x - iterative[p][0]) + fabs(y - iterative[p][1]) +
+          fabs(z - iterative[p][2]) > tolerance) {
+         if (errors < 5)
+            fprintf(stderr, "%s: inverse of %g %g %g is %g %g %g, "
+                    "iterative inverse %g %g %g, error %g\n", what,
+                    points[p][0], points[p][1], points[p][2], x, y, z,
+                    iterative[p][0], iterative[p][1], iterative[p][2],
+                    error);
+         errors++;
+      }
+   }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform grid, copy, linear, concat;
+   VIO_Transform shift;
+   VIO_Real max_error, x, y, z;
+   int p, d, n_not_converged;
+   int errors = 0;
+
+   srand(777);
+
+   make_test_grid_transform(&grid, &grid_spec);
+
+   /* inside the grid and a little outside */
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < 3; d++)
+         points[p][d] = -56.0 + 112.0 * rand() / (VIO_Real) RAND_MAX;
+      general_inverse_transform_point(&grid, points[p][0], points[p][1],
+                                      points[p][2], &iterative[p][0],
+                                      &iterative[p][1], &iterative[p][2]);
+   }
+
+   if (create_grid_inverse_displacements(&grid, &max_error,
+                                         &n_not_converged) != VIO_OK) {
+      fprintf(stderr, "create_grid_inverse_displacements failed\n");
+      return 1;
+   }
+   if (n_not_converged != 0 || max_error > 0.01) {
+      fprintf(stderr, "%d nodes did not converge, max error %g\n",
+              n_not_converged, max_error);
+      errors++;
+   }
+
+   errors += check_inverse(&grid, 0.1, "precomputed");
+
+   copy_general_transform(&grid, &copy);
+   errors += check_inverse(&copy, 0.1, "copy");
+   delete_general_transform(&copy);
+
+   /* the linear part has no inverse displacements of its own */
+   make_identity_transform(&shift);
+   create_linear_transform(&linear, &shift);
+   delete_grid_inverse_displacements(&grid);
+   concat_general_transforms(&linear, &grid, &concat);
+   if (create_grid_inverse_displacements(&concat, &max_error,
+                                         &n_not_converged) != VIO_OK ||
+       n_not_converged != 0) {
+      fprintf(stderr, "concatenated: %d nodes did not converge\n",
+              n_not_converged);
+      errors++;
+   }
+   errors += check_inverse(&concat, 0.1, "concatenated");
+   delete_general_transform(&concat);
+
+   /* without the inverse displacements, the iterative inverse is back */
+   for (p = 0; p < N_POINTS; p++) {
+      general_inverse_transform_point(&grid, points[p][0], points[p][1],
+                                      points[p][2], &x, &y, &z);
+      if (x != iterative[p][0] || y != iterative[p][1] ||
+          z != iterative[p][2]) {
+         if (errors < 5)
+            fprintf(stderr, "deleted: inverse of %g %g %g changed\n",
+                    points[p][0], points[p][1], points[p][2]);
+         errors++;
+      }
+   }
+
+   delete_general_transform(&linear);
+   delete_general_transform(&grid);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
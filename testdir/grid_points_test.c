@@ -0,0 +1,177 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_points_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Applies grid transforms of several voxel types and layouts to
+              points inside, on the edges of and outside the grid with
+              grid_transform_points(), checks that the results are those of
+              grid_transform_point(), that inside the grid they are, to
+              rounding, the displacements interpolated by evaluate_volume(),
+              and that they do not depend on where the vector dimension is.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 1000
+
+/* grid_transform_points() sums the stencil in another order than
+   evaluate_volume() and converts the sums rather than the voxels to real
+   values, so the two agree only to rounding: within TOLERANCE of the
+   largest displacement of the grid, DISPLACEMENT_RANGE */
+#define TOLERANCE 1e-12
+#define DISPLACEMENT_RANGE 2.7
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real transformed[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real vector_last[N_POINTS][VIO_N_DIMENSIONS];
+
+/* A grid with x, y, z sizes 11, 12 and 10, with the vector dimension first
+   or last */
+static VIO_Volume make_grid(nc_type type, VIO_BOOL vector_first)
+{
+   test_grid grid = {
+      NC_FLOAT, FALSE, { 10, 12, 11 }, { -20.0, -27.0, -25.0 },
+      { 4.0, 5.0, 4.5 }, 2.5, { 0.4, 0.3, 0.35, 0.2 }, 0.1, FALSE };
+
+   grid.type = type;
+   grid.vector_first = vector_first;
+   return make_test_displacements(&grid);
+}
+
+static int check_grid(VIO_Volume volume, const char *what)
+{
+   VIO_General_transform transform;
+   VIO_BOOL interpolating[VIO_MAX_DIMENSIONS];
+   VIO_Real voxel[VIO_MAX_DIMENSIONS], values[3], x, y, z, expected;
+   int sizes[VIO_MAX_DIMENSIONS];
+   int p, d, c, vector_dim, degrees;
+   int errors = 0;
+
+   create_grid_transform(&transform, volume, NULL);
+
+   get_volume_sizes(volume, sizes);
+   vector_dim = (sizes[0] == 3) ? 0 : 3;
+   for (d = 0; d < 4; d++)
+      interpolating[d] = (d != vector_dim);
+   interpolating[4] = FALSE;
+
+   if (grid_transform_points(&transform, N_POINTS, points,
+                             transformed) != VIO_OK) {
+      fprintf(stderr, "%s: grid_transform_points failed\n", what);
+      delete_general_transform(&transform);
+      return 1;
+   }
+
+   for (p = 0; p < N_POINTS; p++) {
+      grid_transform_point(&transform, points[p][0], points[p][1],
+                           points[p][2], &x, &y, &z);
+      if (x != transformed[p][0] || y != transformed[p][1] ||
+          z != transformed[p][2]) {
+         if (errors < 5)
+            fprintf(stderr, "%s: point %d is %.17g %.17g %.17g in a batch, "
+                    "%.17g %.17g %.17g alone\n", what, p, transformed[p][0],
+                    transformed[p][1], transformed[p][2], x, y, z);
+         errors++;
+      }
+
+      /* where evaluate_grid_volume() interpolates every dimension by the
+         same degree, evaluate_volume() finds the same displacements, to
+         rounding */
+      convert_world_to_voxel(volume, points[p][0], points[p][1],
+                             points[p][2], voxel);
+      degrees = 2;
+      for (d = 0; d < 4; d++) {
+         if (d == vector_dim)
+            continue;
+         if (voxel[d] < 0.0 || voxel[d] > sizes[d] - 1.0)
+            degrees = -2;
+         else if (degrees == 2 && (voxel[d] < 1.0 || voxel[d] > sizes[d] - 2.0))
+            degrees = -2;
+      }
+      if (degrees == -2 || vector_dim == 0)
+         continue;
+
+      voxel[vector_dim] = 0.0;
+      evaluate_volume(volume, voxel, interpolating, degrees, FALSE, 0.0,
+                      values, NULL, NULL);
+      for (c = 0; c < 3; c++) {
+         expected = points[p][c] + values[c];
+         if (fabs(transformed[p][c] - expected) >
+             TOLERANCE * DISPLACEMENT_RANGE) {
+            if (errors < 5)
+               fprintf(stderr, "%s: point %d component %d is %.17g, "
+                       "expected %.17g\n", what, p, c, transformed[p][c],
+                       expected);
+            errors++;
+         }
+      }
+   }
+
+   delete_general_transform(&transform);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_Volume volume;
+   int p, d;
+   int errors = 0;
+
+   srand(2468);
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < 3; d++)
+         points[p][d] = -32.0 + 64.0 * rand() / (VIO_Real) RAND_MAX;
+   }
+
+   volume = make_grid(NC_FLOAT, FALSE);
+   errors += check_grid(volume, "float");
+   delete_volume(volume);
+
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < 3; d++)
+         vector_last[p][d] = transformed[p][d];
+
+   volume = make_grid(NC_FLOAT, TRUE);
+   errors += check_grid(volume, "vector first");
+   delete_volume(volume);
+
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < 3; d++) {
+         if (transformed[p][d] != vector_last[p][d]) {
+            if (errors < 5)
+               fprintf(stderr, "vector first: point %d component %d is "
+                       "%.17g, %.17g with the vector last\n", p, d,
+                       transformed[p][d], vector_last[p][d]);
+            errors++;
+         }
+      }
+   }
+
+   volume = make_grid(NC_SHORT, FALSE);
+   errors += check_grid(volume, "short");
+   delete_volume(volume);
+
+   volume = make_grid(NC_DOUBLE, FALSE);
+   errors += check_grid(volume, "double");
+   delete_volume(volume);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,166 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : icv_dimconv
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Checks icv dimension conversion on a multi-slice volume for
+              a pure flip and for integer down-sampling, comparing with
+              values computed directly from the stored voxels.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <minc.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define NZ 64
+#define NY 128
+#define NX 96
+
+static short voxels[NZ][NY][NX];
+static short values[NZ][NY][NX];
+
+/* Read the whole volume through an icv with the given size (0 for no
+   resizing) and direction for the two image dimensions */
+static int read_icv(int cdfid, int img, long ysize, long xsize, int flip)
+{
+   int icv;
+   long coord[3] = {0, 0, 0};
+   long count[3];
+
+   icv = miicv_create();
+   miicv_setint(icv, MI_ICV_TYPE, NC_SHORT);
+   miicv_setstr(icv, MI_ICV_SIGN, MI_SIGNED);
+   miicv_setint(icv, MI_ICV_DO_RANGE, FALSE);
+   miicv_setint(icv, MI_ICV_DO_DIM_CONV, TRUE);
+   miicv_setint(icv, MI_ICV_KEEP_ASPECT, FALSE);
+   miicv_setint(icv, MI_ICV_XDIM_DIR,
+                flip ? MI_ICV_NEGATIVE : MI_ICV_POSITIVE);
+   miicv_setint(icv, MI_ICV_YDIM_DIR,
+                flip ? MI_ICV_NEGATIVE : MI_ICV_POSITIVE);
+   if (xsize > 0) miicv_setint(icv, MI_ICV_ADIM_SIZE, xsize);
+   if (ysize > 0) miicv_setint(icv, MI_ICV_BDIM_SIZE, ysize);
+   if (miicv_attach(icv, cdfid, img) == MI_ERROR) {
+      return MI_ERROR;
+   }
+
+   count[0] = NZ;
+   count[1] = (ysize > 0) ? ysize : NY;
+   count[2] = (xsize > 0) ? xsize : NX;
+   memset(values, 0, sizeof(values));
+   if (miicv_get(icv, coord, count, values) == MI_ERROR) {
+      return MI_ERROR;
+   }
+   miicv_free(icv);
+   return MI_NOERROR;
+}
+
+int main(int argc, char **argv)
+{
+   int cdfid, img, dimvar;
+   int dim[3];
+   long coord[3] = {0, 0, 0};
+   long count[3] = {NZ, NY, NX};
+   char filename[256];
+   int cflag = 0;
+   long i, j, k;
+   short *out;
+   double sum;
+   short expected;
+   int errors = 0;
+
+#if MINC2
+   if (argc == 2 && !strcmp(argv[1], "-2")) {
+       cflag = MI2_CREATE_V2;
+   }
+#endif /* MINC2 */
+
+   for (i = 0; i < NZ; i++)
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NX; k++)
+            voxels[i][j][k] =
+               (short) ((i * 977 + j * 31 + k * 7) % 2001 - 1000);
+
+   snprintf(filename, sizeof(filename), "test_icv_dimconv-%d.mnc", getpid());
+   cdfid = micreate(filename, NC_CLOBBER | cflag);
+   dim[0] = ncdimdef(cdfid, MIzspace, NZ);
+   dim[1] = ncdimdef(cdfid, MIyspace, NY);
+   dim[2] = ncdimdef(cdfid, MIxspace, NX);
+   for (i = 0; i < 3; i++) {
+      dimvar = micreate_std_variable(cdfid, (i == 0) ? MIzspace :
+                                     (i == 1) ? MIyspace : MIxspace,
+                                     NC_DOUBLE, 0, NULL);
+      miattputdbl(cdfid, dimvar, MIstep, 1.0);
+   }
+   img = micreate_std_variable(cdfid, MIimage, NC_SHORT, 3, dim);
+   miattputstr(cdfid, img, MIsigntype, MI_SIGNED);
+   ncendef(cdfid);
+   ncvarput(cdfid, img, coord, count, voxels);
+
+   /* Pure flip of both image dimensions */
+   if (read_icv(cdfid, img, 0, 0, TRUE) == MI_ERROR) {
+      fprintf(stderr, "Flipped read failed\n");
+      errors++;
+   }
+   else {
+      for (i = 0; i < NZ; i++)
+         for (j = 0; j < NY; j++)
+            for (k = 0; k < NX; k++)
+               if (values[i][j][k] != voxels[i][NY - 1 - j][NX - 1 - k]) {
+                  errors++;
+               }
+      if (errors) fprintf(stderr, "Flipped read gave wrong values\n");
+   }
+
+   /* Down-sampling by 2 in y and 3 in x */
+   if (read_icv(cdfid, img, NY / 2, NX / 3, FALSE) == MI_ERROR) {
+      fprintf(stderr, "Down-sampled read failed\n");
+      errors++;
+   }
+   else {
+      out = &values[0][0][0];
+      for (i = 0; i < NZ; i++) {
+         for (j = 0; j < NY / 2; j++) {
+            for (k = 0; k < NX / 3; k++) {
+               sum = voxels[i][2*j][3*k] + voxels[i][2*j][3*k+1] +
+                  voxels[i][2*j][3*k+2] + voxels[i][2*j+1][3*k] +
+                  voxels[i][2*j+1][3*k+1] + voxels[i][2*j+1][3*k+2];
+               sum /= 6.0;
+               expected = (short) (sum + ((sum >= 0) ? 0.5 : -0.5));
+               if (out[(i * (NY / 2) + j) * (NX / 3) + k] != expected) {
+                  if (errors < 10)
+                     fprintf(stderr, "Down-sampled value %ld,%ld,%ld is %d, "
+                             "expected %d\n", i, j, k,
+                             out[(i * (NY / 2) + j) * (NX / 3) + k], expected);
+                  errors++;
+               }
+            }
+         }
+      }
+   }
+
+   miclose(cdfid);
+   unlink(filename);
+
+   return (errors != 0);
+}
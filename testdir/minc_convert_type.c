@@ -0,0 +1,170 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : minc_convert_type
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of mismatches (0 on success)
+@DESCRIPTION: Cross-checks MI_convert_type against a per-value reference
+              conversion through MI_TO_DOUBLE/MI_FROM_DOUBLE for every
+              pair of types and signs, with and without scaling and
+              fillvalue checking.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#include "minc_private.h"
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include "type_limits.h"
+
+#define NVALUES 1000
+
+static struct {
+   nc_type type;
+   int sign;
+   char *name;
+} types[]= { { NC_BYTE,   MI_PRIV_UNSIGNED, "unsigned byte" },
+             { NC_BYTE,   MI_PRIV_SIGNED,   "signed byte" },
+             { NC_SHORT,  MI_PRIV_UNSIGNED, "unsigned short" },
+             { NC_SHORT,  MI_PRIV_SIGNED,   "signed short" },
+             { NC_INT,    MI_PRIV_UNSIGNED, "unsigned int" },
+             { NC_INT,    MI_PRIV_SIGNED,   "signed int" },
+             { NC_FLOAT,  MI_PRIV_SIGNED,   "float" },
+             { NC_DOUBLE, MI_PRIV_SIGNED,   "double" } };
+static const int ntypes = sizeof(types)/sizeof(types[0]);
+
+/* Reference implementation: the per-value conversion that MI_convert_type
+   used before the typed kernels */
+static void reference_convert(long nvalues,
+                              nc_type intype, int insgn, void *invalues,
+                              nc_type outtype, int outsgn, void *outvalues,
+                              mi_icv_type *icvp)
+{
+   int inincr = nctypelen(intype);
+   int outincr = nctypelen(outtype);
+   double dvalue = 0.0;
+   double dmax, dmin, epsilon;
+   void *inptr = invalues;
+   void *outptr = outvalues;
+   long i;
+
+   dmax = icvp->fill_valid_max;
+   dmin = icvp->fill_valid_min;
+   epsilon = fabs((dmax - dmin) * FILLVALUE_EPSILON);
+   dmax += epsilon;
+   dmin -= epsilon;
+
+   for (i = 0; i < nvalues; i++) {
+      {MI_TO_DOUBLE(dvalue, intype, insgn, inptr)}
+      if (icvp->do_fillvalue && ((dvalue < dmin) || (dvalue > dmax))) {
+         dvalue = icvp->user_fillvalue;
+      }
+      else if (icvp->do_scale) {
+         dvalue = icvp->scale * dvalue + icvp->offset;
+      }
+      {MI_FROM_DOUBLE(dvalue, outtype, outsgn, outptr)}
+      inptr  = (void *) ((char *)inptr  + inincr);
+      outptr = (void *) ((char *)outptr + outincr);
+   }
+}
+
+/* Fill a buffer with values spanning (and exceeding) the range of the
+   given type */
+static void fill_input(nc_type type, int sign, void *buffer)
+{
+   double vmin, vmax, dvalue;
+   void *ptr = buffer;
+   int incr = nctypelen(type);
+   long i;
+
+   switch (type) {
+   case NC_BYTE:
+      vmin = (sign == MI_PRIV_UNSIGNED) ? 0 : SCHAR_MIN;
+      vmax = (sign == MI_PRIV_UNSIGNED) ? UCHAR_MAX : SCHAR_MAX;
+      break;
+   case NC_SHORT:
+      vmin = (sign == MI_PRIV_UNSIGNED) ? 0 : SHRT_MIN;
+      vmax = (sign == MI_PRIV_UNSIGNED) ? USHRT_MAX : SHRT_MAX;
+      break;
+   case NC_INT:
+      vmin = (sign == MI_PRIV_UNSIGNED) ? 0 : INT_MIN;
+      vmax = (sign == MI_PRIV_UNSIGNED) ? UINT_MAX : INT_MAX;
+      break;
+   default:
+      vmin = -1.0e10;
+      vmax = 1.0e10;
+      break;
+   }
+
+   for (i = 0; i < NVALUES; i++) {
+      /* Mix a ramp over the full range with small values around zero
+         so that rounding of halves is exercised as well as clamping */
+      if (i % 2 == 0)
+         dvalue = vmin + (vmax - vmin) * (double) i / (NVALUES - 1);
+      else
+         dvalue = (i - NVALUES / 2) * 0.25;
+      {MI_FROM_DOUBLE(dvalue, type, sign, ptr)}
+      ptr = (void *) ((char *) ptr + incr);
+   }
+}
+
+int main(void)
+{
+   static double inbuf[NVALUES];
+   static double outbuf[NVALUES];
+   static double refbuf[NVALUES];
+   mi_icv_type icv;
+   int in, out, mode;
+   int errors = 0;
+
+   memset(&icv, 0, sizeof(icv));
+
+   for (in = 0; in < ntypes; in++) {
+      fill_input(types[in].type, types[in].sign, inbuf);
+
+      for (out = 0; out < ntypes; out++) {
+         for (mode = 0; mode < 4; mode++) {
+            icv.do_scale = (mode & 1);
+            icv.scale = 0.37;
+            icv.offset = -12.5;
+            icv.do_fillvalue = (mode & 2) != 0;
+            icv.user_fillvalue = -3.0;
+            icv.fill_valid_min = -100.0;
+            icv.fill_valid_max = 30000.0;
+
+            memset(outbuf, 0x5a, sizeof(outbuf));
+            memset(refbuf, 0x5a, sizeof(refbuf));
+
+            reference_convert(NVALUES,
+                              types[in].type, types[in].sign, inbuf,
+                              types[out].type, types[out].sign, refbuf,
+                              &icv);
+
+            if (MI_convert_type(NVALUES,
+                                types[in].type, types[in].sign, inbuf,
+                                types[out].type, types[out].sign, outbuf,
+                                &icv) == MI_ERROR) {
+               fprintf(stderr, "MI_convert_type failed for %s -> %s\n",
+                       types[in].name, types[out].name);
+               errors++;
+               continue;
+            }
+
+            if (memcmp(outbuf, refbuf,
+                       NVALUES * nctypelen(types[out].type)) != 0) {
+               fprintf(stderr, "Mismatch for %s -> %s (scale=%d, fill=%d)\n",
+                       types[in].name, types[out].name,
+                       icv.do_scale, icv.do_fillvalue);
+               errors++;
+            }
+         }
+      }
+   }
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors;
+}
@@ -0,0 +1,188 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : minc_format_convert_test
+@INPUT      : argc, argv - optional z, y and x lengths of the test volume
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Converts a MINC 1 volume to MINC 2 both with the generic
+              variable copy and with minc_format_convert, checks that the
+              image and image-min/max read back from both are those of
+              the input, and reports the throughput of each.
+@METHOD     : Compression and chunking come from MINC_COMPRESS and
+              MINC_CHUNKING, so set those to benchmark compressed output.
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <minc.h>
+
+static double now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* The conversion as done before the streaming image copy */
+static int generic_convert(const char *input, const char *output)
+{
+   int old_fd, new_fd;
+   struct mi2opts opts;
+
+   memset(&opts, 0, sizeof(opts));
+   opts.struct_version = MI2_OPTS_V1;
+   opts.comp_type = MI2_COMP_UNKNOWN;
+   opts.chunk_type = MI2_CHUNK_UNKNOWN;
+
+   if ((old_fd = miopen(input, NC_NOWRITE)) < 0 ||
+       (new_fd = micreatex(output, NC_CLOBBER | MI2_CREATE_V2, &opts)) < 0) {
+      return MI_ERROR;
+   }
+   micopy_all_var_defs(old_fd, new_fd, 0, NULL);
+   ncendef(new_fd);
+   micopy_all_var_values(old_fd, new_fd, 0, NULL);
+   miclose(old_fd);
+   miclose(new_fd);
+   return MI_NOERROR;
+}
+
+/* Read back a converted file and compare it with the input values */
+static int check_output(const char *name, const char *filename,
+                        const short *voxels, const double *slice_range,
+                        long count[3])
+{
+   short *values;
+   double range[2];
+   long coord[3] = {0, 0, 0};
+   long i;
+   int fd;
+   int errors = 0;
+
+   values = malloc(count[0] * count[1] * count[2] * sizeof(short));
+   if ((fd = miopen(filename, NC_NOWRITE)) < 0 ||
+       ncvarget(fd, ncvarid(fd, MIimage), coord, count, values) < 0) {
+      fprintf(stderr, "%s: cannot read %s\n", name, filename);
+      free(values);
+      return 1;
+   }
+   if (memcmp(values, voxels, count[0] * count[1] * count[2] *
+              sizeof(short)) != 0) {
+      fprintf(stderr, "%s: image differs from input\n", name);
+      errors++;
+   }
+   for (i = 0; i < count[0]; i++) {
+      mivarget1(fd, ncvarid(fd, MIimagemin), &i, NC_DOUBLE, MI_SIGNED,
+                &range[0]);
+      mivarget1(fd, ncvarid(fd, MIimagemax), &i, NC_DOUBLE, MI_SIGNED,
+                &range[1]);
+      if (range[0] != slice_range[2 * i] || range[1] != slice_range[2 * i + 1]) {
+         fprintf(stderr, "%s: wrong range for slice %ld\n", name, i);
+         errors++;
+      }
+   }
+   miclose(fd);
+   free(values);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   char input[256], output[256];
+   long count[3] = {40, 101, 67};
+   long coord[3] = {0, 0, 0};
+   int dim[3];
+   short *voxels;
+   double *slice_range;
+   double t0, t_generic, t_convert;
+   double mbytes;
+   struct stat st;
+   long i, n;
+   int fd, img, imgmin, imgmax;
+   int errors = 0;
+
+   if (argc == 4) {
+      for (i = 0; i < 3; i++) {
+         count[i] = atol(argv[i + 1]);
+      }
+   }
+   n = count[0] * count[1] * count[2];
+
+   voxels = malloc(n * sizeof(short));
+   slice_range = malloc(2 * count[0] * sizeof(double));
+   for (i = 0; i < n; i++) {
+      /* Smooth enough to compress, with some noise */
+      voxels[i] = (short) ((i % count[2]) * 13 + (i / count[2]) % 200 +
+                           (i * 2654435761UL >> 28) % 7);
+   }
+   for (i = 0; i < count[0]; i++) {
+      slice_range[2 * i] = -1.0 - i;
+      slice_range[2 * i + 1] = 100.0 + i;
+   }
+
+   snprintf(input, sizeof(input), "test_format_convert-%d.mnc", getpid());
+   fd = micreate(input, NC_CLOBBER);
+   dim[0] = ncdimdef(fd, MIzspace, count[0]);
+   dim[1] = ncdimdef(fd, MIyspace, count[1]);
+   dim[2] = ncdimdef(fd, MIxspace, count[2]);
+   img = micreate_std_variable(fd, MIimage, NC_SHORT, 3, dim);
+   miattputstr(fd, img, MIsigntype, MI_SIGNED);
+   imgmin = micreate_std_variable(fd, MIimagemin, NC_DOUBLE, 1, dim);
+   imgmax = micreate_std_variable(fd, MIimagemax, NC_DOUBLE, 1, dim);
+   ncendef(fd);
+   ncvarput(fd, img, coord, count, voxels);
+   for (i = 0; i < count[0]; i++) {
+      mivarput1(fd, imgmin, &i, NC_DOUBLE, MI_SIGNED, &slice_range[2 * i]);
+      mivarput1(fd, imgmax, &i, NC_DOUBLE, MI_SIGNED, &slice_range[2 * i + 1]);
+   }
+   miclose(fd);
+
+   snprintf(output, sizeof(output), "test_format_convert-%d-2.mnc", getpid());
+   mbytes = n * sizeof(short) / (1024.0 * 1024.0);
+
+   t0 = now();
+   if (generic_convert(input, output) == MI_ERROR) {
+      fprintf(stderr, "Generic conversion failed\n");
+      errors++;
+   }
+   t_generic = now() - t0;
+   errors += check_output("generic", output, voxels, slice_range, count);
+
+   t0 = now();
+   if (minc_format_convert(input, output) == MI_ERROR) {
+      fprintf(stderr, "minc_format_convert failed\n");
+      errors++;
+   }
+   t_convert = now() - t0;
+   errors += check_output("minc_format_convert", output, voxels,
+                          slice_range, count);
+
+   if (stat(output, &st) == 0) {
+      printf("Output is %ld bytes for %ld bytes of image\n",
+             (long) st.st_size, n * (long) sizeof(short));
+   }
+   printf("generic copy:        %8.1f MB/s\n",
+          (t_generic > 0) ? mbytes / t_generic : 0.0);
+   printf("minc_format_convert: %8.1f MB/s\n",
+          (t_convert > 0) ? mbytes / t_convert : 0.0);
+
+   unlink(input);
+   unlink(output);
+   free(voxels);
+   free(slice_range);
+   return (errors != 0);
+}
@@ -0,0 +1,234 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : minc_simple_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Writes a volume through the simplified interface, checks the
+              per-slice image-min and image-max and the data read back,
+              and compares minc_histogram, and the histogram returned by
+              minc_save_data_histogram, with counts computed directly.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <minc.h>
+#include <minc_simple.h>
+
+#define NZ 8
+#define NY 256
+#define NX 256
+#define NVOXELS (NZ * NY * NX)
+#define NBINS 37
+
+static short voxels[NZ][NY][NX];
+static float volume[NZ][NY][NX];
+static float values[NZ][NY][NX];
+static float fvoxels[NVOXELS];
+
+/* Histogram of n doubles computed one value at a time */
+static void reference_histogram(const double *data, long n, int nbins,
+                                long *counts, double *min, double *max)
+{
+   long i;
+   int bin;
+
+   *min = DBL_MAX;
+   *max = -DBL_MAX;
+   for (i = 0; i < n; i++) {
+      if (data[i] < *min) *min = data[i];
+      if (data[i] > *max) *max = data[i];
+   }
+   memset(counts, 0, nbins * sizeof(long));
+   for (i = 0; i < n; i++) {
+      bin = (*max > *min) ?
+         (int) ((data[i] - *min) * (nbins / (*max - *min))) : 0;
+      counts[(bin >= nbins) ? nbins - 1 : bin]++;
+   }
+}
+
+static int check_histogram(const char *name, void *data, int datatype,
+                           const double *ddata, long n)
+{
+   long counts[NBINS], expected[NBINS];
+   double min, max, emin, emax;
+   int i;
+   int errors = 0;
+
+   reference_histogram(ddata, n, NBINS, expected, &emin, &emax);
+   if (minc_histogram(data, datatype, n, NBINS, counts,
+                      &min, &max) != MINC_STATUS_OK) {
+      fprintf(stderr, "minc_histogram failed for %s\n", name);
+      return 1;
+   }
+   if (min != emin || max != emax) {
+      fprintf(stderr, "%s range is %g..%g, expected %g..%g\n",
+              name, min, max, emin, emax);
+      errors++;
+   }
+   for (i = 0; i < NBINS; i++) {
+      if (counts[i] != expected[i]) {
+         fprintf(stderr, "%s bin %d has %ld, expected %ld\n",
+                 name, i, counts[i], expected[i]);
+         errors++;
+      }
+   }
+   return errors;
+}
+
+/* Writes a volume with minc_save_data_histogram and compares the histogram
+   it returns with counts computed directly */
+static int check_saved_histogram(const char *name, void *data, int datatype,
+                                 const double *ddata)
+{
+   char filename[256];
+   long counts[NBINS], expected[NBINS];
+   double min, max, emin, emax;
+   int fd, i;
+   int errors = 0;
+
+   snprintf(filename, sizeof(filename), "test_minc_simple_hist-%d.mnc",
+            getpid());
+   fd = minc_save_start(filename, MINC_TYPE_SHORT, 0, NZ, NY, NX,
+                        0.0, 1.0, 1.0, 1.0, NULL, "minc_simple_test\n");
+   if (fd < 0 ||
+       minc_save_data_histogram(fd, data, datatype, 0, 0, 0, 0,
+                                0, NZ, NY, NX, NBINS, counts,
+                                &min, &max) != MINC_STATUS_OK) {
+      fprintf(stderr, "Failed to write %s for %s\n", filename, name);
+      return 1;
+   }
+   minc_save_done(fd);
+   unlink(filename);
+
+   reference_histogram(ddata, NVOXELS, NBINS, expected, &emin, &emax);
+   if (min != emin || max != emax) {
+      fprintf(stderr, "saved %s range is %g..%g, expected %g..%g\n",
+              name, min, max, emin, emax);
+      errors++;
+   }
+   for (i = 0; i < NBINS; i++) {
+      if (counts[i] != expected[i]) {
+         fprintf(stderr, "saved %s bin %d has %ld, expected %ld\n",
+                 name, i, counts[i], expected[i]);
+         errors++;
+      }
+   }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   char filename[256];
+   double *ddata;
+   double image_min[NZ], image_max[NZ];
+   double smin, smax;
+   long ct, cz, cy, cx;
+   double dt, dz, dy, dx;
+   long start, count;
+   void *info;
+   long i, j, k;
+   int fd;
+   int errors = 0;
+
+   for (i = 0; i < NZ; i++)
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NX; k++)
+            voxels[i][j][k] =
+               (short) ((i * 977 + j * 31 + k * 7) % (1001 + 500 * i) - 900);
+   for (i = 0; i < NZ; i++)
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NX; k++)
+            volume[i][j][k] = voxels[i][j][k] * 0.25f;
+
+   snprintf(filename, sizeof(filename), "test_minc_simple-%d.mnc", getpid());
+   fd = minc_save_start(filename, MINC_TYPE_SHORT, 0, NZ, NY, NX,
+                        0.0, 1.0, 1.0, 1.0, NULL, "minc_simple_test\n");
+   if (fd < 0 ||
+       minc_save_data(fd, volume, MINC_TYPE_FLOAT, 0, 0, 0, 0,
+                      0, NZ, NY, NX) != MINC_STATUS_OK) {
+      fprintf(stderr, "Failed to write %s\n", filename);
+      return 1;
+   }
+
+   start = 0;
+   count = NZ;
+   mivarget(fd, ncvarid(fd, MIimagemin), &start, &count, NC_DOUBLE,
+            MI_SIGNED, image_min);
+   mivarget(fd, ncvarid(fd, MIimagemax), &start, &count, NC_DOUBLE,
+            MI_SIGNED, image_max);
+   for (i = 0; i < NZ; i++) {
+      smin = DBL_MAX;
+      smax = -DBL_MAX;
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NX; k++) {
+            if (volume[i][j][k] < smin) smin = volume[i][j][k];
+            if (volume[i][j][k] > smax) smax = volume[i][j][k];
+         }
+      if (image_min[i] != smin || image_max[i] != smax) {
+         fprintf(stderr, "Slice %ld range is %g..%g, expected %g..%g\n",
+                 i, image_min[i], image_max[i], smin, smax);
+         errors++;
+      }
+   }
+   minc_save_done(fd);
+
+   if (minc_load_data(filename, values, MINC_TYPE_FLOAT, &ct, &cz, &cy, &cx,
+                      &dt, &dz, &dy, &dx, &info) != MINC_STATUS_OK) {
+      fprintf(stderr, "Failed to read %s\n", filename);
+      errors++;
+   }
+   else {
+      for (i = 0; i < NZ; i++)
+         for (j = 0; j < NY; j++)
+            for (k = 0; k < NX; k++)
+               if (fabs(values[i][j][k] - volume[i][j][k]) > 0.01) {
+                  if (errors < 10)
+                     fprintf(stderr, "Value %ld,%ld,%ld is %g, expected %g\n",
+                             i, j, k, values[i][j][k], volume[i][j][k]);
+                  errors++;
+               }
+      minc_free_info(info);
+   }
+   unlink(filename);
+
+   ddata = malloc(NVOXELS * sizeof(double));
+   for (i = 0; i < NVOXELS; i++) {
+      ddata[i] = (&voxels[0][0][0])[i];
+   }
+   /* Exact counting for the whole volume, binning for a short run */
+   errors += check_histogram("short", voxels, MINC_TYPE_SHORT, ddata,
+                             NVOXELS);
+   errors += check_histogram("short run", voxels, MINC_TYPE_SHORT, ddata,
+                             1000);
+   errors += check_saved_histogram("short", voxels, MINC_TYPE_SHORT, ddata);
+
+   for (i = 0; i < NVOXELS; i++) {
+      fvoxels[i] = (float) (((i * 7919) % 100003) * 0.37 - 5000.0);
+      ddata[i] = fvoxels[i];
+   }
+   errors += check_histogram("float", fvoxels, MINC_TYPE_FLOAT, ddata,
+                             NVOXELS);
+   errors += check_saved_histogram("float", fvoxels, MINC_TYPE_FLOAT, ddata);
+   free(ddata);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return (errors != 0);
+}
@@ -0,0 +1,142 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : nd_tile_loop
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Checks that the tile loop visits every value of a region
+              exactly once, and that nd_copy_tile moves the values of
+              each tile between an array and a packed buffer.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <minc.h>
+#include <nd_loop.h>
+
+#define NDIMS 4
+
+static const long size[NDIMS] = {5, 7, 11, 13};
+#define NVALUES (5 * 7 * 11 * 13)
+
+static long offset_of(const long index[])
+{
+   long offset = 0;
+   int idim;
+
+   for (idim = 0; idim < NDIMS; idim++) {
+      offset = offset * size[idim] + index[idim];
+   }
+   return offset;
+}
+
+static int check_region(const long start[], const long count[],
+                        const long tile[])
+{
+   static int array[NVALUES];
+   static int copy[NVALUES];
+   static int visits[NVALUES];
+   static int buffer[NVALUES];
+   nd_tile_loop loop;
+   long index[NDIMS];
+   long i, offset;
+   int idim;
+   int errors = 0;
+
+   for (i = 0; i < NVALUES; i++) {
+      array[i] = (int) i;
+      copy[i] = -1;
+      visits[i] = 0;
+   }
+
+   nd_begin_tile_loop(&loop, NDIMS, start, count, size, tile);
+   while (nd_next_tile(&loop)) {
+      if (loop.nruns * loop.run_length != loop.nvalues) {
+         fprintf(stderr, "Runs do not cover the tile\n");
+         errors++;
+      }
+      nd_copy_tile(&loop, sizeof(int), array, buffer, TRUE);
+
+      /* The packed buffer holds the tile in array order */
+      for (i = 0; i < loop.nvalues; i++) {
+         offset = i;
+         for (idim = NDIMS - 1; idim >= 0; idim--) {
+            index[idim] = loop.current[idim] + offset % loop.count[idim];
+            offset /= loop.count[idim];
+         }
+         if (buffer[i] != array[offset_of(index)]) {
+            errors++;
+         }
+         visits[offset_of(index)]++;
+      }
+      nd_copy_tile(&loop, sizeof(int), copy, buffer, FALSE);
+   }
+
+   for (i = 0; i < NVALUES; i++) {
+      offset = i;
+      for (idim = NDIMS - 1; idim >= 0; idim--) {
+         index[idim] = offset % size[idim];
+         offset /= size[idim];
+      }
+      for (idim = 0; idim < NDIMS; idim++) {
+         if (index[idim] < start[idim] ||
+             index[idim] >= start[idim] + count[idim]) break;
+      }
+      if (idim < NDIMS) {
+         if (visits[i] != 0 || copy[i] != -1) errors++;
+      }
+      else if (visits[i] != 1 || copy[i] != array[i]) {
+         errors++;
+      }
+   }
+   if (errors) {
+      fprintf(stderr, "Errors for tile %ld,%ld,%ld,%ld\n",
+              tile[0], tile[1], tile[2], tile[3]);
+   }
+   return errors;
+}
+
+int main(void)
+{
+   long full_start[NDIMS] = {0, 0, 0, 0};
+   long start[NDIMS] = {1, 2, 3, 4};
+   long count[NDIMS] = {3, 4, 5, 6};
+   long tiles[][NDIMS] = { {1, 1, 1, 1}, {2, 3, 4, 5}, {1, 1, 11, 13},
+                           {1, 7, 11, 13}, {5, 7, 11, 13}, {2, 2, 11, 2} };
+   long tile[NDIMS];
+   long step[NDIMS] = {1, 1, 4, 1};
+   int i;
+   int errors = 0;
+
+   for (i = 0; i < (int) (sizeof(tiles) / sizeof(tiles[0])); i++) {
+      errors += check_region(start, count, tiles[i]);
+      errors += check_region(full_start, size, tiles[i]);
+   }
+
+   /* Whole fastest dimensions first, then part of the next one */
+   nd_tile_shape(NDIMS, size, sizeof(int), 13 * 11 * 3 * sizeof(int),
+                 NULL, tile);
+   if (tile[0] != 1 || tile[1] != 3 || tile[2] != 11 || tile[3] != 13) {
+      fprintf(stderr, "Wrong tile shape %ld,%ld,%ld,%ld\n",
+              tile[0], tile[1], tile[2], tile[3]);
+      errors++;
+   }
+   errors += check_region(full_start, size, tile);
+
+   nd_tile_shape(NDIMS, size, sizeof(int), 13 * 7 * sizeof(int),
+                 step, tile);
+   if (tile[0] != 1 || tile[1] != 1 || tile[2] != 4 || tile[3] != 13) {
+      fprintf(stderr, "Wrong stepped tile shape %ld,%ld,%ld,%ld\n",
+              tile[0], tile[1], tile[2], tile[3]);
+      errors++;
+   }
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return (errors != 0);
+}
@@ -0,0 +1,232 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : resample_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Resamples a volume onto the grid of another volume with
+              resample_volume(), through no transform, a concatenation of
+              linear transforms, a grid transform and a thin plate spline
+              whose inverse fails for some voxels, into integer targets,
+              clamped or not, cached or not, and into float targets, and
+              checks the target voxels against values computed one voxel
+              at a time with evaluate_volume().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+static VIO_STR xyz_names[] = { MIxspace, MIyspace, MIzspace };
+
+/* A displacement field over the source, as a 4D grid transform */
+static const test_grid grid_spec = {
+   NC_FLOAT, FALSE, { 9, 10, 11 }, { -24.0, -27.0, -35.0 }, { 6.0, 6.0, 7.0 },
+   1.5, { 0.7, 0.4, 0.4, 0.3 }, 0.0, FALSE };
+
+static VIO_Volume make_source(void)
+{
+   int sizes[VIO_MAX_DIMENSIONS] = { 31, 27, 22, 0, 0 };
+   VIO_Real starts[VIO_MAX_DIMENSIONS] = { -30.25, -24.5, -19.75, 0.0, 0.0 };
+   VIO_Real steps[VIO_MAX_DIMENSIONS] = { 2.0, 1.75, 1.8, 0.0, 0.0 };
+   VIO_Volume volume;
+   int i, j, k;
+
+   volume = create_volume(3, xyz_names, NC_FLOAT, FALSE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   set_volume_starts(volume, starts);
+   set_volume_separations(volume, steps);
+   alloc_volume_data(volume);
+
+   for (i = 0; i < sizes[0]; i++)
+      for (j = 0; j < sizes[1]; j++)
+         for (k = 0; k < sizes[2]; k++)
+            set_volume_real_value(volume, i, j, k, 0, 0,
+                                  (VIO_Real) ((i * 7919 + j * 104729 +
+                                               k * 1299709) % 1000));
+   return volume;
+}
+
+static VIO_Volume make_target(nc_type type)
+{
+   static VIO_STR zyx_names[] = { MIzspace, MIyspace, MIxspace };
+   int sizes[VIO_MAX_DIMENSIONS] = { 19, 35, 41, 0, 0 };
+   VIO_Real starts[VIO_MAX_DIMENSIONS] = { -24.1, -27.3, 33.3, 0.0, 0.0 };
+   VIO_Real steps[VIO_MAX_DIMENSIONS] = { 2.3, 1.4, -1.7, 0.0, 0.0 };
+   VIO_Volume volume;
+
+   volume = create_volume(3, zyx_names, type, TRUE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   set_volume_starts(volume, starts);
+   set_volume_separations(volume, steps);
+   alloc_volume_data(volume);
+   if (type != NC_FLOAT) {
+      set_volume_voxel_range(volume, -32000.0, 32000.0);
+      set_volume_real_range(volume, -100.0, 1100.0);
+   }
+   return volume;
+}
+
+/* Compares the target with a serial evaluation of each of its voxels.  The
+   linear mapping is stepped along rows, so points can move by rounding
+   errors, hence the tolerance for all but nearest neighbour.  If the
+   inverse of the transform fails somewhere, resample_volume() must fail
+   but still write every voxel. */
+static int check_target(VIO_Volume source, VIO_General_transform *transform,
+                        VIO_Volume target, int degrees, VIO_Real tolerance,
+                        VIO_BOOL fails, const char *what)
+{
+   int sizes[VIO_MAX_DIMENSIONS];
+   VIO_Real voxel[VIO_MAX_DIMENSIONS] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+   VIO_Real source_voxel[VIO_MAX_DIMENSIONS];
+   VIO_Real x, y, z, value, expected, voxel_min, voxel_max;
+   int i, j, k;
+   int errors = 0;
+
+   if (resample_volume(source, transform, target, degrees, -50.0) !=
+       (fails ? VIO_ERROR : VIO_OK)) {
+      fprintf(stderr, "%s: resample_volume %s\n", what,
+              fails ? "did not fail" : "failed");
+      return 1;
+   }
+
+   get_volume_sizes(target, sizes);
+   get_volume_voxel_range(target, &voxel_min, &voxel_max);
+
+   for (i = 0; i < sizes[0]; i++)
+      for (j = 0; j < sizes[1]; j++)
+         for (k = 0; k < sizes[2]; k++) {
+            voxel[0] = i;
+            voxel[1] = j;
+            voxel[2] = k;
+            convert_voxel_to_world(target, voxel, &x, &y, &z);
+            if (transform != NULL)
+               general_inverse_transform_point(transform, x, y, z,
+                                               &x, &y, &z);
+            convert_world_to_voxel(source, x, y, z, source_voxel);
+            evaluate_volume(source, source_voxel, NULL, degrees, FALSE,
+                            -50.0, &expected, NULL, NULL);
+
+            /* what the target can hold */
+            expected = convert_value_to_voxel(target, expected);
+            if (get_volume_data_type(target) != VIO_FLOAT) {
+               if (expected < voxel_min)
+                  expected = voxel_min;
+               else if (expected > voxel_max)
+                  expected = voxel_max;
+               expected = (VIO_Real) VIO_ROUND(expected);
+            }
+            else
+               expected = (float) expected;
+            expected = convert_voxel_to_value(target, expected);
+
+            value = get_volume_real_value(target, i, j, k, 0, 0);
+            if (fabs(value - expected) > tolerance) {
+               if (errors < 10)
+                  fprintf(stderr, "%s: voxel %d %d %d is %g, expected %g\n",
+                          what, i, j, k, value, expected);
+               errors++;
+            }
+         }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_Volume source, target;
+   VIO_Transform rotation, shift;
+   VIO_General_transform first, second, linear, grid, folded;
+   VIO_Real quantum = 1200.0 / 64000.0;
+   int threshold;
+   int errors = 0;
+
+   source = make_source();
+
+   make_identity_transform(&rotation);
+   Transform_elem(rotation, 0, 0) = cos(0.2);
+   Transform_elem(rotation, 0, 1) = -sin(0.2);
+   Transform_elem(rotation, 1, 0) = sin(0.2);
+   Transform_elem(rotation, 1, 1) = cos(0.2);
+   make_identity_transform(&shift);
+   Transform_elem(shift, 0, 3) = 1.3;
+   Transform_elem(shift, 2, 3) = -2.1;
+   create_linear_transform(&first, &rotation);
+   create_linear_transform(&second, &shift);
+   concat_general_transforms(&first, &second, &linear);
+
+   make_test_grid_transform(&grid, &grid_spec);
+
+   target = make_target(NC_SHORT);
+   errors += check_target(source, NULL, target, 0, 1e-3 + quantum, FALSE,
+                          "no transform");
+   errors += check_target(source, &linear, target, 0, 1e-3 + quantum, FALSE,
+                          "linear");
+   errors += check_target(source, &linear, target, 2, 1e-3 + quantum, FALSE,
+                          "linear cubic");
+   errors += check_target(source, &grid, target, 0, 1e-9, FALSE, "grid");
+   errors += check_target(source, &grid, target, -1, 1e-9, FALSE,
+                          "grid nearest neighbour");
+   delete_volume(target);
+
+   target = make_target(NC_FLOAT);
+   errors += check_target(source, &linear, target, -1, 0.0, FALSE,
+                          "float nearest neighbour");
+   errors += check_target(source, &linear, target, 0, 1e-3, FALSE,
+                          "float linear");
+   if (set_volume_bspline_interpolation(source, VIO_DOUBLE) != VIO_OK) {
+      fprintf(stderr, "set_volume_bspline_interpolation failed\n");
+      errors++;
+   }
+   errors += check_target(source, &grid, target, 2, 1e-9, FALSE,
+                          "float B-spline");
+   delete_volume(target);
+
+   /* a range narrower than the source values, so that voxels are clamped,
+      into a target in memory and into one held in a cache */
+   target = make_target(NC_SHORT);
+   set_volume_real_range(target, -100.0, 500.0);
+   errors += check_target(source, &grid, target, 0, 1e-9, FALSE, "clamped");
+   delete_volume(target);
+
+   threshold = get_n_bytes_cache_threshold();
+   set_n_bytes_cache_threshold(0);
+   target = make_target(NC_SHORT);
+   set_n_bytes_cache_threshold(threshold);
+   set_volume_real_range(target, -100.0, 500.0);
+   if (!volume_is_cached(target)) {
+      fprintf(stderr, "cached clamped: target was not cached\n");
+      errors++;
+   }
+   errors += check_target(source, &grid, target, 0, 1e-9, FALSE,
+                          "cached clamped");
+   delete_volume(target);
+
+   /* a spline folding over some of the target, where its inverse fails */
+   make_test_thin_plate_transform(&folded, 6, 1.0, 0.0);
+   target = make_target(NC_FLOAT);
+   errors += check_target(source, &folded, target, 0, 1e-9, TRUE, "folded");
+   delete_volume(target);
+   delete_general_transform(&folded);
+
+   delete_general_transform(&grid);
+   delete_general_transform(&linear);
+   delete_general_transform(&second);
+   delete_general_transform(&first);
+   delete_volume(source);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,373 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : scanline_inverse_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Counts the iterations of newton_root_find_with_iterations() on
+              a linear function, and inverts rows of points by a thin plate
+              spline, a grid transform and a concatenation of both with a
+              linear transform, with general_inverse_transform_scanline().
+              Checks that without warm starts the results are those of
+              general_inverse_transform_points(), that with them the
+              inverses are as good and take far fewer iterations, and that
+              points out of order, which defeat the warm starts, are still
+              inverted.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_LANDMARKS 200
+#define N_ROWS 6
+#define ROW_LENGTH 80
+#define N_POINTS (N_ROWS * ROW_LENGTH)
+
+/* the tolerance of the thin plate spline inverse, whose search also stops
+   when its steps get below 0.01, leaving errors a little over 0.01, and
+   that of the grid inverse, a 80th of the grid step */
+#define TPS_TOLERANCE 0.02
+#define GRID_STEP 4.0
+#define GRID_TOLERANCE (GRID_STEP / 80.0)
+
+static const test_grid grid_spec = {
+   NC_DOUBLE, TRUE, { 30, 30, 30 }, { -60.0, -60.0, -60.0 },
+   { GRID_STEP, GRID_STEP, GRID_STEP }, 2.0, { 0.2, 0.5, 0.15, 0.1 }, 0.0,
+   FALSE };
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real expected[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real cold[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real warm[N_POINTS][VIO_N_DIMENSIONS];
+
+static VIO_Real random_real(VIO_Real low, VIO_Real high)
+{
+   return low + (high - low) * rand() / (VIO_Real) RAND_MAX;
+}
+
+static void linear_function(void *data, VIO_Real position[],
+                            VIO_Real values[], VIO_Real **derivatives)
+{
+   values[0] = 2.0 * position[0] + position[1] + 1.0;
+   values[1] = position[0] - 3.0 * position[1];
+   derivatives[0][0] = 2.0;
+   derivatives[0][1] = 1.0;
+   derivatives[1][0] = 1.0;
+   derivatives[1][1] = -3.0;
+}
+
+/* One step solves a linear function, and the second evaluation finds it
+   solved */
+static int check_newton(void)
+{
+   VIO_Real guess[2] = { 10.0, -7.0 };
+   VIO_Real desired[2] = { 7.0, -11.0 };
+   VIO_Real solution[2], plain_solution[2];
+   int n_iterations;
+   VIO_BOOL found, plain_found;
+
+   found = newton_root_find_with_iterations(2, linear_function, NULL, guess,
+                                            desired, solution, 1e-10, 1e-12,
+                                            20, &n_iterations);
+   plain_found = newton_root_find(2, linear_function, NULL, guess, desired,
+                                  plain_solution, 1e-10, 1e-12, 20);
+
+   if (!found || !plain_found || n_iterations != 2 ||
+       fabs(solution[0] - 1.0) > 1e-12 || fabs(solution[1] - 4.0) > 1e-12 ||
+       solution[0] != plain_solution[0] || solution[1] != plain_solution[1]) {
+      fprintf(stderr, "newton: %s after %d iterations at %g %g\n",
+              found ? "found" : "not found", n_iterations, solution[0],
+              solution[1]);
+      return 1;
+   }
+   return 0;
+}
+
+static void make_spline(VIO_General_transform *transform)
+{
+   VIO_Real **landmarks, **weights;
+   int p, d, v;
+
+   VIO_ALLOC2D(landmarks, N_LANDMARKS, 3);
+   VIO_ALLOC2D(weights, N_LANDMARKS + 4, 3);
+
+   for (p = 0; p < N_LANDMARKS; p++) {
+      for (d = 0; d < 3; d++) {
+         landmarks[p][d] = random_real(-60.0, 60.0);
+         weights[p][d] = random_real(-5e-3, 5e-3);
+      }
+   }
+   for (v = 0; v < 3; v++) {
+      weights[N_LANDMARKS][v] = random_real(-2.0, 2.0);
+      for (d = 0; d < 3; d++)
+         weights[N_LANDMARKS + 1 + d][v] = (d == v) ? 1.05 : 0.02 * (d - v);
+   }
+
+   create_thin_plate_transform_real(transform, 3, N_LANDMARKS, landmarks,
+                                    weights);
+   VIO_FREE2D(weights);
+   VIO_FREE2D(landmarks);
+}
+
+/* Rows along x, as the voxels of a resampled volume, or in random order */
+static void make_points(VIO_BOOL shuffled)
+{
+   VIO_Real tmp;
+   int r, i, p, q, d;
+
+   for (r = 0; r < N_ROWS; r++) {
+      for (i = 0; i < ROW_LENGTH; i++) {
+         p = r * ROW_LENGTH + i;
+         points[p][VIO_X] = -40.0 + i;
+         points[p][VIO_Y] = -30.0 + 11.0 * r;
+         points[p][VIO_Z] = 25.0 - 7.0 * r;
+      }
+   }
+
+   if (shuffled) {
+      for (p = N_POINTS - 1; p > 0; p--) {
+         q = rand() % (p + 1);
+         for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+            tmp = points[p][d];
+            points[p][d] = points[q][d];
+            points[q][d] = tmp;
+         }
+      }
+   }
+}
+
+/* Sum of absolute differences between the point and the forward transform
+   of its inverse */
+static VIO_Real inverse_error(VIO_General_transform *transform,
+                              VIO_Real point[], VIO_Real inverse[])
+{
+   VIO_Real x, y, z;
+
+   general_transform_point(transform, inverse[VIO_X], inverse[VIO_Y],
+                           inverse[VIO_Z], &x, &y, &z);
+   return fabs(x - point[VIO_X]) + fabs(y - point[VIO_Y]) +
+          fabs(z - point[VIO_Z]);
+}
+
+static int check_transform(VIO_General_transform *transform,
+                           VIO_Real tolerance, VIO_BOOL shuffled,
+                           VIO_Real max_ratio, const char *what)
+{
+   long cold_iterations, warm_iterations;
+   VIO_Real cold_error, warm_error, distance;
+   int p, d;
+   int errors = 0;
+
+   make_points(shuffled);
+
+   if (general_inverse_transform_points(transform, N_POINTS, points,
+                                        expected) != VIO_OK ||
+       general_inverse_transform_scanline(transform, FALSE, N_POINTS, points,
+                                          cold, &cold_iterations) != VIO_OK ||
+       general_inverse_transform_scanline(transform, TRUE, N_POINTS, points,
+                                          warm, &warm_iterations) != VIO_OK) {
+      fprintf(stderr, "%s: inverse failed\n", what);
+      return 1;
+   }
+
+   printf("%s: %ld iterations cold, %ld warm\n", what, cold_iterations,
+          warm_iterations);
+
+   if (cold_iterations < N_POINTS ||
+       warm_iterations > max_ratio * cold_iterations) {
+      fprintf(stderr, "%s: %ld iterations cold, %ld warm\n", what,
+              cold_iterations, warm_iterations);
+      errors++;
+   }
+
+   for (p = 0; p < N_POINTS; p++) {
+      distance = 0.0;
+      for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+         if (cold[p][d] != expected[p][d]) {
+            if (errors < 5)
+               fprintf(stderr, "%s: cold inverse of point %d is %.17g, "
+                       "expected %.17g\n", what, p, cold[p][d],
+                       expected[p][d]);
+            errors++;
+         }
+         distance += fabs(warm[p][d] - cold[p][d]);
+      }
+
+      /* the warm inverse is as good as the cold one, or good enough */
+      cold_error = inverse_error(transform, points[p], cold[p]);
+      warm_error = inverse_error(transform, points[p], warm[p]);
+      if (warm_error > tolerance && warm_error > cold_error + 1e-9) {
+         if (errors < 5)
+            fprintf(stderr, "%s: warm inverse of point %d is off by %g, "
+                    "cold by %g\n", what, p, warm_error, cold_error);
+         errors++;
+      }
+
+      /* and the same inverse */
+      if (distance > 0.1) {
+         if (errors < 5)
+            fprintf(stderr, "%s: warm inverse of point %d is %g from the "
+                    "cold one\n", what, p, distance);
+         errors++;
+      }
+   }
+
+   return errors;
+}
+
+/* A spline with a single landmark at the origin, which folds the ray
+   x > 0, y = z = 0 onto the origin, where its Jacobian is singular */
+static void make_folded_spline(VIO_General_transform *transform)
+{
+   VIO_Real landmark[VIO_N_DIMENSIONS] = { 0.0, 0.0, 0.0 };
+   VIO_Real weights[VIO_N_DIMENSIONS + 2][VIO_N_DIMENSIONS] = {
+      { -1.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 },
+      { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+   VIO_Real *landmark_ptrs[1];
+   VIO_Real *weight_ptrs[VIO_N_DIMENSIONS + 2];
+   int p;
+
+   landmark_ptrs[0] = landmark;
+   for (p = 0; p < VIO_N_DIMENSIONS + 2; p++)
+      weight_ptrs[p] = weights[p];
+
+   create_thin_plate_transform_real(transform, VIO_N_DIMENSIONS, 1,
+                                    landmark_ptrs, weight_ptrs);
+}
+
+/* A grid which squeezes x > 0 to a hundredth, so that the search for an
+   inverse crawls through it */
+static void make_squeezing_grid(VIO_General_transform *transform)
+{
+   test_grid grid = grid_spec;
+   VIO_Volume volume;
+   VIO_Real x;
+   int i, j, k;
+
+   grid.amplitude = 0.0;
+   volume = make_test_displacements(&grid);
+
+   for (i = 0; i < grid.sizes[0]; i++)
+      for (j = 0; j < grid.sizes[1]; j++)
+         for (k = 0; k < grid.sizes[2]; k++) {
+            x = grid.starts[2] + k * grid.steps[2];
+            set_volume_real_value(volume, VIO_X, i, j, k, 0,
+                                  (x > 0.0) ? -0.99 * x : 0.0);
+         }
+
+   create_grid_transform(transform, volume, NULL);
+   delete_volume(volume);
+}
+
+/* The warm start for the second point is guessed from the inverse of the
+   first where the search from it fails, so the inverse has to be found
+   again from the usual start */
+static int check_fallback(VIO_General_transform *transform,
+                          VIO_Real first_x, VIO_Real second_x,
+                          VIO_Real tolerance, const char *what)
+{
+   VIO_Real fold_points[2][VIO_N_DIMENSIONS] = {
+      { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+   VIO_Real fold_cold[2][VIO_N_DIMENSIONS], fold_warm[2][VIO_N_DIMENSIONS];
+   long cold_iterations, warm_iterations;
+   VIO_Real error;
+   int d;
+
+   fold_points[0][VIO_X] = first_x;
+   fold_points[1][VIO_X] = second_x;
+
+   if (general_inverse_transform_scanline(transform, FALSE, 2, fold_points,
+                                          fold_cold,
+                                          &cold_iterations) != VIO_OK ||
+       general_inverse_transform_scanline(transform, TRUE, 2, fold_points,
+                                          fold_warm,
+                                          &warm_iterations) != VIO_OK) {
+      fprintf(stderr, "%s: inverse failed\n", what);
+      return 1;
+   }
+
+   error = inverse_error(transform, fold_points[1], fold_warm[1]);
+   for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+      if (fold_warm[1][d] != fold_cold[1][d])
+         error = -1.0;
+   }
+
+   /* the failed warm start took iterations of its own */
+   if (error < 0.0 || error > tolerance ||
+       warm_iterations <= cold_iterations) {
+      fprintf(stderr, "%s: inverse %g %g %g, cold %g %g %g, "
+              "%ld iterations cold, %ld warm\n", what, fold_warm[1][VIO_X],
+              fold_warm[1][VIO_Y], fold_warm[1][VIO_Z], fold_cold[1][VIO_X],
+              fold_cold[1][VIO_Y], fold_cold[1][VIO_Z], cold_iterations,
+              warm_iterations);
+      return 1;
+   }
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform spline, grid, linear, first, chain, folded;
+   VIO_Transform matrix;
+   int errors = 0;
+
+   srand(97531);
+
+   errors += check_newton();
+
+   make_spline(&spline);
+   make_test_grid_transform(&grid, &grid_spec);
+   make_identity_transform(&matrix);
+   Transform_elem(matrix, 0, 0) = 0.9;
+   Transform_elem(matrix, 1, 2) = 0.1;
+   Transform_elem(matrix, 2, 3) = -3.0;
+   create_linear_transform(&linear, &matrix);
+   concat_general_transforms(&linear, &spline, &first);
+   concat_general_transforms(&first, &grid, &chain);
+
+   errors += check_transform(&spline, TPS_TOLERANCE, FALSE, 0.6, "spline");
+   errors += check_transform(&grid, GRID_TOLERANCE, FALSE, 0.7, "grid");
+   errors += check_transform(&chain, TPS_TOLERANCE + GRID_TOLERANCE, FALSE,
+                             0.6, "chain");
+
+   /* out of order, the warm starts are mostly useless but harmless */
+   errors += check_transform(&chain, TPS_TOLERANCE + GRID_TOLERANCE, TRUE,
+                             2.0, "shuffled chain");
+
+   /* the first point is inverted to x = -1, so the second's warm start is
+      at x = 0.5, on the fold */
+   make_folded_spline(&folded);
+   errors += check_fallback(&folded, -2.0, -0.5, TPS_TOLERANCE,
+                            "folded spline");
+   delete_general_transform(&folded);
+
+   /* the first point is beyond the squeezed part, so its search only gets
+      to x = 40 or so in it, and the second's warm start is left there */
+   make_squeezing_grid(&folded);
+   errors += check_fallback(&folded, 4.0, -1.0, GRID_TOLERANCE,
+                            "squeezing grid");
+   delete_general_transform(&folded);
+
+   delete_general_transform(&chain);
+   delete_general_transform(&first);
+   delete_general_transform(&linear);
+   delete_general_transform(&grid);
+   delete_general_transform(&spline);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
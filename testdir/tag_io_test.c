@@ -0,0 +1,442 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_io_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Inputs ascii tag files, written by hand with comments, tabs,
+              carriage returns and all the optional fields, and written by
+              output_tag_file() with random positions, with
+              input_tag_file() and checks the tags are exactly those read a
+              tag at a time by input_one_tag().  Writes them as binary tag
+              files and checks input_tag_file() reads them back the same.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#define N_RANDOM_TAGS 3000
+
+typedef struct
+{
+   int       n_volumes;
+   int       n_tags;
+   VIO_Real  **tags1;
+   VIO_Real  **tags2;
+   VIO_Real  *weights;
+   int       *structure_ids;
+   int       *patient_ids;
+   VIO_STR   *labels;
+   VIO_Status status;
+} tag_set;
+
+static const char *hand_written =
+   "MNI Tag Point File\n"
+   "Volumes = 2;\n"
+   "% a comment\n"
+   "# another comment\n"
+   "\n"
+   "Points =\n"
+   " 1 2 3 4 5 6\n"
+   " -1.5 2.25e2 3E-3 4.0 +5 -0 \"a label\"\n"
+   " 0.1 0.2 0.3 \t0.4 0.5 0.6 0.75\t3 4\n"
+   " 1.234567890123456789 1e-300 5e22 7 8 9 0.5 -2 7 unquoted\r\n"
+   "% a comment between tags\n"
+   " 10 20 30 40 50 60 \"\"\n"
+   " 1.5 2.5 3.5 4.5 5.5 6.5 lonely\n"
+   " 9 8 7 6 5 4 1 2 3 \"last label\";\n"
+   "X";
+
+static const char *semicolon_alone =
+   "MNI Tag Point File\n"
+   "Volumes = 1;\n"
+   "Points =\n"
+   " 0.125 -3.5 100\n"
+   " 1e5 2 3 0.25 1 1\n"
+   ";\n"
+   "X";
+
+static const char *malformed =
+   "MNI Tag Point File\n"
+   "Volumes = 1;\n"
+   "Points =\n"
+   " 1 2 3\n"
+   " 4 5 x\n"
+   " 7 8 9;\n";
+
+static void write_text(const char *filename, const char *text)
+{
+   FILE *file = fopen(filename, "wb");
+
+   fputs(text, file);
+   fclose(file);
+}
+
+/* Reads the tags a tag at a time, as the reference */
+static void input_one_at_a_time(const char *filename, tag_set *set)
+{
+   FILE *file;
+   VIO_Real tag1[3], tag2[3], weight;
+   int structure_id, patient_id;
+   VIO_STR label;
+
+   file = fopen(filename, "rb");
+   set->n_tags = 0;
+   set->status = initialize_tag_file_input(file, &set->n_volumes);
+
+   VIO_ALLOC2D(set->tags1, N_RANDOM_TAGS, 3);
+   VIO_ALLOC2D(set->tags2, N_RANDOM_TAGS, 3);
+   ALLOC(set->weights, N_RANDOM_TAGS);
+   ALLOC(set->structure_ids, N_RANDOM_TAGS);
+   ALLOC(set->patient_ids, N_RANDOM_TAGS);
+   ALLOC(set->labels, N_RANDOM_TAGS);
+
+   while (set->status == VIO_OK &&
+          input_one_tag(file, set->n_volumes, tag1, tag2, &weight,
+                        &structure_id, &patient_id, &label, &set->status)) {
+      memcpy(set->tags1[set->n_tags], tag1, sizeof(tag1));
+      memcpy(set->tags2[set->n_tags], tag2, sizeof(tag2));
+      set->weights[set->n_tags] = weight;
+      set->structure_ids[set->n_tags] = structure_id;
+      set->patient_ids[set->n_tags] = patient_id;
+      set->labels[set->n_tags] = label;
+      set->n_tags++;
+   }
+   fclose(file);
+}
+
+static void delete_one_at_a_time(tag_set *set)
+{
+   int i;
+
+   for (i = 0; i < set->n_tags; i++)
+      delete_string(set->labels[i]);
+   VIO_FREE2D(set->tags1);
+   VIO_FREE2D(set->tags2);
+   FREE(set->weights);
+   FREE(set->structure_ids);
+   FREE(set->patient_ids);
+   FREE(set->labels);
+}
+
+static int same_label(VIO_STR a, VIO_STR b)
+{
+   if (a == NULL || b == NULL)
+      return a == b;
+   return strcmp(a, b) == 0;
+}
+
+static int compare_sets(tag_set *expected, tag_set *got, const char *what)
+{
+   int i, d;
+   int errors = 0;
+
+   if (got->status != expected->status || got->n_tags != expected->n_tags ||
+       (expected->status == VIO_OK && got->n_volumes != expected->n_volumes)) {
+      fprintf(stderr, "%s: status %d, %d tags, %d volumes; expected %d, %d "
+              "tags, %d volumes\n", what, (int) got->status, got->n_tags,
+              got->n_volumes, (int) expected->status, expected->n_tags,
+              expected->n_volumes);
+      return 1;
+   }
+
+   for (i = 0; i < expected->n_tags; i++) {
+      for (d = 0; d < 3; d++) {
+         if (got->tags1[i][d] != expected->tags1[i][d] ||
+             (expected->n_volumes == 2 &&
+              got->tags2[i][d] != expected->tags2[i][d]))
+            errors++;
+      }
+      if (got->weights[i] != expected->weights[i] ||
+          got->structure_ids[i] != expected->structure_ids[i] ||
+          got->patient_ids[i] != expected->patient_ids[i] ||
+          !same_label(got->labels[i], expected->labels[i])) {
+         errors++;
+      }
+      if (errors > 0) {
+         fprintf(stderr, "%s: tag %d is %.17g %.17g %.17g %g %d %d \"%s\", "
+                 "expected %.17g %.17g %.17g %g %d %d \"%s\"\n", what, i,
+                 got->tags1[i][0], got->tags1[i][1], got->tags1[i][2],
+                 got->weights[i], got->structure_ids[i], got->patient_ids[i],
+                 got->labels[i] ? got->labels[i] : "(null)",
+                 expected->tags1[i][0], expected->tags1[i][1],
+                 expected->tags1[i][2], expected->weights[i],
+                 expected->structure_ids[i], expected->patient_ids[i],
+                 expected->labels[i] ? expected->labels[i] : "(null)");
+         return errors;
+      }
+   }
+   return 0;
+}
+
+static void input_whole(const char *filename, tag_set *set)
+{
+   set->n_volumes = 0;
+   set->status = input_tag_file((VIO_STR) filename, &set->n_volumes,
+                                &set->n_tags, &set->tags1, &set->tags2,
+                                &set->weights, &set->structure_ids,
+                                &set->patient_ids, &set->labels);
+}
+
+/* Inputs the ascii file whole, compares with the tags read one at a time
+   and with those written, if known, then writes and reads it back as a
+   binary tag file */
+static int check_file(const char *filename, const char *binary_filename,
+                      tag_set *written, const char *what)
+{
+   tag_set expected, got, binary;
+   int errors = 0;
+
+   input_one_at_a_time(filename, &expected);
+   input_whole(filename, &got);
+   errors += compare_sets(&expected, &got, what);
+   if (written != NULL)
+      errors += compare_sets(written, &got, what);
+
+   if (got.status == VIO_OK) {
+      if (output_tag_file_binary((VIO_STR) binary_filename, "binary tags",
+                                 got.n_volumes, got.n_tags, got.tags1,
+                                 got.tags2, got.weights, got.structure_ids,
+                                 got.patient_ids, got.labels) != VIO_OK) {
+         fprintf(stderr, "%s: cannot output binary file\n", what);
+         errors++;
+      }
+      else {
+         input_whole(binary_filename, &binary);
+         errors += compare_sets(&expected, &binary, what);
+         if (binary.status == VIO_OK)
+            free_tag_points(binary.n_volumes, binary.n_tags, binary.tags1,
+                            binary.tags2, binary.weights,
+                            binary.structure_ids, binary.patient_ids,
+                            binary.labels);
+      }
+   }
+
+   if (got.n_tags > 0)
+      free_tag_points(got.n_volumes, got.n_tags, got.tags1, got.tags2,
+                      got.weights, got.structure_ids, got.patient_ids,
+                      got.labels);
+   delete_one_at_a_time(&expected);
+   return errors;
+}
+
+/* A binary file without the optional fields reads back with the defaults of
+   an ascii file */
+static int check_binary_defaults(const char *binary_filename)
+{
+   VIO_Real **tags, **tags2, *weights;
+   int *structure_ids, *patient_ids, n_volumes, n_tags, i;
+   VIO_STR *labels;
+   int errors = 0;
+
+   VIO_ALLOC2D(tags, 5, 3);
+   for (i = 0; i < 5; i++) {
+      tags[i][0] = i;
+      tags[i][1] = -i;
+      tags[i][2] = 0.5 * i;
+   }
+
+   if (output_tag_file_binary((VIO_STR) binary_filename, NULL, 1, 5, tags,
+                              NULL, NULL, NULL, NULL, NULL) != VIO_OK ||
+       input_tag_file((VIO_STR) binary_filename, &n_volumes, &n_tags, &tags2,
+                      NULL, &weights, &structure_ids, &patient_ids,
+                      &labels) != VIO_OK) {
+      fprintf(stderr, "defaults: cannot output or input binary file\n");
+      VIO_FREE2D(tags);
+      return 1;
+   }
+
+   if (n_volumes != 1 || n_tags != 5) {
+      fprintf(stderr, "defaults: %d volumes, %d tags\n", n_volumes, n_tags);
+      errors++;
+   }
+   else {
+      for (i = 0; i < 5; i++) {
+         if (tags2[i][0] != tags[i][0] || tags2[i][1] != tags[i][1] ||
+             tags2[i][2] != tags[i][2] || weights[i] != 0.0 ||
+             structure_ids[i] != -1 || patient_ids[i] != -1 ||
+             labels[i] != NULL) {
+            fprintf(stderr, "defaults: tag %d differs\n", i);
+            errors++;
+         }
+      }
+   }
+
+   free_tag_points(n_volumes, n_tags, tags2, NULL, weights, structure_ids,
+                   patient_ids, labels);
+   VIO_FREE2D(tags);
+   return errors;
+}
+
+/* input_tag_points() leaves the file just after the tags, and reads the
+   same tags through a pipe, which cannot seek back over the block read */
+static int check_file_position(const char *filename)
+{
+   FILE *file;
+   int n_volumes, n_tags, n_piped_tags;
+   VIO_Real **tags, **piped_tags;
+   char command[1024];
+   int errors = 0;
+   char ch;
+
+   file = fopen(filename, "rb");
+   if (input_tag_points(file, &n_volumes, &n_tags, &tags, NULL, NULL, NULL,
+                        NULL, NULL) != VIO_OK ||
+       mni_get_nonwhite_character(file, &ch) != VIO_OK || ch != 'X') {
+      fprintf(stderr, "file position: not left after the tags\n");
+      errors++;
+   }
+   fclose(file);
+
+   snprintf(command, sizeof(command), "cat %s", filename);
+   file = popen(command, "r");
+   if (file == NULL ||
+       input_tag_points(file, &n_volumes, &n_piped_tags, &piped_tags, NULL,
+                        NULL, NULL, NULL, NULL) != VIO_OK ||
+       n_piped_tags != n_tags ||
+       (n_tags > 0 && (piped_tags[n_tags - 1][VIO_X] != tags[n_tags - 1][VIO_X]
+                       || piped_tags[0][VIO_Z] != tags[0][VIO_Z]))) {
+      fprintf(stderr, "file position: tags not read through a pipe\n");
+      errors++;
+   }
+   if (file != NULL) {
+      if (n_piped_tags > 0)
+         free_tag_points(1, n_piped_tags, piped_tags, NULL, NULL, NULL, NULL,
+                         NULL);
+      pclose(file);
+   }
+
+   if (n_tags > 0)
+      free_tag_points(1, n_tags, tags, NULL, NULL, NULL, NULL, NULL);
+   return errors;
+}
+
+static VIO_Real random_coordinate(void)
+{
+   VIO_Real value = (rand() / (VIO_Real) RAND_MAX - 0.5) * 200.0;
+
+   switch (rand() % 8) {
+   case 0:
+      return value * 1e-30;
+   case 1:
+      return value * 1e25;
+   case 2:
+      return floor(value);
+   default:
+      return value;
+   }
+}
+
+/* The value as written with %.15g and converted back by the C library */
+static VIO_Real as_written(VIO_Real value)
+{
+   char text[64];
+
+   snprintf(text, sizeof(text), "%.15g", value);
+   return strtod(text, NULL);
+}
+
+/* Random tags, written by output_tag_file(), passing back the values they
+   should be read as */
+static void write_random_tags(const char *filename, tag_set *written)
+{
+   VIO_Real **tags1, **tags2, *weights;
+   int *structure_ids, *patient_ids, i, d;
+   VIO_STR *labels;
+   static VIO_STR names[] = { "caudate", "left putamen", "", NULL };
+
+   VIO_ALLOC2D(tags1, N_RANDOM_TAGS, 3);
+   VIO_ALLOC2D(tags2, N_RANDOM_TAGS, 3);
+   ALLOC(weights, N_RANDOM_TAGS);
+   ALLOC(structure_ids, N_RANDOM_TAGS);
+   ALLOC(patient_ids, N_RANDOM_TAGS);
+   ALLOC(labels, N_RANDOM_TAGS);
+
+   for (i = 0; i < N_RANDOM_TAGS; i++) {
+      for (d = 0; d < 3; d++) {
+         tags1[i][d] = random_coordinate();
+         tags2[i][d] = random_coordinate();
+      }
+      weights[i] = random_coordinate();
+      structure_ids[i] = rand() % 100 - 50;
+      patient_ids[i] = rand();
+      labels[i] = names[rand() % 4];
+   }
+
+   output_tag_file((VIO_STR) filename, "random tags", 2, N_RANDOM_TAGS, tags1,
+                   tags2, weights, structure_ids, patient_ids, labels);
+
+   for (i = 0; i < N_RANDOM_TAGS; i++) {
+      for (d = 0; d < 3; d++) {
+         tags1[i][d] = as_written(tags1[i][d]);
+         tags2[i][d] = as_written(tags2[i][d]);
+      }
+      weights[i] = as_written(weights[i]);
+   }
+
+   written->n_volumes = 2;
+   written->n_tags = N_RANDOM_TAGS;
+   written->tags1 = tags1;
+   written->tags2 = tags2;
+   written->weights = weights;
+   written->structure_ids = structure_ids;
+   written->patient_ids = patient_ids;
+   written->labels = labels;
+   written->status = VIO_OK;
+}
+
+int main(int argc, char **argv)
+{
+   char filename[256], binary_filename[256];
+   tag_set written;
+   int errors = 0;
+
+   srand(2468);
+
+   snprintf(filename, sizeof(filename), "test_tag_io-%d.tag", getpid());
+   snprintf(binary_filename, sizeof(binary_filename),
+            "test_tag_io-%d-binary.tag", getpid());
+
+   write_text(filename, hand_written);
+   errors += check_file(filename, binary_filename, NULL, "hand written");
+   errors += check_file_position(filename);
+
+   write_text(filename, semicolon_alone);
+   errors += check_file(filename, binary_filename, NULL,
+                        "semicolon alone");
+   errors += check_file_position(filename);
+
+   write_text(filename, malformed);
+   errors += check_file(filename, binary_filename, NULL, "malformed");
+
+   write_random_tags(filename, &written);
+   errors += check_file(filename, binary_filename, &written, "random");
+   VIO_FREE2D(written.tags1);
+   VIO_FREE2D(written.tags2);
+   FREE(written.weights);
+   FREE(written.structure_ids);
+   FREE(written.patient_ids);
+   FREE(written.labels);
+
+   errors += check_binary_defaults(binary_filename);
+
+   unlink(filename);
+   unlink(binary_filename);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
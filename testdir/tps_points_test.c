@@ -0,0 +1,534 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tps_points_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Evaluates a 3D thin plate spline with a few thousand landmarks,
+              with and without derivatives, against sums of
+              thin_plate_spline_U() over the landmarks, and transforms
+              batches of points by it and by a 2D thin plate spline, forward
+              and inverse, checking them against the point by point
+              transforms, and the approximate batch transforms against the
+              exact ones to within their tolerance, and against a general
+              transform given the same tolerance.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#define N_LANDMARKS 2000
+#define N_POINTS 300
+#define N_CLUSTER 200
+
+static VIO_Real positions[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real transformed[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real in_place[N_POINTS][VIO_N_DIMENSIONS];
+
+static VIO_Real random_real(VIO_Real low, VIO_Real high)
+{
+   return low + (high - low) * rand() / (VIO_Real) RAND_MAX;
+}
+
+/* Landmarks spread over a box, small weights and an affine part close to
+   the identity; the 2D kernel, r^2 log r^2, needs much smaller weights */
+static void make_spline(int n_dims, VIO_Real ***points, VIO_Real ***weights)
+{
+   VIO_Real weight = (n_dims == 3) ? 1e-4 : 1e-7;
+   int p, d, v;
+
+   VIO_ALLOC2D(*points, N_LANDMARKS, n_dims);
+   VIO_ALLOC2D(*weights, N_LANDMARKS + n_dims + 1, n_dims);
+
+   for (p = 0; p < N_LANDMARKS; p++) {
+      for (d = 0; d < n_dims; d++) {
+         (*points)[p][d] = random_real(-60.0, 60.0);
+         (*weights)[p][d] = random_real(-weight, weight);
+      }
+   }
+   for (v = 0; v < n_dims; v++) {
+      (*weights)[N_LANDMARKS][v] = random_real(-2.0, 2.0);
+      for (d = 0; d < n_dims; d++)
+         (*weights)[N_LANDMARKS + 1 + d][v] = (d == v) ? 1.02 : 0.01 * (d - v);
+   }
+}
+
+/* The spline and its derivatives summed as evaluate_thin_plate_spline()
+   defines them */
+static void reference_spline(VIO_Real **points, VIO_Real **weights,
+                             VIO_Real pos[], VIO_Real values[],
+                             VIO_Real derivs[3][3])
+{
+   VIO_Real dist, r, delta[3];
+   int p, v, d;
+
+   for (v = 0; v < 3; v++) {
+      values[v] = 0.0;
+      for (d = 0; d < 3; d++)
+         derivs[v][d] = 0.0;
+   }
+
+   for (p = 0; p < N_LANDMARKS; p++) {
+      dist = thin_plate_spline_U(pos, points[p], 3);
+      for (v = 0; v < 3; v++)
+         values[v] = values[v] + weights[p][v] * dist;
+
+      for (d = 0; d < 3; d++)
+         delta[d] = pos[d] - points[p][d];
+      r = sqrt(delta[0] * delta[0] + delta[1] * delta[1] +
+               delta[2] * delta[2]);
+      for (v = 0; v < 3; v++)
+         for (d = 0; d < 3; d++)
+            derivs[v][d] += weights[p][v] * (r == 0.0 ? 0.0 : delta[d] / r);
+   }
+
+   for (v = 0; v < 3; v++)
+      values[v] += weights[N_LANDMARKS][v];
+
+   for (v = 0; v < 3; v++) {
+      for (d = 0; d < 3; d++) {
+         values[v] += weights[N_LANDMARKS + 1 + d][v] * pos[d];
+         derivs[v][d] += weights[N_LANDMARKS + 1 + d][v];
+      }
+   }
+}
+
+static int check_evaluation(VIO_Real **points, VIO_Real **weights)
+{
+   VIO_Real values[3], no_derivs_values[3], expected[3];
+   VIO_Real expected_derivs[3][3], **derivs;
+   int p, v, d;
+   int errors = 0;
+
+   VIO_ALLOC2D(derivs, 3, 3);
+
+   for (p = 0; p < N_POINTS; p++) {
+      /* also exactly at a landmark */
+      if (p == 0)
+         for (d = 0; d < 3; d++)
+            positions[p][d] = points[7][d];
+
+      reference_spline(points, weights, positions[p], expected,
+                       expected_derivs);
+      evaluate_thin_plate_spline(3, 3, N_LANDMARKS, points, weights,
+                                 positions[p], no_derivs_values, NULL);
+      evaluate_thin_plate_spline(3, 3, N_LANDMARKS, points, weights,
+                                 positions[p], values, derivs);
+
+      for (v = 0; v < 3; v++) {
+         if (values[v] != expected[v] || no_derivs_values[v] != expected[v]) {
+            if (errors < 5)
+               fprintf(stderr, "point %d value %d is %.17g, %.17g without "
+                       "derivatives, expected %.17g\n", p, v, values[v],
+                       no_derivs_values[v], expected[v]);
+            errors++;
+         }
+         for (d = 0; d < 3; d++) {
+            if (derivs[v][d] != expected_derivs[v][d]) {
+               if (errors < 5)
+                  fprintf(stderr, "point %d derivative %d %d is %.17g, "
+                          "expected %.17g\n", p, v, d, derivs[v][d],
+                          expected_derivs[v][d]);
+               errors++;
+            }
+         }
+      }
+   }
+
+   VIO_FREE2D(derivs);
+   return errors;
+}
+
+/* Transforms the positions both ways in batches, in place and not, and
+   compares with the point by point transforms */
+static int check_batches(int n_dims, VIO_Real **points, VIO_Real **weights)
+{
+   VIO_Real x, y, z, fx, fy, fz;
+   VIO_Status status, in_place_status;
+   int p, d, inverse;
+   int errors = 0;
+
+   for (inverse = 0; inverse < 2; inverse++) {
+      for (p = 0; p < N_POINTS; p++)
+         for (d = 0; d < VIO_N_DIMENSIONS; d++)
+            in_place[p][d] = positions[p][d];
+
+      if (inverse) {
+         status = thin_plate_spline_inverse_transform_points(n_dims,
+                     N_LANDMARKS, points, weights, N_POINTS, positions,
+                     transformed);
+         in_place_status = thin_plate_spline_inverse_transform_points(n_dims,
+                     N_LANDMARKS, points, weights, N_POINTS, in_place,
+                     in_place);
+      }
+      else {
+         status = thin_plate_spline_transform_points(n_dims, N_LANDMARKS,
+                     points, weights, N_POINTS, positions, transformed);
+         in_place_status = thin_plate_spline_transform_points(n_dims,
+                     N_LANDMARKS, points, weights, N_POINTS, in_place,
+                     in_place);
+      }
+      if (status != VIO_OK || in_place_status != VIO_OK) {
+         fprintf(stderr, "%dD %s: batch failed\n", n_dims,
+                 inverse ? "inverse" : "forward");
+         errors++;
+      }
+
+      for (p = 0; p < N_POINTS; p++) {
+         x = positions[p][0];
+         y = positions[p][1];
+         z = positions[p][2];
+         if (inverse)
+            thin_plate_spline_inverse_transform(n_dims, N_LANDMARKS, points,
+                                                weights, positions[p][0],
+                                                positions[p][1],
+                                                positions[p][2], &x, &y, &z);
+         else
+            thin_plate_spline_transform(n_dims, N_LANDMARKS, points, weights,
+                                        positions[p][0], positions[p][1],
+                                        positions[p][2], &x, &y, &z);
+
+         if (x != transformed[p][0] || y != transformed[p][1] ||
+             z != transformed[p][2] || x != in_place[p][0] ||
+             y != in_place[p][1] || z != in_place[p][2]) {
+            if (errors < 5)
+               fprintf(stderr, "%dD %s: point %d is %.17g %.17g %.17g, "
+                       "%.17g %.17g %.17g in place, %.17g %.17g %.17g "
+                       "alone\n", n_dims, inverse ? "inverse" : "forward",
+                       p, transformed[p][0], transformed[p][1],
+                       transformed[p][2], in_place[p][0], in_place[p][1],
+                       in_place[p][2], x, y, z);
+            errors++;
+         }
+
+         if (inverse && n_dims == 3) {
+            thin_plate_spline_transform(n_dims, N_LANDMARKS, points, weights,
+                                        x, y, z, &fx, &fy, &fz);
+            if (fabs(fx - positions[p][0]) + fabs(fy - positions[p][1]) +
+                fabs(fz - positions[p][2]) > 0.01) {
+               if (errors < 5)
+                  fprintf(stderr, "inverse of point %d maps to %g %g %g\n",
+                          p, fx, fy, fz);
+               errors++;
+            }
+         }
+      }
+   }
+   return errors;
+}
+
+/* Transforms the positions by the 3D spline approximately, checking that
+   each coordinate is within tolerance of the exact transform, and that
+   the exact spline maps each approximate inverse to within the tolerance
+   of the search plus three times tolerance of its position */
+static int check_approximate(VIO_Real **points, VIO_Real **weights,
+                             VIO_Real tolerance)
+{
+   static VIO_Real exact[N_POINTS][VIO_N_DIMENSIONS];
+   VIO_Real error, max_error, fx, fy, fz;
+   int p, d;
+   int errors = 0;
+
+   if (thin_plate_spline_transform_points(3, N_LANDMARKS, points, weights,
+                                          N_POINTS, positions,
+                                          exact) != VIO_OK ||
+       thin_plate_spline_transform_points_approximate(3, N_LANDMARKS, points,
+                                          weights, tolerance, N_POINTS,
+                                          positions, transformed) != VIO_OK) {
+      fprintf(stderr, "approximate %g: forward batch failed\n", tolerance);
+      return 1;
+   }
+
+   max_error = 0.0;
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+         error = fabs(transformed[p][d] - exact[p][d]);
+         if (error > max_error)
+            max_error = error;
+         if (tolerance <= 0.0 ? error != 0.0 : error > tolerance) {
+            if (errors < 5)
+               fprintf(stderr, "approximate %g: point %d coordinate %d is "
+                       "%.17g, exactly %.17g\n", tolerance, p, d,
+                       transformed[p][d], exact[p][d]);
+            errors++;
+         }
+      }
+   }
+
+   /* the far field was approximated at all */
+   if (tolerance > 0.0 && max_error == 0.0) {
+      fprintf(stderr, "approximate %g: no point differs from the exact "
+              "transform\n", tolerance);
+      errors++;
+   }
+
+   if (thin_plate_spline_inverse_transform_points_approximate(3, N_LANDMARKS,
+          points, weights, tolerance, N_POINTS, positions,
+          transformed) != VIO_OK) {
+      fprintf(stderr, "approximate %g: inverse batch failed\n", tolerance);
+      return errors + 1;
+   }
+
+   for (p = 0; p < N_POINTS; p++) {
+      thin_plate_spline_transform(3, N_LANDMARKS, points, weights,
+                                  transformed[p][0], transformed[p][1],
+                                  transformed[p][2], &fx, &fy, &fz);
+      if (fabs(fx - positions[p][0]) + fabs(fy - positions[p][1]) +
+          fabs(fz - positions[p][2]) > 0.01 + 3.0 * tolerance) {
+         if (errors < 5)
+            fprintf(stderr, "approximate %g: inverse of point %d maps to "
+                    "%g %g %g\n", tolerance, p, fx, fy, fz);
+         errors++;
+      }
+   }
+
+   return errors;
+}
+
+/* Compares the batches of positions, coordinate by coordinate */
+static int count_differences(const char *label,
+                             VIO_Real a[][VIO_N_DIMENSIONS],
+                             VIO_Real b[][VIO_N_DIMENSIONS])
+{
+   int p, d;
+   int errors = 0;
+
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+         if (a[p][d] != b[p][d]) {
+            if (errors < 5)
+               fprintf(stderr, "%s: point %d coordinate %d is %.17g, "
+                       "expected %.17g\n", label, p, d, a[p][d], b[p][d]);
+            errors++;
+         }
+      }
+   }
+   return errors;
+}
+
+/* A tolerance set on a thin plate spline transform is used by the general
+   transforms of points, one at a time and in batches, forward and inverse,
+   giving the results of the approximate batch transforms; it is kept by
+   copies, inverses and concatenations, and setting it to 0 makes the
+   transform exact again */
+static int check_transform_tolerance(VIO_Real **points, VIO_Real **weights,
+                                     VIO_Real tolerance)
+{
+   static VIO_Real expected[N_POINTS][VIO_N_DIMENSIONS];
+   VIO_General_transform transform, copy, inverse, linear, concated;
+   VIO_Transform identity;
+   VIO_Real x, y, z;
+   int p;
+   int errors = 0;
+
+   create_thin_plate_transform_real(&transform, 3, N_LANDMARKS, points,
+                                    weights);
+   set_thin_plate_spline_tolerance(&transform, tolerance);
+   if (get_thin_plate_spline_tolerance(&transform) != tolerance) {
+      fprintf(stderr, "transform tolerance is %g, set to %g\n",
+              get_thin_plate_spline_tolerance(&transform), tolerance);
+      errors++;
+   }
+
+   /* forward */
+   thin_plate_spline_transform_points_approximate(3, N_LANDMARKS, points,
+                                                  weights, tolerance,
+                                                  N_POINTS, positions,
+                                                  expected);
+   if (general_transform_points(&transform, N_POINTS, positions,
+                                transformed) != VIO_OK) {
+      fprintf(stderr, "transform tolerance: forward batch failed\n");
+      errors++;
+   }
+   errors += count_differences("transform tolerance forward", transformed,
+                               expected);
+   for (p = 0; p < N_POINTS; p++) {
+      general_transform_point(&transform, positions[p][0], positions[p][1],
+                              positions[p][2], &x, &y, &z);
+      transformed[p][0] = x;
+      transformed[p][1] = y;
+      transformed[p][2] = z;
+   }
+   errors += count_differences("transform tolerance forward point",
+                               transformed, expected);
+
+   make_identity_transform(&identity);
+   create_linear_transform(&linear, &identity);
+   concat_general_transforms(&linear, &transform, &concated);
+   general_transform_points(&concated, N_POINTS, positions, transformed);
+   errors += count_differences("transform tolerance concatenated",
+                               transformed, expected);
+
+   /* inverse */
+   thin_plate_spline_inverse_transform_points_approximate(3, N_LANDMARKS,
+                                                  points, weights, tolerance,
+                                                  N_POINTS, positions,
+                                                  expected);
+   if (general_inverse_transform_points(&transform, N_POINTS, positions,
+                                        transformed) != VIO_OK) {
+      fprintf(stderr, "transform tolerance: inverse batch failed\n");
+      errors++;
+   }
+   errors += count_differences("transform tolerance inverse", transformed,
+                               expected);
+   for (p = 0; p < N_POINTS; p++) {
+      general_inverse_transform_point(&transform, positions[p][0],
+                                      positions[p][1], positions[p][2],
+                                      &x, &y, &z);
+      transformed[p][0] = x;
+      transformed[p][1] = y;
+      transformed[p][2] = z;
+   }
+   errors += count_differences("transform tolerance inverse point",
+                               transformed, expected);
+
+   copy_general_transform(&transform, &copy);
+   general_inverse_transform_points(&copy, N_POINTS, positions, transformed);
+   errors += count_differences("transform tolerance copy", transformed,
+                               expected);
+
+   create_inverse_general_transform(&transform, &inverse);
+   general_transform_points(&inverse, N_POINTS, positions, transformed);
+   errors += count_differences("transform tolerance inverted", transformed,
+                               expected);
+
+   /* exact again, in the concatenation too */
+   set_thin_plate_spline_tolerance(&concated, 0.0);
+   set_thin_plate_spline_tolerance(&transform, 0.0);
+   if (get_thin_plate_spline_tolerance(&transform) != 0.0 ||
+       get_thin_plate_spline_tolerance(
+                      get_nth_general_transform(&concated, 1)) != 0.0) {
+      fprintf(stderr, "transform tolerance: not exact after setting 0\n");
+      errors++;
+   }
+   thin_plate_spline_transform_points(3, N_LANDMARKS, points, weights,
+                                      N_POINTS, positions, expected);
+   general_transform_points(&transform, N_POINTS, positions, transformed);
+   errors += count_differences("transform tolerance exact", transformed,
+                               expected);
+   general_transform_points(&concated, N_POINTS, positions, transformed);
+   errors += count_differences("transform tolerance exact concatenated",
+                               transformed, expected);
+
+   delete_general_transform(&inverse);
+   delete_general_transform(&copy);
+   delete_general_transform(&concated);
+   delete_general_transform(&linear);
+   delete_general_transform(&transform);
+   return errors;
+}
+
+/* A cluster of landmarks seen from afar is taken as a whole, so the error
+   of the approximate transform is that of the expansion, which falls as
+   the cube of the distance: doubling the distance must divide it by about
+   eight, where a second order expansion would only divide it by four */
+static int check_far_cluster(void)
+{
+   static const VIO_Real directions[3][VIO_N_DIMENSIONS] = {
+      { 1.0, 0.0, 0.0 }, { 0.6, -0.8, 0.0 }, { -0.48, 0.36, 0.8 } };
+   VIO_Real **points, **weights;
+   VIO_Real far[6][VIO_N_DIMENSIONS], exact[6][VIO_N_DIMENSIONS];
+   VIO_Real approximate[6][VIO_N_DIMENSIONS], errors_at[2];
+   int p, d, k, i;
+   int errors = 0;
+
+   VIO_ALLOC2D(points, N_CLUSTER, VIO_N_DIMENSIONS);
+   VIO_ALLOC2D(weights, N_CLUSTER + VIO_N_DIMENSIONS + 1, VIO_N_DIMENSIONS);
+   for (p = 0; p < N_CLUSTER; p++) {
+      for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+         points[p][d] = random_real(-1.0, 1.0);
+         weights[p][d] = random_real(-1e-4, 1e-4);
+      }
+   }
+   for (p = N_CLUSTER; p < N_CLUSTER + VIO_N_DIMENSIONS + 1; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         weights[p][d] = (p - N_CLUSTER == d + 1) ? 1.0 : 0.0;
+
+   for (k = 0; k < 3; k++)
+      for (i = 0; i < 2; i++)
+         for (d = 0; d < VIO_N_DIMENSIONS; d++)
+            far[2 * k + i][d] = 20.0 * (i + 1) * directions[k][d];
+
+   if (thin_plate_spline_transform_points(3, N_CLUSTER, points, weights, 6,
+                                          far, exact) != VIO_OK ||
+       thin_plate_spline_transform_points_approximate(3, N_CLUSTER, points,
+                                          weights, 1.0, 6, far,
+                                          approximate) != VIO_OK) {
+      fprintf(stderr, "far cluster: batch failed\n");
+      errors++;
+   }
+   else {
+      for (k = 0; k < 3; k++) {
+         for (i = 0; i < 2; i++) {
+            errors_at[i] = 0.0;
+            for (d = 0; d < VIO_N_DIMENSIONS; d++)
+               errors_at[i] += fabs(approximate[2 * k + i][d] -
+                                    exact[2 * k + i][d]);
+         }
+         if (!(errors_at[1] > 0.0 && errors_at[0] > 6.0 * errors_at[1])) {
+            fprintf(stderr, "far cluster: errors %g at 20 and %g at 40 along "
+                    "direction %d\n", errors_at[0], errors_at[1], k);
+            errors++;
+         }
+      }
+   }
+
+   VIO_FREE2D(weights);
+   VIO_FREE2D(points);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform transform;
+   VIO_Real **points, **weights;
+   int p, d;
+   int errors = 0;
+
+   srand(8642);
+
+   make_spline(3, &points, &weights);
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         positions[p][d] = random_real(-50.0, 50.0);
+
+   errors += check_evaluation(points, weights);
+   errors += check_batches(3, points, weights);
+   errors += check_approximate(points, weights, 1e-3);
+   errors += check_approximate(points, weights, 1e-8);
+   errors += check_approximate(points, weights, 0.0);
+   errors += check_transform_tolerance(points, weights, 1e-3);
+   errors += check_far_cluster();
+   VIO_FREE2D(weights);
+   VIO_FREE2D(points);
+
+   make_spline(2, &points, &weights);
+   errors += check_batches(2, points, weights);
+
+   /* 2D splines are always exact */
+   create_thin_plate_transform_real(&transform, 2, N_LANDMARKS, points,
+                                    weights);
+   set_thin_plate_spline_tolerance(&transform, 1.0);
+   if (get_thin_plate_spline_tolerance(&transform) != 0.0) {
+      fprintf(stderr, "2D transform has a tolerance\n");
+      errors++;
+   }
+   delete_general_transform(&transform);
+   VIO_FREE2D(weights);
+   VIO_FREE2D(points);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
@@ -0,0 +1,134 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_fixtures
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Grid and thin plate spline transforms shared by the transform
+              tests.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "transform_fixtures.h"
+
+#define N_LANDMARKS 6
+
+/* Vanishes at the edges of the grid, where the grid transform becomes the
+   identity */
+static VIO_Real window(int i, int size)
+{
+   return sin(M_PI * i / (size - 1.0));
+}
+
+VIO_Volume make_test_displacements(const test_grid *grid)
+{
+   static VIO_STR last_names[] = { MIzspace, MIyspace, MIxspace,
+                                   MIvector_dimension };
+   static VIO_STR first_names[] = { MIvector_dimension, MIzspace, MIyspace,
+                                    MIxspace };
+   int sizes[VIO_MAX_DIMENSIONS];
+   VIO_Real starts[VIO_MAX_DIMENSIONS], steps[VIO_MAX_DIMENSIONS];
+   VIO_Real value, range;
+   VIO_Volume volume;
+   int i, j, k, c, d, first;
+
+   /* the spatial dimensions follow the vector dimension or come first */
+   first = grid->vector_first ? 1 : 0;
+   for (d = 0; d < VIO_MAX_DIMENSIONS; d++) {
+      sizes[d] = 0;
+      starts[d] = 0.0;
+      steps[d] = 1.0;
+   }
+   sizes[grid->vector_first ? 0 : VIO_N_DIMENSIONS] = VIO_N_DIMENSIONS;
+   for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+      sizes[first + d] = grid->sizes[d];
+      starts[first + d] = grid->starts[d];
+      steps[first + d] = grid->steps[d];
+   }
+
+   volume = create_volume(4, grid->vector_first ? first_names : last_names,
+                          grid->type, TRUE, 0.0, 0.0);
+   set_volume_sizes(volume, sizes);
+   set_volume_starts(volume, starts);
+   set_volume_separations(volume, steps);
+   alloc_volume_data(volume);
+   if (grid->type != NC_FLOAT && grid->type != NC_DOUBLE) {
+      range = 2.0 * (fabs(grid->amplitude) + 2.0 * fabs(grid->offset));
+      set_volume_voxel_range(volume, -32000.0, 32000.0);
+      set_volume_real_range(volume, -range, range);
+   }
+
+   for (i = 0; i < grid->sizes[0]; i++)
+      for (j = 0; j < grid->sizes[1]; j++)
+         for (k = 0; k < grid->sizes[2]; k++)
+            for (c = 0; c < VIO_N_DIMENSIONS; c++) {
+               value = grid->amplitude *
+                       sin(grid->frequencies[0] * i +
+                           grid->frequencies[1] * c) *
+                       cos(grid->frequencies[2] * j -
+                           grid->frequencies[3] * k) +
+                       grid->offset * c;
+               if (grid->windowed)
+                  value *= window(i, grid->sizes[0]) *
+                           window(j, grid->sizes[1]) *
+                           window(k, grid->sizes[2]);
+
+               if (grid->vector_first)
+                  set_volume_real_value(volume, c, i, j, k, 0, value);
+               else
+                  set_volume_real_value(volume, i, j, k, c, 0, value);
+            }
+
+   return volume;
+}
+
+void make_test_grid_transform(VIO_General_transform *transform,
+                              const test_grid *grid)
+{
+   VIO_Volume volume;
+
+   volume = make_test_displacements(grid);
+   create_grid_transform(transform, volume, NULL);
+   delete_volume(volume);
+}
+
+void make_test_thin_plate_transform(VIO_General_transform *transform,
+                                    int n_landmarks, VIO_Real weight_scale,
+                                    VIO_Real skew)
+{
+   VIO_Real landmarks[N_LANDMARKS][VIO_N_DIMENSIONS] = {
+      { -20.0, -15.0, -10.0 }, { 20.0, -10.0, 5.0 }, { 0.0, 25.0, -5.0 },
+      { -10.0, 5.0, 20.0 }, { 15.0, 15.0, 15.0 }, { 5.0, -20.0, 10.0 } };
+   VIO_Real weights[N_LANDMARKS + VIO_N_DIMENSIONS + 1][VIO_N_DIMENSIONS];
+   VIO_Real *landmark_ptrs[N_LANDMARKS];
+   VIO_Real *weight_ptrs[N_LANDMARKS + VIO_N_DIMENSIONS + 1];
+   int p, d;
+
+   if (n_landmarks > N_LANDMARKS)
+      n_landmarks = N_LANDMARKS;
+
+   for (p = 0; p < n_landmarks; p++) {
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         weights[p][d] = weight_scale * sin(p + 2.0 * d);
+      landmark_ptrs[p] = landmarks[p];
+   }
+   for (d = 0; d < VIO_N_DIMENSIONS; d++) {
+      weights[n_landmarks][d] = 0.5 * d;
+      for (p = 0; p < VIO_N_DIMENSIONS; p++)
+         weights[n_landmarks + 1 + p][d] = (p == d) ? 1.0 + skew :
+                                           0.4 * skew * (d - p);
+   }
+   for (p = 0; p < n_landmarks + VIO_N_DIMENSIONS + 1; p++)
+      weight_ptrs[p] = weights[p];
+
+   create_thin_plate_transform_real(transform, VIO_N_DIMENSIONS, n_landmarks,
+                                    landmark_ptrs, weight_ptrs);
+}
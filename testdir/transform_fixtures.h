@@ -0,0 +1,48 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_fixtures.h
+@INPUT      :
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Grid and thin plate spline transforms shared by the transform
+              tests.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#ifndef TRANSFORM_FIXTURES_H
+#define TRANSFORM_FIXTURES_H
+
+#include <volume_io.h>
+
+/* A displacement field sampled on a grid, the wave
+      amplitude * sin(f[0] * i + f[1] * c) * cos(f[2] * j - f[3] * k)
+      + offset * c
+   at the z, y, x indices i, j, k of each node and component c, optionally
+   tapered to zero at the edges of the grid */
+typedef struct {
+   nc_type type;                        /* integer types are scaled to fit */
+   VIO_BOOL vector_first;               /* or last */
+   int sizes[VIO_N_DIMENSIONS];         /* z, y, x */
+   VIO_Real starts[VIO_N_DIMENSIONS];
+   VIO_Real steps[VIO_N_DIMENSIONS];
+   VIO_Real amplitude;
+   VIO_Real frequencies[4];
+   VIO_Real offset;
+   VIO_BOOL windowed;
+} test_grid;
+
+VIO_Volume make_test_displacements(const test_grid *grid);
+
+void make_test_grid_transform(VIO_General_transform *transform,
+                              const test_grid *grid);
+
+/* A 3D thin plate spline on the first n_landmarks (at most 6) of a fixed
+   set, with weights weight_scale * sin(p + 2 d) and a linear part with
+   1 + skew on the diagonal */
+void make_test_thin_plate_transform(VIO_General_transform *transform,
+                                    int n_landmarks, VIO_Real weight_scale,
+                                    VIO_Real skew);
+
+#endif
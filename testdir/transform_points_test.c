@@ -0,0 +1,269 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_points_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Transforms arrays of points with general_transform_points()
+              and general_inverse_transform_points() by each kind of
+              transform, by a concatenation of all of them and by nested
+              and inverted concatenations, in place and into another array,
+              and checks the results are those of general_transform_point()
+              and general_inverse_transform_point(), also for a
+              concatenation that fails for one point of the batch.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_POINTS 300
+#define N_BATCH 40
+
+static const test_grid grid_spec = {
+   NC_FLOAT, FALSE, { 9, 10, 11 }, { -32.0, -36.0, -40.0 }, { 8.0, 8.0, 8.0 },
+   2.0, { 0.4, 0.3, 0.3, 0.2 }, 0.0, FALSE };
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real transformed[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real in_place[N_POINTS][VIO_N_DIMENSIONS];
+
+static void scale_point(void *user_data, VIO_Real x, VIO_Real y, VIO_Real z,
+                        VIO_Real *x_trans, VIO_Real *y_trans,
+                        VIO_Real *z_trans)
+{
+   VIO_Real scale = *(VIO_Real *) user_data;
+
+   *x_trans = scale * x;
+   *y_trans = scale * y + 1.0;
+   *z_trans = scale * z;
+}
+
+static void unscale_point(void *user_data, VIO_Real x, VIO_Real y, VIO_Real z,
+                          VIO_Real *x_trans, VIO_Real *y_trans,
+                          VIO_Real *z_trans)
+{
+   VIO_Real scale = *(VIO_Real *) user_data;
+
+   *x_trans = x / scale;
+   *y_trans = (y - 1.0) / scale;
+   *z_trans = z / scale;
+}
+
+/* Transforms the points both ways with the batched calls, in place and not,
+   and compares with the point by point calls */
+static int check_transform(VIO_General_transform *transform, const char *what)
+{
+   VIO_Real x, y, z;
+   int p, d, inverse;
+   int errors = 0;
+   VIO_Status status, in_place_status;
+
+   for (inverse = 0; inverse < 2; inverse++) {
+      for (p = 0; p < N_POINTS; p++)
+         for (d = 0; d < VIO_N_DIMENSIONS; d++)
+            in_place[p][d] = points[p][d];
+
+      if (inverse) {
+         status = general_inverse_transform_points(transform, N_POINTS,
+                                                   points, transformed);
+         in_place_status = general_inverse_transform_points(
+                              transform, N_POINTS, in_place, in_place);
+      }
+      else {
+         status = general_transform_points(transform, N_POINTS, points,
+                                           transformed);
+         in_place_status = general_transform_points(transform, N_POINTS,
+                                                    in_place, in_place);
+      }
+      if (status != VIO_OK || in_place_status != VIO_OK) {
+         fprintf(stderr, "%s: transforming %s failed\n", what,
+                 inverse ? "inverse" : "forward");
+         errors++;
+         continue;
+      }
+
+      for (p = 0; p < N_POINTS; p++) {
+         if (inverse)
+            general_inverse_transform_point(transform, points[p][0],
+                                            points[p][1], points[p][2],
+                                            &x, &y, &z);
+         else
+            general_transform_point(transform, points[p][0], points[p][1],
+                                    points[p][2], &x, &y, &z);
+
+         if (x != transformed[p][0] || y != transformed[p][1] ||
+             z != transformed[p][2] || x != in_place[p][0] ||
+             y != in_place[p][1] || z != in_place[p][2]) {
+            if (errors < 5)
+               fprintf(stderr, "%s %s: point %d is %.17g %.17g %.17g, "
+                       "%.17g %.17g %.17g in place, %.17g %.17g %.17g "
+                       "alone\n", what, inverse ? "inverse" : "forward", p,
+                       transformed[p][0], transformed[p][1],
+                       transformed[p][2], in_place[p][0], in_place[p][1],
+                       in_place[p][2], x, y, z);
+            errors++;
+         }
+      }
+   }
+   return errors;
+}
+
+/* Transforms a batch of points of which one fails in the inverse thin plate
+   spline in the middle of the concatenation, checking that the batch fails
+   but that every point, the failed one too, comes out as it does alone */
+static int check_failing_point(VIO_General_transform *linear)
+{
+   VIO_General_transform folded, inverted_folded, first, chain;
+   VIO_Real batch[N_BATCH][VIO_N_DIMENSIONS], x, y, z;
+   VIO_Real alone[N_BATCH][VIO_N_DIMENSIONS];
+   int good[N_BATCH], p, d, n_good, failed, source;
+   int errors = 0;
+
+   /* weights large enough for the spline to fold over a few points */
+   make_test_thin_plate_transform(&folded, 6, 1.0, 0.0);
+   create_inverse_general_transform(&folded, &inverted_folded);
+   concat_general_transforms(linear, &inverted_folded, &first);
+   concat_general_transforms(&first, linear, &chain);
+
+   /* the first point that fails, in the middle of points that do not */
+   failed = -1;
+   n_good = 0;
+   for (p = 0; p < N_POINTS; p++) {
+      if (general_transform_point(&chain, points[p][0], points[p][1],
+                                  points[p][2], &x, &y, &z) != VIO_OK) {
+         if (failed < 0)
+            failed = p;
+      }
+      else if (n_good < N_BATCH - 1)
+         good[n_good++] = p;
+   }
+
+   if (failed >= 0 && n_good == N_BATCH - 1) {
+      for (p = 0; p < N_BATCH; p++) {
+         if (p == N_BATCH / 2)
+            source = failed;
+         else
+            source = good[p < N_BATCH / 2 ? p : p - 1];
+         for (d = 0; d < VIO_N_DIMENSIONS; d++)
+            batch[p][d] = points[source][d];
+         general_transform_point(&chain, batch[p][0], batch[p][1],
+                                 batch[p][2], &alone[p][0], &alone[p][1],
+                                 &alone[p][2]);
+      }
+   }
+
+   if (failed < 0 || n_good < N_BATCH - 1) {
+      fprintf(stderr, "failing point: no point fails alone\n");
+      errors++;
+   }
+   else if (general_transform_points(&chain, N_BATCH, batch, batch) !=
+            VIO_ERROR) {
+      fprintf(stderr, "failing point: the batch did not fail\n");
+      errors++;
+   }
+   else {
+      for (p = 0; p < N_BATCH; p++) {
+         if (batch[p][0] != alone[p][0] || batch[p][1] != alone[p][1] ||
+             batch[p][2] != alone[p][2]) {
+            if (errors < 5)
+               fprintf(stderr, "failing point: point %d%s is %.17g %.17g "
+                       "%.17g, %.17g %.17g %.17g alone\n", p,
+                       p == N_BATCH / 2 ? " (failed)" : "", batch[p][0],
+                       batch[p][1], batch[p][2], alone[p][0], alone[p][1],
+                       alone[p][2]);
+            errors++;
+         }
+      }
+   }
+
+   delete_general_transform(&chain);
+   delete_general_transform(&first);
+   delete_general_transform(&inverted_folded);
+   delete_general_transform(&folded);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_Transform matrix;
+   VIO_General_transform linear, projective, grid, tps, user, inverted_grid;
+   VIO_General_transform first, all, nested, inverted;
+   VIO_Real scale = 1.1;
+   int p, d;
+   int errors = 0;
+
+   srand(4321);
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         points[p][d] = -45.0 + 90.0 * rand() / (VIO_Real) RAND_MAX;
+
+   make_identity_transform(&matrix);
+   Transform_elem(matrix, 0, 0) = cos(0.3);
+   Transform_elem(matrix, 0, 1) = -sin(0.3);
+   Transform_elem(matrix, 1, 0) = sin(0.3);
+   Transform_elem(matrix, 1, 1) = cos(0.3);
+   Transform_elem(matrix, 0, 3) = 2.5;
+   Transform_elem(matrix, 2, 3) = -1.25;
+   create_linear_transform(&linear, &matrix);
+
+   make_identity_transform(&matrix);
+   Transform_elem(matrix, 0, 2) = 0.2;
+   Transform_elem(matrix, 3, 0) = 0.002;
+   create_linear_transform(&projective, &matrix);
+
+   make_test_grid_transform(&grid, &grid_spec);
+   make_test_thin_plate_transform(&tps, 6, 0.02, 0.0);
+   create_user_transform(&user, &scale, sizeof(scale), scale_point,
+                         unscale_point);
+   create_inverse_general_transform(&grid, &inverted_grid);
+
+   errors += check_transform(&linear, "linear");
+   errors += check_transform(&projective, "projective");
+   errors += check_transform(&grid, "grid");
+   errors += check_transform(&inverted_grid, "inverted grid");
+   errors += check_transform(&tps, "thin plate spline");
+   errors += check_transform(&user, "user");
+
+   concat_general_transforms(&linear, &grid, &first);
+   concat_general_transforms(&first, &tps, &all);
+   concat_general_transforms(&all, &user, &first);
+   delete_general_transform(&all);
+   concat_general_transforms(&first, &projective, &all);
+   delete_general_transform(&first);
+   errors += check_transform(&all, "concatenated");
+
+   /* a concatenation holding an inverted concatenation */
+   create_inverse_general_transform(&all, &inverted);
+   concat_general_transforms(&inverted_grid, &inverted, &first);
+   concat_general_transforms(&linear, &first, &nested);
+   errors += check_transform(&nested, "nested");
+   errors += check_failing_point(&linear);
+
+   delete_general_transform(&nested);
+   delete_general_transform(&first);
+   delete_general_transform(&inverted);
+   delete_general_transform(&all);
+   delete_general_transform(&inverted_grid);
+   delete_general_transform(&user);
+   delete_general_transform(&tps);
+   delete_general_transform(&grid);
+   delete_general_transform(&projective);
+   delete_general_transform(&linear);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
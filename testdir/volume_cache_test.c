@@ -0,0 +1,375 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : volume_cache_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Reads a chunked MINC2 file into a cached volume that is too
+              small to hold it, checks that the cache blocks follow the
+              HDF5 chunks and that every voxel is read correctly, then
+              modifies the volume, writes it out and reads it back whole.
+              The reads and writes are also done from several threads at
+              once, so that the cache shards are shared between threads,
+              and blocks missed at a constant stride must be read ahead.
+              Each eviction policy is checked against the statistics, and
+              evicted blocks must be found in the compressed tier.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <volume_io.h>
+#include "minc_parallel.h"
+
+#define NZ 20
+#define NY 36
+#define NX 44
+
+#define CZ 8
+#define CY 16
+#define CX 16
+
+static short voxels[NZ][NY][NX];
+
+static VIO_Volume shared_volume;
+
+static int create_file(const char *filename)
+{
+   static char *dimnames[] = { "zspace", "yspace", "xspace" };
+   misize_t sizes[3] = { NZ, NY, NX };
+   misize_t start[3] = { 0, 0, 0 };
+   int chunk[3] = { CZ, CY, CX };
+   midimhandle_t dims[3];
+   mivolumeprops_t props;
+   mihandle_t hvol;
+   int i;
+
+   if (minew_volume_props(&props) < 0 ||
+       miset_props_compression_type(props, MI_COMPRESS_ZLIB) < 0 ||
+       miset_props_zlib_compression(props, 1) < 0 ||
+       miset_props_blocking(props, 3, chunk) < 0) {
+      return VIO_ERROR;
+   }
+
+   for (i = 0; i < 3; i++) {
+      if (micreate_dimension(dimnames[i], MI_DIMCLASS_SPATIAL,
+                             MI_DIMATTR_REGULARLY_SAMPLED, sizes[i],
+                             &dims[i]) < 0) {
+         return VIO_ERROR;
+      }
+   }
+
+   if (micreate_volume(filename, 3, dims, MI_TYPE_SHORT, MI_CLASS_REAL,
+                       props, &hvol) < 0 ||
+       micreate_volume_image(hvol) < 0 ||
+       miset_volume_valid_range(hvol, 1000.0, -1000.0) < 0 ||
+       miset_volume_range(hvol, 1000.0, -1000.0) < 0 ||
+       miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, sizes,
+                                   voxels) < 0) {
+      return VIO_ERROR;
+   }
+
+   mifree_volume_props(props);
+   miclose_volume(hvol);
+   return VIO_OK;
+}
+
+/* Visits every voxel, jumping between blocks so that the cache has to
+   evict and re-read them */
+static int check_volume(VIO_Volume volume, int negate_every, const char *what)
+{
+   int i, j, k, n, errors = 0;
+   double value, expected;
+
+   for (n = 0; n < NZ * NY * NX; n++) {
+      i = (n * 7) % NZ;
+      j = (n * 13) % NY;
+      k = n % NX;
+      value = get_volume_real_value(volume, i, j, k, 0, 0);
+      expected = voxels[i][j][k];
+      if (negate_every > 0 && i % negate_every == 0) {
+         expected = -expected;
+      }
+      if (fabs(value - expected) > 1.0e-3) {
+         if (errors < 10) {
+            fprintf(stderr, "%s: voxel %d,%d,%d is %g, expected %g\n",
+                    what, i, j, k, value, expected);
+         }
+         errors++;
+      }
+   }
+   return errors;
+}
+
+/* Parallel read of the z-slices [first, last) */
+static int check_slices(long first, long last, int thread, void *data)
+{
+   long i;
+   int j, k;
+
+   for (i = first; i < last; i++)
+      for (k = 0; k < NX; k++)
+         for (j = 0; j < NY; j++)
+            if (get_volume_real_value(shared_volume, (int) i, j, k, 0, 0) !=
+                voxels[i][j][k]) {
+               return MI_ERROR;
+            }
+   return MI_NOERROR;
+}
+
+/* Parallel negation of every third z-slice in [first, last) */
+static int negate_slices(long first, long last, int thread, void *data)
+{
+   long i;
+   int j, k;
+
+   for (i = first; i < last; i++)
+      if (i % 3 == 0)
+         for (j = 0; j < NY; j++)
+            for (k = 0; k < NX; k++)
+               set_volume_real_value(shared_volume, (int) i, j, k, 0, 0,
+                                     -voxels[i][j][k]);
+   return MI_NOERROR;
+}
+
+/* Misses the first three blocks of the first row of blocks, then waits
+   for the read-ahead thread to bring in the next one and uses it */
+static int check_prefetch(VIO_Volume volume)
+{
+   long n_prefetched, n_useful;
+   int tries, errors = 0;
+
+   set_volume_cache_prefetch_blocks(volume, 4);
+
+   errors += get_volume_real_value(volume, 0, 0, 0, 0, 0) != voxels[0][0][0];
+   errors += get_volume_real_value(volume, 0, 0, CX, 0, 0) != voxels[0][0][CX];
+   errors += get_volume_real_value(volume, 0, 0, 2 * CX, 0, 0) !=
+      voxels[0][0][2 * CX];
+
+   for (tries = 0; tries < 1000; tries++) {
+      get_volume_cache_prefetch_stats(volume, &n_prefetched, &n_useful);
+      if (n_prefetched > 0)
+         break;
+      usleep(10000);
+   }
+
+   errors += get_volume_real_value(volume, 0, CY, 0, 0, 0) != voxels[0][CY][0];
+
+   get_volume_cache_prefetch_stats(volume, &n_prefetched, &n_useful);
+   if (n_prefetched < 1 || n_useful != 1) {
+      fprintf(stderr, "%ld blocks read ahead, %ld used, expected 1 used\n",
+              n_prefetched, n_useful);
+      errors++;
+   }
+   return errors;
+}
+
+/* Reads the first voxel of the block with the given index */
+static void touch_block(VIO_Volume volume, int block)
+{
+   (void) get_volume_real_value(volume, (block / 9) * CZ, (block / 3 % 3) * CY,
+                                (block % 3) * CX, 0, 0);
+}
+
+/* Checks the statistics of each eviction policy, and that 2Q keeps a
+   block used twice through a scan of the whole volume while LRU does not.
+   Block 4 is in the same shard as block 0 for any power of two shards up
+   to 4, so that the second use of block 0 is not a previous-block hit */
+static int check_policies(VIO_Volume volume)
+{
+   static VIO_Cache_eviction_policy policies[] = {
+      LRU_CACHE_EVICTION, CLOCK_CACHE_EVICTION, TWO_QUEUE_CACHE_EVICTION };
+   static char *names[] = { "LRU", "CLOCK", "2Q" };
+   VIO_volume_cache_stats stats;
+   long n_misses;
+   int p, block, errors = 0;
+
+   set_volume_cache_prefetch_blocks(volume, 0);
+
+   for (p = 0; p < 3; p++) {
+      set_volume_cache_eviction_policy(volume, policies[p]);
+      reset_volume_cache_stats(volume);
+
+      errors += check_volume(volume, 0, names[p]);
+
+      get_volume_cache_stats(volume, &stats);
+      if (stats.n_hits + stats.n_previous_block_hits + stats.n_misses !=
+          NZ * NY * NX || stats.n_misses < 27 ||
+          stats.n_evictions > stats.n_misses ||
+          stats.n_bytes_read < NZ * NY * NX * sizeof(short) ||
+          stats.n_dirty_writes != 0) {
+         fprintf(stderr, "%s: wrong statistics: %ld hits, %ld previous, "
+                 "%ld misses, %ld evictions, %lu bytes read\n", names[p],
+                 stats.n_hits, stats.n_previous_block_hits, stats.n_misses,
+                 stats.n_evictions, (unsigned long) stats.n_bytes_read);
+         errors++;
+      }
+
+      set_volume_cache_eviction_policy(volume, policies[p]);
+      touch_block(volume, 0);
+      touch_block(volume, 4);
+      touch_block(volume, 0);
+      for (block = 1; block < 27; block++)
+         touch_block(volume, block);
+
+      get_volume_cache_stats(volume, &stats);
+      n_misses = stats.n_misses;
+      touch_block(volume, 0);
+      get_volume_cache_stats(volume, &stats);
+
+      if ((policies[p] == TWO_QUEUE_CACHE_EVICTION &&
+           stats.n_misses != n_misses) ||
+          (policies[p] == LRU_CACHE_EVICTION &&
+           stats.n_misses != n_misses + 1)) {
+         fprintf(stderr, "%s: block used twice was %s by a scan\n", names[p],
+                 (stats.n_misses == n_misses) ? "kept" : "evicted");
+         errors++;
+      }
+   }
+
+   set_volume_cache_eviction_policy(volume, LRU_CACHE_EVICTION);
+   return errors;
+}
+
+/* Turns on a compressed tier large enough for the whole volume, so that
+   each block is read from the file at most once */
+static int check_compressed_tier(VIO_Volume volume)
+{
+   VIO_volume_cache_stats stats;
+   int errors;
+
+   set_volume_cache_compressed_bytes(volume, (size_t) NZ * NY * NX *
+                                     sizeof(short));
+   reset_volume_cache_stats(volume);
+
+   errors = check_volume(volume, 0, "Compressed tier");
+
+   get_volume_cache_stats(volume, &stats);
+   if (stats.n_compressed_hits < 1 ||
+       stats.n_bytes_read > 27 * CZ * CY * CX * sizeof(short) ||
+       stats.n_compressed_bytes == 0) {
+      fprintf(stderr, "Compressed tier: %ld hits, %lu bytes held, "
+              "%lu bytes read\n", stats.n_compressed_hits,
+              (unsigned long) stats.n_compressed_bytes,
+              (unsigned long) stats.n_bytes_read);
+      errors++;
+   }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   char filename[256], outname[256];
+   VIO_Volume volume;
+   int i, j, k;
+   int errors = 0;
+
+   for (i = 0; i < NZ; i++)
+      for (j = 0; j < NY; j++)
+         for (k = 0; k < NX; k++)
+            voxels[i][j][k] =
+               (short) ((i * 977 + j * 31 + k * 7) % 2001 - 1000);
+
+   snprintf(filename, sizeof(filename), "test_volume_cache-%d.mnc", getpid());
+   snprintf(outname, sizeof(outname), "test_volume_cache-out-%d.mnc",
+            getpid());
+
+   if (create_file(filename) != VIO_OK) {
+      fprintf(stderr, "Unable to create %s\n", filename);
+      return 1;
+   }
+
+   /* Sizes beyond 2 gigabytes are kept by the size_t interface, and
+      clamped by the int one */
+   set_default_max_bytes_in_cache_size((size_t) 3 << 30);
+   if (get_default_max_bytes_in_cache_size() != (size_t) 3 << 30 ||
+       get_default_max_bytes_in_cache() != INT_MAX) {
+      fprintf(stderr, "Cache size above 2 gigabytes was not kept\n");
+      errors++;
+   }
+
+   /* Cache every volume, with room for 16 of the 27 blocks */
+   set_n_bytes_cache_threshold(0);
+   set_default_max_bytes_in_cache(16 * CZ * CY * CX * sizeof(short));
+
+   if (input_volume(filename, 3, NULL, MI_ORIGINAL_TYPE, FALSE, 0.0, 0.0,
+                    TRUE, &volume, NULL) != VIO_OK) {
+      fprintf(stderr, "Unable to read %s\n", filename);
+      unlink(filename);
+      return 1;
+   }
+
+   if (!volume_is_cached(volume)) {
+      fprintf(stderr, "Volume was not cached\n");
+      errors++;
+   }
+   else if (volume->cache.block_sizes[0] != CZ ||
+            volume->cache.block_sizes[1] != CY ||
+            volume->cache.block_sizes[2] != CX) {
+      fprintf(stderr, "Cache blocks are %d x %d x %d, expected the chunk "
+              "shape %d x %d x %d\n", volume->cache.block_sizes[0],
+              volume->cache.block_sizes[1], volume->cache.block_sizes[2],
+              CZ, CY, CX);
+      errors++;
+   }
+
+#ifdef HAVE_PTHREAD
+   errors += check_prefetch(volume);
+#endif
+   errors += check_policies(volume);
+   errors += check_compressed_tier(volume);
+
+   errors += check_volume(volume, 0, "Cached read");
+
+   shared_volume = volume;
+   if (miparallel_for(NZ, 1, check_slices, NULL) != MI_NOERROR) {
+      fprintf(stderr, "Parallel cached read gave wrong values\n");
+      errors++;
+   }
+
+   /* Modifying the volume moves it to a temporary file */
+   miparallel_for(NZ, 1, negate_slices, NULL);
+
+   errors += check_volume(volume, 3, "Cached write");
+
+   if (output_volume(outname, NC_SHORT, TRUE, 0.0, 0.0, volume,
+                     "volume_cache_test", NULL) != VIO_OK) {
+      fprintf(stderr, "Unable to write %s\n", outname);
+      errors++;
+   }
+   delete_volume(volume);
+
+   /* Read the result back without the cache */
+   set_n_bytes_cache_threshold(-1);
+   if (input_volume(outname, 3, NULL, MI_ORIGINAL_TYPE, FALSE, 0.0, 0.0,
+                    TRUE, &volume, NULL) != VIO_OK) {
+      fprintf(stderr, "Unable to read %s\n", outname);
+      errors++;
+   }
+   else {
+      errors += check_volume(volume, 3, "Written volume");
+      delete_volume(volume);
+   }
+
+   unlink(filename);
+   unlink(outname);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return (errors != 0);
+}
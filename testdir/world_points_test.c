@@ -0,0 +1,168 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : world_points_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Checks the conversions between voxel and world coordinates
+              against the voxel to world transform of the volume, after
+              each geometry setter, for a 4D volume, a 2D volume and a
+              projective transform, and checks that the batched conversions
+              give the same results as the point by point ones.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#define N_POINTS 257
+
+static VIO_Real voxels[N_POINTS][VIO_MAX_DIMENSIONS];
+static VIO_Real world[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real batch_voxels[N_POINTS][VIO_MAX_DIMENSIONS];
+static VIO_Real batch_world[N_POINTS][VIO_N_DIMENSIONS];
+
+/* Converts random points both ways, one at a time and batched, and checks
+   them against the voxel to world transform of the volume */
+static int check_points(VIO_Volume volume, const char *what)
+{
+   VIO_General_transform *transform;
+   VIO_Real xyz[VIO_N_DIMENSIONS], x, y, z, voxel[VIO_MAX_DIMENSIONS];
+   int p, c, d, n_dims;
+   int errors = 0;
+
+   n_dims = get_volume_n_dimensions(volume);
+   transform = get_voxel_to_world_transform(volume);
+
+   for (p = 0; p < N_POINTS; p++) {
+      for (d = 0; d < VIO_MAX_DIMENSIONS; d++)
+         voxels[p][d] = (d < n_dims) ?
+            -5.0 + 40.0 * rand() / (VIO_Real) RAND_MAX : 0.0;
+   }
+
+   convert_voxel_to_world_points(volume, N_POINTS, voxels, batch_world);
+
+   for (p = 0; p < N_POINTS; p++) {
+      convert_voxel_to_world(volume, voxels[p], &world[p][VIO_X],
+                             &world[p][VIO_Y], &world[p][VIO_Z]);
+
+      reorder_voxel_to_xyz(volume, voxels[p], xyz);
+      general_transform_point(transform, xyz[VIO_X], xyz[VIO_Y], xyz[VIO_Z],
+                              &x, &y, &z);
+      if (world[p][VIO_X] != x || world[p][VIO_Y] != y ||
+          world[p][VIO_Z] != z) {
+         if (errors < 5)
+            fprintf(stderr, "%s: world %g %g %g, transform gives %g %g %g\n",
+                    what, world[p][VIO_X], world[p][VIO_Y], world[p][VIO_Z],
+                    x, y, z);
+         errors++;
+      }
+      for (c = 0; c < VIO_N_DIMENSIONS; c++) {
+         if (batch_world[p][c] != world[p][c]) {
+            if (errors < 5)
+               fprintf(stderr, "%s: batched world %d is %.17g, not %.17g\n",
+                       what, c, batch_world[p][c], world[p][c]);
+            errors++;
+         }
+      }
+   }
+
+   convert_world_to_voxel_points(volume, N_POINTS, world, batch_voxels);
+
+   for (p = 0; p < N_POINTS; p++) {
+      convert_world_to_voxel(volume, world[p][VIO_X], world[p][VIO_Y],
+                             world[p][VIO_Z], voxel);
+
+      general_inverse_transform_point(transform, world[p][VIO_X],
+                                      world[p][VIO_Y], world[p][VIO_Z],
+                                      &xyz[VIO_X], &xyz[VIO_Y], &xyz[VIO_Z]);
+      for (c = 0; c < VIO_N_DIMENSIONS; c++) {
+         d = volume->spatial_axes[c];
+         if (d >= 0 && voxel[d] != xyz[c]) {
+            if (errors < 5)
+               fprintf(stderr, "%s: voxel %d is %.17g, transform gives "
+                       "%.17g\n", what, d, voxel[d], xyz[c]);
+            errors++;
+         }
+      }
+      for (d = 0; d < n_dims; d++) {
+         if (batch_voxels[p][d] != voxel[d]) {
+            if (errors < 5)
+               fprintf(stderr, "%s: batched voxel %d is %.17g, not %.17g\n",
+                       what, d, batch_voxels[p][d], voxel[d]);
+            errors++;
+         }
+         if (fabs(voxel[d] - voxels[p][d]) > 1e-9 &&
+             (d == volume->spatial_axes[VIO_X] ||
+              d == volume->spatial_axes[VIO_Y] ||
+              d == volume->spatial_axes[VIO_Z])) {
+            if (errors < 5)
+               fprintf(stderr, "%s: voxel %d goes back to %.17g, not %.17g\n",
+                       what, d, voxel[d], voxels[p][d]);
+            errors++;
+         }
+      }
+   }
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   static VIO_STR names4[] = { MItime, MIzspace, MIyspace, MIxspace };
+   static VIO_STR names2[] = { MIxspace, MIzspace };
+   VIO_Real starts[VIO_MAX_DIMENSIONS] = { 3.0, -10.5, 20.25, -7.0, 0.0 };
+   VIO_Real steps[VIO_MAX_DIMENSIONS] = { 2.0, 1.5, -0.75, 1.25, 0.0 };
+   VIO_Real cosine[VIO_N_DIMENSIONS] = { 0.1, 0.98, -0.05 };
+   VIO_Volume volume;
+   VIO_Transform projective;
+   VIO_General_transform transform;
+   int errors = 0;
+
+   srand(1234);
+
+   volume = create_volume(4, names4, NC_SHORT, TRUE, 0.0, 0.0);
+   errors += check_points(volume, "identity");
+
+   set_volume_starts(volume, starts);
+   errors += check_points(volume, "starts");
+
+   set_volume_separations(volume, steps);
+   errors += check_points(volume, "separations");
+
+   set_volume_direction_cosine(volume, 2, cosine);
+   errors += check_points(volume, "direction cosine");
+
+   make_identity_transform(&projective);
+   Transform_elem(projective, 0, 1) = 0.3;
+   Transform_elem(projective, 1, 3) = 4.0;
+   Transform_elem(projective, 2, 2) = 2.0;
+   create_linear_transform(&transform, &projective);
+   set_voxel_to_world_transform(volume, &transform);
+   errors += check_points(volume, "set transform");
+
+   Transform_elem(projective, 3, 0) = 0.01;
+   create_linear_transform(&transform, &projective);
+   set_voxel_to_world_transform(volume, &transform);
+   errors += check_points(volume, "projective");
+   delete_volume(volume);
+
+   volume = create_volume(2, names2, NC_FLOAT, FALSE, 0.0, 0.0);
+   set_volume_starts(volume, starts);
+   set_volume_separations(volume, steps);
+   errors += check_points(volume, "2D");
+   delete_volume(volume);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
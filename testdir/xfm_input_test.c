@@ -0,0 +1,428 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : xfm_input_test
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of errors (0 on success)
+@DESCRIPTION: Writes a transform file concatenating a linear, an inverted thin
+              plate spline and a grid transform, and checks that it is input
+              with exactly the values written, with and without the binary
+              cache of transform files, that the cache is only written for
+              files which have not just been modified, that it is read when
+              it is up to date and ignored when it is damaged or the file has
+              changed.  Also checks mni_scan_real() against strtod().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <time.h>
+#include <math.h>
+
+#include <volume_io.h>
+
+#include "transform_fixtures.h"
+
+#define N_LANDMARKS 40
+#define N_POINTS 100
+
+static char xfm_filename[256];
+static char cache_filename[sizeof(xfm_filename) + sizeof(".cache")];
+static char grid_filename[256];
+static char volume_filename[256];
+
+static VIO_Real points[N_POINTS][VIO_N_DIMENSIONS];
+static VIO_Real expected[N_POINTS][VIO_N_DIMENSIONS];
+
+/* The values written, all exactly representable in a few decimal digits */
+static VIO_Real linear_value(int i, int j, VIO_Real translation)
+{
+   if (j == 3)
+      return (i == 0) ? translation : -1.5 * i;
+   return (i == j) ? 1.0 + 0.25 * i : 0.125 * (i - j);
+}
+
+static VIO_Real landmark_value(int p, int d)
+{
+   return ((p * 7919 + d * 104729) % 120001 - 60000) / 1000.0;
+}
+
+static VIO_Real weight_value(int p, int d)
+{
+   if (p < N_LANDMARKS)
+      return ((p * 31 + d * 17) % 201 - 100) / 1e7;
+   if (p == N_LANDMARKS)
+      return 0.5 * (d + 1);
+   return (p - N_LANDMARKS - 1 == d) ? 1.0 : 0.0;
+}
+
+static void write_grid_volume(void)
+{
+   static const test_grid grid_spec = {
+      NC_DOUBLE, TRUE, { 8, 9, 10 }, { -40.0, -45.0, -50.0 },
+      { 10.0, 10.0, 10.0 }, 1.5, { 0.5, 0.3, 0.4, 0.3 }, 0.0, FALSE };
+   VIO_General_transform grid;
+
+   make_test_grid_transform(&grid, &grid_spec);
+   output_transform_file(grid_filename, NULL, &grid);
+   delete_general_transform(&grid);
+   unlink(grid_filename);
+}
+
+/* Writes the transform file by hand, in several number formats, and dates
+   it age seconds ago */
+static void write_xfm(VIO_Real translation, int age)
+{
+   struct utimbuf times;
+   FILE *file;
+   int i, j, p, d, value;
+
+   file = fopen(xfm_filename, "w");
+   fprintf(file, "MNI Transform File\n%% a test transform\n\n");
+   fprintf(file, "Transform_Type = Linear;\nLinear_Transform =");
+   for (i = 0; i < 3; i++) {
+      fprintf(file, "\n");
+      for (j = 0; j < 4; j++)
+         fprintf(file, " %g", linear_value(i, j, translation));
+   }
+   fprintf(file, ";\n");
+
+   fprintf(file, "Transform_Type = Thin_Plate_Spline_Transform;\n"
+                 "Invert_Flag = True;\nNumber_Dimensions = 3;\nPoints =");
+   for (p = 0; p < N_LANDMARKS; p++) {
+      fprintf(file, "\n");
+      for (d = 0; d < 3; d++) {
+         value = (int) floor(landmark_value(p, d) * 1000.0 + 0.5);
+         if (d == 0)
+            fprintf(file, " %.3f", value / 1000.0);
+         else if (d == 1)
+            fprintf(file, "  %de-3", value);
+         else
+            fprintf(file, " %.5E", value / 1000.0);
+      }
+   }
+   fprintf(file, ";\nDisplacements =");
+   for (p = 0; p < N_LANDMARKS + 4; p++) {
+      fprintf(file, "\n");
+      for (d = 0; d < 3; d++) {
+         if (p < N_LANDMARKS)
+            fprintf(file, " %de-7",
+                    (int) floor(weight_value(p, d) * 1e7 + 0.5));
+         else
+            fprintf(file, " %.17g", weight_value(p, d));
+      }
+   }
+   fprintf(file, ";\n");
+
+   fprintf(file, "Transform_Type = Grid_Transform;\n"
+                 "Displacement_Volume = %s;\n", volume_filename);
+   fclose(file);
+
+   times.actime = times.modtime = time(NULL) - age;
+   utime(xfm_filename, &times);
+}
+
+/* Checks the transform input against the values written */
+static int check_transform(VIO_General_transform *transform,
+                           VIO_Real translation, const char *what)
+{
+   VIO_General_transform *linear, *tps, *grid;
+   VIO_Real x, y, z;
+   int i, j, p, d;
+   int errors = 0;
+
+   if (get_transform_type(transform) != CONCATENATED_TRANSFORM ||
+       get_n_concated_transforms(transform) != 3) {
+      fprintf(stderr, "%s: not a concatenation of three transforms\n", what);
+      return 1;
+   }
+
+   linear = get_nth_general_transform(transform, 0);
+   tps = get_nth_general_transform(transform, 1);
+   grid = get_nth_general_transform(transform, 2);
+
+   if (get_transform_type(linear) != LINEAR || linear->inverse_flag ||
+       get_transform_type(tps) != THIN_PLATE_SPLINE || !tps->inverse_flag ||
+       tps->n_points != N_LANDMARKS || tps->n_dimensions != 3 ||
+       get_transform_type(grid) != GRID_TRANSFORM || grid->inverse_flag ||
+       grid->displacement_volume == NULL) {
+      fprintf(stderr, "%s: wrong types, flags or sizes\n", what);
+      return 1;
+   }
+
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 4; j++) {
+         if (Transform_elem(*linear->linear_transform, i, j) !=
+             ((i == 3) ? (j == 3) : linear_value(i, j, translation))) {
+            fprintf(stderr, "%s: linear element %d %d is %.17g\n", what, i,
+                    j, Transform_elem(*linear->linear_transform, i, j));
+            errors++;
+         }
+      }
+   }
+
+   for (p = 0; p < N_LANDMARKS + 4; p++) {
+      for (d = 0; d < 3; d++) {
+         if ((p < N_LANDMARKS && tps->points[p][d] != landmark_value(p, d)) ||
+             tps->displacements[p][d] != weight_value(p, d)) {
+            if (errors < 5)
+               fprintf(stderr, "%s: landmark %d %d is %.17g, weight %.17g\n",
+                       what, p, d, p < N_LANDMARKS ? tps->points[p][d] : 0.0,
+                       tps->displacements[p][d]);
+            errors++;
+         }
+      }
+   }
+
+   /* the points were transformed with the first translation */
+   for (p = 0; translation == 12.5 && p < N_POINTS; p++) {
+      general_transform_point(transform, points[p][0], points[p][1],
+                              points[p][2], &x, &y, &z);
+      if (x != expected[p][0] || y != expected[p][1] || z != expected[p][2]) {
+         if (errors < 5)
+            fprintf(stderr, "%s: point %d is %.17g %.17g %.17g\n", what, p,
+                    x, y, z);
+         errors++;
+      }
+   }
+
+   return errors;
+}
+
+static int check_input(VIO_Real translation, const char *what)
+{
+   VIO_General_transform transform;
+   int errors;
+
+   if (input_transform_file(xfm_filename, &transform) != VIO_OK) {
+      fprintf(stderr, "%s: cannot input %s\n", what, xfm_filename);
+      return 1;
+   }
+   errors = check_transform(&transform, translation, what);
+   delete_general_transform(&transform);
+   return errors;
+}
+
+static long file_size(const char *filename)
+{
+   FILE *file;
+   long size;
+
+   if ((file = fopen(filename, "rb")) == NULL)
+      return -1;
+   fseek(file, 0, SEEK_END);
+   size = ftell(file);
+   fclose(file);
+   return size;
+}
+
+/* Replaces the first occurrence of a double in the cache, in place */
+static int patch_cache(VIO_Real old_value, VIO_Real new_value)
+{
+   FILE *file;
+   char *buffer;
+   long size, i;
+   int found = 0;
+
+   size = file_size(cache_filename);
+   if (size <= 0)
+      return 0;
+   buffer = malloc(size);
+   file = fopen(cache_filename, "r+b");
+   if (fread(buffer, 1, size, file) == (size_t) size) {
+      for (i = 0; i + (long) sizeof(VIO_Real) <= size; i++) {
+         if (memcmp(buffer + i, &old_value, sizeof(VIO_Real)) == 0) {
+            fseek(file, i, SEEK_SET);
+            fwrite(&new_value, sizeof(VIO_Real), 1, file);
+            found = 1;
+            break;
+         }
+      }
+   }
+   fclose(file);
+   free(buffer);
+   return found;
+}
+
+static int check_cache(void)
+{
+   VIO_General_transform transform;
+   long size;
+   int errors = 0;
+
+   set_transform_file_cache(TRUE);
+
+   /* just modified, so not cached */
+   unlink(cache_filename);
+   write_xfm(12.5, 0);
+   errors += check_input(12.5, "new file");
+   if (file_size(cache_filename) >= 0) {
+      fprintf(stderr, "a file just modified was cached\n");
+      errors++;
+   }
+
+   write_xfm(12.5, 100);
+   errors += check_input(12.5, "cache written");
+   size = file_size(cache_filename);
+   if (size <= 0) {
+      fprintf(stderr, "no cache written\n");
+      return errors + 1;
+   }
+   errors += check_input(12.5, "cache read");
+
+   /* the cache, not the file, is read while it is up to date */
+   if (!patch_cache(12.5, 99.5)) {
+      fprintf(stderr, "translation not found in the cache\n");
+      errors++;
+   }
+   errors += check_input(99.5, "patched cache");
+
+   /* a damaged cache is ignored and replaced */
+   if (truncate(cache_filename, size - 8) != 0)
+      errors++;
+   errors += check_input(12.5, "truncated cache");
+   if (file_size(cache_filename) != size) {
+      fprintf(stderr, "truncated cache not replaced\n");
+      errors++;
+   }
+
+   /* a file of the same size with another date is read again */
+   write_xfm(13.5, 50);
+   errors += check_input(13.5, "changed file");
+   errors += check_input(13.5, "changed file cache");
+
+   /* without the cache, the file is read */
+   set_transform_file_cache(FALSE);
+   patch_cache(13.5, 99.5);
+   errors += check_input(13.5, "cache off");
+
+   /* errors are still reported */
+   set_transform_file_cache(TRUE);
+   unlink(cache_filename);
+   write_xfm(12.5, 100);
+   if (truncate(xfm_filename, file_size(xfm_filename) / 2) != 0)
+      errors++;
+   if (input_transform_file(xfm_filename, &transform) == VIO_OK) {
+      fprintf(stderr, "truncated file input\n");
+      delete_general_transform(&transform);
+      errors++;
+   }
+   if (file_size(cache_filename) >= 0) {
+      fprintf(stderr, "truncated file cached\n");
+      errors++;
+   }
+   set_transform_file_cache(FALSE);
+
+   return errors;
+}
+
+static int check_scan_real(void)
+{
+   static const struct { const char *str; VIO_Real value; int length; }
+   cases[] = {
+      { "0", 0.0, 1 }, { "-0.5", -0.5, 4 }, { "+2.25;", 2.25, 5 },
+      { "1e3", 1000.0, 3 }, { "-1.5E-2 ", -0.015, 7 }, { ".125", 0.125, 4 },
+      { "7.", 7.0, 2 }, { "3e", 0.0, 0 }, { "4e+", 0.0, 0 },
+      { "123456789012345", 123456789012345.0, 15 },
+      { "x", 0.0, 0 }, { "-", 0.0, 0 }, { ".", 0.0, 0 }, { "", 0.0, 0 }
+   };
+   char str[64];
+   VIO_Real value, random;
+   int i, n;
+   int errors = 0;
+
+   for (i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); i++) {
+      value = -1.0;
+      n = mni_scan_real(cases[i].str, &value);
+      if (n != cases[i].length || (n > 0 && value != cases[i].value)) {
+         fprintf(stderr, "mni_scan_real(\"%s\") is %d, %.17g\n",
+                 cases[i].str, n, value);
+         errors++;
+      }
+   }
+
+   /* whatever it scans must be what strtod() reads */
+   for (i = 0; i < 100000; i++) {
+      random = (rand() / (VIO_Real) RAND_MAX - 0.5) *
+               pow(10.0, rand() % 40 - 20);
+      if (i % 2)
+         snprintf(str, sizeof(str), "%.15g", random);
+      else
+         snprintf(str, sizeof(str), "%.*f", i % 7, random);
+      n = mni_scan_real(str, &value);
+      if (n != 0 && (n != (int) strlen(str) || value != strtod(str, NULL))) {
+         if (errors < 5)
+            fprintf(stderr, "mni_scan_real(\"%s\") is %d, %.17g\n", str, n,
+                    value);
+         errors++;
+      }
+   }
+
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   VIO_General_transform transform;
+   int p, d;
+   int errors = 0;
+
+   srand(2468);
+
+   snprintf(xfm_filename, sizeof(xfm_filename), "test_xfm_input-%d.xfm",
+            getpid());
+   snprintf(cache_filename, sizeof(cache_filename), "%s.cache",
+            xfm_filename);
+   snprintf(grid_filename, sizeof(grid_filename), "test_xfm_grid-%d.xfm",
+            getpid());
+   snprintf(volume_filename, sizeof(volume_filename),
+            "test_xfm_grid-%d_grid_0.mnc", getpid());
+
+   errors += check_scan_real();
+
+   write_grid_volume();
+   write_xfm(12.5, 100);
+
+   for (p = 0; p < N_POINTS; p++)
+      for (d = 0; d < VIO_N_DIMENSIONS; d++)
+         points[p][d] = -40.0 + 80.0 * rand() / (VIO_Real) RAND_MAX;
+
+   set_transform_file_cache(FALSE);
+   if (input_transform_file(xfm_filename, &transform) != VIO_OK) {
+      fprintf(stderr, "cannot input %s\n", xfm_filename);
+      errors++;
+   }
+   else {
+      for (p = 0; p < N_POINTS; p++)
+         general_transform_point(&transform, points[p][0], points[p][1],
+                                 points[p][2], &expected[p][0],
+                                 &expected[p][1], &expected[p][2]);
+      delete_general_transform(&transform);
+
+      errors += check_input(12.5, "text");
+      if (file_size(cache_filename) >= 0) {
+         fprintf(stderr, "cache written while off\n");
+         errors++;
+      }
+
+      errors += check_cache();
+   }
+
+   unlink(xfm_filename);
+   unlink(cache_filename);
+   unlink(volume_filename);
+
+   if (errors == 0) {
+      printf("No errors\n");
+   }
+   return errors != 0;
+}
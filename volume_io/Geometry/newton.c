@@ -19,6 +19,11 @@
 
 #define  STEP_RATIO  1.0
 
+/* --- extrapolate_root_guess() extrapolates no further than this many times
+       the last change in the values */
+
+#define  MAX_EXTRAPOLATION  2.0
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : newton_root_find
 @INPUT      : n_dimensions                - dimensionality of domain and range
@@ -35,12 +40,14 @@
               max_iterations
 @OUTPUT     :
               solution[n_dimensions]
+              n_iterations                - number of evaluations of the
+                                            function, or NULL
 @RETURNS    : TRUE if successful
 @DESCRIPTION: Performs a newton root find of a function by taking steps of
               x' = (desired - f(x)) / grad(f(x)),
               where x starts at initial_guess and
               is updated until the f(x) is close to zero.  x is passed back
-              in solution.
+              in solution, and the number of iterations in n_iterations.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -48,7 +55,7 @@
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  VIO_BOOL  newton_root_find(
+VIOAPI  VIO_BOOL  newton_root_find_with_iterations(
     int    n_dimensions,
     void   (*function) ( void *, VIO_Real [],  VIO_Real [], VIO_Real ** ),
     void   *function_data,
@@ -57,7 +64,8 @@ VIOAPI  VIO_BOOL  newton_root_find(
     VIO_Real   solution[],
     VIO_Real   function_tolerance,
     VIO_Real   delta_tolerance,
-    int    max_iterations )
+    int    max_iterations,
+    int    *n_iterations )
 {
     int       iter, dim;
     VIO_Real      *values, **derivatives, *delta, error, best_error, *position;
@@ -139,5 +147,126 @@ VIOAPI  VIO_BOOL  newton_root_find(
     VIO_FREE2D( derivatives );
     FREE( position );
 
+    if( n_iterations != NULL )
+        *n_iterations = iter;
+
     return( success );
 }
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : newton_root_find
+@INPUT      : n_dimensions
+              function
+              function_data
+              initial_guess[n_dimensions]
+              desired_values[n_dimensions]
+              function_tolerance
+              delta_tolerance
+              max_iterations
+@OUTPUT     :
+              solution[n_dimensions]
+@RETURNS    : TRUE if successful
+@DESCRIPTION: Performs a newton root find of a function, as
+              newton_root_find_with_iterations().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : May 10, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_BOOL  newton_root_find(
+    int    n_dimensions,
+    void   (*function) ( void *, VIO_Real [],  VIO_Real [], VIO_Real ** ),
+    void   *function_data,
+    VIO_Real   initial_guess[],
+    VIO_Real   desired_values[],
+    VIO_Real   solution[],
+    VIO_Real   function_tolerance,
+    VIO_Real   delta_tolerance,
+    int    max_iterations )
+{
+    return( newton_root_find_with_iterations( n_dimensions, function,
+                                              function_data, initial_guess,
+                                              desired_values, solution,
+                                              function_tolerance,
+                                              delta_tolerance, max_iterations,
+                                              NULL ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : extrapolate_root_guess
+@INPUT      : n_dimensions
+              desired_values[n_dimensions]    - values to solve for next
+              previous_desired[n_dimensions]  - values last solved for
+              previous_solution[n_dimensions]
+              earlier_desired[n_dimensions]   - values solved for before
+                                                those, or NULL
+              earlier_solution[n_dimensions]
+@OUTPUT     : guess[n_dimensions]
+@RETURNS    :
+@DESCRIPTION: Guesses the solution for desired_values from the solutions for
+              nearby values, to start newton_root_find() or a similar search
+              close to it when solving for a sequence of values such as the
+              points along a scanline.  The part of the change in the values
+              along the last change is extrapolated from the last two
+              solutions, which follows the derivative of the function, and
+              the rest of the change is added to the last solution as it is.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  extrapolate_root_guess(
+    int        n_dimensions,
+    VIO_Real   desired_values[],
+    VIO_Real   previous_desired[],
+    VIO_Real   previous_solution[],
+    VIO_Real   earlier_desired[],
+    VIO_Real   earlier_solution[],
+    VIO_Real   guess[] )
+{
+    int        dim;
+    VIO_Real   step, last_step, dot, last_dot, t;
+
+    /*--- t is how far the values have moved along their last change */
+
+    t = 0.0;
+
+    if( earlier_desired != NULL )
+    {
+        dot = 0.0;
+        last_dot = 0.0;
+        for_less( dim, 0, n_dimensions )
+        {
+            step = desired_values[dim] - previous_desired[dim];
+            last_step = previous_desired[dim] - earlier_desired[dim];
+            dot += step * last_step;
+            last_dot += last_step * last_step;
+        }
+
+        if( last_dot > 0.0 )
+            t = dot / last_dot;
+
+        /*--- the solutions are only known to within a tolerance, so only
+              extrapolate over distances like the last change, as along a
+              scanline */
+
+        if( t < 0.0 || t > MAX_EXTRAPOLATION )
+            t = 0.0;
+    }
+
+    for_less( dim, 0, n_dimensions )
+    {
+        guess[dim] = previous_solution[dim] +
+                     desired_values[dim] - previous_desired[dim];
+
+        if( t != 0.0 )
+        {
+            guess[dim] += t * ( previous_solution[dim] - earlier_solution[dim]
+                                - previous_desired[dim] + earlier_desired[dim] );
+        }
+    }
+}
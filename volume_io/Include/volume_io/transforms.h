@@ -38,6 +38,13 @@ typedef enum { LINEAR,
                GRID_TRANSFORM
              } VIO_Transform_types;
 
+/* --- the quantities compute_deformation_volume() can map */
+
+typedef enum { JACOBIAN_DETERMINANT,
+               JACOBIAN_MATRIX,
+               DISPLACEMENT_MAGNITUDE
+             } VIO_Deformation_quantity;
+
 /* --- the user transformation function */
 
 typedef  void   (*VIO_User_transform_function)( void  *user_data,
@@ -68,11 +75,21 @@ typedef struct VIO_General_transform
     VIO_Real                    **displacements;   /* n_points + n_dim + 1 by */
                                                    /* n_dim */
 
+    /* --- landmarks grouped for approximate evaluation, if set by
+           set_thin_plate_spline_tolerance() */
+
+    void                        *tps_tree;
+
     /* --- grid transform */
 
     void                        *displacement_volume;
     VIO_STR                     displacement_volume_file;
 
+    /* --- displacements of the inverse transform, on the same grid, if
+           precomputed by create_grid_inverse_displacements() */
+
+    void                        *inverse_displacement_volume;
+
     /* --- user_defined */
 
     void                        *user_data;
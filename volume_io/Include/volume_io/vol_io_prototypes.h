@@ -29,6 +29,21 @@ VIOAPI  VIO_Status  input_transform_file(
     const char              *filename,
     VIO_General_transform   *transform );
 
+VIOAPI  void  set_grid_transform_float_input(
+    VIO_BOOL  state );
+
+VIOAPI  VIO_BOOL  get_grid_transform_float_input( void );
+
+VIOAPI  void  set_grid_transform_cached_input(
+    VIO_BOOL  state );
+
+VIOAPI  VIO_BOOL  get_grid_transform_cached_input( void );
+
+VIOAPI  void  set_transform_file_cache(
+    VIO_BOOL  state );
+
+VIOAPI  VIO_BOOL  get_transform_file_cache( void );
+
 VIOAPI  void  create_linear_transform(
     VIO_General_transform   *transform,
     VIO_Transform           *linear_transform );
@@ -120,6 +135,36 @@ VIOAPI  VIO_Status  general_inverse_transform_point(
     VIO_Real                *y_transformed,
     VIO_Real                *z_transformed );
 
+VIOAPI  VIO_Status  general_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  general_inverse_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  general_inverse_transform_scanline(
+    VIO_General_transform   *transform,
+    VIO_BOOL                warm_start,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS],
+    long                    *n_iterations );
+
+VIOAPI  VIO_Status  general_transform_point_with_jacobian(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed,
+    VIO_Real                jacobian[][VIO_N_DIMENSIONS] );
+
 VIOAPI  void  copy_general_transform(
     VIO_General_transform   *transform,
     VIO_General_transform   *copy );
@@ -136,6 +181,10 @@ VIOAPI  void  concat_general_transforms(
     VIO_General_transform   *second,
     VIO_General_transform   *result );
 
+VIOAPI  void  simplify_general_transform(
+    VIO_General_transform   *transform,
+    VIO_General_transform   *simplified );
+
 VIOAPI  void  delete_general_transform(
     VIO_General_transform   *transform );
 
@@ -162,6 +211,10 @@ VIOAPI  VIO_Status  mni_input_keyword_and_equal_sign(
     const char   keyword[],
     VIO_BOOL     print_error_message );
 
+VIOAPI  int  mni_scan_real(
+    const char  str[],
+    VIO_Real    *value );
+
 VIOAPI  VIO_Status  mni_input_real(
     FILE    *file,
     VIO_Real    *d );
@@ -211,6 +264,18 @@ VIOAPI  VIO_Status  output_tag_points(
     int       patient_ids[],
     VIO_STR    *labels );
 
+VIOAPI  VIO_Status  output_tag_points_binary(
+    FILE      *file,
+    VIO_STR    comments,
+    int       n_volumes,
+    int       n_tag_points,
+    VIO_Real      **tags_volume1,
+    VIO_Real      **tags_volume2,
+    VIO_Real      weights[],
+    int       structure_ids[],
+    int       patient_ids[],
+    VIO_STR    labels[] );
+
 VIOAPI  void  free_tag_points(
     int       n_volumes,
     int       n_tag_points,
@@ -237,6 +302,18 @@ VIOAPI  VIO_Status  output_tag_file(
     int       patient_ids[],
     VIO_STR    labels[] );
 
+VIOAPI  VIO_Status  output_tag_file_binary(
+    VIO_STR    filename,
+    VIO_STR    comments,
+    int       n_volumes,
+    int       n_tag_points,
+    VIO_Real      **tags_volume1,
+    VIO_Real      **tags_volume2,
+    VIO_Real      weights[],
+    int       structure_ids[],
+    int       patient_ids[],
+    VIO_STR    labels[] );
+
 VIOAPI  VIO_Status  input_tag_file(
     VIO_STR    filename,
     int       *n_volumes,
@@ -304,6 +381,81 @@ VIOAPI  VIO_Status  thin_plate_spline_inverse_transform(
     VIO_Real    *y_transformed,
     VIO_Real    *z_transformed );
 
+VIOAPI  VIO_Status  thin_plate_spline_transform_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  thin_plate_spline_transform_points_approximate(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   tolerance,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_points_approximate(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   tolerance,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_scanline(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_BOOL   warm_start,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS],
+    long       *n_iterations );
+
+VIOAPI  void  set_thin_plate_spline_tolerance(
+    VIO_General_transform   *transform,
+    VIO_Real                tolerance );
+
+VIOAPI  VIO_Real  get_thin_plate_spline_tolerance(
+    VIO_General_transform   *transform );
+
+VIOAPI  VIO_Status  thin_plate_spline_general_transform_point(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed );
+
+VIOAPI  VIO_Status  thin_plate_spline_general_transform_points(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_BOOL                warm_start,
+    int                     n_positions,
+    VIO_Real                positions[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed[][VIO_N_DIMENSIONS],
+    long                    *n_iterations );
+
 VIOAPI  VIO_Real  thin_plate_spline_U(
     VIO_Real   pos[],
     VIO_Real   landmark[],
@@ -366,6 +518,18 @@ VIOAPI  VIO_BOOL invert_square_matrix(
     VIO_Real  **matrix,
     VIO_Real  **inverse );
 
+VIOAPI  VIO_BOOL  newton_root_find_with_iterations(
+    int    n_dimensions,
+    void   (*function) ( void *, VIO_Real [],  VIO_Real [], VIO_Real ** ),
+    void   *function_data,
+    VIO_Real   initial_guess[],
+    VIO_Real   desired_values[],
+    VIO_Real   solution[],
+    VIO_Real   function_tolerance,
+    VIO_Real   delta_tolerance,
+    int    max_iterations,
+    int    *n_iterations );
+
 VIOAPI  VIO_BOOL newton_root_find(
     int    n_dimensions,
     void   (*function) ( void *, VIO_Real [],  VIO_Real [], VIO_Real ** ),
@@ -377,6 +541,15 @@ VIOAPI  VIO_BOOL newton_root_find(
     VIO_Real   delta_tolerance,
     int    max_iterations );
 
+VIOAPI  void  extrapolate_root_guess(
+    int        n_dimensions,
+    VIO_Real   desired_values[],
+    VIO_Real   previous_desired[],
+    VIO_Real   previous_solution[],
+    VIO_Real   earlier_desired[],
+    VIO_Real   earlier_solution[],
+    VIO_Real   guess[] );
+
 VIOAPI  void  create_orthogonal_vector(
     VIO_Vector  *v,
     VIO_Vector  *ortho );
@@ -1093,6 +1266,13 @@ VIOAPI  void  set_volume_real_value(
     int      v4,
     VIO_Real     value );
 
+VIOAPI  VIO_Status  set_volume_bspline_interpolation(
+    VIO_Volume       volume,
+    VIO_Data_types   coefficient_type );
+
+VIOAPI  VIO_Data_types  get_volume_bspline_interpolation(
+    VIO_Volume   volume );
+
 VIOAPI  void  set_volume_interpolation_tolerance(
     VIO_Real   tolerance );
 
@@ -1107,6 +1287,16 @@ VIOAPI  int   evaluate_volume(
     VIO_Real           **first_deriv,
     VIO_Real           ***second_deriv );
 
+VIOAPI  int   evaluate_volume_points(
+    VIO_Volume         volume,
+    int                n_points,
+    VIO_Real           voxel_coords[][VIO_MAX_DIMENSIONS],
+    VIO_BOOL       interpolating_dimensions[],
+    int            degrees_continuity,
+    VIO_BOOL       use_linear_at_edge,
+    VIO_Real           outside_value,
+    VIO_Real           values[] );
+
 VIOAPI  void   evaluate_volume_in_world(
     VIO_Volume         volume,
     VIO_Real           x,
@@ -1126,6 +1316,13 @@ VIOAPI  void   evaluate_volume_in_world(
     VIO_Real           deriv_yz[],
     VIO_Real           deriv_zz[] );
 
+VIOAPI  VIO_Status  resample_volume(
+    VIO_Volume              source,
+    VIO_General_transform   *transform,
+    VIO_Volume              target,
+    int                     degrees_continuity,
+    VIO_Real                fill_value );
+
 VIOAPI  void  convert_voxels_to_values(
     VIO_Volume   volume,
     int      n_voxels,
@@ -1348,6 +1545,16 @@ VIOAPI  VIO_Status  input_minc_hyperslab(
     int              start[],
     int              count[] );
 
+VIOAPI  VIO_Status  input_minc2_hyperslab(
+    Minc_file        file,
+    VIO_Data_types   data_type,
+    int              n_array_dims,
+    int              array_sizes[],
+    void             *array_data_ptr,
+    int              to_array[],
+    int              start[],
+    int              count[] );
+
 VIOAPI  VIO_BOOL input_more_minc_file(
     Minc_file   file,
     VIO_Real        *fraction_done );
@@ -1581,6 +1788,16 @@ VIOAPI  VIO_Status  output_minc_hyperslab(
     int                 file_start[],
     int                 file_count[] );
 
+VIOAPI  VIO_Status  output_minc2_hyperslab(
+    Minc_file           file,
+    VIO_Data_types      data_type,
+    int                 n_array_dims,
+    int                 array_sizes[],
+    void                *array_data_ptr,
+    int                 to_array[],
+    int                 file_start[],
+    int                 file_count[] );
+
 VIOAPI  VIO_Status  output_volume_to_minc_file_position(
     Minc_file     file,
     VIO_Volume    volume,
@@ -1805,12 +2022,32 @@ VIOAPI  void  set_default_max_bytes_in_cache(
 
 VIOAPI  int  get_default_max_bytes_in_cache( void );
 
+VIOAPI  void  set_default_max_bytes_in_cache_size(
+    size_t   max_bytes );
+
+VIOAPI  size_t  get_default_max_bytes_in_cache_size( void );
+
 VIOAPI  void  set_default_cache_block_sizes(
     int                      block_sizes[] );
 
 VIOAPI  void  set_cache_block_sizes_hint(
     VIO_Cache_block_size_hints  hint );
 
+VIOAPI  void  set_default_cache_prefetch_blocks(
+    int   n_blocks );
+
+VIOAPI  int  get_default_cache_prefetch_blocks( void );
+
+VIOAPI  void  set_default_cache_compressed_bytes(
+    size_t   max_bytes );
+
+VIOAPI  size_t  get_default_cache_compressed_bytes( void );
+
+VIOAPI  void  set_default_cache_eviction_policy(
+    VIO_Cache_eviction_policy  policy );
+
+VIOAPI  VIO_Cache_eviction_policy  get_default_cache_eviction_policy( void );
+
 VIOAPI  void  initialize_volume_cache(
     VIO_volume_cache_struct   *cache,
     VIO_Volume                volume );
@@ -1833,6 +2070,34 @@ VIOAPI  void  set_volume_cache_size(
     VIO_Volume    volume,
     int           max_memory_bytes );
 
+VIOAPI  void  set_volume_cache_size_bytes(
+    VIO_Volume    volume,
+    size_t        max_memory_bytes );
+
+VIOAPI  void  set_volume_cache_compressed_bytes(
+    VIO_Volume    volume,
+    size_t        max_bytes );
+
+VIOAPI  void  set_volume_cache_prefetch_blocks(
+    VIO_Volume    volume,
+    int           n_blocks );
+
+VIOAPI  void  set_volume_cache_eviction_policy(
+    VIO_Volume                 volume,
+    VIO_Cache_eviction_policy  policy );
+
+VIOAPI  void  get_volume_cache_prefetch_stats(
+    VIO_Volume    volume,
+    long          *n_prefetched,
+    long          *n_useful );
+
+VIOAPI  void  get_volume_cache_stats(
+    VIO_Volume               volume,
+    VIO_volume_cache_stats   *stats );
+
+VIOAPI  void  reset_volume_cache_stats(
+    VIO_Volume   volume );
+
 VIOAPI  void  set_cache_output_volume_parameters(
     VIO_Volume                  volume,
     VIO_STR                     filename,
@@ -2134,6 +2399,18 @@ VIOAPI  void  convert_3D_world_to_voxel(
     VIO_Real     *voxel2,
     VIO_Real     *voxel3 );
 
+VIOAPI  void  convert_voxel_to_world_points(
+    VIO_Volume   volume,
+    int          n_points,
+    VIO_Real     voxels[][VIO_MAX_DIMENSIONS],
+    VIO_Real     world[][VIO_N_DIMENSIONS] );
+
+VIOAPI  void  convert_world_to_voxel_points(
+    VIO_Volume   volume,
+    int          n_points,
+    VIO_Real     world[][VIO_N_DIMENSIONS],
+    VIO_Real     voxels[][VIO_MAX_DIMENSIONS] );
+
 VIOAPI  VIO_Real  get_volume_voxel_min(
     VIO_Volume   volume );
 
@@ -2195,6 +2472,30 @@ VIOAPI  VIO_Status  grid_transform_point(
     VIO_Real                *y_transformed,
     VIO_Real                *z_transformed );
 
+VIOAPI  VIO_Status  grid_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] );
+
+VIOAPI  VIO_Status  grid_inverse_transform_scanline(
+    VIO_General_transform   *transform,
+    VIO_BOOL                warm_start,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS],
+    long                    *n_iterations );
+
+VIOAPI  VIO_Status  grid_transform_point_with_jacobian(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed,
+    VIO_Real                jacobian[][VIO_N_DIMENSIONS] );
+
 VIOAPI  VIO_Status  grid_inverse_transform_point_with_input_steps(
     VIO_General_transform   *transform,
     VIO_Real                x,
@@ -2214,4 +2515,28 @@ VIOAPI  VIO_Status  grid_inverse_transform_point(
     VIO_Real                *y_transformed,
     VIO_Real                *z_transformed );
 
+VIOAPI  VIO_Status  create_grid_inverse_displacements(
+    VIO_General_transform   *transform,
+    VIO_Real                *max_error,
+    int                     *n_not_converged );
+
+VIOAPI  void  delete_grid_inverse_displacements(
+    VIO_General_transform   *transform );
+
+VIOAPI  VIO_Status  flatten_general_transform(
+    VIO_General_transform   *transform,
+    int                     sizes[],
+    VIO_Real                starts[],
+    VIO_Real                steps[],
+    VIO_General_transform   *flattened,
+    VIO_Real                *max_error );
+
+VIOAPI  VIO_Status  compute_deformation_volume(
+    VIO_General_transform      *transform,
+    VIO_Deformation_quantity   quantity,
+    VIO_Volume                 volume,
+    VIO_Real                   *min_value,
+    VIO_Real                   *max_value,
+    VIO_Real                   *mean_value );
+
 #endif /*VOL_IO_PROTOTYPES_H*/
@@ -115,11 +115,31 @@ typedef  struct
     VIO_BOOL                voxel_to_world_transform_uptodate;
     VIO_General_transform   voxel_to_world_transform;
 
+    /* voxel_to_world_transform and its inverse as plain matrices, indexed
+       [row][column] and applied to x, y, z voxel coordinates, kept up to
+       date with the transform.  Only valid if the transform is affine. */
+
+    VIO_BOOL                world_matrices_valid;
+    VIO_Real                voxel_to_world_matrix[4][4];
+    VIO_Real                world_to_voxel_matrix[4][4];
+
     VIO_STR                 coordinate_system_name;
 
     VIO_Real               *irregular_starts[VIO_MAX_DIMENSIONS];
     VIO_Real               *irregular_widths[VIO_MAX_DIMENSIONS];
     VIO_BOOL               is_labels;
+
+    /* cubic B-spline coefficients, in voxel units, used by evaluate_volume()
+       for cubic interpolation if bspline_coefficient_type is VIO_FLOAT or
+       VIO_DOUBLE and they are up to date.  Writes through functions mark
+       them out of date; writes through the SET_VOXEL macros do not.  After
+       any voxel write, evaluate_volume() silently returns the interpolating
+       (Catmull-Rom) spline instead of the B-spline until
+       set_volume_bspline_interpolation() is called again. */
+
+    VIO_Data_types          bspline_coefficient_type;
+    VIO_BOOL                bspline_coefficients_uptodate;
+    VIO_multidim_array      bspline_coefficients;
 } volume_struct;
 
 typedef  volume_struct  *VIO_Volume;
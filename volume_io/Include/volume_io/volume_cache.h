@@ -37,26 +37,59 @@
 typedef  enum  { SLICE_ACCESS, RANDOM_VOLUME_ACCESS }
                VIO_Cache_block_size_hints;
 
+/* --- which block is evicted when the cache is full: the least recently
+       used, the next one not used since the last sweep of a clock hand,
+       or, for 2Q, the oldest block used only once if those fill more than
+       a quarter of the cache, so that a single scan through the volume
+       does not flush the blocks used repeatedly */
+
+typedef  enum  { LRU_CACHE_EVICTION, CLOCK_CACHE_EVICTION,
+                 TWO_QUEUE_CACHE_EVICTION }
+               VIO_Cache_eviction_policy;
+
+typedef  struct
+{
+    long        n_hits;
+    long        n_previous_block_hits;
+    long        n_misses;
+    long        n_evictions;
+    long        n_dirty_writes;
+    long        n_prefetched;
+    long        n_useful_prefetches;
+    size_t      n_bytes_read;
+    VIO_Real    io_seconds;
+    long        n_compressed_hits;
+    size_t      n_compressed_bytes;
+} VIO_volume_cache_stats;
+
 #define  CACHE_DEBUGGING
 #undef   CACHE_DEBUGGING
 
 typedef  struct  VIO_cache_block_struct
 {
-    int                         block_index;
+    long                        block_index;
     VIO_SCHAR                modified_flag;
+    VIO_SCHAR                prefetched_flag;
+    VIO_SCHAR                referenced_flag;
+    VIO_SCHAR                probation_flag;
     VIO_multidim_array              array;
     struct  VIO_cache_block_struct  *prev_used;
     struct  VIO_cache_block_struct  *next_used;
-    struct  VIO_cache_block_struct  **prev_hash;
-    struct  VIO_cache_block_struct  *next_hash;
 } VIO_cache_block_struct;
 
 typedef  struct
 {
-    int       block_index_offset;
+    long      block_index_offset;
     int       block_offset;
 } VIO_cache_lookup_struct;
 
+/* --- the blocks are divided between shards, each with its own lock, block
+       table and least recently used list, so that several threads can use
+       the cache at once.  Both structures are private to volume_cache.c */
+
+struct  VIO_cache_shard_struct;
+struct  VIO_cache_shared_struct;
+
 typedef struct
 {
     int                         n_dimensions;
@@ -73,23 +106,23 @@ typedef struct
     minc_output_options         options;
 
     VIO_BOOL                    writing_to_temp_file;
-    int                         total_block_size;
+    size_t                      total_block_size;
     int                         block_sizes[VIO_MAX_DIMENSIONS];
     int                         blocks_per_dim[VIO_MAX_DIMENSIONS];
     VIO_BOOL                    output_file_is_open;
     VIO_BOOL                    must_read_blocks_before_use;
     void                        *minc_file;
-    int                         n_blocks;
-    int                         max_cache_bytes;
-    int                         max_blocks;
-    int                         hash_table_size;
-    VIO_cache_block_struct      *head;
-    VIO_cache_block_struct      *tail;
-    VIO_cache_block_struct      **hash_table;
+    size_t                      max_cache_bytes;
+    size_t                      max_compressed_bytes;
+    size_t                      max_blocks;
+    size_t                      n_volume_blocks;
+    int                         n_shards;
+    int                         prefetch_blocks;
+    VIO_Cache_eviction_policy   eviction_policy;
+    struct VIO_cache_shard_struct   *shards;
+    struct VIO_cache_shared_struct  *shared;
 
     VIO_cache_lookup_struct     *lookup[VIO_MAX_DIMENSIONS];
-    VIO_cache_block_struct      *previous_block;
-    int                         previous_block_index;
 
     VIO_BOOL                    debugging_on;
     int                         n_accesses;
@@ -18,6 +18,14 @@
 
 #include  <internal_volume_io.h>
 
+#if HAVE_SYS_STAT_H
+#include  <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+#if HAVE_UNISTD_H
+#include  <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#include  <time.h>
+
 /*--------------------- file format keywords ------------------------------ */
 
 static const VIO_STR      TRANSFORM_FILE_HEADER = "MNI Transform File";
@@ -34,6 +42,44 @@ static const VIO_STR      DISPLACEMENTS_STRING = "Displacements";
 static const VIO_STR      GRID_TRANSFORM_STRING = "Grid_Transform";
 static const VIO_STR      DISPLACEMENT_VOLUME = "Displacement_Volume";
 
+/*--------------------- grid transform input options ---------------------- */
+
+static  VIO_BOOL  grid_float_input_set = FALSE;
+static  VIO_BOOL  grid_float_input = FALSE;
+
+static  VIO_BOOL  grid_cached_input_set = FALSE;
+static  VIO_BOOL  grid_cached_input = FALSE;
+
+/*--------------------- transform file cache ------------------------------ */
+
+static  VIO_BOOL  transform_file_cache_set = FALSE;
+static  VIO_BOOL  transform_file_cache = FALSE;
+
+static const VIO_STR      TRANSFORM_CACHE_SUFFIX = "cache";
+static const VIO_STR      TRANSFORM_CACHE_HEADER = "MNI Transform Cache";
+
+#define  TRANSFORM_CACHE_VERSION      1
+
+/*--- a file modified this recently may be modified again within the same
+      second, without changing its size, so it is not cached */
+
+#define  TRANSFORM_CACHE_MIN_AGE      2
+
+/*--- a transform as it is described in a transform file, before it is
+      created */
+
+typedef struct
+{
+    VIO_Transform_types  type;
+    VIO_BOOL             inverse_flag;
+    VIO_Transform        linear_transform;
+    int                  n_dimensions;
+    int                  n_points;
+    VIO_Real             **points;
+    VIO_Real             **displacements;
+    VIO_STR              volume_filename;
+} transform_record;
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_default_transform_file_suffix
 @INPUT      :
@@ -306,12 +352,240 @@ VIOAPI  VIO_Status  output_transform(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : input_one_transform
-@INPUT      : file
-              filename    - used to get relative paths
-@OUTPUT     : transform
+@NAME       : set_grid_transform_float_input
+@INPUT      : state
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets whether the displacement volumes of grid transforms are
+              input as float, with the vector dimension last, rather than in
+              the type of the file.  This holds the three displacements of
+              each node together and takes half the memory of a double
+              volume.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_grid_transform_float_input(
+    VIO_BOOL  state )
+{
+    grid_float_input = state;
+    grid_float_input_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_grid_transform_float_input
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : TRUE or FALSE
+@DESCRIPTION: Returns whether grid transform volumes are input as float.  If
+              it hasn't been set, returns TRUE if the environment variable
+              GRID_TRANSFORM_FLOAT is set to a nonzero number.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_BOOL  get_grid_transform_float_input( void )
+{
+    int   state;
+
+    if( !grid_float_input_set )
+    {
+        if( getenv( "GRID_TRANSFORM_FLOAT" ) != NULL &&
+            sscanf( getenv( "GRID_TRANSFORM_FLOAT" ), "%d", &state ) == 1 )
+        {
+            grid_float_input = (state != 0);
+        }
+        grid_float_input_set = TRUE;
+    }
+
+    return( grid_float_input );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_grid_transform_cached_input
+@INPUT      : state
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets whether the displacement volumes of grid transforms are
+              input as cached volumes, whatever their size, so that only the
+              blocks of the grid which are used are read from the file.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_grid_transform_cached_input(
+    VIO_BOOL  state )
+{
+    grid_cached_input = state;
+    grid_cached_input_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_grid_transform_cached_input
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : TRUE or FALSE
+@DESCRIPTION: Returns whether grid transform volumes are input as cached
+              volumes.  If it hasn't been set, returns TRUE if the environment
+              variable GRID_TRANSFORM_CACHED is set to a nonzero number.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_BOOL  get_grid_transform_cached_input( void )
+{
+    int   state;
+
+    if( !grid_cached_input_set )
+    {
+        if( getenv( "GRID_TRANSFORM_CACHED" ) != NULL &&
+            sscanf( getenv( "GRID_TRANSFORM_CACHED" ), "%d", &state ) == 1 )
+        {
+            grid_cached_input = (state != 0);
+        }
+        grid_cached_input_set = TRUE;
+    }
+
+    return( grid_cached_input );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_transform_file_cache
+@INPUT      : state
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets whether input_transform_file() keeps a binary copy of each
+              transform file it reads, in a file of the same name with
+              ".cache" appended, and inputs the copy instead of parsing the
+              file while the size and modification time of the file are
+              those the copy was made from.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_transform_file_cache(
+    VIO_BOOL  state )
+{
+    transform_file_cache = state;
+    transform_file_cache_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_transform_file_cache
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : TRUE or FALSE
+@DESCRIPTION: Returns whether transform files are cached.  If it hasn't been
+              set, returns TRUE if the environment variable
+              TRANSFORM_FILE_CACHE is set to a nonzero number.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_BOOL  get_transform_file_cache( void )
+{
+    int   state;
+
+    if( !transform_file_cache_set )
+    {
+        if( getenv( "TRANSFORM_FILE_CACHE" ) != NULL &&
+            sscanf( getenv( "TRANSFORM_FILE_CACHE" ), "%d", &state ) == 1 )
+        {
+            transform_file_cache = (state != 0);
+        }
+        transform_file_cache_set = TRUE;
+    }
+
+    return( transform_file_cache );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_grid_volume
+@INPUT      : volume_filename
+@OUTPUT     : volume
 @RETURNS    : VIO_OK or VIO_ERROR
-@DESCRIPTION: Inputs a transform from the file.
+@DESCRIPTION: Inputs the displacement volume of a grid transform, as float
+              with the vector dimension last if get_grid_transform_float_input()
+              is TRUE, and as a cached volume if
+              get_grid_transform_cached_input() is TRUE.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  input_grid_volume(
+    VIO_STR      volume_filename,
+    VIO_Volume   *volume )
+{
+    static VIO_STR      vector_last_names[] = { ANY_SPATIAL_DIMENSION,
+                                                ANY_SPATIAL_DIMENSION,
+                                                ANY_SPATIAL_DIMENSION,
+                                                MIvector_dimension };
+    VIO_Status          status;
+    VIO_STR             *dim_names;
+    nc_type             data_type;
+    int                 threshold;
+    VIO_BOOL            cached;
+    minc_input_options  options;
+
+    set_default_minc_input_options( &options );
+    set_minc_input_vector_to_scalar_flag( &options, FALSE );
+
+    if( get_grid_transform_float_input() )
+    {
+        dim_names = vector_last_names;
+        data_type = NC_FLOAT;
+    }
+    else
+    {
+        dim_names = NULL;
+        data_type = MI_ORIGINAL_TYPE;
+    }
+
+    /*--- a zero threshold makes input_volume() cache the volume */
+
+    cached = get_grid_transform_cached_input();
+    threshold = get_n_bytes_cache_threshold();
+    if( cached )
+        set_n_bytes_cache_threshold( 0 );
+
+    status = input_volume( volume_filename, 4, dim_names, data_type, FALSE,
+                           0.0, 0.0, TRUE, volume, &options );
+
+    if( cached )
+        set_n_bytes_cache_threshold( threshold );
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_transform_record
+@INPUT      : file
+@OUTPUT     : record
+@RETURNS    : VIO_OK, VIO_ERROR, or VIO_END_OF_FILE if there are no more
+              transforms
+@DESCRIPTION: Inputs the description of a transform from the file, without
+              creating it.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -319,22 +593,18 @@ VIOAPI  VIO_Status  output_transform(
 @MODIFIED   : Feb. 21, 1995   David MacDonald - added grid transforms
 ---------------------------------------------------------------------------- */
 
-static VIO_Status input_one_transform(
+static VIO_Status input_transform_record(
     FILE                *file,
-    const char          *filename,
-    VIO_General_transform   *transform )
+    transform_record    *record )
 {
     VIO_Status        status;
     int               i, j, n_points, n_dimensions;
     VIO_Real          **points, **displacements;
     VIO_Real          value, *points_1d;
-    VIO_STR           type_name, str, volume_filename, directory, tmp_filename;
-    VIO_Volume        volume;
+    VIO_STR           type_name, str, volume_filename;
     VIO_Transform     linear_transform;
     VIO_Transform_types   transform_type;
     VIO_BOOL              inverse_flag;
-    VIO_General_transform inverse;
-    minc_input_options    options;
 
     inverse_flag = FALSE;
 
@@ -448,7 +718,7 @@ static VIO_Status input_one_transform(
         if( mni_skip_expected_character( file, (char) ';' ) != VIO_OK )
             return( VIO_ERROR );
 
-        create_linear_transform( transform, &linear_transform );
+        record->linear_transform = linear_transform;
 
         break;
 
@@ -477,13 +747,19 @@ static VIO_Status input_one_transform(
         if( mni_input_keyword_and_equal_sign( file, POINTS_STRING, TRUE ) != VIO_OK)
             return( VIO_ERROR );
         if( mni_input_reals( file, &n_points, &points_1d ) != VIO_OK )
+        {
+            if( n_points > 0 )
+                FREE( points_1d );
             return( VIO_ERROR );
+        }
 
         if( n_points % n_dimensions != 0 )
         {
             print_error(
                         "Number of points (%d) must be multiple of number of dimensions (%d)\n",
                         n_points, n_dimensions );
+            if( n_points > 0 )
+                FREE( points_1d );
             return( VIO_ERROR );
         }
 
@@ -506,7 +782,11 @@ static VIO_Status input_one_transform(
 
         if( mni_input_keyword_and_equal_sign( file, DISPLACEMENTS_STRING, TRUE )
                                                                        != VIO_OK )
+        {
+            VIO_FREE2D( points );
+            VIO_FREE2D( displacements );
             return( VIO_ERROR );
+        }
 
         for_less( i, 0, n_points + n_dimensions + 1 )
         {
@@ -515,6 +795,8 @@ static VIO_Status input_one_transform(
                 if( mni_input_real( file, &value ) != VIO_OK )
                 {
                     print_error( "Expected more displacements.\n" );
+                    VIO_FREE2D( points );
+                    VIO_FREE2D( displacements );
                     return( VIO_ERROR );
                 }
                 displacements[i][j] = value;
@@ -522,14 +804,16 @@ static VIO_Status input_one_transform(
         }
 
         if( mni_skip_expected_character( file, (char) ';' ) != VIO_OK )
+        {
+            VIO_FREE2D( points );
+            VIO_FREE2D( displacements );
             return( VIO_ERROR );
+        }
 
-        create_thin_plate_transform_real( transform, n_dimensions,
-                                          n_points, points, displacements );
-
-
-        VIO_FREE2D( points );
-        VIO_FREE2D( displacements );
+        record->n_dimensions = n_dimensions;
+        record->n_points = n_points;
+        record->points = points;
+        record->displacements = displacements;
 
         break;
 
@@ -559,6 +843,112 @@ static VIO_Status input_one_transform(
             return( VIO_ERROR );
         }
 
+        record->volume_filename = volume_filename;
+
+        break;
+    }
+
+    record->type = transform_type;
+    record->inverse_flag = inverse_flag;
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_transform_record
+@INPUT      : record
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Deletes the memory of a transform record.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  delete_transform_record(
+    transform_record   *record )
+{
+    if( record->type == THIN_PLATE_SPLINE )
+    {
+        VIO_FREE2D( record->points );
+        VIO_FREE2D( record->displacements );
+    }
+    else if( record->type == GRID_TRANSFORM )
+        delete_string( record->volume_filename );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_transform_records
+@INPUT      : n_records
+              records
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Deletes a list of transform records.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  delete_transform_records(
+    int                n_records,
+    transform_record   records[] )
+{
+    int   i;
+
+    for_less( i, 0, n_records )
+        delete_transform_record( &records[i] );
+
+    if( n_records > 0 )
+        FREE( records );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_transform_from_record
+@INPUT      : record
+              filename    - used to get relative paths
+@OUTPUT     : transform
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Creates the transform a record describes, inputting the
+              displacement volume of a grid transform.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  create_transform_from_record(
+    transform_record        *record,
+    const char              *filename,
+    VIO_General_transform   *transform )
+{
+    VIO_STR                volume_filename, directory, tmp_filename;
+    VIO_Volume             volume;
+    VIO_General_transform  inverse;
+
+    switch( record->type )
+    {
+    default:
+        print_error( "Unsupported transform type %d \n", record->type );
+        return( VIO_ERROR );
+
+    case LINEAR:
+        create_linear_transform( transform, &record->linear_transform );
+        break;
+
+    case THIN_PLATE_SPLINE:
+        create_thin_plate_transform_real( transform, record->n_dimensions,
+                                          record->n_points, record->points,
+                                          record->displacements );
+        break;
+
+    case GRID_TRANSFORM:
+        volume_filename = create_string( record->volume_filename );
+
         /*--- if the volume filename is relative, add the required directory */
 
         if( volume_filename[0] != '/' && filename != NULL )
@@ -577,13 +967,7 @@ static VIO_Status input_one_transform(
 
         /*--- input the displacement volume */
 
-        /*TODO: initialize strings*/
-        set_default_minc_input_options( &options );
-        set_minc_input_vector_to_scalar_flag( &options, FALSE );
-
-        if( input_volume( volume_filename, 4, NULL,
-                          MI_ORIGINAL_TYPE, FALSE, 0.0, 0.0,
-                          TRUE, &volume, &options ) != VIO_OK )
+        if( input_grid_volume( volume_filename, &volume ) != VIO_OK )
         {
             delete_string( volume_filename );
             return( VIO_ERROR );
@@ -591,13 +975,10 @@ static VIO_Status input_one_transform(
         create_grid_transform_no_copy( transform, volume, volume_filename );
         delete_string( volume_filename );
 
-        /*--- create the transform */
-
-
         break;
     }
 
-    if( inverse_flag )
+    if( record->inverse_flag )
     {
         create_inverse_general_transform( transform, &inverse );
         delete_general_transform( transform );
@@ -608,36 +989,30 @@ static VIO_Status input_one_transform(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : input_transform
+@NAME       : input_transform_records
 @INPUT      : file
-              filename    - used to define directory for relative filename
-@OUTPUT     : transform
+@OUTPUT     : n_records
+              records
 @RETURNS    : VIO_OK or VIO_ERROR
-@DESCRIPTION: Inputs the transform from the file.
+@DESCRIPTION: Inputs the header and the descriptions of all the transforms
+              of a transform file.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : 1993            David MacDonald
-@MODIFIED   : Feb. 21, 1995   D. MacDonald
+@CREATED    :
+@MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  VIO_Status  input_transform(
-    FILE                *file,
-    const char          *filename,
-    VIO_General_transform   *transform )
+static  VIO_Status  input_transform_records(
+    FILE               *file,
+    int                *n_records,
+    transform_record   *records[] )
 {
-    VIO_Status              status;
-    int                 n_transforms;
-    VIO_STR              line;
-    VIO_General_transform   next, concated;
-
-    /* parameter checking */
+    VIO_Status         status;
+    VIO_STR            line;
+    transform_record   record;
 
-    if( file == (FILE *) 0 )
-    {
-        print_error( "input_transform(): passed NULL FILE ptr.\n");
-        return( VIO_ERROR );
-    }
+    *n_records = 0;
 
     /* okay read the header */
 
@@ -657,10 +1032,65 @@ VIOAPI  VIO_Status  input_transform(
 
     delete_string( line );
 
-    n_transforms = 0;
-    while( (status = input_one_transform( file, filename, &next )) == VIO_OK )
+    while( (status = input_transform_record( file, &record )) == VIO_OK )
+    {
+        ADD_ELEMENT_TO_ARRAY( *records, *n_records, record,
+                              DEFAULT_CHUNK_SIZE );
+    }
+
+    if( status == VIO_ERROR )
+    {
+        delete_transform_records( *n_records, *records );
+        *n_records = 0;
+        print_error( "input_transform: error reading transform.\n" );
+        return( VIO_ERROR );
+    }
+    else if( *n_records == 0 )
+    {
+        print_error( "input_transform: no transform present.\n" );
+        return( VIO_ERROR );
+    }
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_transform_from_records
+@INPUT      : n_records
+              records
+              filename    - used to get relative paths
+@OUTPUT     : transform
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Creates the concatenation of the transforms the records
+              describe.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  create_transform_from_records(
+    int                     n_records,
+    transform_record        records[],
+    const char              *filename,
+    VIO_General_transform   *transform )
+{
+    int                     i;
+    VIO_General_transform   next, concated;
+
+    for_less( i, 0, n_records )
     {
-        if( n_transforms == 0 )
+        if( create_transform_from_record( &records[i], filename,
+                                          &next ) != VIO_OK )
+        {
+            if( i > 0 )
+                delete_general_transform( transform );
+            print_error( "input_transform: error reading transform.\n" );
+            return( VIO_ERROR );
+        }
+
+        if( i == 0 )
             *transform = next;
         else
         {
@@ -669,21 +1099,52 @@ VIOAPI  VIO_Status  input_transform(
             delete_general_transform( &next );
             *transform = concated;
         }
-        ++n_transforms;
     }
 
-    if( status == VIO_ERROR )
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_transform
+@INPUT      : file
+              filename    - used to define directory for relative filename
+@OUTPUT     : transform
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Inputs the transform from the file.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : 1993            David MacDonald
+@MODIFIED   : Feb. 21, 1995   D. MacDonald
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  input_transform(
+    FILE                *file,
+    const char          *filename,
+    VIO_General_transform   *transform )
+{
+    VIO_Status          status;
+    int                 n_records;
+    transform_record    *records;
+
+    /* parameter checking */
+
+    if( file == (FILE *) 0 )
     {
-        print_error( "input_transform: error reading transform.\n" );
+        print_error( "input_transform(): passed NULL FILE ptr.\n");
         return( VIO_ERROR );
     }
-    else if( n_transforms == 0 )
+
+    status = input_transform_records( file, &n_records, &records );
+
+    if( status == VIO_OK )
     {
-        print_error( "input_transform: no transform present.\n" );
-        return( VIO_ERROR );
+        status = create_transform_from_records( n_records, records, filename,
+                                                transform );
+        delete_transform_records( n_records, records );
     }
 
-    return( VIO_OK );
+    return( status );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -726,12 +1187,411 @@ VIOAPI  VIO_Status  output_transform_file(
     return( status );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_transform_filename_used
+@INPUT      : filename
+@OUTPUT     :
+@RETURNS    : the filename
+@DESCRIPTION: Returns the name of the file open_file_with_default_suffix()
+              opens to input the transform file.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_STR  get_transform_filename_used(
+    const char   *filename )
+{
+    VIO_STR   expanded, base_name, used_filename;
+
+    expanded = expand_filename( filename );
+
+    if( !file_exists( expanded ) )
+    {
+        base_name = remove_directories_from_filename( expanded );
+
+        if( find_character( base_name, '.' ) < 0 )
+        {
+            used_filename = concat_strings( expanded, "." );
+            concat_to_string( &used_filename,
+                              get_default_transform_file_suffix() );
+            if( file_exists( used_filename ) )
+                replace_string( &expanded, used_filename );
+            else
+                delete_string( used_filename );
+        }
+
+        delete_string( base_name );
+    }
+
+    return( expanded );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_transform_file_key
+@INPUT      : filename
+@OUTPUT     : size
+              modification_time
+@RETURNS    : TRUE if the file could be examined
+@DESCRIPTION: Gets the size and modification time of a file, which identify
+              the contents of a transform file in its cache.  Both are zero
+              if the file cannot be examined.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  get_transform_file_key(
+    VIO_STR    filename,
+    VIO_Real   *size,
+    VIO_Real   *modification_time )
+{
+#if HAVE_SYS_STAT_H
+    struct stat   stat_buffer;
+#endif
+
+    *size = 0.0;
+    *modification_time = 0.0;
+
+#if HAVE_SYS_STAT_H
+    if( stat( filename, &stat_buffer ) != 0 ||
+        !S_ISREG( stat_buffer.st_mode ) )
+        return( FALSE );
+
+    *size = (VIO_Real) stat_buffer.st_size;
+    *modification_time = (VIO_Real) stat_buffer.st_mtime;
+
+    return( TRUE );
+#else
+    return( FALSE );
+#endif /* HAVE_SYS_STAT_H */
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_cache_values
+@INPUT      : file
+              n_bytes_left
+              size        - of each value
+              n_values
+@OUTPUT     : values
+              n_bytes_left
+@RETURNS    : TRUE if all the values were read
+@DESCRIPTION: Reads values from a transform cache file, checking first that
+              the file has enough bytes left for them, so that a damaged count
+              cannot cause a huge allocation.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  input_cache_values(
+    FILE       *file,
+    VIO_Real   *n_bytes_left,
+    size_t     size,
+    int        n_values,
+    void       *values )
+{
+    if( n_values < 0 || (VIO_Real) size * n_values > *n_bytes_left )
+        return( FALSE );
+
+    if( n_values > 0 &&
+        fread( values, size, (size_t) n_values, file ) != (size_t) n_values )
+        return( FALSE );
+
+    *n_bytes_left -= (VIO_Real) size * n_values;
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_transform_cache
+@INPUT      : cache_filename
+              size                - of the transform file
+              modification_time   - of the transform file
+@OUTPUT     : n_records
+              records
+@RETURNS    : TRUE if the cache was read and belongs to the transform file
+@DESCRIPTION: Inputs the transform records from the cache of a transform
+              file, if it was made from a file of the given size and
+              modification time, in this byte order.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  input_transform_cache(
+    VIO_STR            cache_filename,
+    VIO_Real           size,
+    VIO_Real           modification_time,
+    int                *n_records,
+    transform_record   *records[] )
+{
+    FILE               *file;
+    VIO_BOOL           valid;
+    VIO_Real           n_bytes_left, cache_size, cache_time, key[2];
+    int                i, header_ints[3], record_ints[5];
+    char               header[80];
+    transform_record   record;
+
+    *n_records = 0;
+
+    if( !get_transform_file_key( cache_filename, &n_bytes_left, &cache_time ) )
+        return( FALSE );
+
+    file = fopen( cache_filename, "rb" );
+    if( file == NULL )
+        return( FALSE );
+
+    /*--- the header line, byte order, version, number of records, and the
+          size and modification time of the transform file */
+
+    valid = (fgets( header, (int) sizeof(header), file ) != NULL &&
+             (int) strlen( header ) ==
+                           string_length( TRANSFORM_CACHE_HEADER ) + 1 &&
+             strncmp( header, TRANSFORM_CACHE_HEADER,
+                      string_length( TRANSFORM_CACHE_HEADER ) ) == 0);
+
+    n_bytes_left -= (VIO_Real) string_length( TRANSFORM_CACHE_HEADER ) + 1.0;
+
+    valid = valid &&
+            input_cache_values( file, &n_bytes_left, sizeof(int), 3,
+                                header_ints ) &&
+            header_ints[0] == 1 &&
+            header_ints[1] == TRANSFORM_CACHE_VERSION &&
+            header_ints[2] > 0 &&
+            input_cache_values( file, &n_bytes_left, sizeof(VIO_Real), 2,
+                                key );
+
+    cache_size = key[0];
+    if( valid && (cache_size != size || key[1] != modification_time) )
+        valid = FALSE;
+
+    for_less( i, 0, (valid ? header_ints[2] : 0) )
+    {
+        if( !input_cache_values( file, &n_bytes_left, sizeof(int), 5,
+                                 record_ints ) )
+        {
+            valid = FALSE;
+            break;
+        }
+
+        record.type = (VIO_Transform_types) record_ints[0];
+        record.inverse_flag = (record_ints[1] != 0);
+
+        if( record.type == LINEAR )
+        {
+            valid = input_cache_values( file, &n_bytes_left, sizeof(VIO_Real),
+                                        4 * 4, &Transform_elem(
+                                            record.linear_transform, 0, 0 ) );
+        }
+        else if( record.type == THIN_PLATE_SPLINE )
+        {
+            record.n_dimensions = record_ints[2];
+            record.n_points = record_ints[3];
+
+            valid = (record.n_dimensions > 0 && record.n_points > 0 &&
+                     (VIO_Real) sizeof(VIO_Real) * record.n_dimensions *
+                     (2 * record.n_points + record.n_dimensions + 1) <=
+                     n_bytes_left);
+
+            if( !valid )
+                break;
+
+            VIO_ALLOC2D( record.points, record.n_points, record.n_dimensions );
+            VIO_ALLOC2D( record.displacements,
+                         record.n_points + record.n_dimensions + 1,
+                         record.n_dimensions );
+
+            /*--- the rows of VIO_ALLOC2D arrays are contiguous */
+
+            if( !input_cache_values( file, &n_bytes_left, sizeof(VIO_Real),
+                                     record.n_points * record.n_dimensions,
+                                     record.points[0] ) ||
+                !input_cache_values( file, &n_bytes_left, sizeof(VIO_Real),
+                                     (record.n_points + record.n_dimensions
+                                      + 1) * record.n_dimensions,
+                                     record.displacements[0] ) )
+            {
+                delete_transform_record( &record );
+                valid = FALSE;
+            }
+        }
+        else if( record.type == GRID_TRANSFORM )
+        {
+            valid = (record_ints[4] >= 0 &&
+                     (VIO_Real) record_ints[4] <= n_bytes_left);
+
+            if( !valid )
+                break;
+
+            record.volume_filename = alloc_string( record_ints[4] );
+            if( input_cache_values( file, &n_bytes_left, sizeof(char),
+                                    record_ints[4],
+                                    record.volume_filename ) )
+                record.volume_filename[record_ints[4]] = VIO_END_OF_STRING;
+            else
+            {
+                delete_transform_record( &record );
+                valid = FALSE;
+            }
+        }
+        else
+            valid = FALSE;
+
+        if( !valid )
+            break;
+
+        ADD_ELEMENT_TO_ARRAY( *records, *n_records, record,
+                              DEFAULT_CHUNK_SIZE );
+    }
+
+    /*--- the whole file must have been read */
+
+    if( valid && (n_bytes_left != 0.0 || fgetc( file ) != EOF) )
+        valid = FALSE;
+
+    (void) fclose( file );
+
+    if( !valid )
+    {
+        delete_transform_records( *n_records, *records );
+        *n_records = 0;
+    }
+
+    return( valid );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : output_transform_cache
+@INPUT      : cache_filename
+              size                - of the transform file
+              modification_time   - of the transform file
+              n_records
+              records
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Outputs the transform records to the cache of a transform file.
+              The cache is written to a temporary file which is then renamed,
+              so that other processes never read a partial cache.  Failure is
+              silent, as the cache is only an optimization.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  output_transform_cache(
+    VIO_STR            cache_filename,
+    VIO_Real           size,
+    VIO_Real           modification_time,
+    int                n_records,
+    transform_record   records[] )
+{
+    FILE               *file;
+    VIO_BOOL           okay;
+    VIO_Real           key[2];
+    VIO_STR            tmp_filename;
+    char               suffix[80];
+    int                i, header_ints[3], record_ints[5];
+    size_t             n_values;
+    transform_record   *record;
+
+#if HAVE_UNISTD_H
+    (void) snprintf( suffix, sizeof(suffix), "-%d", (int) getpid() );
+#else
+    (void) strcpy( suffix, "-tmp" );
+#endif /* HAVE_UNISTD_H */
+
+    tmp_filename = concat_strings( cache_filename, suffix );
+
+    file = fopen( tmp_filename, "wb" );
+    if( file == NULL )
+    {
+        delete_string( tmp_filename );
+        return;
+    }
+
+    header_ints[0] = 1;
+    header_ints[1] = TRANSFORM_CACHE_VERSION;
+    header_ints[2] = n_records;
+    key[0] = size;
+    key[1] = modification_time;
+
+    okay = (fprintf( file, "%s\n", TRANSFORM_CACHE_HEADER ) > 0 &&
+            fwrite( header_ints, sizeof(int), 3, file ) == 3 &&
+            fwrite( key, sizeof(VIO_Real), 2, file ) == 2);
+
+    for_less( i, 0, n_records )
+    {
+        record = &records[i];
+
+        record_ints[0] = (int) record->type;
+        record_ints[1] = (int) record->inverse_flag;
+        record_ints[2] = 0;
+        record_ints[3] = 0;
+        record_ints[4] = 0;
+
+        if( record->type == THIN_PLATE_SPLINE )
+        {
+            record_ints[2] = record->n_dimensions;
+            record_ints[3] = record->n_points;
+        }
+        else if( record->type == GRID_TRANSFORM )
+            record_ints[4] = string_length( record->volume_filename );
+
+        okay = okay && fwrite( record_ints, sizeof(int), 5, file ) == 5;
+
+        if( record->type == LINEAR )
+        {
+            okay = okay && fwrite( &Transform_elem(record->linear_transform,0,0),
+                                   sizeof(VIO_Real), 4 * 4, file ) == 4 * 4;
+        }
+        else if( record->type == THIN_PLATE_SPLINE )
+        {
+            n_values = (size_t) record->n_points *
+                       (size_t) record->n_dimensions;
+            okay = okay && fwrite( record->points[0], sizeof(VIO_Real),
+                                   n_values, file ) == n_values;
+            n_values = (size_t) (record->n_points + record->n_dimensions + 1) *
+                       (size_t) record->n_dimensions;
+            okay = okay && fwrite( record->displacements[0], sizeof(VIO_Real),
+                                   n_values, file ) == n_values;
+        }
+        else if( record->type == GRID_TRANSFORM )
+        {
+            n_values = (size_t) record_ints[4];
+            okay = okay && fwrite( record->volume_filename, sizeof(char),
+                                   n_values, file ) == n_values;
+        }
+    }
+
+    if( fclose( file ) != 0 )
+        okay = FALSE;
+
+    if( !okay || rename( tmp_filename, cache_filename ) != 0 )
+        (void) remove( tmp_filename );
+
+    delete_string( tmp_filename );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : input_transform_file
 @INPUT      : filename
 @OUTPUT     : transform
 @RETURNS    : VIO_OK or VIO_ERROR
-@DESCRIPTION: Opens the file, inputs the transform, and closes the file.
+@DESCRIPTION: Opens the file, inputs the transform, and closes the file.  If
+              get_transform_file_cache() is TRUE, the transform is input from
+              the cache of the file when it is up to date, and the cache is
+              written when it is not.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -743,18 +1603,75 @@ VIOAPI  VIO_Status  input_transform_file(
     const char              *filename,
     VIO_General_transform   *transform )
 {
-    VIO_Status  status;
-    FILE    *file;
+    VIO_Status          status;
+    FILE                *file;
+    int                 n_records;
+    transform_record    *records;
+    VIO_STR             used_filename, cache_filename;
+    VIO_Real            size, modification_time;
+    VIO_BOOL            cacheable;
+
+    if( !get_transform_file_cache() )
+    {
+        status = open_file_with_default_suffix( filename,
+                          get_default_transform_file_suffix(),
+                          READ_FILE, ASCII_FORMAT, &file );
 
-    status = open_file_with_default_suffix( filename,
-                      get_default_transform_file_suffix(),
-                      READ_FILE, ASCII_FORMAT, &file );
+        if( status == VIO_OK )
+            status = input_transform( file, filename, transform );
 
-    if( status == VIO_OK )
-        status = input_transform( file, filename, transform );
+        if( status == VIO_OK )
+            status = close_file( file );
+
+        return( status );
+    }
+
+    used_filename = get_transform_filename_used( filename );
+    cache_filename = concat_strings( used_filename, "." );
+    concat_to_string( &cache_filename, TRANSFORM_CACHE_SUFFIX );
+
+    cacheable = get_transform_file_key( used_filename, &size,
+                                        &modification_time );
+
+    if( cacheable && input_transform_cache( cache_filename, size,
+                                            modification_time,
+                                            &n_records, &records ) )
+    {
+        status = VIO_OK;
+    }
+    else
+    {
+        status = open_file( used_filename, READ_FILE, ASCII_FORMAT, &file );
+
+        if( status == VIO_OK )
+        {
+            status = input_transform_records( file, &n_records, &records );
+
+            if( close_file( file ) != VIO_OK && status == VIO_OK )
+            {
+                delete_transform_records( n_records, records );
+                status = VIO_ERROR;
+            }
+        }
+
+        if( status == VIO_OK && cacheable &&
+            (VIO_Real) time( NULL ) - modification_time >=
+                                                  TRANSFORM_CACHE_MIN_AGE )
+        {
+            output_transform_cache( cache_filename, size, modification_time,
+                                    n_records, records );
+        }
+    }
 
     if( status == VIO_OK )
-        status = close_file( file );
+    {
+        status = create_transform_from_records( n_records, records, filename,
+                                                transform );
+        delete_transform_records( n_records, records );
+    }
+
+    delete_string( cache_filename );
+    delete_string( used_filename );
 
     return( status );
 }
@@ -100,6 +100,7 @@ static  void  initialize_thin_plate_transform(
     transform->n_dimensions = n_dimensions;
     transform->n_points = n_points;
     transform->displacement_volume = NULL;
+    transform->tps_tree = NULL;
 
     VIO_ALLOC2D( transform->points, n_points, n_dimensions );
     VIO_ALLOC2D( transform->displacements, n_points + n_dimensions + 1,
@@ -291,6 +292,8 @@ static  void  internal_create_grid_transform(
       transform->displacement_volume = NULL;
     }
 
+    transform->inverse_displacement_volume = NULL;
+
     /*Will be initialized on save*/
     if(displacement_volume_file)
       transform->displacement_volume_file = create_string( displacement_volume_file );
@@ -566,26 +569,10 @@ static  VIO_Status  transform_or_invert_point_with_input_steps(
         break;
 
     case THIN_PLATE_SPLINE:
-        if( inverse_flag )
-        {
-            return thin_plate_spline_inverse_transform( transform->n_dimensions,
-                                                 transform->n_points,
-                                                 transform->points,
-                                                 transform->displacements,
-                                                 x, y, z,
-                                                 x_transformed, y_transformed,
-                                                 z_transformed );
-        }
-        else
-        {
-            return thin_plate_spline_transform( transform->n_dimensions,
-                                         transform->n_points,
-                                         transform->points,
-                                         transform->displacements,
-                                         x, y, z,
+        return thin_plate_spline_general_transform_point( transform,
+                                         inverse_flag, x, y, z,
                                          x_transformed, y_transformed,
                                          z_transformed );
-        }
         break;
 
     case GRID_TRANSFORM:
@@ -804,6 +791,722 @@ VIOAPI  VIO_Status  general_inverse_transform_point(
                                x_transformed, y_transformed, z_transformed );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : linear_transform_points
+@INPUT      : transform
+              n_points
+              points
+@OUTPUT     : transformed_points  - may be the same array as points
+@RETURNS    :
+@DESCRIPTION: Transforms many points by the transform matrix, giving the same
+              results as transform_point() on each.  An affine matrix is
+              applied in one loop over the points.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  linear_transform_points(
+    VIO_Transform   *transform,
+    int             n_points,
+    VIO_Real        points[][VIO_N_DIMENSIONS],
+    VIO_Real        transformed_points[][VIO_N_DIMENSIONS] )
+{
+    int        p;
+    VIO_Real   x, y, z;
+
+    if( Transform_elem(*transform,3,0) != 0.0 ||
+        Transform_elem(*transform,3,1) != 0.0 ||
+        Transform_elem(*transform,3,2) != 0.0 ||
+        Transform_elem(*transform,3,3) != 1.0 )
+    {
+        for_less( p, 0, n_points )
+        {
+            (void) transform_point( transform,
+                                    points[p][VIO_X], points[p][VIO_Y],
+                                    points[p][VIO_Z],
+                                    &transformed_points[p][VIO_X],
+                                    &transformed_points[p][VIO_Y],
+                                    &transformed_points[p][VIO_Z] );
+        }
+        return;
+    }
+
+    for_less( p, 0, n_points )
+    {
+        x = points[p][VIO_X];
+        y = points[p][VIO_Y];
+        z = points[p][VIO_Z];
+
+        transformed_points[p][VIO_X] = Transform_elem(*transform,0,0) * x +
+                                       Transform_elem(*transform,0,1) * y +
+                                       Transform_elem(*transform,0,2) * z +
+                                       Transform_elem(*transform,0,3);
+        transformed_points[p][VIO_Y] = Transform_elem(*transform,1,0) * x +
+                                       Transform_elem(*transform,1,1) * y +
+                                       Transform_elem(*transform,1,2) * z +
+                                       Transform_elem(*transform,1,3);
+        transformed_points[p][VIO_Z] = Transform_elem(*transform,2,0) * x +
+                                       Transform_elem(*transform,2,1) * y +
+                                       Transform_elem(*transform,2,2) * z +
+                                       Transform_elem(*transform,2,3);
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_concatenated_point
+@INPUT      : transform   - a concatenated transform
+              inverse_flag
+              first_step  - number of its transforms already applied
+              point
+@OUTPUT     : transformed_point  - may be the same as point
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Takes one point through the rest of a concatenated transform,
+              or of its inverse, as general_transform_point() does, stopping
+              at the first transform that fails.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  transform_concatenated_point(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    int                     first_step,
+    VIO_Real                point[],
+    VIO_Real                transformed_point[] )
+{
+    int          step, trans;
+    VIO_Real     x, y, z;
+    VIO_Status   status;
+
+    x = point[VIO_X];
+    y = point[VIO_Y];
+    z = point[VIO_Z];
+    status = VIO_OK;
+
+    for_less( step, first_step, transform->n_transforms )
+    {
+        if( inverse_flag )
+        {
+            trans = transform->n_transforms - 1 - step;
+            status = general_inverse_transform_point_with_input_steps(
+                                 &transform->transforms[trans], x, y, z, NULL,
+                                 &x, &y, &z );
+        }
+        else
+        {
+            status = general_transform_point_with_input_steps(
+                                 &transform->transforms[step], x, y, z, NULL,
+                                 &x, &y, &z );
+        }
+
+        if( status != VIO_OK )
+            break;
+    }
+
+    transformed_point[VIO_X] = x;
+    transformed_point[VIO_Y] = y;
+    transformed_point[VIO_Z] = z;
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_or_invert_points
+@INPUT      : transform
+              inverse_flag
+              warm_start          - start the search for each inverse from
+                                    that of the point before
+              n_points
+              points
+@OUTPUT     : transformed_points  - may be the same array as points
+              n_iterations        - incremented by the number of forward
+                                    evaluations made by searches for
+                                    inverses
+@RETURNS    : VIO_OK, or VIO_ERROR if any point failed
+@DESCRIPTION: Transforms many points by the general transform or its inverse,
+              depending on inverse_flag.  A concatenated transform passes the
+              whole array through each of its transforms in turn, rather
+              than each point through all of them.  A point that fails is
+              left as general_transform_point() would leave it, and the
+              others are still transformed.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  transform_or_invert_points(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_BOOL                warm_start,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS],
+    long                    *n_iterations )
+{
+    int          p, trans, step;
+    long         iterations;
+    VIO_Status   status;
+    VIO_Real     (*stage_points)[VIO_N_DIMENSIONS];
+    VIO_General_transform  *sub;
+
+    switch( transform->type )
+    {
+    case LINEAR:
+        if( inverse_flag )
+            linear_transform_points( transform->inverse_linear_transform,
+                                     n_points, points, transformed_points );
+        else
+            linear_transform_points( transform->linear_transform,
+                                     n_points, points, transformed_points );
+        return VIO_OK;
+
+    case GRID_TRANSFORM:
+        if( !transform->displacement_volume ) {
+          handle_internal_error( "Not initialized grid transform, make sure you have MINC1" );
+          return VIO_ERROR;
+        }
+        if( !inverse_flag )
+            return grid_transform_points( transform, n_points, points,
+                                          transformed_points );
+
+        status = grid_inverse_transform_scanline( transform, warm_start,
+                                                  n_points, points,
+                                                  transformed_points,
+                                                  &iterations );
+        *n_iterations += iterations;
+        return status;
+
+    case THIN_PLATE_SPLINE:
+        status = thin_plate_spline_general_transform_points( transform,
+                                 inverse_flag, warm_start, n_points, points,
+                                 transformed_points, &iterations );
+        *n_iterations += iterations;
+        return status;
+
+    case CONCATENATED_TRANSFORM:
+        if( transformed_points != points )
+        {
+            for_less( p, 0, n_points )
+            {
+                transformed_points[p][VIO_X] = points[p][VIO_X];
+                transformed_points[p][VIO_Y] = points[p][VIO_Y];
+                transformed_points[p][VIO_Z] = points[p][VIO_Z];
+            }
+        }
+
+        if( n_points <= 0 )
+            return VIO_OK;
+
+        ALLOC( stage_points, n_points );
+        status = VIO_OK;
+
+        for_less( step, 0, transform->n_transforms )
+        {
+            trans = inverse_flag ? transform->n_transforms - 1 - step : step;
+            sub = &transform->transforms[trans];
+
+            /*--- only linear transforms cannot fail */
+
+            if( sub->type != LINEAR )
+            {
+                for_less( p, 0, n_points )
+                {
+                    stage_points[p][VIO_X] = transformed_points[p][VIO_X];
+                    stage_points[p][VIO_Y] = transformed_points[p][VIO_Y];
+                    stage_points[p][VIO_Z] = transformed_points[p][VIO_Z];
+                }
+            }
+
+            if( transform_or_invert_points( sub,
+                          inverse_flag ? !sub->inverse_flag : sub->inverse_flag,
+                          warm_start, n_points, transformed_points,
+                          transformed_points, n_iterations ) != VIO_OK )
+            {
+                /*--- some point failed in this transform; take each point
+                      from here through the rest of the concatenation on its
+                      own, so that a point that fails stops where it would
+                      in general_transform_point() and the others go on */
+
+                for_less( p, 0, n_points )
+                {
+                    if( transform_concatenated_point( transform, inverse_flag,
+                                              step, stage_points[p],
+                                              transformed_points[p] ) != VIO_OK )
+                        status = VIO_ERROR;
+                }
+                break;
+            }
+        }
+
+        FREE( stage_points );
+        return status;
+
+    default:
+        break;
+    }
+
+    /* the remaining transforms go one point at a time, each point whether
+       or not one before it failed */
+
+    status = VIO_OK;
+    for_less( p, 0, n_points )
+    {
+        if( transform_or_invert_point_with_input_steps( transform,
+                          inverse_flag,
+                          points[p][VIO_X], points[p][VIO_Y], points[p][VIO_Z],
+                          NULL,
+                          &transformed_points[p][VIO_X],
+                          &transformed_points[p][VIO_Y],
+                          &transformed_points[p][VIO_Z] ) != VIO_OK )
+            status = VIO_ERROR;
+    }
+
+    return status;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : general_transform_points
+@INPUT      : transform
+              n_points
+              points              - array of x,y,z positions
+@OUTPUT     : transformed_points  - may be the same array as points
+@RETURNS    : VIO_OK, or VIO_ERROR if any point failed
+@DESCRIPTION: Transforms many points by the general transform, giving the
+              same results as general_transform_point() on each, failed
+              points included.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  general_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] )
+{
+    long   n_iterations;
+
+    return transform_or_invert_points( transform, transform->inverse_flag,
+                                       FALSE, n_points, points,
+                                       transformed_points, &n_iterations );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : general_inverse_transform_points
+@INPUT      : transform
+              n_points
+              points              - array of x,y,z positions
+@OUTPUT     : transformed_points  - may be the same array as points
+@RETURNS    : VIO_OK, or VIO_ERROR if any point failed
+@DESCRIPTION: Transforms many points by the inverse of the general transform,
+              giving the same results as general_inverse_transform_point()
+              on each, failed points included.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  general_inverse_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] )
+{
+    long   n_iterations;
+
+    return transform_or_invert_points( transform, !transform->inverse_flag,
+                                       FALSE, n_points, points,
+                                       transformed_points, &n_iterations );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : general_inverse_transform_scanline
+@INPUT      : transform
+              warm_start          - start the search for each inverse from
+                                    that of the point before
+              n_points
+              points              - array of x,y,z positions, in order along
+                                    one or more lines
+@OUTPUT     : transformed_points  - may be the same array as points
+              n_iterations        - number of forward evaluations made by
+                                    searches for inverses, or NULL
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms many points by the inverse of the general transform,
+              as general_inverse_transform_points() does, counting the
+              iterations of the searches for the inverses of thin plate
+              spline and grid transforms.  Without warm_start the results
+              are the same as general_inverse_transform_points().  With
+              warm_start, each search starts from the inverse of the point
+              before, moved by as much as the point moved.  For points along
+              a scanline, such as the voxels of a row being resampled, this
+              is much closer than the usual start and takes far fewer
+              iterations.  A search which fails from there is made again from
+              the usual start, so jumps between lines are harmless.  User
+              transforms have inverse functions of their own, and are
+              inverted one point at a time as usual.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  general_inverse_transform_scanline(
+    VIO_General_transform   *transform,
+    VIO_BOOL                warm_start,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS],
+    long                    *n_iterations )
+{
+    long         iterations;
+    VIO_Status   status;
+
+    iterations = 0;
+
+    status = transform_or_invert_points( transform, !transform->inverse_flag,
+                                         warm_start, n_points, points,
+                                         transformed_points, &iterations );
+
+    if( n_iterations != NULL )
+        *n_iterations = iterations;
+
+    return( status );
+}
+
+/* --- step in world units of the central differences used for the Jacobian
+       of transforms with no derivatives of their own */
+
+#define  JACOBIAN_STEP  1.0e-3
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : multiply_jacobians
+@INPUT      : outer
+              inner
+@OUTPUT     : product  - may be the same array as inner
+@RETURNS    :
+@DESCRIPTION: Multiplies two 3 by 3 Jacobians, the Jacobian of the outer
+              transform applied after the inner one.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  multiply_jacobians(
+    VIO_Real   outer[][VIO_N_DIMENSIONS],
+    VIO_Real   inner[][VIO_N_DIMENSIONS],
+    VIO_Real   product[][VIO_N_DIMENSIONS] )
+{
+    int        c, d, i;
+    VIO_Real   sum, result[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        sum = 0.0;
+        for_less( i, 0, VIO_N_DIMENSIONS )
+            sum += outer[c][i] * inner[i][d];
+        result[c][d] = sum;
+    }
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    for_less( d, 0, VIO_N_DIMENSIONS )
+        product[c][d] = result[c][d];
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : invert_jacobian
+@INPUT      : jacobian
+@OUTPUT     : inverse
+@RETURNS    : VIO_OK, or VIO_ERROR if the Jacobian is singular
+@DESCRIPTION: Inverts a 3 by 3 Jacobian by its cofactors.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  invert_jacobian(
+    VIO_Real   jacobian[][VIO_N_DIMENSIONS],
+    VIO_Real   inverse[][VIO_N_DIMENSIONS] )
+{
+    int        c, d;
+    VIO_Real   det, cofactors[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        cofactors[c][d] =
+            jacobian[(c+1)%3][(d+1)%3] * jacobian[(c+2)%3][(d+2)%3] -
+            jacobian[(c+1)%3][(d+2)%3] * jacobian[(c+2)%3][(d+1)%3];
+    }
+
+    det = jacobian[0][0] * cofactors[0][0] +
+          jacobian[0][1] * cofactors[0][1] +
+          jacobian[0][2] * cofactors[0][2];
+
+    if( det == 0.0 )
+        return( VIO_ERROR );
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    for_less( d, 0, VIO_N_DIMENSIONS )
+        inverse[c][d] = cofactors[d][c] / det;
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_or_invert_point_with_jacobian
+@INPUT      : transform
+              inverse_flag
+              x
+              y
+              z
+@OUTPUT     : transformed  - the transformed point
+              jacobian     - jacobian[c][d] is the derivative of the
+                             transformed coordinate c with respect to d
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms a point by the general transform or its inverse,
+              depending on inverse_flag, and finds the Jacobian of the
+              mapping there.  Linear, grid and thin plate spline transforms
+              have exact derivatives, the Jacobian of an inverse is the
+              inverse of the Jacobian at the inverted point, and that of a
+              concatenation is the product of the Jacobians of its
+              transforms.  User and projective transforms are differentiated
+              by central differences.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  transform_or_invert_point_with_jacobian(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                transformed[],
+    VIO_Real                jacobian[][VIO_N_DIMENSIONS] )
+{
+    int             c, d, trans;
+    VIO_Real        forward[VIO_N_DIMENSIONS];
+    VIO_Real        forward_jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+    VIO_Real        position[VIO_N_DIMENSIONS], plus[VIO_N_DIMENSIONS];
+    VIO_Real        minus[VIO_N_DIMENSIONS], values[VIO_N_DIMENSIONS];
+    VIO_Real        *derivs[VIO_N_DIMENSIONS];
+    VIO_Transform   *linear;
+    VIO_BOOL        member_inverse;
+    VIO_Status      status;
+
+    switch( transform->type )
+    {
+    case LINEAR:
+        linear = inverse_flag ? transform->inverse_linear_transform :
+                                transform->linear_transform;
+
+        if( Transform_elem(*linear,3,0) != 0.0 ||
+            Transform_elem(*linear,3,1) != 0.0 ||
+            Transform_elem(*linear,3,2) != 0.0 ||
+            Transform_elem(*linear,3,3) != 1.0 )
+            break;
+
+        (void) transform_point( linear, x, y, z, &transformed[VIO_X],
+                                &transformed[VIO_Y], &transformed[VIO_Z] );
+
+        for_less( c, 0, VIO_N_DIMENSIONS )
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            jacobian[c][d] = Transform_elem(*linear,c,d);
+
+        return( VIO_OK );
+
+    case THIN_PLATE_SPLINE:
+    case GRID_TRANSFORM:
+        if( inverse_flag )
+        {
+            if( (status = transform_or_invert_point_with_input_steps(
+                              transform, TRUE, x, y, z, NULL,
+                              &transformed[VIO_X], &transformed[VIO_Y],
+                              &transformed[VIO_Z] )) != VIO_OK ||
+                (status = transform_or_invert_point_with_jacobian(
+                              transform, FALSE, transformed[VIO_X],
+                              transformed[VIO_Y], transformed[VIO_Z],
+                              forward, forward_jacobian )) != VIO_OK )
+                return( status );
+
+            return( invert_jacobian( forward_jacobian, jacobian ) );
+        }
+
+        if( transform->type == GRID_TRANSFORM )
+        {
+            if( !transform->displacement_volume ) {
+              handle_internal_error( "Not initialized grid transform, make sure you have MINC1" );
+              return VIO_ERROR;
+            }
+            return( grid_transform_point_with_jacobian( transform, x, y, z,
+                                  &transformed[VIO_X], &transformed[VIO_Y],
+                                  &transformed[VIO_Z], jacobian ) );
+        }
+
+        /*--- dimensions beyond those of the spline pass through */
+
+        position[VIO_X] = x;
+        position[VIO_Y] = y;
+        position[VIO_Z] = z;
+
+        for_less( c, 0, VIO_N_DIMENSIONS )
+        {
+            transformed[c] = position[c];
+            derivs[c] = jacobian[c];
+            for_less( d, 0, VIO_N_DIMENSIONS )
+                jacobian[c][d] = (c == d) ? 1.0 : 0.0;
+        }
+
+        evaluate_thin_plate_spline( transform->n_dimensions,
+                                    transform->n_dimensions,
+                                    transform->n_points, transform->points,
+                                    transform->displacements, position,
+                                    values, derivs );
+
+        for_less( c, 0, transform->n_dimensions )
+            transformed[c] = values[c];
+
+        return( VIO_OK );
+
+    case CONCATENATED_TRANSFORM:
+        transformed[VIO_X] = x;
+        transformed[VIO_Y] = y;
+        transformed[VIO_Z] = z;
+
+        for_less( c, 0, VIO_N_DIMENSIONS )
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            jacobian[c][d] = (c == d) ? 1.0 : 0.0;
+
+        for_less( trans, 0, transform->n_transforms )
+        {
+            if( inverse_flag )
+            {
+                d = transform->n_transforms - 1 - trans;
+                member_inverse = !transform->transforms[d].inverse_flag;
+            }
+            else
+            {
+                d = trans;
+                member_inverse = transform->transforms[d].inverse_flag;
+            }
+
+            if( (status = transform_or_invert_point_with_jacobian(
+                              &transform->transforms[d], member_inverse,
+                              transformed[VIO_X], transformed[VIO_Y],
+                              transformed[VIO_Z], transformed,
+                              forward_jacobian )) != VIO_OK )
+                return( status );
+
+            multiply_jacobians( forward_jacobian, jacobian, jacobian );
+        }
+        return( VIO_OK );
+
+    default:
+        break;
+    }
+
+    /*--- central differences for the remaining transforms */
+
+    if( (status = transform_or_invert_point_with_input_steps( transform,
+                      inverse_flag, x, y, z, NULL, &transformed[VIO_X],
+                      &transformed[VIO_Y], &transformed[VIO_Z] )) != VIO_OK )
+        return( status );
+
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        position[VIO_X] = x;
+        position[VIO_Y] = y;
+        position[VIO_Z] = z;
+
+        position[d] += JACOBIAN_STEP;
+        if( (status = transform_or_invert_point_with_input_steps( transform,
+                          inverse_flag, position[VIO_X], position[VIO_Y],
+                          position[VIO_Z], NULL, &plus[VIO_X], &plus[VIO_Y],
+                          &plus[VIO_Z] )) != VIO_OK )
+            return( status );
+
+        position[d] -= 2.0 * JACOBIAN_STEP;
+        if( (status = transform_or_invert_point_with_input_steps( transform,
+                          inverse_flag, position[VIO_X], position[VIO_Y],
+                          position[VIO_Z], NULL, &minus[VIO_X], &minus[VIO_Y],
+                          &minus[VIO_Z] )) != VIO_OK )
+            return( status );
+
+        for_less( c, 0, VIO_N_DIMENSIONS )
+            jacobian[c][d] = (plus[c] - minus[c]) / (2.0 * JACOBIAN_STEP);
+    }
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : general_transform_point_with_jacobian
+@INPUT      : transform
+              x
+              y
+              z
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+              jacobian       - jacobian[c][d] is the derivative of the
+                               transformed coordinate c with respect to d
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms a point by the general transform, as
+              general_transform_point() does, and finds the Jacobian of the
+              transform at the point.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  general_transform_point_with_jacobian(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed,
+    VIO_Real                jacobian[][VIO_N_DIMENSIONS] )
+{
+    VIO_Real     transformed[VIO_N_DIMENSIONS];
+    VIO_Status   status;
+
+    status = transform_or_invert_point_with_jacobian( transform,
+                                 transform->inverse_flag, x, y, z,
+                                 transformed, jacobian );
+
+    *x_transformed = transformed[VIO_X];
+    *y_transformed = transformed[VIO_Y];
+    *z_transformed = transformed[VIO_Z];
+
+    return( status );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : copy_and_invert_transform
 @INPUT      : transform
@@ -863,6 +1566,10 @@ static  void  copy_and_invert_transform(
             for_less( j, 0, copy->n_dimensions )
                 copy->displacements[i][j] = transform->displacements[i][j];
 
+        copy->tps_tree = NULL;
+        set_thin_plate_spline_tolerance( copy,
+                               get_thin_plate_spline_tolerance( transform ) );
+
         if( invert_it )
             copy->inverse_flag = !copy->inverse_flag;
         break;
@@ -874,6 +1581,9 @@ static  void  copy_and_invert_transform(
         if( transform->displacement_volume_file )
           copy->displacement_volume_file =
             create_string( transform->displacement_volume_file );
+        if( transform->inverse_displacement_volume )
+          copy->inverse_displacement_volume = (void *) copy_volume(
+                              (VIO_Volume) transform->inverse_displacement_volume );
 
         if( invert_it )
             copy->inverse_flag = !copy->inverse_flag;
@@ -1121,6 +1831,149 @@ VIOAPI  void  concat_general_transforms(
         *result = *result_ptr;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : append_simplified_stages
+@INPUT      : transform
+              invert_it
+              n_stages
+              stages
+@OUTPUT     : n_stages
+              stages
+@RETURNS    :
+@DESCRIPTION: Appends copies of the transform, or of its inverse, to the
+              list of stages, expanding concatenated transforms into their
+              members and multiplying adjacent linear transforms together.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  append_simplified_stages(
+    VIO_General_transform   *transform,
+    VIO_BOOL                invert_it,
+    int                     *n_stages,
+    VIO_General_transform   **stages )
+{
+    int                     trans;
+    VIO_General_transform   stage, *last;
+
+    if( transform->type == CONCATENATED_TRANSFORM )
+    {
+        if( transform->inverse_flag )
+            invert_it = !invert_it;
+
+        if( invert_it )
+        {
+            for( trans = transform->n_transforms-1;  trans >= 0;  --trans )
+                append_simplified_stages( &transform->transforms[trans], TRUE,
+                                          n_stages, stages );
+        }
+        else
+        {
+            for_less( trans, 0, transform->n_transforms )
+                append_simplified_stages( &transform->transforms[trans], FALSE,
+                                          n_stages, stages );
+        }
+        return;
+    }
+
+    copy_and_invert_transform( transform, invert_it, &stage );
+
+    last = (*n_stages > 0) ? &(*stages)[*n_stages-1] : NULL;
+
+    if( stage.type == LINEAR && last != NULL && last->type == LINEAR )
+    {
+        concat_transforms( last->linear_transform,
+                           last->linear_transform, stage.linear_transform );
+        concat_transforms( last->inverse_linear_transform,
+                           stage.inverse_linear_transform,
+                           last->inverse_linear_transform );
+        delete_general_transform( &stage );
+    }
+    else
+    {
+        ADD_ELEMENT_TO_ARRAY( *stages, *n_stages, stage, DEFAULT_CHUNK_SIZE );
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : simplify_general_transform
+@INPUT      : transform
+@OUTPUT     : simplified
+@RETURNS    :
+@DESCRIPTION: Creates a transform equivalent to the given one with as few
+              stages as possible: nested and inverted concatenations are
+              expanded into a single list, adjacent linear transforms are
+              multiplied into one, and linear transforms which are exactly
+              the identity are dropped.  The result is the same transform
+              up to the rounding of the matrix products, and is a single
+              transform rather than a concatenation when only one stage
+              remains.  To replace a nonlinear chain by a single grid, see
+              flatten_general_transform().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  simplify_general_transform(
+    VIO_General_transform   *transform,
+    VIO_General_transform   *simplified )
+{
+    int                     i, j, n_stages, n_kept;
+    VIO_BOOL                identity;
+    VIO_Transform           identity_transform;
+    VIO_General_transform   *stages;
+
+    n_stages = 0;
+    stages = NULL;
+
+    append_simplified_stages( transform, FALSE, &n_stages, &stages );
+
+    /*--- drop linear stages which do nothing */
+
+    make_identity_transform( &identity_transform );
+
+    n_kept = 0;
+    for_less( i, 0, n_stages )
+    {
+        identity = stages[i].type == LINEAR;
+        for( j = 0;  identity && j < 16;  ++j )
+        {
+            identity = Transform_elem( *stages[i].linear_transform,
+                                       j / 4, j % 4 ) ==
+                       Transform_elem( identity_transform, j / 4, j % 4 );
+        }
+
+        if( identity )
+            delete_general_transform( &stages[i] );
+        else
+            stages[n_kept++] = stages[i];
+    }
+
+    if( n_kept == 0 )
+    {
+        create_linear_transform( simplified, &identity_transform );
+        if( n_stages > 0 )
+            FREE( stages );
+    }
+    else if( n_kept == 1 )
+    {
+        *simplified = stages[0];
+        FREE( stages );
+    }
+    else
+    {
+        simplified->type = CONCATENATED_TRANSFORM;
+        simplified->inverse_flag = FALSE;
+        simplified->n_transforms = n_kept;
+        simplified->transforms = stages;
+    }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : delete_general_transform
 @INPUT      : transform
@@ -1148,6 +2001,8 @@ VIOAPI  void  delete_general_transform(
         break;
 
     case THIN_PLATE_SPLINE:
+        set_thin_plate_spline_tolerance( transform, 0.0 );
+
         if( transform->n_points > 0 && transform->n_dimensions > 0 )
         {
             VIO_FREE2D( transform->points );
@@ -1158,6 +2013,8 @@ VIOAPI  void  delete_general_transform(
     case GRID_TRANSFORM:
         if( transform->displacement_volume )
           delete_volume( (VIO_Volume) transform->displacement_volume );
+        if( transform->inverse_displacement_volume )
+          delete_volume( (VIO_Volume) transform->inverse_displacement_volume );
         if( transform->displacement_volume_file )
           delete_string(transform->displacement_volume_file);
 
@@ -16,6 +16,7 @@
 #endif /*HAVE_CONFIG_H*/
 
 #include  <internal_volume_io.h>
+#include  "minc_parallel.h"
 
 #define   DEGREES_CONTINUITY         2    /* -1 = Nearest; 0 = Linear; 1 = Quadratic; 2 = Cubic interpolation */
 #define   SPLINE_DEGREE         ((DEGREES_CONTINUITY) + 2)
@@ -24,6 +25,24 @@
 
 #define   FOUR_DIMS      4
 
+#define   NUMBER_TRIES   10
+
+/* --- inverting at the nodes of a precomputed inverse displacement grid
+       is done to a tolerance this much tighter, in this many tries */
+
+#define   NODE_TOLERANCE_FACTOR   0.1
+#define   NODE_NUMBER_TRIES       100
+
+#define   INVERSE_NODES_PER_TILE  64
+
+/* --- rows of grid nodes sampled at a time when flattening a transform */
+
+#define   FLATTEN_ROWS_PER_TILE   4
+
+/* --- rows of voxels of a deformation volume computed at a time */
+
+#define   DEFORMATION_ROWS_PER_TILE   4
+
 #ifdef USE_NEWTONS_METHOD
 #define   INVERSE_FUNCTION_TOLERANCE     0.01
 #define   INVERSE_DELTA_TOLERANCE        1.0e-5
@@ -41,6 +60,466 @@ static void   evaluate_grid_volume(
     VIO_Real           deriv_y[],
     VIO_Real           deriv_z[] );
 
+/* --- number of points converted to voxel coordinates at a time */
+
+#define   GRID_POINTS_BATCH_SIZE   64
+
+/* --- what evaluate_grid_volume() finds out about the displacement volume
+       on each call, found once for a set of points */
+
+typedef  struct
+{
+    VIO_Volume       volume;
+    int              vector_dim;
+    int              sizes[FOUR_DIMS];
+    size_t           strides[FOUR_DIMS];
+    VIO_BOOL         is_2dslice;
+    VIO_Data_types   data_type;
+    void             *data;
+    VIO_Real         scale;
+    VIO_Real         translation;
+} grid_volume_info;
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_grid_volume_info
+@INPUT      : volume
+@OUTPUT     : info
+@RETURNS    : TRUE if the volume can be evaluated by evaluate_grid_fast()
+@DESCRIPTION: Finds the vector dimension, sizes, strides and voxel storage
+              of a displacement volume.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  get_grid_volume_info(
+    VIO_Volume         volume,
+    grid_volume_info   *info )
+{
+    int   d;
+
+    if( get_volume_n_dimensions(volume) != FOUR_DIMS )
+        handle_internal_error( "get_grid_volume_info" );
+
+    info->volume = volume;
+
+    for_less( info->vector_dim, 0, FOUR_DIMS ) {
+        for_less( d, 0, VIO_N_DIMENSIONS ) {
+            if( volume->spatial_axes[d] == info->vector_dim )
+                break;
+        }
+        if( d == VIO_N_DIMENSIONS )
+            break;
+    }
+
+    get_volume_sizes( volume, info->sizes );
+
+    info->strides[FOUR_DIMS-1] = 1;
+    for_down( d, FOUR_DIMS-2, 0 )
+        info->strides[d] = info->strides[d+1] * (size_t) info->sizes[d+1];
+
+    info->is_2dslice = FALSE;
+    for_less( d, 0, FOUR_DIMS ) {
+        if( d != info->vector_dim && info->sizes[d] == 1 )
+            info->is_2dslice = TRUE;
+    }
+
+    info->data_type = get_volume_data_type( volume );
+
+    if( volume->real_range_set && !volume->is_labels ) {
+        info->scale = volume->real_value_scale;
+        info->translation = volume->real_value_translation;
+    } else {
+        info->scale = 1.0;
+        info->translation = 0.0;
+    }
+
+    if( volume->is_cached_volume || !volume_is_alloced( volume ) ||
+        info->sizes[info->vector_dim] != N_COMPONENTS || info->is_2dslice ) {
+        info->data = NULL;
+        return( FALSE );
+    }
+
+    GET_MULTIDIM_PTR_4D( info->data, volume->array, 0, 0, 0, 0 )
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_grid_fast
+@INPUT      : info
+              voxel
+@OUTPUT     : values
+@RETURNS    : TRUE if the point was evaluated
+@DESCRIPTION: Evaluates the displacement at a voxel position, as done by
+              evaluate_grid_volume() with cubic interpolation, but with the
+              tricubic (Catmull-Rom) or trilinear weights computed once per
+              dimension and the control vertices read straight from the
+              voxel array.  Returns FALSE for points where
+              evaluate_grid_volume() would lower the degree below linear
+              or not interpolate at all, which are left to it.
+              The sums are taken in a different order, and the voxel to
+              value conversion is applied to them rather than to each
+              control vertex, so the displacements are not bit for bit
+              those of evaluate_grid_volume(): they agree to within
+              rounding, a few units in the last place of the largest
+              displacement of the stencil.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#define  SUM_GRID_STENCIL( type ) \
+         { \
+             type  *ptr = (type *) info->data + base; \
+             for_less( i, 0, n_weights ) \
+             for_less( j, 0, n_weights ) \
+             { \
+                 w_ij = weights[0][i] * weights[1][j]; \
+                 row = ptr + (size_t) i * stride[0] + (size_t) j * stride[1]; \
+                 for_less( k, 0, n_weights ) \
+                 { \
+                     w = w_ij * weights[2][k]; \
+                     sum[0] += w * (VIO_Real) row[0]; \
+                     sum[1] += w * (VIO_Real) row[vector_stride]; \
+                     sum[2] += w * (VIO_Real) row[2*vector_stride]; \
+                     row += stride[2]; \
+                 } \
+             } \
+         }
+
+static  VIO_BOOL  evaluate_grid_fast(
+    grid_volume_info   *info,
+    VIO_Real           voxel[],
+    VIO_Real           values[] )
+{
+    int        d, id, degrees_continuity, n_weights, start;
+    int        i, j, k;
+    size_t     base, stride[VIO_N_DIMENSIONS], vector_stride;
+    VIO_Real   bound, pos, u, w, w_ij, sum[N_COMPONENTS];
+    VIO_Real   weights[VIO_N_DIMENSIONS][4];
+
+    /*--- lower the degree near the edges, as evaluate_grid_volume() does */
+
+    degrees_continuity = DEGREES_CONTINUITY;
+    bound = (VIO_Real) degrees_continuity / 2.0;
+
+    for_less( d, 0, FOUR_DIMS ) {
+      if( d == info->vector_dim ) continue;
+      while( degrees_continuity >= -1 &&
+             (voxel[d] < bound  ||
+              voxel[d] > (VIO_Real) info->sizes[d] - 1.0 - bound ||
+              bound == (VIO_Real) info->sizes[d] - 1.0 - bound ) ) {
+        --degrees_continuity;
+        if( degrees_continuity == 1 )
+          degrees_continuity = 0;
+        bound = (VIO_Real) degrees_continuity / 2.0;
+      }
+    }
+
+    if( degrees_continuity != 2 && degrees_continuity != 0 )
+        return( FALSE );
+
+    n_weights = degrees_continuity + 2;
+
+    /*--- the start and weights of the stencil along each spatial dimension */
+
+    base = 0;
+    id = 0;
+    for_less( d, 0, FOUR_DIMS ) {
+        if( d == info->vector_dim ) continue;
+
+        pos = voxel[d] - bound;
+        start = VIO_FLOOR( pos );
+        if( start < 0 ) {
+            start = 0;
+        } else if( start+degrees_continuity+1 >= info->sizes[d] ) {
+            start = info->sizes[d] - degrees_continuity - 2;
+        }
+        u = pos - (VIO_Real) start;
+
+        if( n_weights == 4 ) {
+            weights[id][0] = u * (-0.5 + u * (1.0 - 0.5 * u));
+            weights[id][1] = 1.0 + u * u * (-2.5 + 1.5 * u);
+            weights[id][2] = u * (0.5 + u * (2.0 - 1.5 * u));
+            weights[id][3] = u * u * (-0.5 + 0.5 * u);
+        } else {
+            weights[id][0] = 1.0 - u;
+            weights[id][1] = u;
+        }
+
+        base += (size_t) start * info->strides[d];
+        stride[id] = info->strides[d];
+        ++id;
+    }
+
+    vector_stride = info->strides[info->vector_dim];
+
+    sum[0] = 0.0;
+    sum[1] = 0.0;
+    sum[2] = 0.0;
+
+    switch( info->data_type )
+    {
+    case VIO_UNSIGNED_BYTE:
+        { const unsigned char *row; SUM_GRID_STENCIL( unsigned char ) }
+        break;
+    case VIO_SIGNED_BYTE:
+        { const signed char *row; SUM_GRID_STENCIL( signed char ) }
+        break;
+    case VIO_UNSIGNED_SHORT:
+        { const unsigned short *row; SUM_GRID_STENCIL( unsigned short ) }
+        break;
+    case VIO_SIGNED_SHORT:
+        { const signed short *row; SUM_GRID_STENCIL( signed short ) }
+        break;
+    case VIO_UNSIGNED_INT:
+        { const unsigned int *row; SUM_GRID_STENCIL( unsigned int ) }
+        break;
+    case VIO_SIGNED_INT:
+        { const signed int *row; SUM_GRID_STENCIL( signed int ) }
+        break;
+    case VIO_FLOAT:
+        { const float *row; SUM_GRID_STENCIL( float ) }
+        break;
+    case VIO_DOUBLE:
+        { const double *row; SUM_GRID_STENCIL( double ) }
+        break;
+    default:
+        return( FALSE );
+    }
+
+    /*--- the weights sum to one, so the voxel to value conversion can be
+          applied to the sums, which changes the result only by rounding */
+
+    values[0] = info->scale * sum[0] + info->translation;
+    values[1] = info->scale * sum[1] + info->translation;
+    values[2] = info->scale * sum[2] + info->translation;
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_grid_fast_with_derivs
+@INPUT      : info
+              voxel
+@OUTPUT     : values
+              voxel_derivs  - voxel_derivs[c][id] is the derivative of
+                              component c along the id'th spatial dimension
+                              of the volume, per voxel
+@RETURNS    : TRUE if the point was evaluated
+@DESCRIPTION: Evaluates the displacement and its derivatives at a voxel
+              position as evaluate_grid_fast() does the displacement, with
+              the derivatives of the tricubic or trilinear weights.  Returns
+              FALSE for the points evaluate_grid_fast() leaves to
+              evaluate_grid_volume().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#define  SUM_GRID_STENCIL_DERIVS( type ) \
+         { \
+             type  *ptr = (type *) info->data + base; \
+             for_less( i, 0, n_weights ) \
+             for_less( j, 0, n_weights ) \
+             { \
+                 row = ptr + (size_t) i * stride[0] + (size_t) j * stride[1]; \
+                 for_less( k, 0, n_weights ) \
+                 { \
+                     w[0] = weights[0][i] * weights[1][j] * weights[2][k]; \
+                     w[1] = dweights[0][i] * weights[1][j] * weights[2][k]; \
+                     w[2] = weights[0][i] * dweights[1][j] * weights[2][k]; \
+                     w[3] = weights[0][i] * weights[1][j] * dweights[2][k]; \
+                     for_less( c, 0, N_COMPONENTS ) \
+                     { \
+                         value = (VIO_Real) row[c*vector_stride]; \
+                         for_less( n, 0, 4 ) \
+                             sum[c][n] += w[n] * value; \
+                     } \
+                     row += stride[2]; \
+                 } \
+             } \
+         }
+
+static  VIO_BOOL  evaluate_grid_fast_with_derivs(
+    grid_volume_info   *info,
+    VIO_Real           voxel[],
+    VIO_Real           values[],
+    VIO_Real           voxel_derivs[][VIO_N_DIMENSIONS] )
+{
+    int        d, id, degrees_continuity, n_weights, start;
+    int        i, j, k, c, n;
+    size_t     base, stride[VIO_N_DIMENSIONS], vector_stride;
+    VIO_Real   bound, pos, u, w[4], value, sum[N_COMPONENTS][4];
+    VIO_Real   weights[VIO_N_DIMENSIONS][4], dweights[VIO_N_DIMENSIONS][4];
+
+    /*--- lower the degree near the edges, as evaluate_grid_volume() does */
+
+    degrees_continuity = DEGREES_CONTINUITY;
+    bound = (VIO_Real) degrees_continuity / 2.0;
+
+    for_less( d, 0, FOUR_DIMS ) {
+      if( d == info->vector_dim ) continue;
+      while( degrees_continuity >= -1 &&
+             (voxel[d] < bound  ||
+              voxel[d] > (VIO_Real) info->sizes[d] - 1.0 - bound ||
+              bound == (VIO_Real) info->sizes[d] - 1.0 - bound ) ) {
+        --degrees_continuity;
+        if( degrees_continuity == 1 )
+          degrees_continuity = 0;
+        bound = (VIO_Real) degrees_continuity / 2.0;
+      }
+    }
+
+    if( degrees_continuity != 2 && degrees_continuity != 0 )
+        return( FALSE );
+
+    n_weights = degrees_continuity + 2;
+
+    base = 0;
+    id = 0;
+    for_less( d, 0, FOUR_DIMS ) {
+        if( d == info->vector_dim ) continue;
+
+        pos = voxel[d] - bound;
+        start = VIO_FLOOR( pos );
+        if( start < 0 ) {
+            start = 0;
+        } else if( start+degrees_continuity+1 >= info->sizes[d] ) {
+            start = info->sizes[d] - degrees_continuity - 2;
+        }
+        u = pos - (VIO_Real) start;
+
+        if( n_weights == 4 ) {
+            weights[id][0] = u * (-0.5 + u * (1.0 - 0.5 * u));
+            weights[id][1] = 1.0 + u * u * (-2.5 + 1.5 * u);
+            weights[id][2] = u * (0.5 + u * (2.0 - 1.5 * u));
+            weights[id][3] = u * u * (-0.5 + 0.5 * u);
+            dweights[id][0] = -0.5 + u * (2.0 - 1.5 * u);
+            dweights[id][1] = u * (-5.0 + 4.5 * u);
+            dweights[id][2] = 0.5 + u * (4.0 - 4.5 * u);
+            dweights[id][3] = u * (-1.0 + 1.5 * u);
+        } else {
+            weights[id][0] = 1.0 - u;
+            weights[id][1] = u;
+            dweights[id][0] = -1.0;
+            dweights[id][1] = 1.0;
+        }
+
+        base += (size_t) start * info->strides[d];
+        stride[id] = info->strides[d];
+        ++id;
+    }
+
+    vector_stride = info->strides[info->vector_dim];
+
+    for_less( c, 0, N_COMPONENTS )
+    for_less( n, 0, 4 )
+        sum[c][n] = 0.0;
+
+    switch( info->data_type )
+    {
+    case VIO_UNSIGNED_BYTE:
+        { const unsigned char *row; SUM_GRID_STENCIL_DERIVS( unsigned char ) }
+        break;
+    case VIO_SIGNED_BYTE:
+        { const signed char *row; SUM_GRID_STENCIL_DERIVS( signed char ) }
+        break;
+    case VIO_UNSIGNED_SHORT:
+        { const unsigned short *row; SUM_GRID_STENCIL_DERIVS( unsigned short ) }
+        break;
+    case VIO_SIGNED_SHORT:
+        { const signed short *row; SUM_GRID_STENCIL_DERIVS( signed short ) }
+        break;
+    case VIO_UNSIGNED_INT:
+        { const unsigned int *row; SUM_GRID_STENCIL_DERIVS( unsigned int ) }
+        break;
+    case VIO_SIGNED_INT:
+        { const signed int *row; SUM_GRID_STENCIL_DERIVS( signed int ) }
+        break;
+    case VIO_FLOAT:
+        { const float *row; SUM_GRID_STENCIL_DERIVS( float ) }
+        break;
+    case VIO_DOUBLE:
+        { const double *row; SUM_GRID_STENCIL_DERIVS( double ) }
+        break;
+    default:
+        return( FALSE );
+    }
+
+    /*--- the derivatives of the weights sum to zero, so only the scale
+          of the voxel to value conversion applies to them */
+
+    for_less( c, 0, N_COMPONENTS )
+    {
+        values[c] = info->scale * sum[c][0] + info->translation;
+        for_less( id, 0, VIO_N_DIMENSIONS )
+            voxel_derivs[c][id] = info->scale * sum[c][id+1];
+    }
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_grid_volume_points
+@INPUT      : volume
+              n_points
+              points        - world positions
+@OUTPUT     : displacements
+@RETURNS    :
+@DESCRIPTION: Evaluates a displacement volume at many world positions, with
+              cubic interpolation, as evaluate_grid_volume() would.  The
+              positions are converted to voxels a batch at a time, and most
+              are evaluated by evaluate_grid_fast().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  evaluate_grid_volume_points(
+    VIO_Volume   volume,
+    int          n_points,
+    VIO_Real     points[][VIO_N_DIMENSIONS],
+    VIO_Real     displacements[][VIO_N_DIMENSIONS] )
+{
+    int                p, b, n_batch;
+    VIO_BOOL           fast;
+    VIO_Real           voxels[GRID_POINTS_BATCH_SIZE][VIO_MAX_DIMENSIONS];
+    grid_volume_info   info;
+
+    fast = get_grid_volume_info( volume, &info );
+
+    for( b = 0;  b < n_points;  b += GRID_POINTS_BATCH_SIZE )
+    {
+        n_batch = MIN( GRID_POINTS_BATCH_SIZE, n_points - b );
+
+        if( fast )
+            convert_world_to_voxel_points( volume, n_batch, &points[b],
+                                           voxels );
+
+        for_less( p, 0, n_batch )
+        {
+            if( !fast || !evaluate_grid_fast( &info, voxels[p],
+                                              displacements[b+p] ) )
+            {
+                evaluate_grid_volume( volume, points[b+p][VIO_X],
+                                      points[b+p][VIO_Y], points[b+p][VIO_Z],
+                                      DEGREES_CONTINUITY,
+                                      displacements[b+p], NULL, NULL, NULL );
+            }
+        }
+    }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : grid_transform_point
 @INPUT      : transform
@@ -68,7 +547,8 @@ VIOAPI  VIO_Status  grid_transform_point(
     VIO_Real                *y_transformed,
     VIO_Real                *z_transformed )
 {
-    VIO_Real    displacements[N_COMPONENTS];
+    VIO_Real    point[1][VIO_N_DIMENSIONS];
+    VIO_Real    displacements[VIO_N_DIMENSIONS];
     VIO_Volume  volume;
 
     /* --- the volume that defines the transform is an offset vector,
@@ -80,8 +560,11 @@ VIOAPI  VIO_Status  grid_transform_point(
 
     volume = (VIO_Volume) transform->displacement_volume;
 
-    evaluate_grid_volume( volume, x, y, z, DEGREES_CONTINUITY, displacements,
-                          NULL, NULL, NULL );
+    point[0][VIO_X] = x;
+    point[0][VIO_Y] = y;
+    point[0][VIO_Z] = z;
+
+    evaluate_grid_volume_points( volume, 1, point, &displacements );
 
     *x_transformed = x + displacements[VIO_X];
     *y_transformed = y + displacements[VIO_Y];
@@ -90,6 +573,142 @@ VIOAPI  VIO_Status  grid_transform_point(
     return VIO_OK;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_transform_points
+@INPUT      : transform
+              n_points
+              points              - world positions
+@OUTPUT     : transformed_points  - may be the same array as points
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Applies a grid transform to many points, giving the same
+              results as grid_transform_point() on each.  The displacement
+              volume is examined once for all points rather than once per
+              point.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_transform_points(
+    VIO_General_transform   *transform,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS] )
+{
+    int        p, b, n_batch, c;
+    VIO_Real   displacements[GRID_POINTS_BATCH_SIZE][VIO_N_DIMENSIONS];
+
+    if(!transform->displacement_volume)
+      return VIO_ERROR;
+
+    for( b = 0;  b < n_points;  b += GRID_POINTS_BATCH_SIZE )
+    {
+        n_batch = MIN( GRID_POINTS_BATCH_SIZE, n_points - b );
+
+        evaluate_grid_volume_points(
+                          (VIO_Volume) transform->displacement_volume,
+                          n_batch, &points[b], displacements );
+
+        for_less( p, 0, n_batch )
+        for_less( c, 0, VIO_N_DIMENSIONS )
+            transformed_points[b+p][c] = points[b+p][c] + displacements[p][c];
+    }
+
+    return VIO_OK;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_transform_point_with_jacobian
+@INPUT      : transform
+              x
+              y
+              z
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+              jacobian       - jacobian[c][d] is the derivative of the
+                               transformed coordinate c with respect to d
+@RETURNS    : VIO_Status
+@DESCRIPTION: Applies the grid transform to the point, as
+              grid_transform_point() does, and finds its Jacobian from the
+              derivatives of the interpolating spline.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_transform_point_with_jacobian(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed,
+    VIO_Real                jacobian[][VIO_N_DIMENSIONS] )
+{
+    int                c, d, id;
+    VIO_Real           values[N_COMPONENTS], deriv_x[N_COMPONENTS];
+    VIO_Real           deriv_y[N_COMPONENTS], deriv_z[N_COMPONENTS];
+    VIO_Real           voxel[VIO_MAX_DIMENSIONS];
+    VIO_Real           voxel_vector[VIO_MAX_DIMENSIONS];
+    VIO_Real           voxel_derivs[N_COMPONENTS][VIO_N_DIMENSIONS];
+    VIO_Volume         volume;
+    grid_volume_info   info;
+
+    if(!transform->displacement_volume)
+      return VIO_ERROR;
+
+    volume = (VIO_Volume) transform->displacement_volume;
+
+    convert_world_to_voxel( volume, x, y, z, voxel );
+
+    if( get_grid_volume_info( volume, &info ) &&
+        evaluate_grid_fast_with_derivs( &info, voxel, values, voxel_derivs ) )
+    {
+        /*--- the derivatives along the voxel axes to world derivatives */
+
+        for_less( c, 0, N_COMPONENTS )
+        {
+            id = 0;
+            for_less( d, 0, FOUR_DIMS )
+            {
+                if( d == info.vector_dim )
+                    voxel_vector[d] = 0.0;
+                else
+                    voxel_vector[d] = voxel_derivs[c][id++];
+            }
+
+            convert_voxel_normal_vector_to_world( volume, voxel_vector,
+                                    &deriv_x[c], &deriv_y[c], &deriv_z[c] );
+        }
+    }
+    else
+    {
+        evaluate_grid_volume( volume, x, y, z, DEGREES_CONTINUITY, values,
+                              deriv_x, deriv_y, deriv_z );
+    }
+
+    *x_transformed = x + values[VIO_X];
+    *y_transformed = y + values[VIO_Y];
+    *z_transformed = z + values[VIO_Z];
+
+    for_less( c, 0, N_COMPONENTS )
+    {
+        jacobian[c][VIO_X] = deriv_x[c];
+        jacobian[c][VIO_Y] = deriv_y[c];
+        jacobian[c][VIO_Z] = deriv_z[c];
+
+        jacobian[c][c] += 1.0;
+    }
+
+    return VIO_OK;
+}
+
 #ifdef USE_NEWTONS_METHOD
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : forward_function
@@ -142,267 +761,1449 @@ static  void  forward_function(
         derivatives[c][Y] = deriv_y[c];
         derivatives[c][Z] = deriv_z[c];
 
-        derivatives[c][c] += 1.0;    /* deriv of (x,y,z) w.r.t. x or y or z  */
+        derivatives[c][c] += 1.0;    /* deriv of (x,y,z) w.r.t. x or y or z  */
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_transform_point
+@INPUT      : transform
+              x
+              y
+              z
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+@RETURNS    : VIO_Status
+@DESCRIPTION: Applies the inverse grid transform to the point.  This is done
+              by using newton-rhapson steps to find the point which maps to
+              the parameters (x,y,z).
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Feb. 21, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+/* ---------------------------------------------------------------------------
+
+     There are two different versions of the grid inverse function.  I would
+have hoped that my version worked best, since it uses first derivatives and
+Newton's method.  However, Louis' version seems to work better, perhaps since
+it matches the code he uses in minctracc to generate the grid transforms.
+
+- David MacDonald
+
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_inverse_transform_point(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed )
+{
+    VIO_Real   solution[VIO_N_DIMENSIONS];
+    VIO_Real   initial_guess[VIO_N_DIMENSIONS];
+    VIO_Real   desired_values[VIO_N_DIMENSIONS];
+
+    /* --- fill in the initial guess */
+
+    initial_guess[X] = x;
+    initial_guess[Y] = y;
+    initial_guess[Z] = z;
+
+    /* --- define what the desired function values are */
+
+    desired_values[X] = x;
+    desired_values[Y] = y;
+    desired_values[Z] = z;
+
+    /* --- find the x,y,z that are mapped to the desired values */
+
+    if( newton_root_find( VIO_N_DIMENSIONS, forward_function,
+                          (void *) transform,
+                          initial_guess, desired_values,
+                          solution, INVERSE_FUNCTION_TOLERANCE,
+                          INVERSE_DELTA_TOLERANCE, MAX_INVERSE_ITERATIONS ))
+    {
+        *x_transformed = solution[X];
+        *y_transformed = solution[Y];
+        *z_transformed = solution[Z];
+        return VIO_OK;
+    }
+    else  /* --- if no solution found, not sure what is reasonable to return */
+    {
+        *x_transformed = x;
+        *y_transformed = y;
+        *z_transformed = z;
+        return VIO_ERROR;
+    }
+    return VIO_ERROR;
+}
+#endif
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_tolerance
+@INPUT      : volume             - displacement volume
+              input_volume_steps - steps of the volume being resampled,
+                                   or NULL
+@OUTPUT     :
+@RETURNS    : tolerance on the inverse
+@DESCRIPTION: Finds the error on the inverse of a grid transform which is
+              small enough, from the step sizes of the volume being
+              resampled if known, otherwise from those of the grid.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : 1993?   Louis Collins
+@MODIFIED   : 2013 June 10, Matthijs van Eede, added the possibility to pass
+                            along the step sizes of the input file which is
+                            being resampled to determine the appropriate error
+                            margin (ftol)
+---------------------------------------------------------------------------- */
+
+static  VIO_Real  grid_inverse_tolerance(
+    VIO_Volume   volume,
+    VIO_Real     *input_volume_steps )
+{
+    VIO_Real   ftol;
+    int    sizes[VIO_MAX_DIMENSIONS];
+    VIO_Real   steps[VIO_MAX_DIMENSIONS];
+    short d, vector_dim = -1;
+    int i;
+
+    // Adapt ftol to grid step sizes. For 1mm stx volume with grid 4mm, we
+    // are using ftol=0.05 (=4mm/80). For histology data at grid 0.125mm,
+    // then use ftol=0.125/80=0.0015625, which is fine on 0.01mm volume.
+    // ftol = 0.05;   // good for MNI space at 1mm (grid 2mm or 4mm)
+    // ftol = 0.001;  // acceptable for big brain slice (grid at 0.125, voxel at 0.01mm)
+
+    // This is ok too:
+    // Make the error a fraction of the initial residual.
+    // ftol = 0.05 * smallest_e + 0.0001;
+
+    get_volume_sizes( volume, sizes );
+    get_volume_separations( volume, steps );
+
+    /*--- find which of 4 dimensions is the vector dimension */
+
+    for_less( vector_dim, 0, FOUR_DIMS ) {
+      for_less( d, 0, VIO_N_DIMENSIONS ) {
+        if( volume->spatial_axes[d] == vector_dim ) break;
+      }
+      if( d == VIO_N_DIMENSIONS ) break;
+    }
+
+    // If we have information about the step sizes of the input volume that is
+    // being resampled, base the tolerance on those instead of the step sizes
+    // of the deformation grid; there can be a significant difference.
+
+    ftol = -1.0;
+    if( input_volume_steps != NULL){
+      for_less( i, 0, 3 ) {
+        if( ftol < 0 ) ftol = input_volume_steps[i];
+        if( input_volume_steps[i] < ftol ) ftol = input_volume_steps[i];
+      }
+    }
+    else {
+      for_less( d, 0, FOUR_DIMS ) {
+        if( d == vector_dim ) continue;
+        if( sizes[d] == 1 ) continue;
+        if( ftol < 0 ) ftol = steps[d];
+        if( steps[d] < ftol ) ftol = steps[d];
+      }
+    }
+
+    ftol = ftol / 80.0;
+    if( ftol > 0.05 ) ftol = 0.05;   // just to be sure for large grids
+
+    return( ftol );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : refine_grid_inverse
+@INPUT      : transform
+              x
+              y
+              z
+              ftol       - tolerance on the error
+              max_tries  - number of forward evaluations allowed
+              tx, ty, tz - initial guess
+@OUTPUT     : tx, ty, tz - best inverse found
+              error      - its error, as a sum of absolute differences
+              n_tries    - number of forward evaluations made
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Improves a guess at the inverse of a grid transform at x, y, z
+              by stepping the guess along the error of its forward
+              transform, keeping the best guess found.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : 1993?   Louis Collins
+@MODIFIED   : 1994    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  refine_grid_inverse(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                ftol,
+    int                     max_tries,
+    VIO_Real                *tx,
+    VIO_Real                *ty,
+    VIO_Real                *tz,
+    VIO_Real                *error,
+    int                     *n_tries )
+{
+    int    tries;
+    VIO_Real   best_x, best_y, best_z;
+    VIO_Real   gx, gy, gz;
+    VIO_Real   error_x, error_y, error_z, e, smallest_e;
+    VIO_Status status=VIO_ERROR;
+
+    if((status=grid_transform_point( transform, *tx, *ty, *tz, &gx, &gy, &gz ))!=VIO_OK)
+    return status;
+
+    error_x = x - gx;
+    error_y = y - gy;
+    error_z = z - gz;
+
+    tries = 0;
+
+    smallest_e = VIO_FABS(error_x) + VIO_FABS(error_y) + VIO_FABS(error_z);
+    best_x = *tx;
+    best_y = *ty;
+    best_z = *tz;
+
+    while( ++tries < max_tries && smallest_e > ftol ) {
+        *tx += 0.95 * error_x;
+        *ty += 0.95 * error_y;
+        *tz += 0.95 * error_z;
+
+        if((status=grid_transform_point( transform, *tx, *ty, *tz, &gx, &gy, &gz ))!=VIO_OK)
+          return status;
+
+        error_x = x - gx;
+        error_y = y - gy;
+        error_z = z - gz;
+
+        e = VIO_FABS(error_x) + VIO_FABS(error_y) + VIO_FABS(error_z);
+
+        if( e < smallest_e ) {
+            smallest_e = e;
+            best_x = *tx;
+            best_y = *ty;
+            best_z = *tz;
+        }
+    }
+
+    *tx = best_x;
+    *ty = best_y;
+    *tz = best_z;
+    *error = smallest_e;
+    *n_tries = tries;
+    return VIO_OK;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_transform_point_with_input_steps
+@INPUT      : transform
+              x
+              y
+              z
+              input_volume_steps
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+@RETURNS    :
+@DESCRIPTION: Transforms the point by the inverse of the grid transform.
+              Approximates the solution using a simple iterative step
+              method, or interpolates the inverse displacements if they
+              were precomputed by create_grid_inverse_displacements().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : 1993?   Louis Collins
+@MODIFIED   : 1994    David MacDonald
+@MODIFIED   : 2013 June 10, Matthijs van Eede, added the possibility to pass
+                            along the step sizes of the input file which is
+                            being resampled to determine the appropriate error
+                            margin (ftol)
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_inverse_transform_point_with_input_steps(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *input_volume_steps,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed )
+{
+    VIO_Real   tx, ty, tz;
+    VIO_Real   smallest_e;
+    int        n_tries;
+    VIO_Real   point[1][VIO_N_DIMENSIONS];
+    VIO_Real   displacements[VIO_N_DIMENSIONS];
+    VIO_Status status=VIO_ERROR;
+
+    if(!transform->displacement_volume)
+      return VIO_ERROR;
+
+    /* --- with precomputed inverse displacements, the inverse is a lookup */
+
+    if( transform->inverse_displacement_volume != NULL ) {
+        point[0][VIO_X] = x;
+        point[0][VIO_Y] = y;
+        point[0][VIO_Z] = z;
+
+        evaluate_grid_volume_points(
+                   (VIO_Volume) transform->inverse_displacement_volume,
+                   1, point, &displacements );
+
+        *x_transformed = x + displacements[VIO_X];
+        *y_transformed = y + displacements[VIO_Y];
+        *z_transformed = z + displacements[VIO_Z];
+        return VIO_OK;
+    }
+
+    if((status=grid_transform_point( transform, x, y, z, &tx, &ty, &tz ))!=VIO_OK)
+      return status;
+    tx = x - (tx - x);
+    ty = y - (ty - y);
+    tz = z - (tz - z);
+
+    if((status=refine_grid_inverse( transform, x, y, z,
+                  grid_inverse_tolerance( (VIO_Volume) transform->displacement_volume,
+                                          input_volume_steps ),
+                  NUMBER_TRIES, &tx, &ty, &tz, &smallest_e, &n_tries ))!=VIO_OK)
+      return status;
+
+    *x_transformed = tx;
+    *y_transformed = ty;
+    *z_transformed = tz;
+    return VIO_OK;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_transform_point
+@INPUT      : transform
+              x
+              y
+              z
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+@RETURNS    :
+@DESCRIPTION: Transforms the point by the inverse of the grid transform.
+              Approximates the solution using a simple iterative step
+              method.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : 1993?   Louis Collins
+@MODIFIED   : 1994    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_inverse_transform_point(
+    VIO_General_transform   *transform,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed )
+{
+    return grid_inverse_transform_point_with_input_steps(transform, x, y, z,
+                                           NULL,
+                                           x_transformed, y_transformed, z_transformed );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : grid_inverse_transform_scanline
+@INPUT      : transform
+              warm_start         - start each inverse from that of the point
+                                   before
+              n_points
+              points             - array of x,y,z positions, in order along
+                                   one or more lines
+@OUTPUT     : transformed_points - may be the same array as points
+              n_iterations       - number of forward evaluations made, or
+                                   NULL
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms many points by the inverse of the grid transform,
+              giving the same results as grid_inverse_transform_point() on
+              each without warm_start.  With warm_start, the search for each
+              inverse starts from a guess extrapolated by
+              extrapolate_root_guess() from the inverses of the points
+              before, instead of from the negated forward displacement.
+              Neighbouring points have nearly the same inverses, so this
+              takes fewer steps.  If the search from there does not get
+              within the tolerance, it is made again from the usual start
+              and the better of the two kept.  Points are looked up in
+              precomputed inverse displacements if there are any.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  grid_inverse_transform_scanline(
+    VIO_General_transform   *transform,
+    VIO_BOOL                warm_start,
+    int                     n_points,
+    VIO_Real                points[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed_points[][VIO_N_DIMENSIONS],
+    long                    *n_iterations )
+{
+    int        p, d, n_tries, n_previous;
+    long       total_tries;
+    VIO_Real   tx, ty, tz, cold_x, cold_y, cold_z;
+    VIO_Real   point[VIO_N_DIMENSIONS], guess[VIO_N_DIMENSIONS];
+    VIO_Real   previous[2][VIO_N_DIMENSIONS];
+    VIO_Real   previous_inverse[2][VIO_N_DIMENSIONS];
+    VIO_Real   ftol, error, cold_error;
+    VIO_Status status;
+
+    if( n_iterations != NULL )
+        *n_iterations = 0;
+
+    if( !transform->displacement_volume )
+        return VIO_ERROR;
+
+    /* --- with precomputed inverse displacements, the inverse is a lookup */
+
+    if( transform->inverse_displacement_volume != NULL )
+    {
+        for_less( p, 0, n_points )
+        {
+            if( (status = grid_inverse_transform_point( transform,
+                                 points[p][VIO_X], points[p][VIO_Y],
+                                 points[p][VIO_Z],
+                                 &transformed_points[p][VIO_X],
+                                 &transformed_points[p][VIO_Y],
+                                 &transformed_points[p][VIO_Z] )) != VIO_OK )
+                return status;
+        }
+        return VIO_OK;
+    }
+
+    ftol = grid_inverse_tolerance( (VIO_Volume) transform->displacement_volume,
+                                   NULL );
+
+    total_tries = 0;
+    n_previous = 0;
+
+    for_less( p, 0, n_points )
+    {
+        /*--- copy the point, as transformed_points may be the same array */
+
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            point[d] = points[p][d];
+
+        error = 0.0;
+        tx = ty = tz = 0.0;
+
+        if( warm_start && n_previous > 0 )
+        {
+            extrapolate_root_guess( VIO_N_DIMENSIONS, point, previous[0],
+                                    previous_inverse[0],
+                                    (n_previous > 1) ? previous[1] : NULL,
+                                    previous_inverse[1], guess );
+            tx = guess[VIO_X];
+            ty = guess[VIO_Y];
+            tz = guess[VIO_Z];
+
+            if( (status = refine_grid_inverse( transform, point[VIO_X],
+                                               point[VIO_Y], point[VIO_Z],
+                                               ftol, NUMBER_TRIES,
+                                               &tx, &ty, &tz,
+                                               &error, &n_tries )) != VIO_OK )
+                return status;
+
+            total_tries += n_tries;
+        }
+
+        /*--- the usual start, the negated forward displacement */
+
+        if( !warm_start || n_previous == 0 || error > ftol )
+        {
+            if( (status = grid_transform_point( transform, point[VIO_X],
+                                                point[VIO_Y], point[VIO_Z],
+                                                &cold_x, &cold_y,
+                                                &cold_z )) != VIO_OK )
+                return status;
+            cold_x = point[VIO_X] - (cold_x - point[VIO_X]);
+            cold_y = point[VIO_Y] - (cold_y - point[VIO_Y]);
+            cold_z = point[VIO_Z] - (cold_z - point[VIO_Z]);
+
+            if( (status = refine_grid_inverse( transform, point[VIO_X],
+                                               point[VIO_Y], point[VIO_Z],
+                                               ftol, NUMBER_TRIES,
+                                               &cold_x, &cold_y, &cold_z,
+                                               &cold_error,
+                                               &n_tries )) != VIO_OK )
+                return status;
+
+            total_tries += 1 + n_tries;
+
+            if( !warm_start || n_previous == 0 || cold_error < error )
+            {
+                tx = cold_x;
+                ty = cold_y;
+                tz = cold_z;
+            }
+        }
+
+        transformed_points[p][VIO_X] = tx;
+        transformed_points[p][VIO_Y] = ty;
+        transformed_points[p][VIO_Z] = tz;
+
+        /*--- remember the last two inverses */
+
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            previous[1][d] = previous[0][d];
+            previous_inverse[1][d] = previous_inverse[0][d];
+            previous[0][d] = point[d];
+        }
+        previous_inverse[0][VIO_X] = tx;
+        previous_inverse[0][VIO_Y] = ty;
+        previous_inverse[0][VIO_Z] = tz;
+        n_previous = MIN( n_previous + 1, 2 );
+    }
+
+    if( n_iterations != NULL )
+        *n_iterations = total_tries;
+
+    return VIO_OK;
+}
+
+typedef  struct
+{
+    VIO_General_transform   *transform;
+    VIO_Volume              volume;
+    VIO_Volume              inverse;
+    float                   *inverse_data;
+    int                     vector_dim;
+    int                     sizes[FOUR_DIMS];
+    VIO_Real                ftol;
+    VIO_Real                *max_error;        /* per thread */
+    long                    *n_not_converged;  /* per thread */
+} grid_inverse_info;
+
+/* miparallel_for() callback inverting the grid transform at the grid
+   nodes [first,last), the nodes being numbered in the order of the grid
+   volume, without the vector dimension */
+
+static  int  invert_grid_nodes(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    grid_inverse_info  *info = (grid_inverse_info *) data;
+    long               node, n;
+    int                d, c, index[FOUR_DIMS];
+    size_t             offset, strides[FOUR_DIMS];
+    VIO_Real           voxel[VIO_MAX_DIMENSIONS];
+    VIO_Real           x, y, z, tx, ty, tz, error, displacement[N_COMPONENTS];
+    int                n_tries;
+
+    strides[FOUR_DIMS-1] = 1;
+    for_down( d, FOUR_DIMS-2, 0 )
+        strides[d] = strides[d+1] * (size_t) info->sizes[d+1];
+
+    for_less( d, 0, VIO_MAX_DIMENSIONS )
+        voxel[d] = 0.0;
+
+    for( node = first;  node < last;  ++node )
+    {
+        n = node;
+        for_down( d, FOUR_DIMS-1, 0 )
+        {
+            if( d == info->vector_dim )
+                index[d] = 0;
+            else
+            {
+                index[d] = (int) (n % info->sizes[d]);
+                n /= info->sizes[d];
+            }
+            voxel[d] = (VIO_Real) index[d];
+        }
+
+        /*--- start from the negated forward displacement, as is done for
+              each point when there is no precomputed inverse */
+
+        convert_voxel_to_world( info->volume, voxel, &x, &y, &z );
+
+        if( grid_transform_point( info->transform, x, y, z,
+                                  &tx, &ty, &tz ) != VIO_OK )
+            return( MI_ERROR );
+        tx = x - (tx - x);
+        ty = y - (ty - y);
+        tz = z - (tz - z);
+
+        if( refine_grid_inverse( info->transform, x, y, z, info->ftol,
+                                 NODE_NUMBER_TRIES, &tx, &ty, &tz,
+                                 &error, &n_tries ) != VIO_OK )
+            return( MI_ERROR );
+
+        if( error > info->ftol )
+            ++info->n_not_converged[thread];
+        if( error > info->max_error[thread] )
+            info->max_error[thread] = error;
+
+        displacement[VIO_X] = tx - x;
+        displacement[VIO_Y] = ty - y;
+        displacement[VIO_Z] = tz - z;
+
+        for_less( c, 0, N_COMPONENTS )
+        {
+            index[info->vector_dim] = c;
+            if( info->inverse_data != NULL )
+            {
+                offset = 0;
+                for_less( d, 0, FOUR_DIMS )
+                    offset += (size_t) index[d] * strides[d];
+                info->inverse_data[offset] = (float) displacement[c];
+            }
+            else
+                set_volume_real_value( info->inverse, index[0], index[1],
+                                       index[2], index[3], 0,
+                                       displacement[c] );
+        }
+    }
+
+    return( MI_NOERROR );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_grid_inverse_displacements
+@INPUT      : transform
+@OUTPUT     : max_error        - largest error of the inverse at a grid node
+              n_not_converged  - number of grid nodes where the inverse did
+                                 not reach the tolerance
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Computes the displacements of the inverse of a grid transform
+              at each node of its grid, and keeps them in the transform, so
+              that grid_inverse_transform_point() interpolates them instead
+              of iterating for each point.  The nodes are inverted in
+              parallel, to a tenth of the usual tolerance.  The inverse
+              displacements are interpolated like the forward ones, so
+              between nodes the error of the inverse also depends on how
+              smooth the field is; max_error and n_not_converged report the
+              convergence at the nodes.  Each grid transform of a
+              concatenated transform is processed, the results being
+              combined.  Either output may be NULL.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  create_grid_inverse_displacements(
+    VIO_General_transform   *transform,
+    VIO_Real                *max_error,
+    int                     *n_not_converged )
+{
+    int                 d, i, n_threads, n_bad;
+    long                n_nodes;
+    VIO_Real            error;
+    VIO_Volume          volume, inverse;
+    VIO_Status          status;
+    grid_inverse_info   info;
+
+    if( max_error != NULL )
+        *max_error = 0.0;
+    if( n_not_converged != NULL )
+        *n_not_converged = 0;
+
+    if( get_transform_type( transform ) == CONCATENATED_TRANSFORM )
+    {
+        for_less( i, 0, get_n_concated_transforms( transform ) )
+        {
+            status = create_grid_inverse_displacements(
+                           get_nth_general_transform( transform, i ),
+                           &error, &n_bad );
+            if( status != VIO_OK )
+                return( status );
+            if( max_error != NULL && error > *max_error )
+                *max_error = error;
+            if( n_not_converged != NULL )
+                *n_not_converged += n_bad;
+        }
+        return( VIO_OK );
+    }
+
+    if( get_transform_type( transform ) != GRID_TRANSFORM )
+        return( VIO_OK );
+
+    if( transform->displacement_volume == NULL )
+        return( VIO_ERROR );
+
+    delete_grid_inverse_displacements( transform );
+
+    volume = (VIO_Volume) transform->displacement_volume;
+
+    inverse = copy_volume_definition( volume, NC_FLOAT, FALSE, 0.0, 0.0 );
+    if( inverse == NULL )
+        return( VIO_ERROR );
+
+    info.transform = transform;
+    info.volume = volume;
+    info.inverse = inverse;
+    get_volume_sizes( volume, info.sizes );
+    info.ftol = NODE_TOLERANCE_FACTOR * grid_inverse_tolerance( volume, NULL );
+
+    for_less( info.vector_dim, 0, FOUR_DIMS ) {
+      for_less( d, 0, VIO_N_DIMENSIONS ) {
+        if( volume->spatial_axes[d] == info.vector_dim ) break;
+      }
+      if( d == VIO_N_DIMENSIONS ) break;
+    }
+
+    if( inverse->is_cached_volume )
+        info.inverse_data = NULL;
+    else
+    {
+        GET_MULTIDIM_PTR_4D( info.inverse_data, inverse->array, 0, 0, 0, 0 )
+    }
+
+    n_nodes = (long) (get_volume_total_n_voxels( volume ) / N_COMPONENTS);
+
+    /*--- the world transform of the grid is brought up to date before the
+          threads use it; a cached volume is not safe to share, so is
+          done in this thread */
+
+    (void) get_voxel_to_world_transform( volume );
+
+    n_threads = miget_parallel_threads();
+    if( volume->is_cached_volume || inverse->is_cached_volume )
+        n_threads = 1;
+
+    ALLOC( info.max_error, n_threads );
+    ALLOC( info.n_not_converged, n_threads );
+    for_less( i, 0, n_threads )
+    {
+        info.max_error[i] = 0.0;
+        info.n_not_converged[i] = 0;
+    }
+
+    if( n_threads == 1 )
+        status = invert_grid_nodes( 0, n_nodes, 0, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
+    else
+        status = miparallel_for( n_nodes, INVERSE_NODES_PER_TILE,
+                                 invert_grid_nodes, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
+
+    for_less( i, 0, n_threads )
+    {
+        if( max_error != NULL && info.max_error[i] > *max_error )
+            *max_error = info.max_error[i];
+        if( n_not_converged != NULL )
+            *n_not_converged += (int) info.n_not_converged[i];
+    }
+
+    FREE( info.max_error );
+    FREE( info.n_not_converged );
+
+    if( status != VIO_OK )
+    {
+        delete_volume( inverse );
+        return( status );
+    }
+
+    transform->inverse_displacement_volume = (void *) inverse;
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_grid_inverse_displacements
+@INPUT      : transform
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Deletes the inverse displacements precomputed by
+              create_grid_inverse_displacements(), so that the inverse of
+              the grid transform is again found for each point, e.g. after
+              changing the displacement volume.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  delete_grid_inverse_displacements(
+    VIO_General_transform   *transform )
+{
+    int   i;
+
+    if( get_transform_type( transform ) == CONCATENATED_TRANSFORM )
+    {
+        for_less( i, 0, get_n_concated_transforms( transform ) )
+            delete_grid_inverse_displacements(
+                               get_nth_general_transform( transform, i ) );
+    }
+    else if( get_transform_type( transform ) == GRID_TRANSFORM &&
+             transform->inverse_displacement_volume != NULL )
+    {
+        delete_volume( (VIO_Volume) transform->inverse_displacement_volume );
+        transform->inverse_displacement_volume = NULL;
+    }
+}
+
+typedef  struct
+{
+    VIO_General_transform   *transform;
+    VIO_General_transform   *flattened;
+    VIO_Volume              volume;
+    float                   *data;
+    int                     sizes[VIO_N_DIMENSIONS];   /* x, y, z */
+    VIO_Real                starts[VIO_N_DIMENSIONS];
+    VIO_Real                steps[VIO_N_DIMENSIONS];
+    VIO_Real                *max_error;                /* per thread */
+} flatten_info;
+
+/* miparallel_for() callback sampling the displacements of the transform at
+   the grid nodes along the rows [first,last), row z * sizes[y] + y being
+   the nodes with those z and y indices */
+
+static  int  sample_transform_rows(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    flatten_info  *info = (flatten_info *) data;
+    long          row;
+    int           i, j, k, c, n;
+    float         *ptr;
+    VIO_Real      (*points)[VIO_N_DIMENSIONS];
+    VIO_Real      (*transformed)[VIO_N_DIMENSIONS];
+    VIO_Real      displacement;
+    int           status = MI_NOERROR;
+
+    n = info->sizes[VIO_X];
+
+    ALLOC( points, n );
+    ALLOC( transformed, n );
+
+    for( row = first;  row < last && status == MI_NOERROR;  ++row )
+    {
+        i = (int) (row / info->sizes[VIO_Y]);
+        j = (int) (row % info->sizes[VIO_Y]);
+
+        for_less( k, 0, n )
+        {
+            points[k][VIO_X] = info->starts[VIO_X] +
+                               (VIO_Real) k * info->steps[VIO_X];
+            points[k][VIO_Y] = info->starts[VIO_Y] +
+                               (VIO_Real) j * info->steps[VIO_Y];
+            points[k][VIO_Z] = info->starts[VIO_Z] +
+                               (VIO_Real) i * info->steps[VIO_Z];
+        }
+
+        if( general_transform_points( info->transform, n, points,
+                                      transformed ) != VIO_OK )
+        {
+            status = MI_ERROR;
+            break;
+        }
+
+        ptr = (info->data == NULL) ? NULL :
+              info->data + (size_t) row * (size_t) n * N_COMPONENTS;
+
+        for_less( k, 0, n )
+        for_less( c, 0, N_COMPONENTS )
+        {
+            displacement = transformed[k][c] - points[k][c];
+            if( ptr != NULL )
+                ptr[k * N_COMPONENTS + c] = (float) displacement;
+            else
+                set_volume_real_value( info->volume, i, j, k, c, 0,
+                                       displacement );
+        }
+    }
+
+    FREE( transformed );
+    FREE( points );
+
+    return( status );
+}
+
+/* miparallel_for() callback comparing the flattened transform with the
+   transform at the centres of the grid cells in the rows [first,last) of
+   cells, numbered as the rows of nodes */
+
+static  int  check_flattened_rows(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    flatten_info  *info = (flatten_info *) data;
+    long          row;
+    int           i, j, k, n;
+    VIO_Real      (*points)[VIO_N_DIMENSIONS];
+    VIO_Real      (*expected)[VIO_N_DIMENSIONS];
+    VIO_Real      (*flattened)[VIO_N_DIMENSIONS];
+    VIO_Real      dx, dy, dz, error;
+    int           status = MI_NOERROR;
+
+    n = info->sizes[VIO_X] - 1;
+
+    ALLOC( points, n );
+    ALLOC( expected, n );
+    ALLOC( flattened, n );
+
+    for( row = first;  row < last;  ++row )
+    {
+        i = (int) (row / (info->sizes[VIO_Y] - 1));
+        j = (int) (row % (info->sizes[VIO_Y] - 1));
+
+        for_less( k, 0, n )
+        {
+            points[k][VIO_X] = info->starts[VIO_X] +
+                               ((VIO_Real) k + 0.5) * info->steps[VIO_X];
+            points[k][VIO_Y] = info->starts[VIO_Y] +
+                               ((VIO_Real) j + 0.5) * info->steps[VIO_Y];
+            points[k][VIO_Z] = info->starts[VIO_Z] +
+                               ((VIO_Real) i + 0.5) * info->steps[VIO_Z];
+        }
+
+        if( general_transform_points( info->transform, n, points,
+                                      expected ) != VIO_OK ||
+            grid_transform_points( info->flattened, n, points,
+                                   flattened ) != VIO_OK )
+        {
+            status = MI_ERROR;
+            break;
+        }
+
+        for_less( k, 0, n )
+        {
+            dx = flattened[k][VIO_X] - expected[k][VIO_X];
+            dy = flattened[k][VIO_Y] - expected[k][VIO_Y];
+            dz = flattened[k][VIO_Z] - expected[k][VIO_Z];
+            error = sqrt( dx * dx + dy * dy + dz * dz );
+            if( error > info->max_error[thread] )
+                info->max_error[thread] = error;
+        }
     }
+
+    FREE( flattened );
+    FREE( expected );
+    FREE( points );
+
+    return( status );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : grid_inverse_transform_point
+@NAME       : flatten_general_transform
 @INPUT      : transform
-              x
-              y
-              z
-@OUTPUT     : x_transformed
-              y_transformed
-              z_transformed
-@RETURNS    : VIO_Status
-@DESCRIPTION: Applies the inverse grid transform to the point.  This is done
-              by using newton-rhapson steps to find the point which maps to
-              the parameters (x,y,z).
+              sizes      - number of grid nodes along x, y and z
+              starts     - world position of the first node
+              steps      - spacing of the nodes along x, y and z
+@OUTPUT     : flattened  - a grid transform
+              max_error  - if non-NULL, the largest distance between the
+                           flattened transform and the transform at the
+                           centres of the grid cells
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Resamples any transform, typically a chain of linear and
+              nonlinear transforms, into a single grid transform whose
+              float displacements are those of the transform at the nodes
+              of the given grid, so that applying it costs one grid
+              evaluation however long the chain.  Between the nodes the
+              displacements are interpolated, hence the error estimate;
+              outside the grid the flattened transform is not the original
+              one.  The nodes are sampled by several threads, so the
+              transform must be safe to apply from several threads at once,
+              which holds for all but user transforms.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Feb. 21, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-/* ---------------------------------------------------------------------------
-
-     There are two different versions of the grid inverse function.  I would
-have hoped that my version worked best, since it uses first derivatives and
-Newton's method.  However, Louis' version seems to work better, perhaps since
-it matches the code he uses in minctracc to generate the grid transforms.
-
-- David MacDonald
-
----------------------------------------------------------------------------- */
-
-VIOAPI  VIO_Status  grid_inverse_transform_point(
+VIOAPI  VIO_Status  flatten_general_transform(
     VIO_General_transform   *transform,
-    VIO_Real                x,
-    VIO_Real                y,
-    VIO_Real                z,
-    VIO_Real                *x_transformed,
-    VIO_Real                *y_transformed,
-    VIO_Real                *z_transformed )
+    int                     sizes[],
+    VIO_Real                starts[],
+    VIO_Real                steps[],
+    VIO_General_transform   *flattened,
+    VIO_Real                *max_error )
 {
-    VIO_Real   solution[VIO_N_DIMENSIONS];
-    VIO_Real   initial_guess[VIO_N_DIMENSIONS];
-    VIO_Real   desired_values[VIO_N_DIMENSIONS];
+    static VIO_STR   dim_names[] = { MIzspace, MIyspace, MIxspace,
+                                     MIvector_dimension };
+    int              d, i, n_threads, volume_sizes[VIO_MAX_DIMENSIONS];
+    VIO_Real         volume_starts[VIO_MAX_DIMENSIONS];
+    VIO_Real         volume_steps[VIO_MAX_DIMENSIONS], x, y, z;
+    VIO_Volume       volume;
+    VIO_Status       status;
+    flatten_info     info;
+
+    if( max_error != NULL )
+        *max_error = 0.0;
+
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        if( sizes[d] < 2 || steps[d] == 0.0 )
+        {
+            print_error( "flatten_general_transform(): the grid must have at "
+                         "least 2 nodes along each axis.\n" );
+            return( VIO_ERROR );
+        }
 
-    /* --- fill in the initial guess */
+        /*--- the volume dimensions are z, y, x, vector */
 
-    initial_guess[X] = x;
-    initial_guess[Y] = y;
-    initial_guess[Z] = z;
+        volume_sizes[VIO_N_DIMENSIONS-1-d] = sizes[d];
+        volume_starts[VIO_N_DIMENSIONS-1-d] = starts[d];
+        volume_steps[VIO_N_DIMENSIONS-1-d] = steps[d];
 
-    /* --- define what the desired function values are */
+        info.sizes[d] = sizes[d];
+        info.starts[d] = starts[d];
+        info.steps[d] = steps[d];
+    }
+    volume_sizes[VIO_N_DIMENSIONS] = N_COMPONENTS;
+    volume_starts[VIO_N_DIMENSIONS] = 0.0;
+    volume_steps[VIO_N_DIMENSIONS] = 1.0;
 
-    desired_values[X] = x;
-    desired_values[Y] = y;
-    desired_values[Z] = z;
+    volume = create_volume( FOUR_DIMS, dim_names, NC_FLOAT, FALSE, 0.0, 0.0 );
+    if( volume == NULL )
+        return( VIO_ERROR );
 
-    /* --- find the x,y,z that are mapped to the desired values */
+    set_volume_sizes( volume, volume_sizes );
+    set_volume_starts( volume, volume_starts );
+    set_volume_separations( volume, volume_steps );
+    alloc_volume_data( volume );
 
-    if( newton_root_find( VIO_N_DIMENSIONS, forward_function,
-                          (void *) transform,
-                          initial_guess, desired_values,
-                          solution, INVERSE_FUNCTION_TOLERANCE,
-                          INVERSE_DELTA_TOLERANCE, MAX_INVERSE_ITERATIONS ))
+    if( !volume_is_alloced( volume ) )
     {
-        *x_transformed = solution[X];
-        *y_transformed = solution[Y];
-        *z_transformed = solution[Z];
-        return VIO_OK;
+        delete_volume( volume );
+        return( VIO_ERROR );
     }
-    else  /* --- if no solution found, not sure what is reasonable to return */
+
+    info.transform = transform;
+    info.volume = volume;
+
+    if( volume->is_cached_volume )
+        info.data = NULL;
+    else
     {
-        *x_transformed = x;
-        *y_transformed = y;
-        *z_transformed = z;
-        return VIO_ERROR;
+        GET_MULTIDIM_PTR_4D( info.data, volume->array, 0, 0, 0, 0 )
     }
-    return VIO_ERROR;
-}
-#endif
 
-/* ----------------------------- MNI Header -----------------------------------
-@NAME       : grid_inverse_transform_point_with_input_steps
-@INPUT      : transform
-              x
-              y
-              z
-              input_volume_steps
-@OUTPUT     : x_transformed
-              y_transformed
-              z_transformed
-@RETURNS    :
-@DESCRIPTION: Transforms the point by the inverse of the grid transform.
-              Approximates the solution using a simple iterative step
-              method.
-@METHOD     :
-@GLOBALS    :
-@CALLS      :
-@CREATED    : 1993?   Louis Collins
-@MODIFIED   : 1994    David MacDonald
-@MODIFIED   : 2013 June 10, Matthijs van Eede, added the possibility to pass
-                            along the step sizes of the input file which is
-                            being resampled to determine the appropriate error
-                            margin (ftol)
----------------------------------------------------------------------------- */
+    /*--- transforming one point brings the world transforms of any grids
+          in the transform up to date before the threads use them */
 
-VIOAPI  VIO_Status  grid_inverse_transform_point_with_input_steps(
-    VIO_General_transform   *transform,
-    VIO_Real                x,
-    VIO_Real                y,
-    VIO_Real                z,
-    VIO_Real                *input_volume_steps,
-    VIO_Real                *x_transformed,
-    VIO_Real                *y_transformed,
-    VIO_Real                *z_transformed )
-{
-#define  NUMBER_TRIES  10
-    int    tries;
-    VIO_Real   best_x, best_y, best_z;
-    VIO_Real   tx, ty, tz;
-    VIO_Real   gx, gy, gz;
-    VIO_Real   error_x, error_y, error_z, error, smallest_e;
-    VIO_Real   ftol;
-    VIO_Status status=VIO_ERROR;
-    int    sizes[VIO_MAX_DIMENSIONS];
-    VIO_Real   steps[VIO_MAX_DIMENSIONS];
-    VIO_Volume volume;
-    short d, vector_dim = -1;
-    int i;
+    if( general_transform_point( transform, starts[VIO_X], starts[VIO_Y],
+                                 starts[VIO_Z], &x, &y, &z ) != VIO_OK )
+    {
+        delete_volume( volume );
+        return( VIO_ERROR );
+    }
 
-    if((status=grid_transform_point( transform, x, y, z, &tx, &ty, &tz ))!=VIO_OK)
-      return status;
-    tx = x - (tx - x);
-    ty = y - (ty - y);
-    tz = z - (tz - z);
+    n_threads = miget_parallel_threads();
+    if( volume->is_cached_volume )
+        n_threads = 1;
+
+    if( n_threads == 1 )
+        status = sample_transform_rows( 0, (long) sizes[VIO_Z] * sizes[VIO_Y],
+                                        0, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
+    else
+        status = miparallel_for( (long) sizes[VIO_Z] * sizes[VIO_Y],
+                                 FLATTEN_ROWS_PER_TILE,
+                                 sample_transform_rows, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
+
+    if( status != VIO_OK )
+    {
+        delete_volume( volume );
+        return( status );
+    }
 
-    if((status=grid_transform_point( transform, tx, ty, tz, &gx, &gy, &gz ))!=VIO_OK)
-    return status;
+    create_grid_transform_no_copy( flattened, volume, NULL );
 
-    error_x = x - gx;
-    error_y = y - gy;
-    error_z = z - gz;
+    if( max_error == NULL )
+        return( VIO_OK );
 
-    tries = 0;
+    /*--- estimate the error where it is largest for a smooth transform,
+          between the nodes */
 
-    smallest_e = VIO_FABS(error_x) + VIO_FABS(error_y) + VIO_FABS(error_z);
-    best_x = tx;
-    best_y = ty;
-    best_z = tz;
+    info.flattened = flattened;
+    (void) get_voxel_to_world_transform( volume );
 
-    // Adapt ftol to grid step sizes. For 1mm stx volume with grid 4mm, we
-    // are using ftol=0.05 (=4mm/80). For histology data at grid 0.125mm,
-    // then use ftol=0.125/80=0.0015625, which is fine on 0.01mm volume.
-    // ftol = 0.05;   // good for MNI space at 1mm (grid 2mm or 4mm)
-    // ftol = 0.001;  // acceptable for big brain slice (grid at 0.125, voxel at 0.01mm)
+    ALLOC( info.max_error, n_threads );
+    for_less( i, 0, n_threads )
+        info.max_error[i] = 0.0;
 
-    // This is ok too:
-    // Make the error a fraction of the initial residual.
-    // ftol = 0.05 * smallest_e + 0.0001;
+    if( n_threads == 1 )
+        status = check_flattened_rows( 0, (long) (sizes[VIO_Z] - 1) *
+                                          (sizes[VIO_Y] - 1),
+                                       0, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
+    else
+        status = miparallel_for( (long) (sizes[VIO_Z] - 1) *
+                                 (sizes[VIO_Y] - 1),
+                                 FLATTEN_ROWS_PER_TILE,
+                                 check_flattened_rows, &info ) == MI_NOERROR ?
+                 VIO_OK : VIO_ERROR;
 
+    for_less( i, 0, n_threads )
+    {
+        if( info.max_error[i] > *max_error )
+            *max_error = info.max_error[i];
+    }
 
-    volume = (VIO_Volume) transform->displacement_volume;
-    get_volume_sizes( volume, sizes );
-    get_volume_separations( volume, steps );
+    FREE( info.max_error );
 
-    /*--- find which of 4 dimensions is the vector dimension */
+    if( status != VIO_OK )
+        delete_general_transform( flattened );
 
-    for_less( vector_dim, 0, FOUR_DIMS ) {
-      for_less( d, 0, VIO_N_DIMENSIONS ) {
-        if( volume->spatial_axes[d] == vector_dim ) break;
-      }
-      if( d == VIO_N_DIMENSIONS ) break;
-    }
+    return( status );
+}
 
-    // If we have information about the step sizes of the input volume that is
-    // being resampled, base the tolerance on those instead of the step sizes
-    // of the deformation grid; there can be a significant difference.
+typedef  struct
+{
+    VIO_General_transform      *transform;
+    VIO_Deformation_quantity   quantity;
+    VIO_Volume                 volume;
+    int                        sizes[VIO_MAX_DIMENSIONS];
+    int                        outer_dim;
+    int                        inner_dim;
+    int                        row_dim;
+    int                        vector_dim;
+    VIO_Real                   *min_value;                /* per thread */
+    VIO_Real                   *max_value;
+    VIO_Real                   *sum;
+    long                       *n_values;
+    VIO_BOOL                   *failed;
+} deformation_info;
+
+/* miparallel_for() callback computing the deformation at the voxels along
+   the rows [first,last) of the volume, row i * sizes[inner_dim] + j being
+   the voxels with indices i and j along outer_dim and inner_dim */
+
+static  int  compute_deformation_rows(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    deformation_info  *info = (deformation_info *) data;
+    long              row;
+    int               d, c, k, n, index[VIO_MAX_DIMENSIONS];
+    VIO_Real          (*voxels)[VIO_MAX_DIMENSIONS];
+    VIO_Real          (*points)[VIO_N_DIMENSIONS];
+    VIO_Real          (*transformed)[VIO_N_DIMENSIONS];
+    VIO_Real          jacobian[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+    VIO_Real          value, dx, dy, dz;
+    VIO_BOOL          valid, row_failed;
+
+    n = info->sizes[info->row_dim];
+
+    ALLOC( voxels, n );
+    ALLOC( points, n );
+    ALLOC( transformed, n );
+
+    for_less( d, 0, VIO_MAX_DIMENSIONS )
+        index[d] = 0;
+
+    for( row = first;  row < last;  ++row )
+    {
+        index[info->outer_dim] = (int) (row / info->sizes[info->inner_dim]);
+        index[info->inner_dim] = (int) (row % info->sizes[info->inner_dim]);
 
-    ftol = -1.0;
-    if( input_volume_steps != NULL){
-      for_less( i, 0, 3 ) {
-        if( ftol < 0 ) ftol = input_volume_steps[i];
-        if( input_volume_steps[i] < ftol ) ftol = input_volume_steps[i];
-      }
-    }
-    else {
-      for_less( d, 0, FOUR_DIMS ) {
-        if( d == vector_dim ) continue;
-        if( sizes[d] == 1 ) continue;
-        if( ftol < 0 ) ftol = steps[d];
-        if( steps[d] < ftol ) ftol = steps[d];
-      }
-    }
+        for_less( k, 0, n )
+        {
+            for_less( d, 0, VIO_MAX_DIMENSIONS )
+                voxels[k][d] = (VIO_Real) index[d];
+            voxels[k][info->row_dim] = (VIO_Real) k;
+        }
 
-    ftol = ftol / 80.0;
-    if( ftol > 0.05 ) ftol = 0.05;   // just to be sure for large grids
+        convert_voxel_to_world_points( info->volume, n, voxels, points );
 
-    while( ++tries < NUMBER_TRIES && smallest_e > ftol ) {
-        tx += 0.95 * error_x;
-        ty += 0.95 * error_y;
-        tz += 0.95 * error_z;
+        /*--- if the row fails, its points are taken again one at a time to
+              find which of them failed */
 
-        if((status=grid_transform_point( transform, tx, ty, tz, &gx, &gy, &gz ))!=VIO_OK)
-          return status;
+        row_failed = info->quantity == DISPLACEMENT_MAGNITUDE &&
+                     general_transform_points( info->transform, n, points,
+                                               transformed ) != VIO_OK;
 
-        error_x = x - gx;
-        error_y = y - gy;
-        error_z = z - gz;
+        for_less( k, 0, n )
+        {
+            index[info->row_dim] = k;
+            valid = TRUE;
+
+            if( info->quantity == DISPLACEMENT_MAGNITUDE && row_failed &&
+                general_transform_point( info->transform, points[k][VIO_X],
+                                         points[k][VIO_Y], points[k][VIO_Z],
+                                         &dx, &dy, &dz ) != VIO_OK )
+            {
+                value = 0.0;
+                valid = FALSE;
+                info->failed[thread] = TRUE;
+            }
+            else if( info->quantity == DISPLACEMENT_MAGNITUDE )
+            {
+                dx = transformed[k][VIO_X] - points[k][VIO_X];
+                dy = transformed[k][VIO_Y] - points[k][VIO_Y];
+                dz = transformed[k][VIO_Z] - points[k][VIO_Z];
+                value = sqrt( dx * dx + dy * dy + dz * dz );
+            }
+            else if( general_transform_point_with_jacobian( info->transform,
+                         points[k][VIO_X], points[k][VIO_Y], points[k][VIO_Z],
+                         &dx, &dy, &dz, jacobian ) != VIO_OK )
+            {
+                for_less( c, 0, VIO_N_DIMENSIONS )
+                for_less( d, 0, VIO_N_DIMENSIONS )
+                    jacobian[c][d] = 0.0;
+                value = 0.0;
+                valid = FALSE;
+                info->failed[thread] = TRUE;
+            }
+            else
+            {
+                value = jacobian[0][0] * (jacobian[1][1] * jacobian[2][2] -
+                                          jacobian[1][2] * jacobian[2][1]) -
+                        jacobian[0][1] * (jacobian[1][0] * jacobian[2][2] -
+                                          jacobian[1][2] * jacobian[2][0]) +
+                        jacobian[0][2] * (jacobian[1][0] * jacobian[2][1] -
+                                          jacobian[1][1] * jacobian[2][0]);
+            }
 
-        error = VIO_FABS(error_x) + VIO_FABS(error_y) + VIO_FABS(error_z);
+            if( info->quantity == JACOBIAN_MATRIX )
+            {
+                for_less( c, 0, VIO_N_DIMENSIONS )
+                for_less( d, 0, VIO_N_DIMENSIONS )
+                {
+                    index[info->vector_dim] = c * VIO_N_DIMENSIONS + d;
+                    set_volume_real_value( info->volume, index[0], index[1],
+                                           index[2], index[3], index[4],
+                                           jacobian[c][d] );
+                }
+                index[info->vector_dim] = 0;
+            }
+            else
+                set_volume_real_value( info->volume, index[0], index[1],
+                                       index[2], index[3], index[4], value );
 
-        if( error < smallest_e ) {
-            smallest_e = error;
-            best_x = tx;
-            best_y = ty;
-            best_z = tz;
+            if( valid )
+            {
+                if( info->n_values[thread] == 0 ||
+                    value < info->min_value[thread] )
+                    info->min_value[thread] = value;
+                if( info->n_values[thread] == 0 ||
+                    value > info->max_value[thread] )
+                    info->max_value[thread] = value;
+                info->sum[thread] += value;
+                ++info->n_values[thread];
+            }
         }
     }
 
-    *x_transformed = best_x;
-    *y_transformed = best_y;
-    *z_transformed = best_z;
-    return VIO_OK;
+    FREE( transformed );
+    FREE( points );
+    FREE( voxels );
+
+    return( MI_NOERROR );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : grid_inverse_transform_point
+@NAME       : compute_deformation_volume
 @INPUT      : transform
-              x
-              y
-              z
-@OUTPUT     : x_transformed
-              y_transformed
-              z_transformed
-@RETURNS    :
-@DESCRIPTION: Transforms the point by the inverse of the grid transform.
-              Approximates the solution using a simple iterative step
-              method.
+              quantity    - JACOBIAN_DETERMINANT, JACOBIAN_MATRIX or
+                            DISPLACEMENT_MAGNITUDE
+              volume      - the grid on which to compute it
+@OUTPUT     : volume
+              min_value   - if non-NULL, the smallest value computed, or
+                            determinant for JACOBIAN_MATRIX
+              max_value   - if non-NULL, the largest
+              mean_value  - if non-NULL, the mean
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Maps the deformation of a transform over the voxels of a
+              volume, at their world positions: the determinant of its
+              Jacobian, the whole Jacobian, or the length of the
+              displacement.  The volume must have the three spatial
+              dimensions and, for JACOBIAN_MATRIX, one more of size 9 which
+              holds the derivative of output coordinate c with respect to d
+              at index 3 * c + d.  The Jacobians of grid and thin plate
+              spline transforms come from the derivatives of their splines.
+              The volume is allocated if it is not already; an integer
+              volume must have its real range set beforehand.  The rows of
+              voxels are computed by several threads, so the transform must
+              be safe to apply from several threads at once, which holds for
+              all but user transforms.  Voxels where the Jacobian or the
+              displacement cannot be found are set to zero, left out of the
+              statistics, and make the function return VIO_ERROR.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : 1993?   Louis Collins
-@MODIFIED   : 1994    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  VIO_Status  grid_inverse_transform_point(
-    VIO_General_transform   *transform,
-    VIO_Real                x,
-    VIO_Real                y,
-    VIO_Real                z,
-    VIO_Real                *x_transformed,
-    VIO_Real                *y_transformed,
-    VIO_Real                *z_transformed )
+VIOAPI  VIO_Status  compute_deformation_volume(
+    VIO_General_transform      *transform,
+    VIO_Deformation_quantity   quantity,
+    VIO_Volume                 volume,
+    VIO_Real                   *min_value,
+    VIO_Real                   *max_value,
+    VIO_Real                   *mean_value )
 {
-    return grid_inverse_transform_point_with_input_steps(transform, x, y, z,
-                                           NULL,
-                                           x_transformed, y_transformed, z_transformed );
+    int                d, i, n_dims, n_threads;
+    long               n_rows, n_values;
+    VIO_Real           voxel[VIO_MAX_DIMENSIONS], x, y, z, sum;
+    VIO_BOOL           failed;
+    VIO_Status         status;
+    deformation_info   info;
+
+    if( min_value != NULL )
+        *min_value = 0.0;
+    if( max_value != NULL )
+        *max_value = 0.0;
+    if( mean_value != NULL )
+        *mean_value = 0.0;
+
+    /*--- the rows run along the last spatial dimension of the volume */
+
+    n_dims = get_volume_n_dimensions( volume );
+    get_volume_sizes( volume, info.sizes );
+
+    info.vector_dim = -1;
+    info.row_dim = -1;
+    for_less( d, 0, n_dims )
+    {
+        if( volume->spatial_axes[VIO_X] != d &&
+            volume->spatial_axes[VIO_Y] != d &&
+            volume->spatial_axes[VIO_Z] != d )
+            info.vector_dim = d;
+        else
+            info.row_dim = d;
+    }
+
+    if( n_dims != ((quantity == JACOBIAN_MATRIX) ? 4 : 3) ||
+        volume->spatial_axes[VIO_X] < 0 || volume->spatial_axes[VIO_Y] < 0 ||
+        volume->spatial_axes[VIO_Z] < 0 ||
+        (quantity == JACOBIAN_MATRIX &&
+         info.sizes[info.vector_dim] != VIO_N_DIMENSIONS * VIO_N_DIMENSIONS) )
+    {
+        print_error( "compute_deformation_volume(): the volume must have the "
+                     "three spatial dimensions, and one of size 9 for the "
+                     "Jacobian matrix.\n" );
+        return( VIO_ERROR );
+    }
+
+    info.outer_dim = -1;
+    info.inner_dim = -1;
+    for_less( d, 0, n_dims )
+    {
+        if( d == info.vector_dim || d == info.row_dim )
+            continue;
+        if( info.outer_dim < 0 )
+            info.outer_dim = d;
+        else
+            info.inner_dim = d;
+    }
+
+    if( !volume_is_alloced( volume ) )
+    {
+        alloc_volume_data( volume );
+        if( !volume_is_alloced( volume ) )
+            return( VIO_ERROR );
+    }
+
+    info.transform = transform;
+    info.quantity = quantity;
+    info.volume = volume;
+
+    /*--- transforming one point brings the world transforms of the volume
+          and of any grids in the transform up to date before the threads
+          use them */
+
+    for_less( d, 0, VIO_MAX_DIMENSIONS )
+        voxel[d] = 0.0;
+    convert_voxel_to_world( volume, voxel, &x, &y, &z );
+    if( general_transform_point( transform, x, y, z, &x, &y, &z ) != VIO_OK )
+        return( VIO_ERROR );
+
+    n_threads = miget_parallel_threads();
+    if( volume->is_cached_volume )
+        n_threads = 1;
+
+    ALLOC( info.min_value, n_threads );
+    ALLOC( info.max_value, n_threads );
+    ALLOC( info.sum, n_threads );
+    ALLOC( info.n_values, n_threads );
+    ALLOC( info.failed, n_threads );
+    for_less( i, 0, n_threads )
+    {
+        info.min_value[i] = 0.0;
+        info.max_value[i] = 0.0;
+        info.sum[i] = 0.0;
+        info.n_values[i] = 0;
+        info.failed[i] = FALSE;
+    }
+
+    n_rows = (long) info.sizes[info.outer_dim] * info.sizes[info.inner_dim];
+
+    if( n_threads == 1 )
+        status = compute_deformation_rows( 0, n_rows, 0, &info ) ==
+                 MI_NOERROR ? VIO_OK : VIO_ERROR;
+    else
+        status = miparallel_for( n_rows, DEFORMATION_ROWS_PER_TILE,
+                                 compute_deformation_rows, &info ) ==
+                 MI_NOERROR ? VIO_OK : VIO_ERROR;
+
+    /*--- combine the statistics of the threads */
+
+    n_values = 0;
+    sum = 0.0;
+    failed = FALSE;
+    for_less( i, 0, n_threads )
+    {
+        if( info.n_values[i] > 0 )
+        {
+            if( min_value != NULL &&
+                (n_values == 0 || info.min_value[i] < *min_value) )
+                *min_value = info.min_value[i];
+            if( max_value != NULL &&
+                (n_values == 0 || info.max_value[i] > *max_value) )
+                *max_value = info.max_value[i];
+        }
+        n_values += info.n_values[i];
+        sum += info.sum[i];
+        if( info.failed[i] )
+            failed = TRUE;
+    }
+
+    if( mean_value != NULL && n_values > 0 )
+        *mean_value = sum / (VIO_Real) n_values;
+
+    FREE( info.failed );
+    FREE( info.n_values );
+    FREE( info.sum );
+    FREE( info.max_value );
+    FREE( info.min_value );
+
+    if( status == VIO_OK && failed )
+        status = VIO_ERROR;
+
+    return( status );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -443,7 +2244,8 @@ static  void   evaluate_grid_volume(
     int      end[VIO_MAX_DIMENSIONS];
     VIO_Real     fraction[VIO_MAX_DIMENSIONS], bound, pos;
     VIO_Real     coefs[SPLINE_DEGREE*SPLINE_DEGREE*SPLINE_DEGREE*N_COMPONENTS];
-    VIO_Real     values_derivs[N_COMPONENTS + N_COMPONENTS * VIO_N_DIMENSIONS];
+    VIO_Real     values_derivs[N_COMPONENTS * 8];
+    int      n_spline_dims, n_derivs;
     int is_2dslice = -1;
 
 
@@ -598,22 +2400,20 @@ static  void   evaluate_grid_volume(
         for_less( v, 0, N_COMPONENTS )
             values[v] = coefs[v];
     } else {
-        if( is_2dslice == -1 ) {
-          evaluate_interpolating_spline( VIO_N_DIMENSIONS, fraction,
-                                         degrees_continuity + 2,
-                                         N_COMPONENTS, coefs, 0, values_derivs );
-        } else {
-          evaluate_interpolating_spline( VIO_N_DIMENSIONS-1, fraction,
-                                         degrees_continuity + 2,
-                                         N_COMPONENTS, coefs, 0, values_derivs );
-        }
+        n_spline_dims = (is_2dslice == -1) ? VIO_N_DIMENSIONS :
+                                             VIO_N_DIMENSIONS-1;
+        n_derivs = (deriv_x != NULL) ? 1 : 0;
 
-        /*--- extract values and derivatives from values_derivs */
+        evaluate_interpolating_spline( n_spline_dims, fraction,
+                                       degrees_continuity + 2,
+                                       N_COMPONENTS, coefs, n_derivs,
+                                       values_derivs );
 
-        if( deriv_x != NULL )
-            derivs_per_value = 8;
-        else
-            derivs_per_value = 1;
+        /*--- extract values and derivatives from values_derivs, which holds
+              2 by 2 by 2 (or 2 by 2 in a slice) values and first
+              derivatives per component */
+
+        derivs_per_value = 1 << (n_spline_dims * n_derivs);
 
         for_less( v, 0, N_COMPONENTS ) {
             values[v] = values_derivs[v*derivs_per_value];
@@ -626,9 +2426,10 @@ static  void   evaluate_grid_volume(
                 id = 0;
                 for_less( d, 0, FOUR_DIMS )
                 {
-                    if( d != vector_dim )
+                    if( d != vector_dim && d != is_2dslice )
                     {
-                        voxel_vector[d] = values_derivs[v*8 + (4>>id)];
+                        voxel_vector[d] = values_derivs[v*derivs_per_value +
+                                              (1 << (n_spline_dims-1-id))];
                         ++id;
                     }
                     else
@@ -108,6 +108,42 @@ VIOAPI VIO_Status  mni_skip_expected_character(
     return( status );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : add_char_to_input_string
+@INPUT      : string
+              length
+              alloced
+              ch
+@OUTPUT     : string
+              length
+              alloced
+@RETURNS    :
+@DESCRIPTION: Appends a character to a string being input, doubling its
+              allocation as needed rather than reallocating it for each
+              character.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  add_char_to_input_string(
+    VIO_STR   *string,
+    size_t    *length,
+    size_t    *alloced,
+    char      ch )
+{
+    if( *length == *alloced )
+    {
+        *alloced *= 2;
+        REALLOC( *string, *alloced + 1 );
+    }
+
+    (*string)[*length] = ch;
+    ++(*length);
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : mni_input_line
 @INPUT      : file
@@ -129,20 +165,25 @@ VIOAPI VIO_Status  mni_input_line(
 {
     VIO_Status   status;
     char     ch;
+    size_t   length, alloced;
 
-    *string = create_string( NULL );
+    alloced = 32;
+    *string = alloc_string( alloced );
+    length = 0;
 
     status = input_character( file, &ch );
 
     while( status == VIO_OK && ch != '\n' )
     {
         if (ch != '\r') {       /* Always ignore carriage returns */
-            concat_char_to_string( string, ch );
+            add_char_to_input_string( string, &length, &alloced, ch );
         }
 
         status = input_character( file, &ch );
     }
 
+    (*string)[length] = VIO_END_OF_STRING;
+
     if( status != VIO_OK )
     {
         delete_string( *string );
@@ -180,8 +221,11 @@ VIOAPI VIO_Status  mni_input_string(
     VIO_Status   status;
     char     ch;
     VIO_BOOL quoted;
+    size_t   length, alloced;
 
-    *string = create_string( NULL );
+    alloced = 32;
+    *string = alloc_string( alloced );
+    length = 0;
 
     status = mni_get_nonwhite_character( file, &ch );
 
@@ -199,7 +243,7 @@ VIOAPI VIO_Status  mni_input_string(
            ch != termination_char1 && ch != termination_char2 && ch != '\n' )
     {
         if (ch != '\r') {       /* Always ignore carriage returns */
-            concat_char_to_string( string, ch );
+            add_char_to_input_string( string, &length, &alloced, ch );
         }
         status = input_character( file, &ch );
     }
@@ -207,9 +251,10 @@ VIOAPI VIO_Status  mni_input_string(
     if( !quoted )
         (void) unget_character( file, ch );
 
-    while( string_length(*string) > 0 &&
-           (*string)[string_length(*string)-1] == ' ' )
-        (*string)[string_length(*string)-1] = VIO_END_OF_STRING;
+    while( length > 0 && (*string)[length-1] == ' ' )
+        --length;
+
+    (*string)[length] = VIO_END_OF_STRING;
 
     if( status != VIO_OK )
     {
@@ -294,6 +339,120 @@ static void  unget_string(
         (void) unget_character( file, str[len] );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : mni_scan_real
+@INPUT      : str
+@OUTPUT     : value
+@RETURNS    : number of characters scanned, or 0
+@DESCRIPTION: Scans a decimal real number, optionally signed and with an
+              exponent, from the start of the string.  Only numbers with at
+              most 15 significant digits and a decimal exponent within 22
+              are scanned, which are exactly those that one multiplication
+              or division of exact doubles converts with correct rounding,
+              giving the same value as sscanf().  For anything else, 0 is
+              returned and the caller should fall back on sscanf().  The
+              reals of tag and transform files are almost all written with
+              "%.15g", so are scanned here.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  int  mni_scan_real(
+    const char  str[],
+    VIO_Real    *value )
+{
+    static const VIO_Real  powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+                                               1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                               1e12, 1e13, 1e14, 1e15, 1e16,
+                                               1e17, 1e18, 1e19, 1e20, 1e21,
+                                               1e22 };
+    int       i, n_digits, exponent, exponent_value;
+    VIO_BOOL  negative, negative_exponent, any_digits;
+    VIO_Real  mantissa;
+
+    i = 0;
+    negative = (str[i] == '-');
+    if( str[i] == '-' || str[i] == '+' )
+        ++i;
+
+    mantissa = 0.0;
+    n_digits = 0;
+    exponent = 0;
+    any_digits = FALSE;
+
+    while( str[i] >= '0' && str[i] <= '9' )
+    {
+        if( mantissa != 0.0 || str[i] != '0' )
+        {
+            mantissa = 10.0 * mantissa + (VIO_Real) (str[i] - '0');
+            ++n_digits;
+        }
+        any_digits = TRUE;
+        ++i;
+    }
+
+    if( str[i] == '.' )
+    {
+        ++i;
+        while( str[i] >= '0' && str[i] <= '9' )
+        {
+            if( mantissa != 0.0 || str[i] != '0' )
+            {
+                mantissa = 10.0 * mantissa + (VIO_Real) (str[i] - '0');
+                ++n_digits;
+            }
+            any_digits = TRUE;
+            --exponent;
+            ++i;
+        }
+    }
+
+    if( !any_digits )
+        return( 0 );
+
+    if( str[i] == 'e' || str[i] == 'E' )
+    {
+        ++i;
+        negative_exponent = (str[i] == '-');
+        if( str[i] == '-' || str[i] == '+' )
+            ++i;
+
+        if( str[i] < '0' || str[i] > '9' )
+            return( 0 );
+
+        exponent_value = 0;
+        while( str[i] >= '0' && str[i] <= '9' )
+        {
+            if( exponent_value < 1000 )
+                exponent_value = 10 * exponent_value + (str[i] - '0');
+            ++i;
+        }
+
+        if( negative_exponent )
+            exponent -= exponent_value;
+        else
+            exponent += exponent_value;
+    }
+
+    if( mantissa != 0.0 )
+    {
+        if( n_digits > 15 || exponent < -22 || exponent > 22 )
+            return( 0 );
+
+        if( exponent >= 0 )
+            mantissa *= powers_of_ten[exponent];
+        else
+            mantissa /= powers_of_ten[-exponent];
+    }
+
+    *value = negative ? -mantissa : mantissa;
+
+    return( i );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : mni_input_real
 @INPUT      : file
@@ -313,10 +472,16 @@ VIOAPI VIO_Status  mni_input_real(
 {
     VIO_Status   status;
     VIO_STR   str;
+    int       n_scanned;
 
     status = mni_input_string( file, &str, (char) ' ', (char) ';' );
 
-    if( status == VIO_OK && sscanf( str, "%lf", d ) != 1 )
+    if( status == VIO_OK )
+        n_scanned = mni_scan_real( str, d );
+
+    if( status == VIO_OK &&
+        (n_scanned == 0 || str[n_scanned] != VIO_END_OF_STRING) &&
+        sscanf( str, "%lf", d ) != 1 )
     {
         unget_string( file, str );
         status = VIO_ERROR;
@@ -348,14 +513,31 @@ VIOAPI VIO_Status  mni_input_reals(
     VIO_Real    *reals[] )
 {
     VIO_Real  d;
+    int       n_alloced;
 
     *n = 0;
+    n_alloced = 0;
+
+    /* --- the array is doubled as it fills, then left the size adding
+           the values one at a time would have made it */
 
     while( mni_input_real( file, &d ) != VIO_ERROR )
     {
-        ADD_ELEMENT_TO_ARRAY( *reals, *n, d, DEFAULT_CHUNK_SIZE );
+        if( *n == n_alloced )
+        {
+            SET_ARRAY_SIZE( *reals, n_alloced,
+                            MAX( DEFAULT_CHUNK_SIZE, 2 * n_alloced ),
+                            DEFAULT_CHUNK_SIZE );
+            n_alloced = MAX( DEFAULT_CHUNK_SIZE, 2 * n_alloced );
+        }
+
+        (*reals)[*n] = d;
+        ++(*n);
     }
 
+    if( *n > 0 )
+        SET_ARRAY_SIZE( *reals, n_alloced, *n, DEFAULT_CHUNK_SIZE );
+
     return( mni_skip_expected_character( file, (char) ';' ) );
 }
 
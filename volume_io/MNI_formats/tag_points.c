@@ -17,11 +17,25 @@
 
 
 #include  <internal_volume_io.h>
+#include  <ctype.h>
 
 static   const char      * const TAG_FILE_HEADER = "MNI Tag Point File";
+static   const char      * const BINARY_TAG_FILE_HEADER = "MNI Binary Tag Point File";
 static   const char      * const VOLUMES_STRING = "Volumes";
 static   const char      * const TAG_POINTS_STRING = "Points";
 
+#define  TAG_INPUT_BLOCK_SIZE      65536
+#define  TAG_INPUT_MAX_PUSHED      4
+
+#define  BINARY_TAG_VERSION        1
+#define  BINARY_TAG_HEADER_SIZE    6
+#define  BINARY_TAG_BLOCK_SIZE     4096
+
+#define  BINARY_TAG_WEIGHTS        1
+#define  BINARY_TAG_STRUCTURE_IDS  2
+#define  BINARY_TAG_PATIENT_IDS    4
+#define  BINARY_TAG_LABELS         8
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_default_tag_file_suffix
 @INPUT      :
@@ -364,7 +378,7 @@ static VIO_STR extract_label(
     VIO_STR     str )
 {
     VIO_BOOL  quoted;
-    int      i;
+    int      i, start;
     VIO_STR   label;
 
     i = 0;
@@ -385,38 +399,245 @@ static VIO_STR extract_label(
     /* --- copy characters until either closing quote is found (if quoted),
            or white space or end of string is found */
 
-    label = create_string( NULL );
+    start = i;
 
     while( str[i] != VIO_END_OF_STRING &&
            ( (quoted && str[i] != '"') ||
              (!quoted && str[i] != ' ' && str[i] != '\t') ) )
     {
-        concat_char_to_string( &label, str[i] );
         ++i;
     }
 
+    label = alloc_string( (size_t) (i - start) );
+    (void) memcpy( label, &str[start], (size_t) (i - start) );
+    label[i-start] = VIO_END_OF_STRING;
+
     return( label );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : initialize_tag_file_input
+@NAME       : scan_int_prefix
+@INPUT      : str
+@OUTPUT     : value
+@RETURNS    : number of characters scanned, or 0
+@DESCRIPTION: Scans an optionally signed integer of at most 9 digits, after
+              any white space, from the start of the string, as sscanf()
+              would.  Returns 0 for anything else.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static int  scan_int_prefix(
+    const char  str[],
+    int         *value )
+{
+    int       i, start, digits;
+    VIO_BOOL  negative;
+
+    i = 0;
+    while( isspace( (unsigned char) str[i] ) )
+        ++i;
+
+    negative = (str[i] == '-');
+    if( str[i] == '-' || str[i] == '+' )
+        ++i;
+
+    start = i;
+    digits = 0;
+    while( str[i] >= '0' && str[i] <= '9' && i - start < 10 )
+    {
+        digits = 10 * digits + (str[i] - '0');
+        ++i;
+    }
+
+    if( i == start || i - start > 9 )
+        return( 0 );
+
+    *value = negative ? -digits : digits;
+
+    return( i );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : scan_tag_values
+@INPUT      : line
+@OUTPUT     : weight
+              structure_id
+              patient_id
+              pos           - index of the first character after the values
+                              and any white space following them
+@RETURNS    : TRUE if the three values were scanned
+@DESCRIPTION: Scans the weight, structure id and patient id at the start of
+              the line, the same as sscanf( line, "%lf %d %d %n", ... ).
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_BOOL  scan_tag_values(
+    const char  line[],
+    VIO_Real    *weight,
+    int         *structure_id,
+    int         *patient_id,
+    int         *pos )
+{
+    int   i, n;
+
+    i = 0;
+    while( isspace( (unsigned char) line[i] ) )
+        ++i;
+
+    n = mni_scan_real( &line[i], weight );
+
+    if( n > 0 && isspace( (unsigned char) line[i+n] ) )
+    {
+        i += n;
+        n = scan_int_prefix( &line[i], structure_id );
+        if( n > 0 )
+        {
+            i += n;
+            n = scan_int_prefix( &line[i], patient_id );
+            if( n > 0 )
+            {
+                i += n;
+                while( isspace( (unsigned char) line[i] ) )
+                    ++i;
+
+                *pos = i;
+                return( TRUE );
+            }
+        }
+    }
+
+    return( sscanf( line, "%lf %d %d %n", weight, structure_id,
+                    patient_id, pos ) == 3 );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_tag_line_values
+@INPUT      : line          - the rest of the tag line after the positions,
+                              or NULL if there was none
+@OUTPUT     : ends_in_semicolon
+              weight
+              structure_id
+              patient_id
+              label
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Gets the optional weight, structure id, patient id and label
+              from the rest of a tag line, giving them their defaults if
+              not present.  If the line ends in the semicolon terminating
+              the tags, it is removed from the line and ends_in_semicolon
+              is set, and the caller should put it back on the input.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  input_tag_line_values(
+    VIO_STR    line,
+    VIO_BOOL   *ends_in_semicolon,
+    VIO_Real   *weight,
+    int        *structure_id,
+    int        *patient_id,
+    VIO_STR    *label )
+{
+    VIO_BOOL last_was_blank, in_quotes;
+    int     n_strings, pos, i;
+
+    *ends_in_semicolon = FALSE;
+    *label = NULL;
+    *weight = 0.0;
+    *structure_id = -1;
+    *patient_id = -1;
+
+    n_strings = 0;
+    if( line != NULL )
+    {
+        i = 0;
+        last_was_blank = TRUE;
+        in_quotes = FALSE;
+        while( line[i] != VIO_END_OF_STRING )
+        {
+            if( line[i] == ' ' || line[i] == '\t' )
+            {
+                last_was_blank = TRUE;
+            }
+            else
+            {
+                if( last_was_blank && !in_quotes )
+                    ++n_strings;
+
+                last_was_blank = FALSE;
+
+                if( line[i] == '\"' )
+                    in_quotes = !in_quotes;
+            }
+            ++i;
+        }
+
+        while( i > 0 &&
+               (line[i] == ' ' || line[i] == '\t' ||
+                line[i] == VIO_END_OF_STRING) )
+            --i;
+
+        if( line[i] == ';' )
+        {
+            *ends_in_semicolon = TRUE;
+            line[i] = VIO_END_OF_STRING;
+        }
+    }
+
+    if( n_strings != 0 )
+    {
+        if( n_strings == 1 )
+        {
+            *label = extract_label( line );
+        }
+        else if( n_strings < 3 || n_strings > 4 ||
+                 !scan_tag_values( line, weight, structure_id, patient_id,
+                                   &pos ) )
+        {
+            print_error( "input_tag_points(): error reading tag point\n" );
+            return( VIO_ERROR );
+        }
+        else if( n_strings == 4 )
+        {
+            *label = extract_label( &line[pos] );
+        }
+    }
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_tag_file_header
 @INPUT      : file
-@OUTPUT     : n_volumes
+@OUTPUT     : binary
 @RETURNS    : VIO_OK or VIO_ERROR
-@DESCRIPTION: Reads the tag file header and first part of file.
+@DESCRIPTION: Reads the first line of a tag file, which tells whether it is
+              an ascii or a binary tag file.  For a binary file, the newline
+              ending the line is also read, leaving the file at the binary
+              data.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Oct. 19, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  VIO_Status  initialize_tag_file_input(
+static VIO_Status  input_tag_file_header(
     FILE      *file,
-    int       *n_volumes_ptr )
+    VIO_BOOL  *binary )
 {
     VIO_STR  line;
-    int     n_volumes;
+    char     ch;
 
     /* parameter checking */
 
@@ -429,15 +650,47 @@ VIOAPI  VIO_Status  initialize_tag_file_input(
     /* okay read the header */
 
     if( mni_input_string( file, &line, (char) 0, (char) 0 ) != VIO_OK ||
-        !equal_strings( line, TAG_FILE_HEADER ) )
+        (!equal_strings( line, TAG_FILE_HEADER ) &&
+         !equal_strings( line, BINARY_TAG_FILE_HEADER )) )
     {
         print_error( "input_tag_points(): invalid header in file.\n");
         delete_string( line );
         return( VIO_ERROR );
     }
 
+    *binary = equal_strings( line, BINARY_TAG_FILE_HEADER );
+
     delete_string( line );
 
+    if( *binary && (input_character( file, &ch ) != VIO_OK || ch != '\n') )
+    {
+        print_error( "input_tag_points(): invalid header in file.\n");
+        return( VIO_ERROR );
+    }
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_tag_points_header
+@INPUT      : file
+@OUTPUT     : n_volumes
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Reads the part of an ascii tag file between the first line and
+              the tag points.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  input_tag_points_header(
+    FILE      *file,
+    int       *n_volumes_ptr )
+{
+    int     n_volumes;
+
     /* now read the number of volumes */
 
     if( mni_input_keyword_and_equal_sign( file, VOLUMES_STRING, TRUE ) != VIO_OK )
@@ -471,6 +724,40 @@ VIOAPI  VIO_Status  initialize_tag_file_input(
     return( VIO_OK );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : initialize_tag_file_input
+@INPUT      : file
+@OUTPUT     : n_volumes
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Reads the tag file header and first part of file.  Binary tag
+              files cannot be read a tag at a time, only by
+              input_tag_points().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Oct. 19, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  initialize_tag_file_input(
+    FILE      *file,
+    int       *n_volumes_ptr )
+{
+    VIO_BOOL  binary;
+
+    if( input_tag_file_header( file, &binary ) != VIO_OK )
+        return( VIO_ERROR );
+
+    if( binary )
+    {
+        print_error( "initialize_tag_file_input(): cannot read a binary tag "
+                     "file a tag at a time.\n" );
+        return( VIO_ERROR );
+    }
+
+    return( input_tag_points_header( file, n_volumes_ptr ) );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : read_one_tag
 @INPUT      : file
@@ -504,8 +791,7 @@ static VIO_Status read_one_tag(
 {
     VIO_Status  status;
     VIO_STR  line;
-    VIO_BOOL last_was_blank, in_quotes;
-    int     n_strings, pos, i;
+    VIO_BOOL ends_in_semicolon;
     VIO_Real    x1 = 0.0, y1 = 0.0, z1 = 0.0, x2 = 0.0, y2 = 0.0, z2 = 0.0;
     int     structure_id, patient_id;
     VIO_Real    weight;
@@ -548,68 +834,18 @@ static VIO_Status read_one_tag(
             tags_volume2_ptr[VIO_Z] = z2;
         }
 
-        label = NULL;
-        weight = 0.0;
-        structure_id = -1;
-        patient_id = -1;
-
-        n_strings = 0;
-        if( mni_input_line( file, &line ) == VIO_OK )
-        {
-            i = 0;
-            last_was_blank = TRUE;
-            in_quotes = FALSE;
-            while( line[i] != VIO_END_OF_STRING )
-            {
-                if( line[i] == ' ' || line[i] == '\t' )
-                {
-                    last_was_blank = TRUE;
-                }
-                else
-                {
-                    if( last_was_blank && !in_quotes )
-                        ++n_strings;
-
-                    last_was_blank = FALSE;
-
-                    if( line[i] == '\"' )
-                        in_quotes = !in_quotes;
-                }
-                ++i;
-            }
+        (void) mni_input_line( file, &line );
 
-            while( i > 0 &&
-                   (line[i] == ' ' || line[i] == '\t' ||
-                    line[i] == VIO_END_OF_STRING) )
-                --i;
+        status = input_tag_line_values( line, &ends_in_semicolon, &weight,
+                                        &structure_id, &patient_id, &label );
 
-            if( line[i] == ';' )
-            {
-                (void) unget_character( file, (char) ';' );
-                line[i] = VIO_END_OF_STRING;
-            }
-        }
+        delete_string( line );
 
-        if( n_strings != 0 )
-        {
-            if( n_strings == 1 )
-            {
-                label = extract_label( line );
-            }
-            else if( n_strings < 3 || n_strings > 4 ||
-                     sscanf( line, "%lf %d %d %n", &weight, &structure_id,
-                             &patient_id, &pos ) != 3 )
-            {
-                print_error( "input_tag_points(): error reading tag point\n" );
-                return( VIO_ERROR );
-            }
-            else if( n_strings == 4 )
-            {
-                label = extract_label( &line[pos] );
-            }
-        }
+        if( ends_in_semicolon )
+            (void) unget_character( file, (char) ';' );
 
-        delete_string( line );
+        if( status != VIO_OK )
+            return( status );
 
         if( weight_ptr != NULL )
             *weight_ptr = weight;
@@ -689,6 +925,64 @@ VIOAPI  VIO_Status  output_tag_file(
     return( status );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : output_tag_file_binary
+@INPUT      : filename
+              comments
+              n_volumes
+              n_tag_points
+              tags_volume1
+              tags_volume2
+              weights
+              structure_ids
+              patient_ids
+              labels
+@OUTPUT     :
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Opens the file, outputs the tag points in the binary tag point
+              format, and closes the file.  input_tag_file() reads either
+              format.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  output_tag_file_binary(
+    VIO_STR    filename,
+    VIO_STR    comments,
+    int       n_volumes,
+    int       n_tag_points,
+    VIO_Real      **tags_volume1,
+    VIO_Real      **tags_volume2,
+    VIO_Real      weights[],
+    int       structure_ids[],
+    int       patient_ids[],
+    VIO_STR    labels[] )
+{
+    VIO_Status  status;
+    FILE    *file;
+
+    status = open_file_with_default_suffix( filename,
+                                            get_default_tag_file_suffix(),
+                                            WRITE_FILE, BINARY_FORMAT, &file );
+
+    if( status == VIO_OK )
+    {
+        status = output_tag_points_binary( file, comments, n_volumes,
+                                           n_tag_points, tags_volume1,
+                                           tags_volume2, weights,
+                                           structure_ids, patient_ids,
+                                           labels );
+
+        if( close_file( file ) != VIO_OK )
+            status = VIO_ERROR;
+    }
+
+    return( status );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : input_tag_file
 @INPUT      : filename
@@ -702,6 +996,8 @@ VIOAPI  VIO_Status  output_tag_file(
               labels
 @RETURNS    : VIO_OK or VIO_ERROR
 @DESCRIPTION: Opens the file, inputs the tag points, and closes the file.
+              The file may be an ascii or a binary tag file, so is opened
+              as binary; the ascii reading ignores carriage returns.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -725,7 +1021,7 @@ VIOAPI  VIO_Status  input_tag_file(
 
     status = open_file_with_default_suffix( filename,
                                             get_default_tag_file_suffix(),
-                                            READ_FILE, ASCII_FORMAT, &file );
+                                            READ_FILE, BINARY_FORMAT, &file );
 
     if( status == VIO_OK )
         status = input_tag_points( file, n_volumes, n_tag_points,
@@ -788,59 +1084,1047 @@ VIOAPI  VIO_BOOL  input_one_tag(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : input_tag_points
+@NAME       : tag_input_struct
+@DESCRIPTION: The rest of an ascii tag file, read a block at a time, and
+              the characters put back on it.  The functions using it read
+              the tags exactly as read_one_tag() does through the FILE,
+              without the per character stdio calls and string
+              reallocations.
+---------------------------------------------------------------------------- */
+
+typedef struct
+{
+    FILE     *file;
+    char     *buffer;
+    size_t   n_in_buffer;
+    size_t   pos;
+    int      n_pushed;
+    char     pushed[TAG_INPUT_MAX_PUSHED];
+    VIO_STR  text;
+    size_t   text_length;
+    size_t   text_alloced;
+} tag_input_struct;
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : initialize_tag_input
 @INPUT      : file
-@OUTPUT     : n_volumes
-              n_tag_points
-              tags_volume1
-              tags_volume2
-              weights
-              structure_ids
-              patient_ids
-              labels
-@RETURNS    : OR or VIO_ERROR
-@DESCRIPTION: Inputs an entire tag point file into a set of arrays.
+@OUTPUT     : input
+@RETURNS    :
+@DESCRIPTION: Starts buffered input of the rest of the file.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Oct. 19, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  VIO_Status  input_tag_points(
-    FILE      *file,
-    int       *n_volumes_ptr,
-    int       *n_tag_points,
-    VIO_Real      ***tags_volume1,
-    VIO_Real      ***tags_volume2,
-    VIO_Real      **weights,
-    int       **structure_ids,
-    int       **patient_ids,
-    VIO_STR    *labels[] )
+static void  initialize_tag_input(
+    tag_input_struct  *input,
+    FILE              *file )
 {
-    VIO_Status   status;
-    VIO_Real     tags1[VIO_N_DIMENSIONS];
-    VIO_Real     tags2[VIO_N_DIMENSIONS];
-    VIO_Real     weight;
-    int      structure_id, patient_id, n_volumes;
-    VIO_STR   label;
-
-    status = initialize_tag_file_input( file, &n_volumes );
-
-    if( n_volumes_ptr != NULL )
-        *n_volumes_ptr = n_volumes;
-
-    *n_tag_points = 0;
+    input->file = file;
+    ALLOC( input->buffer, TAG_INPUT_BLOCK_SIZE );
+    input->n_in_buffer = 0;
+    input->pos = 0;
+    input->n_pushed = 0;
+    input->text_alloced = 64;
+    ALLOC( input->text, input->text_alloced );
+    input->text_length = 0;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : terminate_tag_input
+@INPUT      : input
+@OUTPUT     :
+@RETURNS    : TRUE if the file is left just after the characters used
+@DESCRIPTION: Seeks the file back over the characters read into the buffer
+              but not used, and over those put back, which are normally the
+              ones just before, and frees the buffers.  A file which cannot
+              seek, such as a pipe, has lost the unused characters, and gets
+              only the next character put back, as only one is certain to
+              be accepted.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_BOOL  terminate_tag_input(
+    tag_input_struct  *input )
+{
+    int       i, n_pushed;
+    long      n_back;
+    VIO_BOOL  positioned;
+
+    /*--- the characters put back are re-read from the file if they are
+          the ones before the unused part of the buffer */
+
+    n_pushed = input->n_pushed;
+    if( (size_t) n_pushed > input->pos )
+        n_pushed = 0;
+
+    for_less( i, 0, n_pushed )
+    {
+        if( input->buffer[input->pos - (size_t) n_pushed + (size_t) i] !=
+            input->pushed[input->n_pushed - 1 - i] )
+        {
+            n_pushed = 0;
+            break;
+        }
+    }
+
+    n_back = (long) (input->n_in_buffer - input->pos);
+    if( n_pushed == input->n_pushed )
+        n_back += (long) n_pushed;
+
+    positioned = (n_back == 0 ||
+                  fseek( input->file, -n_back, SEEK_CUR ) == 0);
+
+    if( !positioned || n_pushed != input->n_pushed )
+    {
+        if( input->n_pushed > 0 )
+            (void) unget_character( input->file,
+                                    input->pushed[input->n_pushed - 1] );
+        positioned = positioned && input->n_pushed <= 1;
+    }
+
+    FREE( input->buffer );
+    FREE( input->text );
+
+    return( positioned );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_input_character
+@INPUT      : input
+@OUTPUT     : ch
+@RETURNS    : VIO_OK or VIO_ERROR at the end of the file
+@DESCRIPTION: Inputs one character, the last one put back if any, as
+              input_character() does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  tag_input_character(
+    tag_input_struct  *input,
+    char              *ch )
+{
+    if( input->n_pushed > 0 )
+    {
+        --input->n_pushed;
+        *ch = input->pushed[input->n_pushed];
+        return( VIO_OK );
+    }
+
+    if( input->pos == input->n_in_buffer )
+    {
+        input->n_in_buffer = fread( input->buffer, 1, TAG_INPUT_BLOCK_SIZE,
+                                    input->file );
+        input->pos = 0;
+
+        if( input->n_in_buffer == 0 )
+        {
+            *ch = 0;
+            return( VIO_ERROR );
+        }
+    }
+
+    *ch = input->buffer[input->pos];
+    ++input->pos;
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_unget_character
+@INPUT      : input
+              ch
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Puts the character back on the input, as unget_character()
+              does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  tag_unget_character(
+    tag_input_struct  *input,
+    char              ch )
+{
+    if( input->n_pushed < TAG_INPUT_MAX_PUSHED )
+    {
+        input->pushed[input->n_pushed] = ch;
+        ++input->n_pushed;
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : add_to_tag_input_text
+@INPUT      : input
+              ch
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Appends the character to the text of the input, growing it
+              as needed.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  add_to_tag_input_text(
+    tag_input_struct  *input,
+    char              ch )
+{
+    if( input->text_length + 1 >= input->text_alloced )
+    {
+        input->text_alloced *= 2;
+        REALLOC( input->text, input->text_alloced );
+    }
+
+    input->text[input->text_length] = ch;
+    ++input->text_length;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_get_nonwhite_character
+@INPUT      : input
+@OUTPUT     : ch
+@RETURNS    : VIO_OK or VIO_END_OF_FILE
+@DESCRIPTION: Gets the next non white space character, skipping comments, as
+              mni_get_nonwhite_character() does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  tag_get_nonwhite_character(
+    tag_input_struct  *input,
+    char              *ch )
+{
+    VIO_BOOL    in_comment;
+    VIO_Status  status;
+
+    in_comment = FALSE;
+
+    do
+    {
+        status = tag_input_character( input, ch );
+        if( status == VIO_OK )
+        {
+            if( *ch == '%' || *ch == '#' )
+                in_comment = TRUE;
+            else if( *ch == '\n' )
+                in_comment = FALSE;
+        }
+    }
+    while( status == VIO_OK &&
+           (in_comment || *ch == ' ' || *ch == '\t' || *ch == '\n' ||
+            *ch == '\r') );
+
+    if( status == VIO_ERROR )
+        status = VIO_END_OF_FILE;
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_input_real
+@INPUT      : input
+@OUTPUT     : value
+@RETURNS    : VIO_OK, VIO_ERROR or VIO_END_OF_FILE
+@DESCRIPTION: Inputs the next space or semicolon delimited string into the
+              text of the input and scans a real value from it, as
+              mni_input_real() does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  tag_input_real(
+    tag_input_struct  *input,
+    VIO_Real          *value )
+{
+    VIO_Status  status;
+    VIO_BOOL    quoted;
+    char        ch, termination_char1, termination_char2;
+    int         n, i;
+
+    termination_char1 = ' ';
+    termination_char2 = ';';
+    input->text_length = 0;
+
+    status = tag_get_nonwhite_character( input, &ch );
+
+    if( status == VIO_OK && ch == '"' )
+    {
+        quoted = TRUE;
+        status = tag_get_nonwhite_character( input, &ch );
+        termination_char1 = '"';
+        termination_char2 = '"';
+    }
+    else
+        quoted = FALSE;
 
     while( status == VIO_OK &&
-           input_one_tag( file, n_volumes,
-                          tags1, tags2, &weight, &structure_id, &patient_id,
-                          &label, &status ) )
+           ch != termination_char1 && ch != termination_char2 && ch != '\n' )
     {
+        if( ch != '\r' )
+            add_to_tag_input_text( input, ch );
+        status = tag_input_character( input, &ch );
+    }
+
+    if( !quoted )
+        tag_unget_character( input, ch );
+
+    if( status != VIO_OK )
+        return( status );
+
+    while( input->text_length > 0 &&
+           input->text[input->text_length-1] == ' ' )
+        --input->text_length;
+
+    input->text[input->text_length] = VIO_END_OF_STRING;
+
+    n = mni_scan_real( input->text, value );
+
+    if( (n == 0 || input->text[n] != VIO_END_OF_STRING) &&
+        sscanf( input->text, "%lf", value ) != 1 )
+    {
+        i = 0;
+        while( input->text[i] == ' ' || input->text[i] == '\t' )
+            ++i;
+
+        if( input->text[i] != VIO_END_OF_STRING )
+            tag_unget_character( input, input->text[i] );
+
+        status = VIO_ERROR;
+    }
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : tag_input_line
+@INPUT      : input
+@OUTPUT     :
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Inputs the rest of the line into the text of the input, as
+              mni_input_line() does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  tag_input_line(
+    tag_input_struct  *input )
+{
+    VIO_Status  status;
+    char        ch;
+
+    input->text_length = 0;
+
+    status = tag_input_character( input, &ch );
+
+    while( status == VIO_OK && ch != '\n' )
+    {
+        if( ch != '\r' )
+            add_to_tag_input_text( input, ch );
+
+        status = tag_input_character( input, &ch );
+    }
+
+    input->text[input->text_length] = VIO_END_OF_STRING;
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_buffered_tag
+@INPUT      : input
+              n_volumes
+@OUTPUT     : tag_volume1
+              tag_volume2
+              weight
+              structure_id
+              patient_id
+              label
+@RETURNS    : VIO_OK, VIO_ERROR, or VIO_END_OF_FILE after the last tag
+@DESCRIPTION: Reads one tag from the buffered input, as read_one_tag() does.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  input_buffered_tag(
+    tag_input_struct  *input,
+    int               n_volumes,
+    VIO_Real          tag_volume1[],
+    VIO_Real          tag_volume2[],
+    VIO_Real          *weight,
+    int               *structure_id,
+    int               *patient_id,
+    VIO_STR           *label )
+{
+    VIO_Status  status;
+    VIO_BOOL    ends_in_semicolon;
+    char        ch;
+
+    status = tag_input_real( input, &tag_volume1[VIO_X] );
+
+    if( status == VIO_OK )
+    {
+        if( tag_input_real( input, &tag_volume1[VIO_Y] ) != VIO_OK ||
+            tag_input_real( input, &tag_volume1[VIO_Z] ) != VIO_OK ||
+            (n_volumes == 2 &&
+             (tag_input_real( input, &tag_volume2[VIO_X] ) != VIO_OK ||
+              tag_input_real( input, &tag_volume2[VIO_Y] ) != VIO_OK ||
+              tag_input_real( input, &tag_volume2[VIO_Z] ) != VIO_OK)) )
+        {
+            print_error( "read_one_tag(): error reading tag point\n" );
+            return( VIO_ERROR );
+        }
+
+        if( tag_input_line( input ) == VIO_OK )
+            status = input_tag_line_values( input->text, &ends_in_semicolon,
+                                            weight, structure_id, patient_id,
+                                            label );
+        else
+            status = input_tag_line_values( NULL, &ends_in_semicolon,
+                                            weight, structure_id, patient_id,
+                                            label );
+
+        if( ends_in_semicolon )
+            tag_unget_character( input, (char) ';' );
+
+        return( status );
+    }
+
+    if( status == VIO_ERROR )  /* --- found no more tag points, should now find ; */
+    {
+        status = tag_get_nonwhite_character( input, &ch );
+
+        if( status == VIO_OK && ch != ';' )
+        {
+            print_error( "Expected '%c', found '%c'.\n", ';', ch );
+            status = VIO_ERROR;
+        }
+        else if( status != VIO_OK )
+        {
+            print_error( "Expected '%c', found end of file.\n", ';' );
+            status = VIO_ERROR;
+        }
+        else
+            status = VIO_END_OF_FILE;
+    }
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_tag_arrays_size
+@INPUT      : n_volumes
+              previous_n_tags
+              new_n_tags
+@OUTPUT     : tags_volume1
+              tags_volume2
+              weights
+              structure_ids
+              patient_ids
+              labels
+@RETURNS    :
+@DESCRIPTION: Sets the allocated size of those tag arrays that are wanted,
+              the arrays of positions being arrays of pointers.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  set_tag_arrays_size(
+    int       n_volumes,
+    int       previous_n_tags,
+    int       new_n_tags,
+    VIO_Real  ***tags_volume1,
+    VIO_Real  ***tags_volume2,
+    VIO_Real  **weights,
+    int       **structure_ids,
+    int       **patient_ids,
+    VIO_STR   *labels[] )
+{
+    if( tags_volume1 != NULL )
+        SET_ARRAY_SIZE( *tags_volume1, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+
+    if( n_volumes == 2 && tags_volume2 != NULL )
+        SET_ARRAY_SIZE( *tags_volume2, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+
+    if( weights != NULL )
+        SET_ARRAY_SIZE( *weights, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+
+    if( structure_ids != NULL )
+        SET_ARRAY_SIZE( *structure_ids, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+
+    if( patient_ids != NULL )
+        SET_ARRAY_SIZE( *patient_ids, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+
+    if( labels != NULL )
+        SET_ARRAY_SIZE( *labels, previous_n_tags, new_n_tags,
+                        DEFAULT_CHUNK_SIZE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : output_tag_points_binary
+@INPUT      : file
+              comments       - may be null
+              n_volumes
+              n_tag_points
+              tags_volume1
+              tags_volume2
+              weights
+              structure_ids
+              patient_ids
+              labels
+@OUTPUT     :
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Outputs the tag points in the binary tag point format, which
+              holds the same information as an ascii tag file, but is read
+              by input_tag_points() at the speed of the disk.  The file is
+              the line "MNI Binary Tag Point File", then six 4 byte integers:
+              1 in the byte order of the file, the version of the format, 1,
+              n_volumes, n_tag_points, which of the weights (1), structure
+              ids (2), patient ids (4) and labels (8) are present, and the
+              length of the comments.  The comments follow, then the tag
+              positions of each volume as n_tag_points by 3 doubles, the
+              weights as doubles, the ids as 4 byte integers, and the labels
+              as their lengths in 4 byte integers, -1 for no label, followed
+              by all their characters.  Any of weights, structure_ids,
+              patient_ids and labels may be NULL, and are input with the
+              defaults of an ascii tag file.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  output_tag_points_binary(
+    FILE      *file,
+    VIO_STR    comments,
+    int       n_volumes,
+    int       n_tag_points,
+    VIO_Real      **tags_volume1,
+    VIO_Real      **tags_volume2,
+    VIO_Real      weights[],
+    int       structure_ids[],
+    int       patient_ids[],
+    VIO_STR    labels[] )
+{
+    int        header[BINARY_TAG_HEADER_SIZE];
+    int        i, n, volume, n_in_block, *lengths;
+    VIO_Real   *block, **tags;
+    VIO_BOOL   okay;
+
+    if( file == NULL )
+    {
+        print_error( "output_tag_points_binary(): passed NULL FILE ptr.\n");
+        return( VIO_ERROR );
+    }
+
+    if( n_volumes != 1 && n_volumes != 2 )
+    {
+        print_error( "output_tag_points_binary():" );
+        print_error( " can only support 1 or 2 volumes;\n" );
+        print_error( "     you've supplied %d.\n", n_volumes );
+        return( VIO_ERROR );
+    }
+
+    header[0] = 1;
+    header[1] = BINARY_TAG_VERSION;
+    header[2] = n_volumes;
+    header[3] = n_tag_points;
+    header[4] = (weights != NULL ? BINARY_TAG_WEIGHTS : 0) |
+                (structure_ids != NULL ? BINARY_TAG_STRUCTURE_IDS : 0) |
+                (patient_ids != NULL ? BINARY_TAG_PATIENT_IDS : 0) |
+                (labels != NULL ? BINARY_TAG_LABELS : 0);
+    header[5] = string_length( comments );
+
+    okay = fprintf( file, "%s\n", BINARY_TAG_FILE_HEADER ) > 0 &&
+           fwrite( header, sizeof(header[0]), BINARY_TAG_HEADER_SIZE,
+                   file ) == BINARY_TAG_HEADER_SIZE &&
+           fwrite( comments, 1, (size_t) header[5], file ) ==
+                   (size_t) header[5];
+
+    /* --- the positions are gathered into blocks to be written */
+
+    ALLOC( block, 3 * BINARY_TAG_BLOCK_SIZE );
+
+    for( volume = 0;  okay && volume < n_volumes;  ++volume )
+    {
+        tags = (volume == 0) ? tags_volume1 : tags_volume2;
+
+        for( i = 0;  okay && i < n_tag_points;  i += n_in_block )
+        {
+            n_in_block = MIN( BINARY_TAG_BLOCK_SIZE, n_tag_points - i );
+
+            for_less( n, 0, n_in_block )
+            {
+                block[3*n+VIO_X] = tags[i+n][VIO_X];
+                block[3*n+VIO_Y] = tags[i+n][VIO_Y];
+                block[3*n+VIO_Z] = tags[i+n][VIO_Z];
+            }
+
+            okay = fwrite( block, sizeof(block[0]), (size_t) (3 * n_in_block),
+                           file ) == (size_t) (3 * n_in_block);
+        }
+    }
+
+    FREE( block );
+
+    if( okay && weights != NULL && n_tag_points > 0 )
+        okay = fwrite( weights, sizeof(weights[0]), (size_t) n_tag_points,
+                       file ) == (size_t) n_tag_points;
+
+    if( okay && structure_ids != NULL && n_tag_points > 0 )
+        okay = fwrite( structure_ids, sizeof(structure_ids[0]),
+                       (size_t) n_tag_points, file ) == (size_t) n_tag_points;
+
+    if( okay && patient_ids != NULL && n_tag_points > 0 )
+        okay = fwrite( patient_ids, sizeof(patient_ids[0]),
+                       (size_t) n_tag_points, file ) == (size_t) n_tag_points;
+
+    if( okay && labels != NULL && n_tag_points > 0 )
+    {
+        ALLOC( lengths, n_tag_points );
+
+        for_less( i, 0, n_tag_points )
+            lengths[i] = (labels[i] == NULL) ? -1 : string_length( labels[i] );
+
+        okay = fwrite( lengths, sizeof(lengths[0]), (size_t) n_tag_points,
+                       file ) == (size_t) n_tag_points;
+
+        for( i = 0;  okay && i < n_tag_points;  ++i )
+        {
+            if( lengths[i] > 0 )
+                okay = fwrite( labels[i], 1, (size_t) lengths[i], file ) ==
+                       (size_t) lengths[i];
+        }
+
+        FREE( lengths );
+    }
+
+    if( !okay )
+    {
+        print_error( "output_tag_points_binary(): error writing tag points.\n" );
+        return( VIO_ERROR );
+    }
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : swap_binary_tag_bytes
+@INPUT      : data
+              item_size
+              n_items
+@OUTPUT     : data
+@RETURNS    :
+@DESCRIPTION: Reverses the bytes of each item of the array, to read a binary
+              tag file written on a machine of the other byte order.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  swap_binary_tag_bytes(
+    void      *data,
+    size_t    item_size,
+    size_t    n_items )
+{
+    unsigned char  *bytes, tmp;
+    size_t         i, b;
+
+    bytes = (unsigned char *) data;
+
+    for( i = 0;  i < n_items;  ++i )
+    {
+        for( b = 0;  b < item_size / 2;  ++b )
+        {
+            tmp = bytes[i*item_size+b];
+            bytes[i*item_size+b] = bytes[i*item_size+item_size-1-b];
+            bytes[i*item_size+item_size-1-b] = tmp;
+        }
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_binary_tag_data
+@INPUT      : file
+              item_size
+              n_items
+              swap          - whether the bytes of each item are swapped
+@OUTPUT     : data
+@RETURNS    : TRUE if all the items were read
+@DESCRIPTION: Reads an array of items from a binary tag file, putting their
+              bytes into the order of this machine.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_BOOL  input_binary_tag_data(
+    FILE      *file,
+    void      *data,
+    size_t    item_size,
+    size_t    n_items,
+    VIO_BOOL  swap )
+{
+    if( n_items == 0 )
+        return( TRUE );
+
+    if( fread( data, item_size, n_items, file ) != n_items )
+        return( FALSE );
+
+    if( swap )
+        swap_binary_tag_bytes( data, item_size, n_items );
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_binary_tag_points
+@INPUT      : file          - positioned after the first line
+@OUTPUT     : n_volumes
+              n_tag_points
+              tags_volume1
+              tags_volume2
+              weights
+              structure_ids
+              patient_ids
+              labels
+@RETURNS    : VIO_OK or VIO_ERROR
+@DESCRIPTION: Inputs the tag points of a binary tag file, as written by
+              output_tag_points_binary(), into the arrays input_tag_points()
+              passes back for the same ascii tag file.  On error, no arrays
+              are passed back.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_Status  input_binary_tag_points(
+    FILE      *file,
+    int       *n_volumes_ptr,
+    int       *n_tag_points,
+    VIO_Real      ***tags_volume1,
+    VIO_Real      ***tags_volume2,
+    VIO_Real      **weights,
+    int       **structure_ids,
+    int       **patient_ids,
+    VIO_STR    *labels[] )
+{
+    int        header[BINARY_TAG_HEADER_SIZE];
+    int        i, n, volume, flags, *lengths;
+    int        *structure_id_array, *patient_id_array;
+    size_t     n_label_chars, pos;
+    VIO_Real   *positions[2], *weight_array, ***tags;
+    VIO_STR    *label_array;
+    char       *label_chars;
+    VIO_BOOL   swap, okay;
+
+    if( fread( header, sizeof(header[0]), BINARY_TAG_HEADER_SIZE, file ) !=
+        BINARY_TAG_HEADER_SIZE )
+    {
+        print_error( "input_tag_points(): error reading binary tag header.\n" );
+        return( VIO_ERROR );
+    }
+
+    swap = (header[0] != 1);
+    if( swap )
+        swap_binary_tag_bytes( header, sizeof(header[0]),
+                               BINARY_TAG_HEADER_SIZE );
+
+    n = header[3];
+    flags = header[4];
+
+    if( header[0] != 1 || header[1] != BINARY_TAG_VERSION ||
+        (header[2] != 1 && header[2] != 2) || n < 0 || header[5] < 0 )
+    {
+        print_error( "input_tag_points(): invalid binary tag header.\n" );
+        return( VIO_ERROR );
+    }
+
+    /* --- skip the comments */
+
+    okay = TRUE;
+    for( i = 0;  okay && i < header[5];  ++i )
+        okay = (fgetc( file ) != EOF);
+
+    positions[0] = NULL;
+    positions[1] = NULL;
+    weight_array = NULL;
+    structure_id_array = NULL;
+    patient_id_array = NULL;
+    lengths = NULL;
+    label_chars = NULL;
+
+    if( n > 0 )
+    {
+        for_less( volume, 0, header[2] )
+        {
+            ALLOC( positions[volume], 3 * n );
+            okay = okay && input_binary_tag_data( file, positions[volume],
+                                                  sizeof(VIO_Real),
+                                                  (size_t) (3 * n), swap );
+        }
+
+        SET_ARRAY_SIZE( weight_array, 0, n, DEFAULT_CHUNK_SIZE );
+        if( flags & BINARY_TAG_WEIGHTS )
+            okay = okay && input_binary_tag_data( file, weight_array,
+                                                  sizeof(VIO_Real),
+                                                  (size_t) n, swap );
+        else
+            for_less( i, 0, n )
+                weight_array[i] = 0.0;
+
+        SET_ARRAY_SIZE( structure_id_array, 0, n, DEFAULT_CHUNK_SIZE );
+        if( flags & BINARY_TAG_STRUCTURE_IDS )
+            okay = okay && input_binary_tag_data( file, structure_id_array,
+                                                  sizeof(int), (size_t) n,
+                                                  swap );
+        else
+            for_less( i, 0, n )
+                structure_id_array[i] = -1;
+
+        SET_ARRAY_SIZE( patient_id_array, 0, n, DEFAULT_CHUNK_SIZE );
+        if( flags & BINARY_TAG_PATIENT_IDS )
+            okay = okay && input_binary_tag_data( file, patient_id_array,
+                                                  sizeof(int), (size_t) n,
+                                                  swap );
+        else
+            for_less( i, 0, n )
+                patient_id_array[i] = -1;
+
+        ALLOC( lengths, n );
+        if( flags & BINARY_TAG_LABELS )
+            okay = okay && input_binary_tag_data( file, lengths, sizeof(int),
+                                                  (size_t) n, swap );
+        else
+            for_less( i, 0, n )
+                lengths[i] = -1;
+
+        n_label_chars = 0;
+        for_less( i, 0, n )
+        {
+            if( lengths[i] > 0 )
+                n_label_chars += (size_t) lengths[i];
+        }
+
+        if( okay && n_label_chars > 0 )
+        {
+            ALLOC( label_chars, n_label_chars );
+            okay = input_binary_tag_data( file, label_chars, 1,
+                                          n_label_chars, FALSE );
+        }
+    }
+
+    if( !okay )
+    {
+        print_error( "input_tag_points(): error reading binary tag points.\n" );
+
+        FREE( positions[0] );
+        FREE( positions[1] );
+        FREE( weight_array );
+        FREE( structure_id_array );
+        FREE( patient_id_array );
+        FREE( lengths );
+        FREE( label_chars );
+
+        return( VIO_ERROR );
+    }
+
+    if( n_volumes_ptr != NULL )
+        *n_volumes_ptr = header[2];
+
+    *n_tag_points = n;
+
+    if( n == 0 )
+        return( VIO_OK );
+
+    /* --- the positions are passed back as an array of rows */
+
+    for_less( volume, 0, header[2] )
+    {
+        tags = (volume == 0) ? tags_volume1 : tags_volume2;
+
+        if( tags != NULL )
+        {
+            SET_ARRAY_SIZE( *tags, 0, n, DEFAULT_CHUNK_SIZE );
+            for_less( i, 0, n )
+            {
+                ALLOC( (*tags)[i], 3 );
+                (*tags)[i][VIO_X] = positions[volume][3*i+VIO_X];
+                (*tags)[i][VIO_Y] = positions[volume][3*i+VIO_Y];
+                (*tags)[i][VIO_Z] = positions[volume][3*i+VIO_Z];
+            }
+        }
+
+        FREE( positions[volume] );
+    }
+
+    if( weights != NULL )
+        *weights = weight_array;
+    else
+        FREE( weight_array );
+
+    if( structure_ids != NULL )
+        *structure_ids = structure_id_array;
+    else
+        FREE( structure_id_array );
+
+    if( patient_ids != NULL )
+        *patient_ids = patient_id_array;
+    else
+        FREE( patient_id_array );
+
+    if( labels != NULL )
+    {
+        SET_ARRAY_SIZE( label_array, 0, n, DEFAULT_CHUNK_SIZE );
+
+        pos = 0;
+        for_less( i, 0, n )
+        {
+            if( lengths[i] < 0 )
+                label_array[i] = NULL;
+            else
+            {
+                label_array[i] = alloc_string( (size_t) lengths[i] );
+                if( lengths[i] > 0 )
+                    (void) memcpy( label_array[i], &label_chars[pos],
+                                   (size_t) lengths[i] );
+                label_array[i][lengths[i]] = VIO_END_OF_STRING;
+                pos += (size_t) lengths[i];
+            }
+        }
+
+        *labels = label_array;
+    }
+
+    FREE( lengths );
+    FREE( label_chars );
+
+    return( VIO_OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : input_tag_points
+@INPUT      : file
+@OUTPUT     : n_volumes
+              n_tag_points
+              tags_volume1
+              tags_volume2
+              weights
+              structure_ids
+              patient_ids
+              labels
+@RETURNS    : OR or VIO_ERROR
+@DESCRIPTION: Inputs an entire tag point file, ascii or binary, into a set of
+              arrays.  The tags of an ascii file are read from blocks of the
+              file, exactly as input_one_tag() reads them, into arrays grown
+              by doubling.  The file is then left just after the tags if it
+              can seek; otherwise, as for a pipe, the position is undefined.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Oct. 19, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  input_tag_points(
+    FILE      *file,
+    int       *n_volumes_ptr,
+    int       *n_tag_points,
+    VIO_Real      ***tags_volume1,
+    VIO_Real      ***tags_volume2,
+    VIO_Real      **weights,
+    int       **structure_ids,
+    int       **patient_ids,
+    VIO_STR    *labels[] )
+{
+    VIO_Status   status;
+    VIO_Real     tags1[VIO_N_DIMENSIONS];
+    VIO_Real     tags2[VIO_N_DIMENSIONS];
+    VIO_Real     weight;
+    int      structure_id, patient_id, n_volumes, n_alloced;
+    VIO_STR   label;
+    VIO_BOOL  binary;
+    tag_input_struct  input;
+
+    *n_tag_points = 0;
+
+    status = input_tag_file_header( file, &binary );
+
+    if( status == VIO_OK && binary )
+        return( input_binary_tag_points( file, n_volumes_ptr, n_tag_points,
+                                         tags_volume1, tags_volume2, weights,
+                                         structure_ids, patient_ids,
+                                         labels ) );
+
+    if( status == VIO_OK )
+        status = input_tag_points_header( file, &n_volumes );
+
+    if( status != VIO_OK )
+        return( status );
+
+    if( n_volumes_ptr != NULL )
+        *n_volumes_ptr = n_volumes;
+
+    initialize_tag_input( &input, file );
+
+    n_alloced = 0;
+
+    while( (status = input_buffered_tag( &input, n_volumes, tags1, tags2,
+                                         &weight, &structure_id, &patient_id,
+                                         &label )) == VIO_OK )
+    {
+        if( *n_tag_points == n_alloced )
+        {
+            set_tag_arrays_size( n_volumes, n_alloced,
+                                 MAX( DEFAULT_CHUNK_SIZE, 2 * n_alloced ),
+                                 tags_volume1, tags_volume2, weights,
+                                 structure_ids, patient_ids, labels );
+            n_alloced = MAX( DEFAULT_CHUNK_SIZE, 2 * n_alloced );
+        }
+
         if( tags_volume1 != NULL )
         {
-            SET_ARRAY_SIZE( *tags_volume1, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE );
             ALLOC( (*tags_volume1)[*n_tag_points], 3 );
             (*tags_volume1)[*n_tag_points][VIO_X] = tags1[VIO_X];
             (*tags_volume1)[*n_tag_points][VIO_Y] = tags1[VIO_Y];
@@ -849,8 +2133,6 @@ VIOAPI  VIO_Status  input_tag_points(
 
         if( n_volumes == 2 && tags_volume2 != NULL )
         {
-            SET_ARRAY_SIZE( *tags_volume2, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE );
             ALLOC( (*tags_volume2)[*n_tag_points], 3 );
             (*tags_volume2)[*n_tag_points][VIO_X] = tags2[VIO_X];
             (*tags_volume2)[*n_tag_points][VIO_Y] = tags2[VIO_Y];
@@ -858,37 +2140,34 @@ VIOAPI  VIO_Status  input_tag_points(
         }
 
         if( weights != NULL )
-        {
-            SET_ARRAY_SIZE( *weights, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE);
             (*weights)[*n_tag_points] = weight;
-        }
 
         if( structure_ids != NULL )
-        {
-            SET_ARRAY_SIZE( *structure_ids, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE);
             (*structure_ids)[*n_tag_points] = structure_id;
-        }
 
         if( patient_ids != NULL )
-        {
-            SET_ARRAY_SIZE( *patient_ids, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE);
             (*patient_ids)[*n_tag_points] = patient_id;
-        }
 
         if( labels != NULL )
-        {
-            SET_ARRAY_SIZE( *labels, *n_tag_points, *n_tag_points+1,
-                            DEFAULT_CHUNK_SIZE);
             (*labels)[*n_tag_points] = label;
-        }
         else
             delete_string( label );
 
         ++(*n_tag_points);
     }
 
+    if( status == VIO_END_OF_FILE )
+        status = VIO_OK;
+
+    /* --- leave the arrays the size they would have had if grown a tag
+           at a time */
+
+    if( *n_tag_points > 0 )
+        set_tag_arrays_size( n_volumes, n_alloced, *n_tag_points,
+                             tags_volume1, tags_volume2, weights,
+                             structure_ids, patient_ids, labels );
+
+    (void) terminate_tag_input( &input );
+
     return( status );
 }
@@ -16,11 +16,33 @@
 #endif /*HAVE_CONFIG_H*/
 
 #include <internal_volume_io.h>
+#include "minc_parallel.h"
 
 #define   INVERSE_FUNCTION_TOLERANCE     0.01
 #define   INVERSE_DELTA_TOLERANCE        0.01
 #define   MAX_INVERSE_ITERATIONS         20
 
+/* --- batches of points are transformed by several threads when the number
+       of points times the number of landmarks reaches this */
+
+#define   TPS_PARALLEL_MIN_WORK          (1L << 18)
+#define   TPS_POINTS_PER_TILE            16
+
+/* --- warm started inverses restart cold at each tile, so use longer ones */
+
+#define   TPS_WARM_POINTS_PER_TILE       64
+
+/* --- cells of at most this many landmarks are not split; splitting at the
+       median keeps the tree depth, and so the stack, below 32 */
+
+#define   TPS_TREE_LEAF_SIZE             32
+#define   TPS_TREE_STACK_SIZE            64
+
+/* --- sums of w, w s, w s s^T (xx,xy,xz,yy,yz,zz) and w s s s^T (xxx,xxy,
+       xxz,xyy,xyz,xzz,yyy,yyz,yzz,zzz) for each value of a cell */
+
+#define   TPS_TREE_N_MOMENTS             20
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : thin_plate_spline.c
 @INPUT      :
@@ -41,6 +63,35 @@
 ---------------------------------------------------------------------------- */
 
 
+/* ----- landmarks of a 3D spline grouped in a binary tree of cells, for
+         approximate evaluation ---- */
+
+typedef  struct
+{
+    VIO_Real   center[VIO_N_DIMENSIONS];  /* mean of the landmarks */
+    VIO_Real   radius;                    /* distance to the furthest one */
+    VIO_Real   moments[VIO_N_DIMENSIONS][TPS_TREE_N_MOMENTS]; /* s relative
+                                                            to center */
+    VIO_Real   abs_weight;                /* sum of the largest |w| of */
+    VIO_Real   error_moment;              /* each landmark, and of it */
+                                          /* times |s|^4 */
+    int        first;                     /* landmarks [first,last) */
+    int        last;
+    int        children[2];               /* -1 for a leaf */
+} tps_tree_node;
+
+typedef  struct
+{
+    int            n_points;
+    VIO_Real       **weights;       /* of the spline, for the affine part */
+    int            n_nodes;
+    tps_tree_node  *nodes;
+    VIO_Real       (*landmarks)[VIO_N_DIMENSIONS];  /* in the order of the */
+    VIO_Real       (*landmark_weights)[VIO_N_DIMENSIONS];  /* tree */
+    VIO_Real       tolerance;       /* as asked for */
+    VIO_Real       weight_tolerance;  /* per unit of abs_weight */
+} tps_tree;
+
 /* ----- structure used by newton root finding ---- */
 
 typedef  struct
@@ -49,6 +100,7 @@ typedef  struct
     VIO_Real   **weights;
     int    n_points;
     int    n_dims;
+    tps_tree   *tree;           /* to evaluate approximately, or NULL */
 } spline_data_struct;
 
 /*------------ static functions -----------------*/
@@ -65,6 +117,14 @@ static  VIO_Real  thin_plate_spline_U_deriv(
    int    n_dims,
    int    deriv_dim );
 
+static  void  evaluate_thin_plate_spline_3d(
+    int       n_points,
+    VIO_Real  **points,
+    VIO_Real  **weights,
+    VIO_Real  pos[],
+    VIO_Real  values[],
+    VIO_Real  **derivs );
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : evaluate_thin_plate_spline
 @INPUT      : n_dims           - dimensionality of the function
@@ -104,6 +164,13 @@ VIOAPI  void  evaluate_thin_plate_spline(
     int       v, d, p;
     VIO_Real      dist, dist_deriv;
 
+    if( n_dims == 3 && n_values == 3 )
+    {
+        evaluate_thin_plate_spline_3d( n_points, points, weights, pos,
+                                       values, derivs );
+        return;
+    }
+
     /* f(x,y[,z]) =a_{n} + a_{n+1}x + a_{n+1}y + sum_{0}^{n-1}
      *          w_{i}U(|P_{i} - (x,y)|)
      */
@@ -170,6 +237,569 @@ VIOAPI  void  evaluate_thin_plate_spline(
 }
 
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_thin_plate_spline_3d
+@INPUT      : n_points         - number of defining landmarks
+              points[n_points][3]  - landmarks
+              weights[n_points+4][3] - weights for the points
+              pos[3]           - position at which to evaluate
+@OUTPUT     : values[3]        - function values at this position
+              deriv[3][3]      - function derivatives at this point
+@RETURNS    :
+@DESCRIPTION: evaluate_thin_plate_spline() for a 3D transform.  The distance
+              to each landmark is found once for the values and all the
+              derivatives, and the sums are kept in registers; they are
+              added up in the same order, so the results are the same.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  evaluate_thin_plate_spline_3d(
+    int       n_points,
+    VIO_Real  **points,
+    VIO_Real  **weights,
+    VIO_Real  pos[],
+    VIO_Real  values[],
+    VIO_Real  **derivs )
+{
+    int       p, v, d;
+    VIO_Real  x, y, z, dx, dy, dz, r, ux, uy, uz, *w;
+    VIO_Real  v0, v1, v2;
+    VIO_Real  d00, d01, d02, d10, d11, d12, d20, d21, d22;
+
+    x = pos[VIO_X];
+    y = pos[VIO_Y];
+    z = pos[VIO_Z];
+
+    v0 = v1 = v2 = 0.0;
+
+    if( derivs == NULL )
+    {
+        for_less( p, 0, n_points )
+        {
+            dx = x - points[p][VIO_X];
+            dy = y - points[p][VIO_Y];
+            dz = z - points[p][VIO_Z];
+            r = sqrt( dx * dx + dy * dy + dz * dz );
+
+            w = weights[p];
+            v0 = v0 + w[0] * r;
+            v1 = v1 + w[1] * r;
+            v2 = v2 + w[2] * r;
+        }
+    }
+    else
+    {
+        d00 = d01 = d02 = d10 = d11 = d12 = d20 = d21 = d22 = 0.0;
+
+        for_less( p, 0, n_points )
+        {
+            dx = x - points[p][VIO_X];
+            dy = y - points[p][VIO_Y];
+            dz = z - points[p][VIO_Z];
+            r = sqrt( dx * dx + dy * dy + dz * dz );
+
+            w = weights[p];
+            v0 = v0 + w[0] * r;
+            v1 = v1 + w[1] * r;
+            v2 = v2 + w[2] * r;
+
+            /*--- thin_plate_spline_U_deriv() */
+
+            if( r == 0.0 )
+                ux = uy = uz = 0.0;
+            else
+            {
+                ux = dx / r;
+                uy = dy / r;
+                uz = dz / r;
+            }
+
+            d00 += w[0] * ux;
+            d01 += w[0] * uy;
+            d02 += w[0] * uz;
+            d10 += w[1] * ux;
+            d11 += w[1] * uy;
+            d12 += w[1] * uz;
+            d20 += w[2] * ux;
+            d21 += w[2] * uy;
+            d22 += w[2] * uz;
+        }
+
+        derivs[0][0] = d00;
+        derivs[0][1] = d01;
+        derivs[0][2] = d02;
+        derivs[1][0] = d10;
+        derivs[1][1] = d11;
+        derivs[1][2] = d12;
+        derivs[2][0] = d20;
+        derivs[2][1] = d21;
+        derivs[2][2] = d22;
+    }
+
+    values[0] = v0 + weights[n_points][0];
+    values[1] = v1 + weights[n_points][1];
+    values[2] = v2 + weights[n_points][2];
+
+    for_less( v, 0, 3 )
+    {
+        for_less( d, 0, 3 )
+        {
+            values[v] += weights[n_points+1+d][v] * pos[d];
+            if( derivs != NULL )
+                derivs[v][d] += weights[n_points+1+d][v];
+        }
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : select_tps_landmarks
+@INPUT      : tree
+              first
+              last
+              middle
+              axis
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Reorders the landmarks [first,last) of the tree, and their
+              weights, so that those before middle are no further along
+              axis than those from middle on.
+@METHOD     : Hoare's selection.
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  select_tps_landmarks(
+    tps_tree  *tree,
+    int       first,
+    int       last,
+    int       middle,
+    int       axis )
+{
+    int       i, j, d;
+    VIO_Real  pivot, swap;
+
+    --last;
+
+    while( first < last )
+    {
+        pivot = tree->landmarks[(first + last) / 2][axis];
+        i = first;
+        j = last;
+
+        while( i <= j )
+        {
+            while( tree->landmarks[i][axis] < pivot )
+                ++i;
+            while( tree->landmarks[j][axis] > pivot )
+                --j;
+
+            if( i <= j )
+            {
+                for_less( d, 0, VIO_N_DIMENSIONS )
+                {
+                    swap = tree->landmarks[i][d];
+                    tree->landmarks[i][d] = tree->landmarks[j][d];
+                    tree->landmarks[j][d] = swap;
+                    swap = tree->landmark_weights[i][d];
+                    tree->landmark_weights[i][d] =
+                                            tree->landmark_weights[j][d];
+                    tree->landmark_weights[j][d] = swap;
+                }
+                ++i;
+                --j;
+            }
+        }
+
+        if( middle <= j )
+            last = j;
+        else if( middle >= i )
+            first = i;
+        else
+            break;
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : build_tps_tree_node
+@INPUT      : tree
+              first
+              last
+@OUTPUT     :
+@RETURNS    : index of the node
+@DESCRIPTION: Adds the cell of landmarks [first,last) to the tree, with its
+              moments, and splits it at the median of its longest side
+              until the cells hold at most TPS_TREE_LEAF_SIZE landmarks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  int  build_tps_tree_node(
+    tps_tree  *tree,
+    int       first,
+    int       last )
+{
+    int            index, p, c, d, axis, middle;
+    VIO_Real       min[VIO_N_DIMENSIONS], max[VIO_N_DIMENSIONS];
+    VIO_Real       s[VIO_N_DIMENSIONS], w, dist, *m;
+    VIO_Real       abs_w;
+    tps_tree_node  *node;
+
+    index = tree->n_nodes;
+    ++tree->n_nodes;
+    node = &tree->nodes[index];
+    node->first = first;
+    node->last = last;
+
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        node->center[d] = 0.0;
+        min[d] = tree->landmarks[first][d];
+        max[d] = tree->landmarks[first][d];
+    }
+
+    for_less( p, first, last )
+    {
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            node->center[d] += tree->landmarks[p][d];
+            min[d] = MIN( min[d], tree->landmarks[p][d] );
+            max[d] = MAX( max[d], tree->landmarks[p][d] );
+        }
+    }
+
+    for_less( d, 0, VIO_N_DIMENSIONS )
+        node->center[d] /= (VIO_Real) (last - first);
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    {
+        for_less( d, 0, TPS_TREE_N_MOMENTS )
+            node->moments[c][d] = 0.0;
+    }
+
+    node->radius = 0.0;
+    node->abs_weight = 0.0;
+    node->error_moment = 0.0;
+
+    for_less( p, first, last )
+    {
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            s[d] = tree->landmarks[p][d] - node->center[d];
+
+        dist = sqrt( s[0] * s[0] + s[1] * s[1] + s[2] * s[2] );
+        node->radius = MAX( node->radius, dist );
+
+        abs_w = 0.0;
+        for_less( c, 0, VIO_N_DIMENSIONS )
+        {
+            w = tree->landmark_weights[p][c];
+            abs_w = MAX( abs_w, VIO_FABS( w ) );
+            m = node->moments[c];
+            m[0] += w;
+            m[1] += w * s[0];
+            m[2] += w * s[1];
+            m[3] += w * s[2];
+            m[4] += w * s[0] * s[0];
+            m[5] += w * s[0] * s[1];
+            m[6] += w * s[0] * s[2];
+            m[7] += w * s[1] * s[1];
+            m[8] += w * s[1] * s[2];
+            m[9] += w * s[2] * s[2];
+            m[10] += w * s[0] * s[0] * s[0];
+            m[11] += w * s[0] * s[0] * s[1];
+            m[12] += w * s[0] * s[0] * s[2];
+            m[13] += w * s[0] * s[1] * s[1];
+            m[14] += w * s[0] * s[1] * s[2];
+            m[15] += w * s[0] * s[2] * s[2];
+            m[16] += w * s[1] * s[1] * s[1];
+            m[17] += w * s[1] * s[1] * s[2];
+            m[18] += w * s[1] * s[2] * s[2];
+            m[19] += w * s[2] * s[2] * s[2];
+        }
+
+        node->abs_weight += abs_w;
+        node->error_moment += abs_w * dist * dist * dist * dist;
+    }
+
+    if( last - first <= TPS_TREE_LEAF_SIZE )
+    {
+        node->children[0] = -1;
+        node->children[1] = -1;
+        return( index );
+    }
+
+    axis = 0;
+    for_less( d, 1, VIO_N_DIMENSIONS )
+    {
+        if( max[d] - min[d] > max[axis] - min[axis] )
+            axis = d;
+    }
+
+    middle = (first + last) / 2;
+    select_tps_landmarks( tree, first, last, middle, axis );
+
+    node->children[0] = build_tps_tree_node( tree, first, middle );
+    node->children[1] = build_tps_tree_node( tree, middle, last );
+
+    return( index );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_tps_tree
+@INPUT      : n_points
+              points
+              weights
+              tolerance
+@OUTPUT     : tree
+@RETURNS    :
+@DESCRIPTION: Groups the landmarks of a 3D spline in a tree for
+              evaluate_thin_plate_spline_tree(), which then finds the values
+              of the spline to within tolerance.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  create_tps_tree(
+    int       n_points,
+    VIO_Real  **points,
+    VIO_Real  **weights,
+    VIO_Real  tolerance,
+    tps_tree  *tree )
+{
+    int       p, d;
+
+    tree->n_points = n_points;
+    tree->weights = weights;
+    tree->n_nodes = 0;
+    tree->tolerance = tolerance;
+
+    if( n_points == 0 )
+        return;
+
+    ALLOC( tree->landmarks, n_points );
+    ALLOC( tree->landmark_weights, n_points );
+    ALLOC( tree->nodes, 2 * n_points );
+
+    for_less( p, 0, n_points )
+    {
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            tree->landmarks[p][d] = points[p][d];
+            tree->landmark_weights[p][d] = weights[p][d];
+        }
+    }
+
+    (void) build_tps_tree_node( tree, 0, n_points );
+
+    /*--- the tolerance is shared among the cells in proportion to their
+          weights */
+
+    tree->weight_tolerance = tolerance;
+    if( tree->nodes[0].abs_weight > 0.0 )
+        tree->weight_tolerance /= tree->nodes[0].abs_weight;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_tps_tree
+@INPUT      : tree
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Frees the tree made by create_tps_tree().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  delete_tps_tree(
+    tps_tree  *tree )
+{
+    if( tree->n_nodes > 0 )
+    {
+        FREE( tree->nodes );
+        FREE( tree->landmarks );
+        FREE( tree->landmark_weights );
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : evaluate_thin_plate_spline_tree
+@INPUT      : tree
+              pos[3]           - position at which to evaluate
+@OUTPUT     : values[3]        - function values at this position
+              deriv[3][3]      - function derivatives at this point
+@RETURNS    :
+@DESCRIPTION: evaluate_thin_plate_spline() for a 3D transform, with the
+              landmarks of the cells far enough from pos taken together, so
+              that each value is within the tolerance of the tree of the
+              exact one.  The derivatives are those of the approximation,
+              without a stated bound, and are only used to find inverses.
+@METHOD     : The sum of w |y - s| over the landmarks of a cell, with y and
+              s the positions of pos and of each landmark relative to the
+              center of the cell and D = |y|, is expanded to third order
+              in s:  W D - u.M1 + (trace(Q) - u.Q.u) / (2 D) +
+              (u.T1 - T(u,u,u)) / (2 D^2), where u = y/D, W, M1, Q and T
+              are the sums of w, w s, w s s^T and w s s s^T, and T1 is the
+              sum of w s |s|^2.  The fourth derivative of |y - t s| along t
+              is at most 3 |s|^4 / |y - t s|^3, so the error of the
+              expansion is at most E / (8 (D - R)^3) for a cell of radius R
+              with E the sum of |w| |s|^4.  A cell is expanded if this bound
+              is within its share of the tolerance, in proportion to the
+              sum of |w| of its landmarks, so that the bounds of all the
+              cells expanded add up to at most the tolerance; otherwise it
+              is opened, down to leaves which are summed exactly.
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  evaluate_thin_plate_spline_tree(
+    tps_tree  *tree,
+    VIO_Real  pos[],
+    VIO_Real  values[],
+    VIO_Real  **derivs )
+{
+    int            stack[TPS_TREE_STACK_SIZE], n_stack, p, v, d;
+    VIO_Real       y[VIO_N_DIMENSIONS], u[VIO_N_DIMENSIONS];
+    VIO_Real       qu[VIO_N_DIMENSIONS], dist, gap, r, *w, *m;
+    VIO_Real       um1, uqu, h, sums[VIO_N_DIMENSIONS];
+    VIO_Real       tuu[VIO_N_DIMENSIONS], t1[VIO_N_DIMENSIONS], ut1, uuu;
+    VIO_Real       grads[VIO_N_DIMENSIONS][VIO_N_DIMENSIONS];
+    tps_tree_node  *node;
+
+    for_less( v, 0, VIO_N_DIMENSIONS )
+    {
+        sums[v] = 0.0;
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            grads[v][d] = 0.0;
+    }
+
+    n_stack = 0;
+    if( tree->n_nodes > 0 )
+    {
+        stack[0] = 0;
+        n_stack = 1;
+    }
+
+    while( n_stack > 0 )
+    {
+        --n_stack;
+        node = &tree->nodes[stack[n_stack]];
+
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            y[d] = pos[d] - node->center[d];
+        dist = sqrt( y[0] * y[0] + y[1] * y[1] + y[2] * y[2] );
+        gap = dist - node->radius;
+
+        if( gap > 0.0 && node->error_moment <= 8.0 * gap * gap * gap *
+                                               tree->weight_tolerance *
+                                               node->abs_weight )
+        {
+            /*--- far enough for the expansion W D - u.M1 +
+                  (trace(Q) - u.Q.u) / (2 D) + (u.T1 - T(u,u,u)) / (2 D^2) */
+
+            for_less( d, 0, VIO_N_DIMENSIONS )
+                u[d] = y[d] / dist;
+
+            for_less( v, 0, VIO_N_DIMENSIONS )
+            {
+                m = node->moments[v];
+                um1 = u[0] * m[1] + u[1] * m[2] + u[2] * m[3];
+                qu[0] = m[4] * u[0] + m[5] * u[1] + m[6] * u[2];
+                qu[1] = m[5] * u[0] + m[7] * u[1] + m[8] * u[2];
+                qu[2] = m[6] * u[0] + m[8] * u[1] + m[9] * u[2];
+                uqu = u[0] * qu[0] + u[1] * qu[1] + u[2] * qu[2];
+                h = m[4] + m[7] + m[9] - uqu;
+
+                t1[0] = m[10] + m[13] + m[15];
+                t1[1] = m[11] + m[16] + m[18];
+                t1[2] = m[12] + m[17] + m[19];
+                tuu[0] = m[10] * u[0] * u[0] + 2.0 * m[11] * u[0] * u[1] +
+                         2.0 * m[12] * u[0] * u[2] + m[13] * u[1] * u[1] +
+                         2.0 * m[14] * u[1] * u[2] + m[15] * u[2] * u[2];
+                tuu[1] = m[11] * u[0] * u[0] + 2.0 * m[13] * u[0] * u[1] +
+                         2.0 * m[14] * u[0] * u[2] + m[16] * u[1] * u[1] +
+                         2.0 * m[17] * u[1] * u[2] + m[18] * u[2] * u[2];
+                tuu[2] = m[12] * u[0] * u[0] + 2.0 * m[14] * u[0] * u[1] +
+                         2.0 * m[15] * u[0] * u[2] + m[17] * u[1] * u[1] +
+                         2.0 * m[18] * u[1] * u[2] + m[19] * u[2] * u[2];
+                ut1 = u[0] * t1[0] + u[1] * t1[1] + u[2] * t1[2];
+                uuu = u[0] * tuu[0] + u[1] * tuu[1] + u[2] * tuu[2];
+
+                sums[v] += m[0] * dist - um1 + h / (2.0 * dist) +
+                           (ut1 - uuu) / (2.0 * dist * dist);
+
+                if( derivs != NULL )
+                {
+                    for_less( d, 0, VIO_N_DIMENSIONS )
+                        grads[v][d] += m[0] * u[d] -
+                                       (m[1+d] - um1 * u[d]) / dist -
+                                       (h * u[d] / 2.0 + qu[d] - uqu * u[d]) /
+                                       (dist * dist) +
+                                       (t1[d] - 3.0 * ut1 * u[d] -
+                                        3.0 * tuu[d] + 5.0 * uuu * u[d]) /
+                                       (2.0 * dist * dist * dist);
+                }
+            }
+        }
+        else if( node->children[0] < 0 )
+        {
+            /*--- a leaf too close, summed exactly */
+
+            for_less( p, node->first, node->last )
+            {
+                for_less( d, 0, VIO_N_DIMENSIONS )
+                    y[d] = pos[d] - tree->landmarks[p][d];
+                r = sqrt( y[0] * y[0] + y[1] * y[1] + y[2] * y[2] );
+
+                w = tree->landmark_weights[p];
+                for_less( v, 0, VIO_N_DIMENSIONS )
+                    sums[v] += w[v] * r;
+
+                if( derivs != NULL && r != 0.0 )
+                {
+                    for_less( v, 0, VIO_N_DIMENSIONS )
+                        for_less( d, 0, VIO_N_DIMENSIONS )
+                            grads[v][d] += w[v] * y[d] / r;
+                }
+            }
+        }
+        else
+        {
+            stack[n_stack] = node->children[0];
+            stack[n_stack+1] = node->children[1];
+            n_stack += 2;
+        }
+    }
+
+    /*--- the constant and linear components, as for the exact spline */
+
+    for_less( v, 0, VIO_N_DIMENSIONS )
+    {
+        values[v] = sums[v] + tree->weights[tree->n_points][v];
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            values[v] += tree->weights[tree->n_points+1+d][v] * pos[d];
+            if( derivs != NULL )
+                derivs[v][d] = grads[v][d] +
+                               tree->weights[tree->n_points+1+d][v];
+        }
+    }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : thin_plate_spline_transform
 @INPUT      :
@@ -230,6 +860,85 @@ VIOAPI  VIO_Status  thin_plate_spline_transform(
     return VIO_OK;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : invert_thin_plate_spline
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              x_in         - position to inverse transform
+              guess        - starting point of the search, or NULL to start
+                             from x_in
+              tree         - to evaluate the spline approximately, or NULL
+@OUTPUT     : solution
+              n_iterations - number of evaluations of the spline
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse was not found, in which case
+              solution is x_in
+@DESCRIPTION: Finds the inverse of the thin plate spline at x_in by Newton
+              steps.  If the search from a guess fails, it is started again
+              from x_in, so a guess never stops an inverse being found which
+              would be found without it.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  invert_thin_plate_spline(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   x_in[],
+    VIO_Real   guess[],
+    tps_tree   *tree,
+    VIO_Real   solution[],
+    int        *n_iterations )
+{
+    int                 d, iterations;
+    VIO_BOOL            found;
+    spline_data_struct  data;
+
+    data.points = points;
+    data.weights = weights;
+    data.n_points = n_points;
+    data.n_dims = n_dims;
+    data.tree = tree;
+
+    *n_iterations = 0;
+
+    /* --- solve for the root of the function using Newton steps,
+           which require a function (newton_function) that evaluates the
+           thin plate spline and its derivative at an arbitrary point */
+
+    if( guess != NULL )
+    {
+        found = newton_root_find_with_iterations( n_dims, newton_function,
+                          (void *) &data, guess, x_in, solution,
+                          INVERSE_FUNCTION_TOLERANCE, INVERSE_DELTA_TOLERANCE,
+                          MAX_INVERSE_ITERATIONS, &iterations );
+        *n_iterations += iterations;
+
+        if( found )
+            return( VIO_OK );
+    }
+
+    found = newton_root_find_with_iterations( n_dims, newton_function,
+                          (void *) &data, x_in, x_in, solution,
+                          INVERSE_FUNCTION_TOLERANCE, INVERSE_DELTA_TOLERANCE,
+                          MAX_INVERSE_ITERATIONS, &iterations );
+    *n_iterations += iterations;
+
+    if( found )
+        return( VIO_OK );
+
+    for_less( d, 0, n_dims )
+        solution[d] = x_in[d];
+
+    return( VIO_ERROR );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : thin_plate_spline_inverse_transform
 @INPUT      :
@@ -270,7 +979,8 @@ VIOAPI  VIO_Status  thin_plate_spline_inverse_transform(
     VIO_Real    *z_transformed )
 {
     VIO_Real                x_in[VIO_N_DIMENSIONS], solution[VIO_N_DIMENSIONS];
-    spline_data_struct  data;
+    VIO_Status          status;
+    int                 n_iterations;
 
     x_in[VIO_X] = x;
 
@@ -284,31 +994,696 @@ VIOAPI  VIO_Status  thin_plate_spline_inverse_transform(
     else
         x_in[VIO_Z] = 0.0;
 
-    data.points = points;
-    data.weights = weights;
-    data.n_points = n_points;
-    data.n_dims = n_dims;
+    status = invert_thin_plate_spline( n_dims, n_points, points, weights,
+                                       x_in, NULL, NULL, solution,
+                                       &n_iterations );
 
-    /* --- solve for the root of the function using Newton steps,
-           which require a function (newton_function) that evaluates the
-           thin plate spline and its derivative at an arbitrary point */
+    /*--- as for thin_plate_spline_transform(), only the first n_dims
+          coordinates are set */
 
-    if( newton_root_find( n_dims, newton_function, (void *) &data,
-                          x_in, x_in, solution, INVERSE_FUNCTION_TOLERANCE,
-                          INVERSE_DELTA_TOLERANCE, MAX_INVERSE_ITERATIONS ) )
-    {
-        *x_transformed = solution[0];
+    *x_transformed = solution[0];
+
+    if( n_dims >= 2 )
         *y_transformed = solution[1];
+
+    if( n_dims >= 3 )
         *z_transformed = solution[2];
-        return VIO_OK;
+
+    return( status );
+}
+
+typedef  struct
+{
+    int        n_dims;
+    int        n_points;
+    VIO_Real   **points;
+    VIO_Real   **weights;
+    VIO_BOOL   inverse;
+    VIO_BOOL   warm_start;
+    tps_tree   *tree;
+    VIO_Real   (*positions)[VIO_N_DIMENSIONS];
+    VIO_Real   (*transformed)[VIO_N_DIMENSIONS];
+    VIO_BOOL   *failed;       /* per thread */
+    long       *n_iterations; /* per thread */
+} tps_points_info;
+
+/* miparallel_for() callback transforming the positions [first,last).  With
+   warm_start, each inverse is searched for from a guess extrapolated from the
+   inverses of the positions before, which along a scanline is usually close
+   enough to need no step at all */
+
+static  int  transform_tps_positions(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    tps_points_info  *info = (tps_points_info *) data;
+    long             i;
+    int              d, n_iterations;
+    VIO_Real         x_in[VIO_N_DIMENSIONS], solution[VIO_N_DIMENSIONS];
+    VIO_Real         previous_in[2][VIO_N_DIMENSIONS];
+    VIO_Real         previous_solution[2][VIO_N_DIMENSIONS];
+    VIO_Real         guess[VIO_N_DIMENSIONS];
+    int              n_previous;
+    VIO_Status       status;
+
+    n_previous = 0;
+
+    for( i = first;  i < last;  ++i )
+    {
+        /*--- the coordinates beyond n_dims are 0 for the spline, and left
+              as they are in the result */
+
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            x_in[d] = (d < info->n_dims) ? info->positions[i][d] : 0.0;
+            solution[d] = info->positions[i][d];
+        }
+
+        if( info->inverse )
+        {
+            if( info->warm_start && n_previous > 0 )
+            {
+                extrapolate_root_guess( info->n_dims, x_in, previous_in[0],
+                                        previous_solution[0],
+                                        (n_previous > 1) ? previous_in[1] :
+                                                           NULL,
+                                        previous_solution[1], guess );
+            }
+
+            status = invert_thin_plate_spline( info->n_dims, info->n_points,
+                              info->points, info->weights, x_in,
+                              (info->warm_start && n_previous > 0) ? guess :
+                                                                     NULL,
+                              info->tree, solution, &n_iterations );
+
+            info->n_iterations[thread] += n_iterations;
+
+            /*--- remember the last two inverses found */
+
+            if( status == VIO_OK )
+            {
+                for_less( d, 0, info->n_dims )
+                {
+                    previous_in[1][d] = previous_in[0][d];
+                    previous_solution[1][d] = previous_solution[0][d];
+                    previous_in[0][d] = x_in[d];
+                    previous_solution[0][d] = solution[d];
+                }
+                n_previous = MIN( n_previous + 1, 2 );
+            }
+            else
+                n_previous = 0;
+        }
+        else if( info->tree != NULL )
+        {
+            evaluate_thin_plate_spline_tree( info->tree, x_in, solution,
+                                             NULL );
+            status = VIO_OK;
+        }
+        else
+            status = thin_plate_spline_transform( info->n_dims,
+                              info->n_points, info->points, info->weights,
+                              x_in[VIO_X], x_in[VIO_Y], x_in[VIO_Z],
+                              &solution[VIO_X], &solution[VIO_Y],
+                              &solution[VIO_Z] );
+
+        for_less( d, 0, VIO_N_DIMENSIONS )
+            info->transformed[i][d] = solution[d];
+
+        if( status != VIO_OK )
+            info->failed[thread] = TRUE;
     }
+
+    return( MI_NOERROR );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_or_invert_tps_points
+@INPUT      : n_dims
+              n_points
+              points
+              weights
+              inverse
+              n_positions
+              positions
+              warm_start   - start each inverse from that of the position
+                             before
+              tree         - to evaluate the spline approximately, or NULL
+@OUTPUT     : transformed
+              n_iterations - number of evaluations of the spline made by
+                             the inverses, or NULL
+@RETURNS    : VIO_OK, or VIO_ERROR if any inverse did not converge
+@DESCRIPTION: Transforms many positions by the thin plate spline or its
+              inverse.  The work grows with the number of landmarks, so
+              once there is enough of it the positions are shared out
+              between threads; without warm_start each position is
+              transformed exactly as one at a time.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  transform_or_invert_tps_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_BOOL   inverse,
+    VIO_BOOL   warm_start,
+    tps_tree   *tree,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS],
+    long       *n_iterations )
+{
+    int              i, n_threads;
+    tps_points_info  info;
+    VIO_Status       status;
+
+    info.n_dims = n_dims;
+    info.n_points = n_points;
+    info.points = points;
+    info.weights = weights;
+    info.inverse = inverse;
+    info.warm_start = warm_start;
+    info.tree = tree;
+    info.positions = positions;
+    info.transformed = transformed;
+
+    if( (long) n_positions * (long) n_points < TPS_PARALLEL_MIN_WORK )
+        n_threads = 1;
     else
+        n_threads = miget_parallel_threads();
+
+    ALLOC( info.failed, n_threads );
+    ALLOC( info.n_iterations, n_threads );
+    for_less( i, 0, n_threads )
     {
-        *x_transformed = x_in[0];
-        *y_transformed = x_in[1];
-        *z_transformed = x_in[2];
-        return VIO_ERROR;
+        info.failed[i] = FALSE;
+        info.n_iterations[i] = 0;
     }
+
+    if( n_threads == 1 )
+        (void) transform_tps_positions( 0, n_positions, 0, &info );
+    else
+        (void) miparallel_for( n_positions, warm_start ?
+                               TPS_WARM_POINTS_PER_TILE : TPS_POINTS_PER_TILE,
+                               transform_tps_positions, &info );
+
+    status = VIO_OK;
+    if( n_iterations != NULL )
+        *n_iterations = 0;
+
+    for_less( i, 0, n_threads )
+    {
+        if( info.failed[i] )
+            status = VIO_ERROR;
+        if( n_iterations != NULL )
+            *n_iterations += info.n_iterations[i];
+    }
+
+    FREE( info.n_iterations );
+    FREE( info.failed );
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_transform_points
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              n_positions
+              positions    - positions to transform
+@OUTPUT     : transformed  - may be the same array as positions
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms many positions by the thin plate spline, giving the
+              same results as thin_plate_spline_transform() on each, using
+              several threads for large numbers of positions and landmarks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_transform_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] )
+{
+    return( transform_or_invert_tps_points( n_dims, n_points, points, weights,
+                                            FALSE, FALSE, NULL, n_positions,
+                                            positions, transformed, NULL ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_inverse_transform_points
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              n_positions
+              positions    - positions to inverse transform
+@OUTPUT     : transformed  - may be the same array as positions
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse of any position was not
+              found, in which case that position is left as it is
+@DESCRIPTION: Inverse transforms many positions by the thin plate spline,
+              giving the same results as thin_plate_spline_inverse_transform()
+              on each, using several threads for large numbers of positions
+              and landmarks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] )
+{
+    return( transform_or_invert_tps_points( n_dims, n_points, points, weights,
+                                            TRUE, FALSE, NULL, n_positions,
+                                            positions, transformed, NULL ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : approximate_tps_points
+@INPUT      : n_dims
+              n_points
+              points
+              weights
+              tolerance
+              inverse
+              n_positions
+              positions
+@OUTPUT     : transformed
+@RETURNS    : VIO_OK, or VIO_ERROR if any inverse did not converge
+@DESCRIPTION: Transforms many positions by a 3D thin plate spline, or its
+              inverse, evaluated to within tolerance by
+              evaluate_thin_plate_spline_tree(), or exactly for other
+              splines or a tolerance that is not positive.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  approximate_tps_points(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   tolerance,
+    VIO_BOOL   inverse,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] )
+{
+    tps_tree    tree;
+    VIO_Status  status;
+
+    if( n_dims != 3 || tolerance <= 0.0 )
+        return( transform_or_invert_tps_points( n_dims, n_points, points,
+                                                weights, inverse, FALSE, NULL,
+                                                n_positions, positions,
+                                                transformed, NULL ) );
+
+    create_tps_tree( n_points, points, weights, tolerance, &tree );
+
+    status = transform_or_invert_tps_points( n_dims, n_points, points,
+                                             weights, inverse, FALSE, &tree,
+                                             n_positions, positions,
+                                             transformed, NULL );
+
+    delete_tps_tree( &tree );
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_transform_points_approximate
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              tolerance    - largest error allowed in each coordinate
+              n_positions
+              positions    - positions to transform
+@OUTPUT     : transformed  - may be the same array as positions
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Transforms many positions by the thin plate spline as
+              thin_plate_spline_transform_points() does, but for 3D splines
+              takes the landmarks far from each position together in groups.
+              Each coordinate is within tolerance of the exact one, apart
+              from rounding.  This only pays for many landmarks and a loose
+              tolerance: for 20000 landmarks about 60 mm apart, it takes a
+              third of the time at a tolerance of 1 and about the same time
+              at 0.01, including grouping the landmarks, which is done again
+              on each call; set_thin_plate_spline_tolerance() keeps the
+              groups in a transform for repeated use.
+              For 2D splines, or if tolerance is not positive, the positions
+              are transformed exactly.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_transform_points_approximate(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   tolerance,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] )
+{
+    return( approximate_tps_points( n_dims, n_points, points, weights,
+                                    tolerance, FALSE, n_positions, positions,
+                                    transformed ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_inverse_transform_points_approximate
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              tolerance    - largest error allowed in each coordinate of
+                             the spline
+              n_positions
+              positions    - positions to inverse transform
+@OUTPUT     : transformed  - may be the same array as positions
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse of any position was not
+              found, in which case that position is left as it is
+@DESCRIPTION: Inverse transforms many positions by the thin plate spline as
+              thin_plate_spline_inverse_transform_points() does, finding the
+              inverses of the spline evaluated as by
+              thin_plate_spline_transform_points_approximate().  The exact
+              spline maps each inverse found to within the tolerance of
+              the search (0.01 in the sum of the coordinates) plus three
+              times tolerance of the position.  The search evaluates the
+              derivatives as well, so the approximation saves less than for
+              thin_plate_spline_transform_points_approximate(), and at a
+              tight tolerance takes longer than the exact search.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_points_approximate(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_Real   tolerance,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS] )
+{
+    return( approximate_tps_points( n_dims, n_points, points, weights,
+                                    tolerance, TRUE, n_positions, positions,
+                                    transformed ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_inverse_transform_scanline
+@INPUT      : n_dims
+              n_points     - number of landmarks
+              points       - landmarks
+              weights
+              warm_start   - start each inverse from that of the position
+                             before
+              n_positions
+              positions    - positions to inverse transform, in order along
+                             one or more lines
+@OUTPUT     : transformed  - may be the same array as positions
+              n_iterations - number of evaluations of the spline made, or
+                             NULL
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse of any position was not
+              found, in which case that position is left as it is
+@DESCRIPTION: Inverse transforms many positions by the thin plate spline as
+              thin_plate_spline_inverse_transform_points() does, counting
+              the Newton iterations.  With warm_start, the search for each
+              inverse starts from a guess extrapolated by
+              extrapolate_root_guess() from the inverses of the positions
+              before, rather than from the position itself.  Neighbouring
+              positions have nearly the same inverses, so this takes far
+              fewer iterations.  If the search
+              from there fails it is started again from the position, so the
+              inverses found are those of a cold start to within the
+              tolerance of the search.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_inverse_transform_scanline(
+    int        n_dims,
+    int        n_points,
+    VIO_Real   **points,
+    VIO_Real   **weights,
+    VIO_BOOL   warm_start,
+    int        n_positions,
+    VIO_Real   positions[][VIO_N_DIMENSIONS],
+    VIO_Real   transformed[][VIO_N_DIMENSIONS],
+    long       *n_iterations )
+{
+    return( transform_or_invert_tps_points( n_dims, n_points, points, weights,
+                                            TRUE, warm_start, NULL,
+                                            n_positions, positions,
+                                            transformed, n_iterations ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_thin_plate_spline_tolerance
+@INPUT      : transform
+              tolerance    - largest error allowed in each coordinate of
+                             the spline, or 0 to evaluate it exactly
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Groups the landmarks of a 3D thin plate spline transform in a
+              tree once and keeps it in the transform, so that from then on
+              general_transform_point(), general_transform_points(), their
+              inverses and so resample_volume() evaluate the spline as
+              thin_plate_spline_transform_points_approximate() does,
+              without grouping the landmarks again for each call.  Each
+              thin plate spline of a concatenated transform is processed;
+              2D splines and other transforms are left exact.  Jacobians
+              are still found exactly.  Call this again after changing the
+              landmarks or weights of the transform.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_thin_plate_spline_tolerance(
+    VIO_General_transform   *transform,
+    VIO_Real                tolerance )
+{
+    int        i;
+    tps_tree   *tree;
+
+    if( get_transform_type( transform ) == CONCATENATED_TRANSFORM )
+    {
+        for_less( i, 0, get_n_concated_transforms( transform ) )
+            set_thin_plate_spline_tolerance(
+                      get_nth_general_transform( transform, i ), tolerance );
+        return;
+    }
+
+    if( get_transform_type( transform ) != THIN_PLATE_SPLINE )
+        return;
+
+    if( transform->tps_tree != NULL )
+    {
+        tree = (tps_tree *) transform->tps_tree;
+        delete_tps_tree( tree );
+        FREE( tree );
+        transform->tps_tree = NULL;
+    }
+
+    if( tolerance > 0.0 && transform->n_dimensions == VIO_N_DIMENSIONS &&
+        transform->n_points > 0 )
+    {
+        ALLOC( tree, 1 );
+        create_tps_tree( transform->n_points, transform->points,
+                         transform->displacements, tolerance, tree );
+        transform->tps_tree = (void *) tree;
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_thin_plate_spline_tolerance
+@INPUT      : transform
+@OUTPUT     :
+@RETURNS    : tolerance
+@DESCRIPTION: Returns the tolerance set by set_thin_plate_spline_tolerance()
+              for a thin plate spline transform, or 0 if it is evaluated
+              exactly.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Real  get_thin_plate_spline_tolerance(
+    VIO_General_transform   *transform )
+{
+    if( get_transform_type( transform ) != THIN_PLATE_SPLINE ||
+        transform->tps_tree == NULL )
+        return( 0.0 );
+
+    return( ((tps_tree *) transform->tps_tree)->tolerance );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_general_transform_point
+@INPUT      : transform
+              inverse_flag
+              x
+              y
+              z
+@OUTPUT     : x_transformed
+              y_transformed
+              z_transformed
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse was not found
+@DESCRIPTION: Transforms the point by the thin plate spline transform, or
+              its inverse, as thin_plate_spline_transform() or
+              thin_plate_spline_inverse_transform() do, evaluating the
+              spline to the tolerance set by set_thin_plate_spline_tolerance()
+              if any.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_general_transform_point(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_Real                x,
+    VIO_Real                y,
+    VIO_Real                z,
+    VIO_Real                *x_transformed,
+    VIO_Real                *y_transformed,
+    VIO_Real                *z_transformed )
+{
+    VIO_Real     x_in[VIO_N_DIMENSIONS], solution[VIO_N_DIMENSIONS];
+    int          n_iterations;
+    VIO_Status   status;
+
+    if( transform->tps_tree == NULL )
+    {
+        if( inverse_flag )
+            return( thin_plate_spline_inverse_transform(
+                              transform->n_dimensions, transform->n_points,
+                              transform->points, transform->displacements,
+                              x, y, z,
+                              x_transformed, y_transformed, z_transformed ) );
+        else
+            return( thin_plate_spline_transform(
+                              transform->n_dimensions, transform->n_points,
+                              transform->points, transform->displacements,
+                              x, y, z,
+                              x_transformed, y_transformed, z_transformed ) );
+    }
+
+    /*--- only 3D splines have a tree */
+
+    x_in[VIO_X] = x;
+    x_in[VIO_Y] = y;
+    x_in[VIO_Z] = z;
+
+    if( inverse_flag )
+        status = invert_thin_plate_spline( VIO_N_DIMENSIONS,
+                              transform->n_points, transform->points,
+                              transform->displacements, x_in, NULL,
+                              (tps_tree *) transform->tps_tree, solution,
+                              &n_iterations );
+    else
+    {
+        evaluate_thin_plate_spline_tree( (tps_tree *) transform->tps_tree,
+                                         x_in, solution, NULL );
+        status = VIO_OK;
+    }
+
+    *x_transformed = solution[VIO_X];
+    *y_transformed = solution[VIO_Y];
+    *z_transformed = solution[VIO_Z];
+
+    return( status );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thin_plate_spline_general_transform_points
+@INPUT      : transform
+              inverse_flag
+              warm_start   - start each inverse from that of the position
+                             before
+              n_positions
+              positions
+@OUTPUT     : transformed  - may be the same array as positions
+              n_iterations - number of evaluations of the spline made by
+                             the inverses, or NULL
+@RETURNS    : VIO_OK, or VIO_ERROR if the inverse of any position was not
+              found, in which case that position is left as it is
+@DESCRIPTION: Transforms many positions by the thin plate spline transform,
+              or its inverse, as thin_plate_spline_transform_points() or
+              thin_plate_spline_inverse_transform_scanline() do, evaluating
+              the spline to the tolerance set by
+              set_thin_plate_spline_tolerance() if any.  Without warm_start,
+              each position is transformed exactly as by
+              thin_plate_spline_general_transform_point().
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  thin_plate_spline_general_transform_points(
+    VIO_General_transform   *transform,
+    VIO_BOOL                inverse_flag,
+    VIO_BOOL                warm_start,
+    int                     n_positions,
+    VIO_Real                positions[][VIO_N_DIMENSIONS],
+    VIO_Real                transformed[][VIO_N_DIMENSIONS],
+    long                    *n_iterations )
+{
+    return( transform_or_invert_tps_points( transform->n_dimensions,
+                              transform->n_points, transform->points,
+                              transform->displacements, inverse_flag,
+                              warm_start, (tps_tree *) transform->tps_tree,
+                              n_positions, positions, transformed,
+                              n_iterations ) );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -338,6 +1713,13 @@ static  void   newton_function(
 
     spline_data = (spline_data_struct *) function_data;
 
+    if( spline_data->tree != NULL )
+    {
+        evaluate_thin_plate_spline_tree( spline_data->tree, parameters,
+                                         values, first_derivs );
+        return;
+    }
+
     evaluate_thin_plate_spline( spline_data->n_dims, spline_data->n_dims,
                                 spline_data->n_points,
                                 spline_data->points, spline_data->weights,
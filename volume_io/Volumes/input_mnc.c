@@ -984,6 +984,8 @@ static int input_slab(
             volume_start[ind] = file_start[file_ind];
     }
 
+    volume->bspline_coefficients_uptodate = FALSE;
+
     get_multidim_sizes( &volume->array, array_sizes );
     GET_MULTIDIM_PTR( array_data_ptr, volume->array,
                       volume_start[0], volume_start[1], volume_start[2],
@@ -603,7 +603,7 @@ VIOAPI  VIO_Status  close_minc2_input(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : input_minc_hyperslab
+@NAME       : input_minc2_hyperslab
 @INPUT      : file
               data_type
               n_array_dims
@@ -622,7 +622,7 @@ VIOAPI  VIO_Status  close_minc2_input(
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-static  VIO_Status   input_minc2_hyperslab(
+VIOAPI  VIO_Status   input_minc2_hyperslab(
     Minc_file        file,
     VIO_Data_types   data_type,
     int              n_array_dims,
@@ -836,6 +836,8 @@ static int input_slab(
             volume_start[ind] = file_start[file_ind];
     }
 
+    volume->bspline_coefficients_uptodate = FALSE;
+
     get_multidim_sizes( &volume->array, array_sizes );
     GET_MULTIDIM_PTR( array_data_ptr, volume->array,
                       volume_start[0], volume_start[1], volume_start[2],
@@ -883,9 +885,22 @@ VIOAPI  VIO_BOOL  input_more_minc2_file(
     if( !volume_is_alloced( volume ) )
     {
         alloc_volume_data( volume );
+        if( volume->is_cached_volume )
+        {
+            open_cache_volume_input_file( &volume->cache, volume,
+                                          file->filename,
+                                          &file->original_input_options );
+        }
         if( !volume_is_alloced( volume ) ) return( FALSE );
     }
 
+    if( volume->is_cached_volume )
+    {
+        *fraction_done = 1.0;
+        file->end_volume_flag = TRUE;
+        return( FALSE );
+    }
+
       /* --- set the counts for reading, actually these will be the same
               every time */
 
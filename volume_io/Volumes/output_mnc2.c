@@ -329,11 +329,22 @@ VIOAPI  Minc_file  initialize_minc2_output(
     file->outputting_in_order = TRUE;
     file->entire_file_written = FALSE;
     file->ignoring_because_cached = FALSE;
+    file->end_def_done = FALSE;
     file->src_img_var = MI_ERROR;
     file->using_minc2_api = TRUE;
 
     file->filename = expand_filename( filename );
 
+    if( volume_to_attach->is_cached_volume &&
+        volume_to_attach->cache.output_file_is_open &&
+        equal_strings( volume_to_attach->cache.output_filename, file->filename))
+    {
+        file->ignoring_because_cached = TRUE;
+        flush_volume_cache( volume_to_attach );
+        mifree_volume_props( hprops );
+        return( file );
+    }
+
     /*--- find correspondence between volume dimensions and file dimensions */
 
     vol_dimension_names = get_volume_dimension_names( volume_to_attach );
@@ -556,6 +567,9 @@ VIOAPI  VIO_Status  copy_auxiliary_data_from_open_minc2_file(
 {
     VIO_Status  status;
 
+    if( file->ignoring_because_cached )
+        return( VIO_OK );
+
     /*TODO: convert this to MINC2*/
 
 #if 0
@@ -652,6 +666,9 @@ VIOAPI  VIO_Status  add_minc2_history(
     size_t    minc_history_length=0;
     size_t    new_history_length=0;
 
+    if( file->ignoring_because_cached )
+        return( VIO_OK );
+
     if( file->end_def_done )
     {
         print_error( "Cannot call add_minc_history when not in define mode\n" );
@@ -827,7 +844,7 @@ VIOAPI  VIO_Status  set_minc2_output_random_order(
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-static  VIO_Status  output_minc2_hyperslab(
+VIOAPI  VIO_Status  output_minc2_hyperslab(
     Minc_file           file,
     VIO_Data_types      data_type,
     int                 n_array_dims,
@@ -1336,6 +1353,9 @@ VIOAPI  VIO_Status  output_minc2_volume(
     int        d, volume_count[VIO_MAX_DIMENSIONS];
     VIO_BOOL    increment;
 
+    if( file->ignoring_because_cached )
+        return( VIO_OK );
+
     /*--- check number of volumes written */
 
     d = 0;
@@ -1408,16 +1428,19 @@ VIOAPI  VIO_Status  close_minc2_output(
         return( VIO_ERROR );
     }
 
-    if( file->outputting_in_order && !file->entire_file_written )
+    if( !file->ignoring_because_cached )
     {
-        print_error( "Warning:  the MINC2 file has been " );
-        print_error( "closed without writing part of it.\n");
-    }
+        if( file->outputting_in_order && !file->entire_file_written )
+        {
+            print_error( "Warning:  the MINC2 file has been " );
+            print_error( "closed without writing part of it.\n");
+        }
 
-    for_less( d, 0, file->n_file_dimensions )
-        delete_string( file->dim_names[d] );
+        for_less( d, 0, file->n_file_dimensions )
+            delete_string( file->dim_names[d] );
 
-    miclose_volume( file->minc2id );
+        miclose_volume( file->minc2id );
+    }
 
     delete_string( file->filename );
 
@@ -0,0 +1,474 @@
+/**
+ * \file Resampling of a volume onto the voxel grid of another volume,
+ * through a general transform, using several threads.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /*HAVE_CONFIG_H*/
+
+
+#include  <internal_volume_io.h>
+#include  "minc_parallel.h"
+
+/* --- number of target rows resampled by one thread at a time */
+
+#define  RESAMPLE_ROWS_PER_TILE   8
+
+typedef  struct
+{
+    VIO_Volume              source;
+    VIO_General_transform   *transform;
+    VIO_Volume              target;
+    int                     degrees_continuity;
+    VIO_Real                fill_value;
+    int                     sizes[VIO_MAX_DIMENSIONS];
+
+    /* --- for a linear mapping, the source voxel of target voxel 0, and the
+           change in source voxel for one step along each target dimension */
+
+    VIO_BOOL                is_linear;
+    VIO_Real                origin[VIO_MAX_DIMENSIONS];
+    VIO_Real                steps[VIO_N_DIMENSIONS][VIO_MAX_DIMENSIONS];
+
+    /* --- typed target storage, if the target is not cached */
+
+    void                    *target_data;
+    VIO_Real                voxel_min;
+    VIO_Real                voxel_max;
+
+    VIO_BOOL                *failed;          /* per thread, set if the */
+                                              /* transform failed */
+} resample_info;
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : transform_is_linear
+@INPUT      : transform
+@OUTPUT     :
+@RETURNS    : TRUE if the transform is linear
+@DESCRIPTION: Checks if a transform, or every transform of a concatenated
+              transform, is linear.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static VIO_BOOL  transform_is_linear(
+    VIO_General_transform   *transform )
+{
+    int   i;
+
+    switch( get_transform_type( transform ) )
+    {
+    case LINEAR:
+        return( TRUE );
+
+    case CONCATENATED_TRANSFORM:
+        for_less( i, 0, get_n_concated_transforms( transform ) )
+        {
+            if( !transform_is_linear( get_nth_general_transform( transform,
+                                                                 i ) ) )
+                return( FALSE );
+        }
+        return( TRUE );
+
+    default:
+        return( FALSE );
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : map_target_voxel
+@INPUT      : info
+              target_voxel
+@OUTPUT     : source_voxel
+@RETURNS    :
+@DESCRIPTION: Finds the source voxel which is resampled into a target voxel,
+              going through world space and the inverse of the transform.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static void  map_target_voxel(
+    resample_info   *info,
+    VIO_Real        target_voxel[],
+    VIO_Real        source_voxel[] )
+{
+    VIO_Real   x, y, z;
+
+    convert_voxel_to_world( info->target, target_voxel, &x, &y, &z );
+
+    if( info->transform != NULL )
+        general_inverse_transform_point( info->transform, x, y, z,
+                                         &x, &y, &z );
+
+    convert_world_to_voxel( info->source, x, y, z, source_voxel );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : store_resampled_row
+@INPUT      : info
+              v0, v1   - target row
+              values   - real values along the row
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Stores one row of real values in the target volume, converting
+              to the voxel type of the target, straight into its array if it
+              is not cached.  Integer voxels are clamped to the valid range
+              of the target and rounded, whether it is cached or not.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+#define  CLAMP_RESAMPLED_VOXEL( voxel ) \
+         { \
+             if( voxel < info->voxel_min ) \
+                 voxel = info->voxel_min; \
+             else if( voxel > info->voxel_max ) \
+                 voxel = info->voxel_max; \
+             voxel = (VIO_Real) VIO_ROUND( voxel ); \
+         }
+
+#define  STORE_RESAMPLED_VOXELS( type, is_integer ) \
+         { \
+             type  *ptr = (type *) info->target_data + offset; \
+             for_less( k, 0, n ) \
+             { \
+                 voxel = (values[k] - trans) / scale; \
+                 if( is_integer ) \
+                     CLAMP_RESAMPLED_VOXEL( voxel ) \
+                 ptr[k] = (type) voxel; \
+             } \
+         }
+
+static void  store_resampled_row(
+    resample_info   *info,
+    int             v0,
+    int             v1,
+    VIO_Real        values[] )
+{
+    int        k, n;
+    size_t     offset;
+    VIO_Real   voxel, scale, trans;
+    VIO_Volume target = info->target;
+    VIO_Data_types  data_type;
+
+    n = info->sizes[2];
+    data_type = get_volume_data_type( target );
+
+    /*--- convert_value_to_voxel(), hoisted out of the row */
+
+    if( target->real_range_set && !target->is_labels )
+    {
+        scale = target->real_value_scale;
+        trans = target->real_value_translation;
+    }
+    else
+    {
+        scale = 1.0;
+        trans = 0.0;
+    }
+
+    if( info->target_data == NULL )
+    {
+        for_less( k, 0, n )
+        {
+            voxel = (values[k] - trans) / scale;
+            if( data_type != VIO_FLOAT && data_type != VIO_DOUBLE )
+                CLAMP_RESAMPLED_VOXEL( voxel )
+            set_volume_voxel_value( target, v0, v1, k, 0, 0, voxel );
+        }
+        return;
+    }
+
+    offset = ((size_t) v0 * (size_t) info->sizes[1] + (size_t) v1) *
+             (size_t) n;
+
+    switch( data_type )
+    {
+    case VIO_UNSIGNED_BYTE:
+        STORE_RESAMPLED_VOXELS( unsigned char, TRUE )
+        break;
+    case VIO_SIGNED_BYTE:
+        STORE_RESAMPLED_VOXELS( signed char, TRUE )
+        break;
+    case VIO_UNSIGNED_SHORT:
+        STORE_RESAMPLED_VOXELS( unsigned short, TRUE )
+        break;
+    case VIO_SIGNED_SHORT:
+        STORE_RESAMPLED_VOXELS( signed short, TRUE )
+        break;
+    case VIO_UNSIGNED_INT:
+        STORE_RESAMPLED_VOXELS( unsigned int, TRUE )
+        break;
+    case VIO_SIGNED_INT:
+        STORE_RESAMPLED_VOXELS( signed int, TRUE )
+        break;
+    case VIO_FLOAT:
+        STORE_RESAMPLED_VOXELS( float, FALSE )
+        break;
+    case VIO_DOUBLE:
+    default:
+        STORE_RESAMPLED_VOXELS( double, FALSE )
+        break;
+    }
+}
+
+/* miparallel_for() callback resampling the target rows [first,last) */
+
+static int  resample_rows(
+    long   first,
+    long   last,
+    int    thread,
+    void   *data )
+{
+    resample_info  *info = (resample_info *) data;
+    long           row;
+    int            v0, v1, k, d, n;
+    VIO_Real       (*coords)[VIO_MAX_DIMENSIONS];
+    VIO_Real       (*world)[VIO_N_DIMENSIONS];
+    VIO_Real       *values, start[VIO_MAX_DIMENSIONS];
+
+    n = info->sizes[2];
+
+    ALLOC( coords, n );
+    ALLOC( world, n );
+    ALLOC( values, n );
+
+    for( row = first;  row < last;  ++row )
+    {
+        v0 = (int) (row / info->sizes[1]);
+        v1 = (int) (row % info->sizes[1]);
+
+        /*--- find the source voxel of each target voxel of the row */
+
+        if( info->is_linear )
+        {
+            for_less( d, 0, VIO_MAX_DIMENSIONS )
+            {
+                start[d] = info->origin[d] + (VIO_Real) v0 * info->steps[0][d]
+                                           + (VIO_Real) v1 * info->steps[1][d];
+            }
+
+            for_less( k, 0, n )
+            {
+                for_less( d, 0, VIO_MAX_DIMENSIONS )
+                    coords[k][d] = start[d] + (VIO_Real) k * info->steps[2][d];
+            }
+        }
+        else
+        {
+            for_less( k, 0, n )
+            {
+                coords[k][0] = (VIO_Real) v0;
+                coords[k][1] = (VIO_Real) v1;
+                coords[k][2] = (VIO_Real) k;
+                coords[k][3] = 0.0;
+                coords[k][4] = 0.0;
+            }
+
+            convert_voxel_to_world_points( info->target, n, coords, world );
+
+            /*--- a point whose inverse is not found is left where
+                  general_inverse_transform_point() leaves it and the row
+                  is still resampled, but resample_volume() fails */
+
+            if( info->transform != NULL &&
+                general_inverse_transform_points( info->transform, n,
+                                                  world, world ) != VIO_OK )
+                info->failed[thread] = TRUE;
+
+            convert_world_to_voxel_points( info->source, n, world, coords );
+
+            for_less( k, 0, n )
+            {
+                coords[k][3] = 0.0;
+                coords[k][4] = 0.0;
+            }
+        }
+
+        /*--- evaluate the whole row at once */
+
+        (void) evaluate_volume_points( info->source, n, coords, NULL,
+                                       info->degrees_continuity, FALSE,
+                                       info->fill_value, values );
+
+        store_resampled_row( info, v0, v1, values );
+    }
+
+    FREE( values );
+    FREE( world );
+    FREE( coords );
+
+    return( MI_NOERROR );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : resample_volume
+@INPUT      : source             - volume to resample
+              transform          - source world to target world, or NULL
+              target             - allocated volume defining the target grid
+              degrees_continuity - -1 nearest neighbour, 0 linear, 2 cubic
+              fill_value         - real value for points outside the source
+@OUTPUT     : target             - resampled values
+@RETURNS    : VIO_OK if successful
+@DESCRIPTION: Resamples the source volume onto the voxel grid of the target
+              volume.  Each target voxel is mapped to world space, through
+              the inverse of the transform, and into the source volume, where
+              it is evaluated as by evaluate_volume().  The target is
+              processed a row (its last dimension) at a time, rows being
+              handed out to several threads in tiles.  If the whole mapping
+              is linear, the source positions along a row are stepped from
+              its first voxel, otherwise they are transformed a row at a time
+              with general_inverse_transform_points().  Each row is
+              evaluated in one call to evaluate_volume_points(), and written
+              straight into the voxel array of the target if it is not
+              cached.  Both volumes must be 3D with three spatial
+              dimensions.  The transform must be safe to apply from several
+              threads at once, which holds for all but user transforms.
+              Voxels whose source position cannot be found, because the
+              inverse of the transform does not converge there, are
+              resampled where general_inverse_transform_point() leaves them
+              and make the function return VIO_ERROR once every voxel is
+              written.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Status  resample_volume(
+    VIO_Volume              source,
+    VIO_General_transform   *transform,
+    VIO_Volume              target,
+    int                     degrees_continuity,
+    VIO_Real                fill_value )
+{
+    int             d, c, i, n_threads;
+    long            n_rows;
+    VIO_BOOL        failed;
+    VIO_Real        voxel[VIO_MAX_DIMENSIONS], mapped[VIO_MAX_DIMENSIONS];
+    resample_info   info;
+
+    if( get_volume_n_dimensions( source ) != 3 ||
+        get_volume_n_dimensions( target ) != 3 )
+    {
+        print_error( "resample_volume(): volumes must be 3D.\n" );
+        return( VIO_ERROR );
+    }
+
+    for_less( c, 0, VIO_N_DIMENSIONS )
+    {
+        if( source->spatial_axes[c] < 0 || target->spatial_axes[c] < 0 )
+        {
+            print_error( "resample_volume(): volumes must have 3 spatial "
+                         "dimensions.\n" );
+            return( VIO_ERROR );
+        }
+    }
+
+    if( !volume_is_alloced( source ) || !volume_is_alloced( target ) )
+    {
+        print_error( "resample_volume(): volume data not allocated.\n" );
+        return( VIO_ERROR );
+    }
+
+    info.source = source;
+    info.transform = transform;
+    info.target = target;
+    info.degrees_continuity = degrees_continuity;
+    info.fill_value = fill_value;
+    get_volume_sizes( target, info.sizes );
+
+    /*--- probing the mapping also brings the world transforms of both
+          volumes up to date before any threads use them */
+
+    for_less( d, 0, VIO_MAX_DIMENSIONS )
+        voxel[d] = 0.0;
+
+    map_target_voxel( &info, voxel, info.origin );
+    for_less( d, VIO_N_DIMENSIONS, VIO_MAX_DIMENSIONS )
+        info.origin[d] = 0.0;
+
+    info.is_linear = transform == NULL || transform_is_linear( transform );
+    for_less( d, 0, VIO_N_DIMENSIONS )
+    {
+        if( source->irregular_starts[d] != NULL ||
+            target->irregular_starts[d] != NULL )
+            info.is_linear = FALSE;
+    }
+
+    if( info.is_linear )
+    {
+        for_less( d, 0, VIO_N_DIMENSIONS )
+        {
+            voxel[d] = 1.0;
+            map_target_voxel( &info, voxel, mapped );
+            voxel[d] = 0.0;
+
+            for_less( c, 0, VIO_MAX_DIMENSIONS )
+            {
+                if( c < VIO_N_DIMENSIONS )
+                    info.steps[d][c] = mapped[c] - info.origin[c];
+                else
+                    info.steps[d][c] = 0.0;
+            }
+        }
+    }
+
+    /*--- cubic B-spline coefficients must be computed before the threads
+          start evaluating the source */
+
+    if( degrees_continuity == 2 &&
+        get_volume_bspline_interpolation( source ) != VIO_NO_DATA_TYPE &&
+        !source->bspline_coefficients_uptodate &&
+        set_volume_bspline_interpolation( source,
+                        get_volume_bspline_interpolation( source ) ) != VIO_OK )
+        return( VIO_ERROR );
+
+    if( target->is_cached_volume )
+        info.target_data = NULL;
+    else
+    {
+        GET_MULTIDIM_PTR_3D( info.target_data, target->array, 0, 0, 0 )
+    }
+    get_volume_voxel_range( target, &info.voxel_min, &info.voxel_max );
+
+    target->bspline_coefficients_uptodate = FALSE;
+
+    n_threads = miget_parallel_threads();
+    ALLOC( info.failed, n_threads );
+    for_less( i, 0, n_threads )
+        info.failed[i] = FALSE;
+
+    n_rows = (long) info.sizes[0] * (long) info.sizes[1];
+
+    failed = miparallel_for( n_rows, RESAMPLE_ROWS_PER_TILE,
+                             resample_rows, &info ) != MI_NOERROR;
+
+    for_less( i, 0, n_threads )
+    {
+        if( info.failed[i] )
+            failed = TRUE;
+    }
+
+    FREE( info.failed );
+
+    if( failed )
+    {
+        print_error( "resample_volume(): the inverse of the transform was "
+                     "not found for some voxels.\n" );
+        return( VIO_ERROR );
+    }
+
+    return( VIO_OK );
+}
@@ -1135,6 +1135,9 @@ static  void  set_voxel_values(
 {
     VIO_Data_types  data_type;
 
+    if( volume->bspline_coefficients_uptodate )
+        volume->bspline_coefficients_uptodate = FALSE;
+
     data_type = get_volume_data_type( volume );
     switch( n_dims )
     {
@@ -18,22 +18,45 @@
 
 
 #include  <internal_volume_io.h>
+#include  <limits.h>
 
+#ifdef HAVE_PTHREAD
+#include  <pthread.h>
+#endif
+
+#include  "minc_parallel.h"
+#include  <zlib.h>
 
-#define   HASH_FUNCTION_CONSTANT          0.6180339887498948482
-#define   HASH_TABLE_SIZE_FACTOR          3
+#define   BLOCK_TABLE_FLAT_LIMIT          65536
+#define   BLOCK_TABLE_PAGE_SHIFT          12
 
 #define   DEFAULT_BLOCK_SIZE              64
 #define   DEFAULT_CACHE_THRESHOLD         -1
 #define   DEFAULT_MAX_BYTES_IN_CACHE      100000000
 
+#define   MAX_CACHE_SHARDS                64
+#define   CACHE_SHARDS_PER_THREAD         4
+#define   MIN_BLOCKS_PER_SHARD            4
+
+#define   DEFAULT_PREFETCH_BLOCKS         0
+#define   DEFAULT_COMPRESSED_CACHE_BYTES  0
+
 static  VIO_BOOL  n_bytes_cache_threshold_set = FALSE;
 static  int      n_bytes_cache_threshold = DEFAULT_CACHE_THRESHOLD;
 
 static  VIO_BOOL  default_cache_size_set = FALSE;
-static  int      default_cache_size = DEFAULT_MAX_BYTES_IN_CACHE;
+static  size_t   default_cache_size = DEFAULT_MAX_BYTES_IN_CACHE;
 
 
+static  VIO_BOOL  default_prefetch_blocks_set = FALSE;
+static  int      default_prefetch_blocks = DEFAULT_PREFETCH_BLOCKS;
+
+static  VIO_BOOL  default_compressed_size_set = FALSE;
+static  size_t   default_compressed_size = DEFAULT_COMPRESSED_CACHE_BYTES;
+
+static  VIO_BOOL  default_eviction_policy_set = FALSE;
+static  VIO_Cache_eviction_policy  default_eviction_policy = LRU_CACHE_EVICTION;
+
 static  VIO_Cache_block_size_hints   block_size_hint = RANDOM_VOLUME_ACCESS;
 static  VIO_BOOL  default_block_sizes_set = FALSE;
 static  int      default_block_sizes[VIO_MAX_DIMENSIONS] = {
@@ -43,10 +66,124 @@ static  int      default_block_sizes[VIO_MAX_DIMENSIONS] = {
                                                      DEFAULT_BLOCK_SIZE,
                                                      DEFAULT_BLOCK_SIZE };
 
+/* --- a block evicted from the cache and kept in memory, compressed, in the
+       second tier of the cache.  The bytes of the voxels are shuffled so
+       that each byte of the voxels is stored together, then deflated with
+       run-length matching only.  A block which does not compress is kept
+       as it is */
+
+typedef  struct  VIO_compressed_block_struct
+{
+    long                                  block_index;
+    VIO_BOOL                              is_compressed;
+    size_t                                n_bytes;
+    unsigned char                         *data;
+    struct  VIO_compressed_block_struct   *prev_used;
+    struct  VIO_compressed_block_struct   *next_used;
+} VIO_compressed_block_struct;
+
+/* --- an entry of the block table: the block if it is in the cache, or
+       its compressed copy if it is in the second tier */
+
+typedef  struct
+{
+    VIO_cache_block_struct       *block;
+    VIO_compressed_block_struct  *compressed;
+} VIO_cache_table_entry;
+
+/* --- one shard of the cache, holding the blocks whose index modulo the
+       number of shards is the shard index.  The blocks are kept in a used
+       list, most recent first, and for 2Q eviction the blocks used only
+       once are in a separate probation list.  The blocks present are found
+       directly from their index through a two level table: the index
+       divided by the number of shards selects a page and an entry in the
+       page.  Small volumes have a single page, large ones have pages of
+       2^BLOCK_TABLE_PAGE_SHIFT entries, allocated when first used */
+
+typedef  struct  VIO_cache_shard_struct
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t             lock;
+#endif
+    size_t                      n_blocks;
+    size_t                      max_blocks;
+    VIO_cache_block_struct      *head;
+    VIO_cache_block_struct      *tail;
+    VIO_cache_block_struct      *probation_head;
+    VIO_cache_block_struct      *probation_tail;
+    size_t                      n_probation;
+    int                         shard_shift;
+    int                         page_shift;
+    size_t                      n_pages;
+    VIO_cache_table_entry       **block_table;
+    VIO_compressed_block_struct *compressed_head;
+    VIO_compressed_block_struct *compressed_tail;
+    size_t                      compressed_bytes;
+    size_t                      max_compressed_bytes;
+    VIO_BOOL                    streams_initialized;
+    z_stream                    deflater;
+    z_stream                    inflater;
+    unsigned char               *shuffled;
+    unsigned char               *packed;
+    long                        n_compressed_hits;
+    VIO_cache_block_struct      *previous_block;
+    long                        previous_block_index;
+    long                        n_hits;
+    long                        n_previous_block_hits;
+    long                        n_misses;
+    long                        n_evictions;
+    long                        n_useful_prefetches;
+} VIO_cache_shard_struct;
+
+/* --- state shared by all the shards.  The file is only read or written
+       while holding io_lock, as HDF5 is not assumed to be thread-safe,
+       which also protects the I/O statistics.
+       The prefetch fields are protected by prefetch_lock: they hold the
+       recent block misses, from which a constant stride is detected, and
+       the queue of blocks for the prefetch thread to read */
+
+typedef  struct  VIO_cache_shared_struct
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t             io_lock;
+    pthread_mutex_t             prefetch_lock;
+    pthread_cond_t              prefetch_wanted;
+    pthread_t                   prefetch_thread;
+#endif
+    long                        n_dirty_writes;
+    size_t                      n_bytes_read;
+    VIO_Real                    io_seconds;
+    VIO_BOOL                    prefetch_thread_running;
+    VIO_BOOL                    prefetch_stopping;
+    VIO_Volume                  volume;
+    long                        last_miss;
+    long                        last_stride;
+    int                         n_strided_misses;
+    long                        *prefetch_queue;
+    int                         queue_size;
+    int                         queue_start;
+    int                         n_queued;
+    long                        n_prefetched;
+} VIO_cache_shared_struct;
+
+#ifdef HAVE_PTHREAD
+#define  LOCK_CACHE( mutex )     (void) pthread_mutex_lock( &(mutex) )
+#define  UNLOCK_CACHE( mutex )   (void) pthread_mutex_unlock( &(mutex) )
+#else
+#define  LOCK_CACHE( mutex )
+#define  UNLOCK_CACHE( mutex )
+#endif
+
 static  void  alloc_volume_cache(
     VIO_volume_cache_struct   *cache,
     VIO_Volume                volume );
 
+static  void  stop_cache_prefetching(
+    VIO_volume_cache_struct   *cache );
+
+static  void  delete_compressed_blocks(
+    VIO_cache_shard_struct    *shard );
+
 #ifdef  CACHE_DEBUGGING
 static  void  initialize_cache_debug(
     VIO_volume_cache_struct  *cache );
@@ -131,6 +268,26 @@ VIOAPI  int  get_n_bytes_cache_threshold( void )
 
 VIOAPI  void  set_default_max_bytes_in_cache(
     int   max_bytes )
+{
+    set_default_max_bytes_in_cache_size( (size_t) MAX( max_bytes, 0 ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_default_max_bytes_in_cache_size
+@INPUT      : max_bytes
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Same as set_default_max_bytes_in_cache(), for caches larger
+              than can be described by an int.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_default_max_bytes_in_cache_size(
+    size_t   max_bytes )
 {
     default_cache_size_set = TRUE;
     default_cache_size = max_bytes;
@@ -152,14 +309,43 @@ VIOAPI  void  set_default_max_bytes_in_cache(
 
 VIOAPI  int  get_default_max_bytes_in_cache( void )
 {
-    int   n_bytes;
+    size_t   n_bytes;
+
+    n_bytes = get_default_max_bytes_in_cache_size();
+
+    if( n_bytes > (size_t) INT_MAX )
+        return( INT_MAX );
+    else
+        return( (int) n_bytes );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_max_bytes_in_cache_size
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of bytes
+@DESCRIPTION: Returns the maximum number of bytes allowed for a single
+              volume's cache.  If it hasn't been set, returns the program
+              initialized value, or the value set by the environment
+              variable VOLUME_CACHE_SIZE, which may exceed 2 gigabytes.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  size_t  get_default_max_bytes_in_cache_size( void )
+{
+    double   n_bytes;
 
     if( !default_cache_size_set )
     {
         if( getenv( "VOLUME_CACHE_SIZE" ) != NULL &&
-            sscanf( getenv( "VOLUME_CACHE_SIZE" ), "%d", &n_bytes ) == 1 )
+            sscanf( getenv( "VOLUME_CACHE_SIZE" ), "%lf", &n_bytes ) == 1 &&
+            n_bytes >= 0.0 )
         {
-            default_cache_size = n_bytes;
+            default_cache_size = (size_t) n_bytes;
         }
 
         default_cache_size_set = TRUE;
@@ -216,6 +402,178 @@ VIOAPI  void  set_cache_block_sizes_hint(
     default_block_sizes_set = FALSE;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_default_cache_prefetch_blocks
+@INPUT      : n_blocks
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets the default number of blocks read ahead, on a background
+              thread, when the cache sees blocks being missed at a constant
+              stride.  Zero turns read-ahead off.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_default_cache_prefetch_blocks(
+    int   n_blocks )
+{
+    default_prefetch_blocks = MAX( n_blocks, 0 );
+    default_prefetch_blocks_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_cache_prefetch_blocks
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of blocks
+@DESCRIPTION: Returns the default number of blocks read ahead.  If it hasn't
+              been set, returns the program initialized value, or the value
+              set by the environment variable VOLUME_CACHE_PREFETCH.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  int  get_default_cache_prefetch_blocks( void )
+{
+    int   n_blocks;
+
+    if( !default_prefetch_blocks_set )
+    {
+        if( getenv( "VOLUME_CACHE_PREFETCH" ) != NULL &&
+            sscanf( getenv( "VOLUME_CACHE_PREFETCH" ), "%d", &n_blocks ) == 1 &&
+            n_blocks >= 0 )
+        {
+            default_prefetch_blocks = n_blocks;
+        }
+        default_prefetch_blocks_set = TRUE;
+    }
+
+    return( default_prefetch_blocks );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_default_cache_compressed_bytes
+@INPUT      : max_bytes
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets the default amount of memory for the compressed second
+              tier of a volume's cache, which keeps evicted blocks so that
+              they need not be read from the file again.  Zero turns the
+              second tier off.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_default_cache_compressed_bytes(
+    size_t   max_bytes )
+{
+    default_compressed_size = max_bytes;
+    default_compressed_size_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_cache_compressed_bytes
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of bytes
+@DESCRIPTION: Returns the default amount of memory for the compressed second
+              tier.  If it hasn't been set, returns the program initialized
+              value, or the value set by the environment variable
+              VOLUME_CACHE_COMPRESSED_SIZE.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  size_t  get_default_cache_compressed_bytes( void )
+{
+    double   n_bytes;
+
+    if( !default_compressed_size_set )
+    {
+        if( getenv( "VOLUME_CACHE_COMPRESSED_SIZE" ) != NULL &&
+            sscanf( getenv( "VOLUME_CACHE_COMPRESSED_SIZE" ), "%lf",
+                    &n_bytes ) == 1 &&
+            n_bytes >= 0.0 )
+        {
+            default_compressed_size = (size_t) n_bytes;
+        }
+        default_compressed_size_set = TRUE;
+    }
+
+    return( default_compressed_size );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_default_cache_eviction_policy
+@INPUT      : policy
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets the default policy for choosing which block to evict
+              when a volume's cache is full.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_default_cache_eviction_policy(
+    VIO_Cache_eviction_policy  policy )
+{
+    default_eviction_policy = policy;
+    default_eviction_policy_set = TRUE;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_cache_eviction_policy
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : eviction policy
+@DESCRIPTION: Returns the default eviction policy.  If it hasn't been set,
+              returns LRU, or the policy named by the environment variable
+              VOLUME_CACHE_POLICY, one of lru, clock or 2q.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  VIO_Cache_eviction_policy  get_default_cache_eviction_policy( void )
+{
+    VIO_STR   name;
+
+    if( !default_eviction_policy_set )
+    {
+        name = getenv( "VOLUME_CACHE_POLICY" );
+
+        if( name != NULL )
+        {
+            if( equal_strings( name, "clock" ) )
+                default_eviction_policy = CLOCK_CACHE_EVICTION;
+            else if( equal_strings( name, "2q" ) )
+                default_eviction_policy = TWO_QUEUE_CACHE_EVICTION;
+            else
+                default_eviction_policy = LRU_CACHE_EVICTION;
+        }
+        default_eviction_policy_set = TRUE;
+    }
+
+    return( default_eviction_policy );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_default_cache_block_sizes
 @INPUT      :
@@ -276,6 +634,166 @@ static  void  get_default_cache_block_sizes(
     }
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : block_sizes_follow_file_chunks
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : TRUE if the block sizes may be taken from the file
+@DESCRIPTION: Checks that neither the program nor the environment has asked
+              for particular block sizes, in which case the cache blocks of
+              a MINC2 file are made the same shape as its HDF5 chunks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  block_sizes_follow_file_chunks( void )
+{
+    return( !default_block_sizes_set &&
+            block_size_hint == RANDOM_VOLUME_ACCESS &&
+            getenv( "VOLUME_CACHE_BLOCK_SIZE" ) == NULL );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_minc2_chunk_block_sizes
+@INPUT      : cache
+              minc_file
+@OUTPUT     : block_sizes[]
+@RETURNS    : TRUE if the image of the file is chunked
+@DESCRIPTION: Passes back the HDF5 chunk shape of the image, reordered from
+              file dimensions to volume dimensions.  Volume dimensions which
+              are not in the file keep their current block size.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_BOOL  get_minc2_chunk_block_sizes(
+    VIO_volume_cache_struct  *cache,
+    Minc_file                minc_file,
+    int                      block_sizes[] )
+{
+    mivolumeprops_t  props;
+    int              dim, ind, n_chunk_dims;
+    int              chunk_sizes[MAX_VAR_DIMS];
+
+    if( miget_volume_props( minc_file->minc2id, &props ) < 0 )
+        return( FALSE );
+
+    if( miget_props_blocking( props, &n_chunk_dims, chunk_sizes,
+                              MAX_VAR_DIMS ) < 0 ||
+        n_chunk_dims < minc_file->n_file_dimensions )
+    {
+        mifree_volume_props( props );
+        return( FALSE );
+    }
+
+    mifree_volume_props( props );
+
+    for_less( dim, 0, VIO_MAX_DIMENSIONS )
+        block_sizes[dim] = cache->block_sizes[dim];
+
+    for_less( dim, 0, minc_file->n_file_dimensions )
+    {
+        ind = minc_file->to_volume_index[dim];
+        if( ind >= 0 && chunk_sizes[dim] > 0 )
+            block_sizes[ind] = chunk_sizes[dim];
+    }
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : close_cache_input_file
+@INPUT      : minc_file
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Closes a file the cache was reading from, with whichever MINC
+              API it was opened.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  close_cache_input_file(
+    Minc_file   minc_file )
+{
+    if( minc_file->using_minc2_api )
+        (void) close_minc2_input( minc_file );
+#ifdef HAVE_MINC1
+    else
+        (void) close_minc_input( minc_file );
+#endif
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : close_cache_output_file
+@INPUT      : minc_file
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Closes a file the cache was writing to, with whichever MINC
+              API it was opened.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  close_cache_output_file(
+    Minc_file   minc_file )
+{
+    if( minc_file->using_minc2_api )
+        (void) close_minc2_output( minc_file );
+#ifdef HAVE_MINC1
+    else
+        (void) close_minc_output( minc_file );
+#endif
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_n_cache_shards
+@INPUT      :
+@OUTPUT     :
+@RETURNS    : number of shards
+@DESCRIPTION: Returns the number of independently locked shards to divide
+              the cache blocks between, a power of two.  This is one if
+              only one thread is expected to use the cache, otherwise a few
+              shards per thread, unless the environment variable
+              VOLUME_CACHE_SHARDS is set.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  int  get_default_n_cache_shards( void )
+{
+    int   n_wanted, n_shards;
+
+    if( getenv( "VOLUME_CACHE_SHARDS" ) == NULL ||
+        sscanf( getenv( "VOLUME_CACHE_SHARDS" ), "%d", &n_wanted ) != 1 ||
+        n_wanted < 1 )
+    {
+        n_wanted = miget_parallel_threads();
+        if( n_wanted > 1 )
+            n_wanted *= CACHE_SHARDS_PER_THREAD;
+    }
+
+    n_shards = 1;
+    while( n_shards < n_wanted && n_shards < MAX_CACHE_SHARDS )
+        n_shards *= 2;
+
+    return( n_shards );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : initialize_volume_cache
 @INPUT      : cache
@@ -315,7 +833,10 @@ VIOAPI  void  initialize_volume_cache(
     get_volume_sizes( volume, sizes );
 
     get_default_cache_block_sizes( n_dims, sizes, cache->block_sizes );
-    cache->max_cache_bytes = get_default_max_bytes_in_cache();
+    cache->max_cache_bytes = get_default_max_bytes_in_cache_size();
+    cache->prefetch_blocks = get_default_cache_prefetch_blocks();
+    cache->eviction_policy = get_default_cache_eviction_policy();
+    cache->max_compressed_bytes = get_default_cache_compressed_bytes();
 
     alloc_volume_cache( cache, volume );
 
@@ -344,12 +865,36 @@ static  void  alloc_volume_cache(
     VIO_volume_cache_struct   *cache,
     VIO_Volume                volume )
 {
-    int    dim, n_dims, sizes[VIO_MAX_DIMENSIONS], block, block_size;
-    int    x, block_stride, remainder, block_index;
+    int                     dim, n_dims, sizes[VIO_MAX_DIMENSIONS];
+    int                     x, remainder, block_i, s, n_shards, largest;
+    int                     shard_shift, page_shift;
+    long                    block_stride;
+    size_t                  page, block_size, n_shard_blocks;
+    VIO_cache_shard_struct  *shard;
 
     get_volume_sizes( volume, sizes );
     n_dims = get_volume_n_dimensions( volume );
 
+    /*--- each block is a one dimensional array indexed by an int, so halve
+          the longest side of any block with more voxels than that */
+
+    for( ;; )
+    {
+        block_size = 1;
+        largest = 0;
+        for_less( dim, 0, n_dims )
+        {
+            block_size *= (size_t) cache->block_sizes[dim];
+            if( cache->block_sizes[dim] > cache->block_sizes[largest] )
+                largest = dim;
+        }
+
+        if( block_size <= (size_t) INT_MAX )
+            break;
+
+        cache->block_sizes[largest] = (cache->block_sizes[largest] + 1) / 2;
+    }
+
     /*--- count number of blocks needed per dimension */
 
     block_size = 1;
@@ -364,70 +909,261 @@ static  void  alloc_volume_cache(
         for_less( x, 0, sizes[dim] )
         {
             remainder = x % cache->block_sizes[dim];
-            block_index = x / cache->block_sizes[dim];
+            block_i = x / cache->block_sizes[dim];
             cache->lookup[dim][x].block_index_offset =
-                                       block_index * block_stride;
-            cache->lookup[dim][x].block_offset = remainder * block_size;
+                                       (long) block_i * block_stride;
+            cache->lookup[dim][x].block_offset =
+                                       (int) ((size_t) remainder * block_size);
         }
 
-        block_size *= cache->block_sizes[dim];
-        block_stride *= cache->blocks_per_dim[dim];
+        block_size *= (size_t) cache->block_sizes[dim];
+        block_stride *= (long) cache->blocks_per_dim[dim];
     }
 
     cache->total_block_size = block_size;
+    cache->n_volume_blocks = (size_t) block_stride;
     cache->max_blocks = cache->max_cache_bytes / block_size /
-                        get_type_size(get_volume_data_type(volume));
+                        (size_t) get_type_size(get_volume_data_type(volume));
 
     if( cache->max_blocks < 1 )
         cache->max_blocks = 1;
 
-    /*--- create and initialize an empty hash table */
+    /*--- split the blocks between the shards, keeping a few blocks in each
+          so that each shard still has a useful least recently used list */
 
-    cache->hash_table_size = cache->max_blocks * HASH_TABLE_SIZE_FACTOR;
+    n_shards = get_default_n_cache_shards();
 
-    ALLOC( cache->hash_table, cache->hash_table_size );
+    while( n_shards > 1 &&
+           cache->max_blocks / (size_t) n_shards < MIN_BLOCKS_PER_SHARD )
+        n_shards /= 2;
 
-    for_less( block, 0, cache->hash_table_size )
-        cache->hash_table[block] = NULL;
+    cache->n_shards = n_shards;
 
-    /*--- set up the initial pointers */
+    /*--- size the block tables, which have one entry for every block of
+          the volume that can go in the shard */
 
-    cache->previous_block_index = -1;
-    cache->head = NULL;
-    cache->tail = NULL;
-    cache->n_blocks = 0;
-}
+    shard_shift = 0;
+    while( (1 << shard_shift) < n_shards )
+        ++shard_shift;
 
-VIOAPI  VIO_BOOL  volume_cache_is_alloced(
-    VIO_volume_cache_struct   *cache )
-{
-    return( cache->hash_table != NULL );
-}
+    n_shard_blocks = ((cache->n_volume_blocks - 1) >> shard_shift) + 1;
 
-/* ----------------------------- MNI Header -----------------------------------
-@NAME       : get_block_start
-@INPUT      : cache
-              block_index
-@OUTPUT     : block_start[]
-@RETURNS    :
-@DESCRIPTION: Computes the starting voxel indices for a block.
-@METHOD     :
-@GLOBALS    :
-@CALLS      :
-@CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   :
----------------------------------------------------------------------------- */
+    if( n_shard_blocks <= BLOCK_TABLE_FLAT_LIMIT )
+    {
+        page_shift = 0;
+        while( ((size_t) 1 << page_shift) < n_shard_blocks )
+            ++page_shift;
+    }
+    else
+        page_shift = BLOCK_TABLE_PAGE_SHIFT;
+
+    ALLOC( cache->shared, 1 );
+    ALLOC( cache->shards, n_shards );
+
+#ifdef HAVE_PTHREAD
+    {
+        pthread_mutexattr_t  attributes;
+
+        /*--- the locks are recursive, as opening the output file copies
+              the volume through the cache while holding every lock */
+
+        pthread_mutexattr_init( &attributes );
+        pthread_mutexattr_settype( &attributes, PTHREAD_MUTEX_RECURSIVE );
+
+        pthread_mutex_init( &cache->shared->io_lock, &attributes );
+        for_less( s, 0, n_shards )
+            pthread_mutex_init( &cache->shards[s].lock, &attributes );
+
+        pthread_mutexattr_destroy( &attributes );
+
+        pthread_mutex_init( &cache->shared->prefetch_lock, NULL );
+        pthread_cond_init( &cache->shared->prefetch_wanted, NULL );
+    }
+#endif
+
+    cache->shared->prefetch_thread_running = FALSE;
+    cache->shared->prefetch_stopping = FALSE;
+    cache->shared->volume = volume;
+    cache->shared->last_miss = -1;
+    cache->shared->last_stride = 0;
+    cache->shared->n_strided_misses = 0;
+    cache->shared->prefetch_queue = NULL;
+    cache->shared->queue_size = 0;
+    cache->shared->queue_start = 0;
+    cache->shared->n_queued = 0;
+    cache->shared->n_prefetched = 0;
+    cache->shared->n_dirty_writes = 0;
+    cache->shared->n_bytes_read = 0;
+    cache->shared->io_seconds = 0.0;
+
+    for_less( s, 0, n_shards )
+    {
+        shard = &cache->shards[s];
+
+        shard->max_blocks = cache->max_blocks / (size_t) n_shards;
+        if( (size_t) s < cache->max_blocks % (size_t) n_shards )
+            ++shard->max_blocks;
+
+        /*--- create an empty block table */
+
+        shard->shard_shift = shard_shift;
+        shard->page_shift = page_shift;
+        shard->n_pages = ((n_shard_blocks - 1) >> page_shift) + 1;
+
+        ALLOC( shard->block_table, shard->n_pages );
+
+        for_less( page, 0, shard->n_pages )
+            shard->block_table[page] = NULL;
+
+        /*--- set up the initial pointers */
+
+        shard->previous_block = NULL;
+        shard->previous_block_index = -1;
+        shard->head = NULL;
+        shard->tail = NULL;
+        shard->probation_head = NULL;
+        shard->probation_tail = NULL;
+        shard->n_probation = 0;
+        shard->n_blocks = 0;
+        shard->n_hits = 0;
+        shard->n_previous_block_hits = 0;
+        shard->n_misses = 0;
+        shard->n_evictions = 0;
+        shard->n_useful_prefetches = 0;
+
+        /*--- the compressed tier starts empty, and allocates its buffers
+              when first used */
+
+        shard->compressed_head = NULL;
+        shard->compressed_tail = NULL;
+        shard->compressed_bytes = 0;
+        shard->max_compressed_bytes = cache->max_compressed_bytes /
+                                      (size_t) n_shards;
+        shard->streams_initialized = FALSE;
+        shard->shuffled = NULL;
+        shard->packed = NULL;
+        shard->n_compressed_hits = 0;
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : free_block_table_pages
+@INPUT      : shard
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Frees the pages of the block table of a shard, leaving it
+              empty.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  free_block_table_pages(
+    VIO_cache_shard_struct   *shard )
+{
+    size_t   page;
+
+    for_less( page, 0, shard->n_pages )
+    {
+        if( shard->block_table[page] != NULL )
+        {
+            FREE( shard->block_table[page] );
+            shard->block_table[page] = NULL;
+        }
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : free_volume_cache
+@INPUT      : cache
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Frees the tables allocated by alloc_volume_cache().  The
+              blocks must already have been deleted.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  free_volume_cache(
+    VIO_volume_cache_struct   *cache )
+{
+    int   dim, s;
+
+    stop_cache_prefetching( cache );
+
+    if( cache->shared->prefetch_queue != NULL )
+        FREE( cache->shared->prefetch_queue );
+
+    for_less( s, 0, cache->n_shards )
+    {
+        free_block_table_pages( &cache->shards[s] );
+        FREE( cache->shards[s].block_table );
+
+        if( cache->shards[s].streams_initialized )
+        {
+            (void) deflateEnd( &cache->shards[s].deflater );
+            (void) inflateEnd( &cache->shards[s].inflater );
+            FREE( cache->shards[s].shuffled );
+            FREE( cache->shards[s].packed );
+        }
+#ifdef HAVE_PTHREAD
+        pthread_mutex_destroy( &cache->shards[s].lock );
+#endif
+    }
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy( &cache->shared->io_lock );
+    pthread_mutex_destroy( &cache->shared->prefetch_lock );
+    pthread_cond_destroy( &cache->shared->prefetch_wanted );
+#endif
+
+    FREE( cache->shards );
+    FREE( cache->shared );
+    cache->shards = NULL;
+    cache->shared = NULL;
+    cache->n_shards = 0;
+
+    for_less( dim, 0, cache->n_dimensions )
+    {
+        FREE( cache->lookup[dim] );
+    }
+}
+
+VIOAPI  VIO_BOOL  volume_cache_is_alloced(
+    VIO_volume_cache_struct   *cache )
+{
+    return( cache->shards != NULL );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_block_start
+@INPUT      : cache
+              block_index
+@OUTPUT     : block_start[]
+@RETURNS    :
+@DESCRIPTION: Computes the starting voxel indices for a block.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
 
 static  void  get_block_start(
     VIO_volume_cache_struct  *cache,
-    int                  block_index,
+    long                 block_index,
     int                  block_start[] )
 {
     int    dim, block_i;
 
     for_down( dim, cache->n_dimensions-1, 0 )
     {
-        block_i = block_index % cache->blocks_per_dim[dim];
+        block_i = (int) (block_index % cache->blocks_per_dim[dim]);
         block_start[dim] = block_i * cache->block_sizes[dim];
         block_index /= cache->blocks_per_dim[dim];
     }
@@ -461,6 +1197,7 @@ static  void  write_cache_block(
     int              volume_sizes[VIO_MAX_DIMENSIONS];
     int              block_start[VIO_MAX_DIMENSIONS];
     void             *array_data_ptr;
+    VIO_Real         start_time;
 
     minc_file = (Minc_file) cache->minc_file;
 
@@ -487,16 +1224,36 @@ static  void  write_cache_block(
     GET_MULTIDIM_PTR( array_data_ptr, block->array, 0, 0, 0, 0, 0 );
     n_dims = cache->n_dimensions;
 
+    LOCK_CACHE( cache->shared->io_lock );
+
+    start_time = current_realtime_seconds();
+
+    if( minc_file->using_minc2_api )
+    {
+        (void) output_minc2_hyperslab( minc_file,
+                                       get_multidim_data_type(&block->array),
+                                       n_dims, cache->block_sizes,
+                                       array_data_ptr,
+                                       minc_file->to_volume_index,
+                                       file_start, file_count );
+    }
 #ifdef HAVE_MINC1
-    output_minc_hyperslab( (Minc_file) cache->minc_file,
-                                  get_multidim_data_type(&block->array),
-                                  n_dims, cache->block_sizes, array_data_ptr,
-                                  minc_file->to_volume_index,
-                                  file_start, file_count );
-#elif  defined HAVE_MINC2
-    /*TODO: Write out minc file using MINC2 api*/
+    else
+    {
+        (void) output_minc_hyperslab( minc_file,
+                                      get_multidim_data_type(&block->array),
+                                      n_dims, cache->block_sizes,
+                                      array_data_ptr,
+                                      minc_file->to_volume_index,
+                                      file_start, file_count );
+    }
 #endif
     cache->must_read_blocks_before_use = TRUE;
+
+    ++cache->shared->n_dirty_writes;
+    cache->shared->io_seconds += current_realtime_seconds() - start_time;
+
+    UNLOCK_CACHE( cache->shared->io_lock );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -520,6 +1277,8 @@ static  void  flush_cache_blocks(
     VIO_Volume                volume,
     VIO_BOOL               deleting_volume_flag )
 {
+    int                     s, list;
+    VIO_cache_shard_struct  *shard;
     VIO_cache_block_struct  *block;
 
     /*--- don't bother flushing if deleting volume and just writing to temp */
@@ -527,18 +1286,31 @@ static  void  flush_cache_blocks(
     if( cache->writing_to_temp_file && deleting_volume_flag )
         return;
 
-    /*--- step through linked list, freeing blocks */
+    /*--- step through the linked lists of each shard, writing modified
+          blocks */
 
-    block = cache->head;
-    while( block != NULL )
+    for_less( s, 0, cache->n_shards )
     {
-        if( block->modified_flag )
+        shard = &cache->shards[s];
+
+        LOCK_CACHE( shard->lock );
+
+        for_less( list, 0, 2 )
         {
-            write_cache_block( cache, volume, block );
-            block->modified_flag = FALSE;
+            block = (list == 0) ? shard->head : shard->probation_head;
+            while( block != NULL )
+            {
+                if( block->modified_flag )
+                {
+                    write_cache_block( cache, volume, block );
+                    block->modified_flag = FALSE;
+                }
+
+                block = block->next_used;
+            }
         }
 
-        block = block->next_used;
+        UNLOCK_CACHE( shard->lock );
     }
 }
 
@@ -582,35 +1354,56 @@ static  void  delete_cache_blocks(
     VIO_Volume                volume,
     VIO_BOOL               deleting_volume_flag )
 {
-    int                 block;
+    int                     s, list;
+    VIO_cache_shard_struct  *shard;
     VIO_cache_block_struct  *current, *next;
 
+    /*--- make sure the prefetch thread is not adding blocks */
+
+    stop_cache_prefetching( cache );
+
     /*--- if required, write out cache blocks */
 
     if( !cache->writing_to_temp_file || !deleting_volume_flag )
         flush_cache_blocks( cache, volume, deleting_volume_flag );
 
-    /*--- step through linked list, freeing blocks */
-
-    current = cache->head;
-    while( current != NULL )
+    for_less( s, 0, cache->n_shards )
     {
-        next = current->next_used;
-        delete_multidim_array( &current->array );
-        FREE( current );
-        current = next;
-    }
+        shard = &cache->shards[s];
+
+        LOCK_CACHE( shard->lock );
+
+        /*--- step through linked lists, freeing blocks */
+
+        for_less( list, 0, 2 )
+        {
+            current = (list == 0) ? shard->head : shard->probation_head;
+            while( current != NULL )
+            {
+                next = current->next_used;
+                delete_multidim_array( &current->array );
+                FREE( current );
+                current = next;
+            }
+        }
+
+        /*--- initialize shard to no blocks present */
 
-    /*--- initialize cache to no blocks present */
+        shard->n_blocks = 0;
 
-    cache->n_blocks = 0;
+        delete_compressed_blocks( shard );
+        free_block_table_pages( shard );
 
-    for_less( block, 0, cache->hash_table_size )
-        cache->hash_table[block] = NULL;
+        shard->previous_block = NULL;
+        shard->previous_block_index = -1;
+        shard->head = NULL;
+        shard->tail = NULL;
+        shard->probation_head = NULL;
+        shard->probation_tail = NULL;
+        shard->n_probation = 0;
 
-    cache->previous_block_index = -1;
-    cache->head = NULL;
-    cache->tail = NULL;
+        UNLOCK_CACHE( shard->lock );
+    }
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -631,18 +1424,9 @@ VIOAPI  void  delete_volume_cache(
     VIO_volume_cache_struct   *cache,
     VIO_Volume                volume )
 {
-    int   dim, n_dims;
-
     delete_cache_blocks( cache, volume, TRUE );
 
-    FREE( cache->hash_table );
-    cache->hash_table = NULL;
-
-    n_dims = cache->n_dimensions;
-    for_less( dim, 0, n_dims )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     delete_string( cache->input_filename );
     delete_string( cache->output_filename );
@@ -655,19 +1439,10 @@ VIOAPI  void  delete_volume_cache(
 
     if( cache->minc_file != NULL )
     {
-      if( cache->output_file_is_open )
-      {
-#ifdef HAVE_MINC1
-            (void) close_minc_output( (Minc_file) cache->minc_file );
-#elif defined HAVE_MINC2
-            (void) close_minc2_output( (Minc_file) cache->minc_file );
-#endif
-      } else
-#ifdef HAVE_MINC1
-            (void) close_minc_input( (Minc_file) cache->minc_file );
-#elif defined HAVE_MINC2
-            (void) close_minc2_input( (Minc_file) cache->minc_file );
-#endif
+        if( cache->output_file_is_open )
+            close_cache_output_file( (Minc_file) cache->minc_file );
+        else
+            close_cache_input_file( (Minc_file) cache->minc_file );
     }
 }
 
@@ -692,7 +1467,7 @@ VIOAPI  void  set_volume_cache_block_sizes(
     int       block_sizes[] )
 {
     VIO_volume_cache_struct   *cache;
-    int                   d, dim, sizes[VIO_N_DIMENSIONS];
+    int                   d, sizes[VIO_MAX_DIMENSIONS];
     VIO_BOOL               changed;
 
     if( !volume->is_cached_volume )
@@ -720,12 +1495,7 @@ VIOAPI  void  set_volume_cache_block_sizes(
 
     delete_cache_blocks( cache, volume, FALSE );
 
-    FREE( cache->hash_table );
-
-    for_less( dim, 0, get_volume_n_dimensions( volume ) )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     for_less( d, 0, get_volume_n_dimensions(volume) )
         cache->block_sizes[d] = block_sizes[d];
@@ -741,7 +1511,7 @@ VIOAPI  void  set_volume_cache_block_sizes(
 @RETURNS    :
 @DESCRIPTION: Changes the maximum amount of memory in the cache for this
               volume, if it is a cached volume.  This flushes the cache,
-              in order to reallocate the hash table to a new size.
+              in order to reallocate the block tables.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -753,7 +1523,28 @@ VIOAPI  void  set_volume_cache_size(
     VIO_Volume    volume,
     int       max_memory_bytes )
 {
-    int                   dim;
+    set_volume_cache_size_bytes( volume, (size_t) MAX( max_memory_bytes, 0 ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_volume_cache_size_bytes
+@INPUT      : volume
+              max_memory_bytes
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Same as set_volume_cache_size(), for caches larger than can
+              be described by an int.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_volume_cache_size_bytes(
+    VIO_Volume    volume,
+    size_t        max_memory_bytes )
+{
     VIO_volume_cache_struct   *cache;
 
     if( !volume->is_cached_volume )
@@ -763,12 +1554,7 @@ VIOAPI  void  set_volume_cache_size(
 
     delete_cache_blocks( cache, volume, FALSE );
 
-    FREE( cache->hash_table );
-
-    for_less( dim, 0, get_volume_n_dimensions( volume ) )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     cache->max_cache_bytes = max_memory_bytes;
 
@@ -776,134 +1562,405 @@ VIOAPI  void  set_volume_cache_size(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : set_cache_output_volume_parameters
+@NAME       : set_volume_cache_compressed_bytes
 @INPUT      : volume
-              filename
-              file_nc_data_type
-              file_signed_flag
-              file_voxel_min
-              file_voxel_max
-              original_filename  - if non-NULL copies auxiliary info from this
-              history
-              options
+              max_bytes
 @OUTPUT     :
 @RETURNS    :
-@DESCRIPTION: Indicates that rather than using a temporary file for the
-              cached volume, read and write to this file with the associated
-              parameters (similar to output_modified_volume()).
+@DESCRIPTION: Changes the amount of memory for the compressed second tier of
+              the cache of this volume, if it is a cached volume.  Zero turns
+              the second tier off.  This flushes the cache.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Nov.  4, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  void  set_cache_output_volume_parameters(
-    VIO_Volume                      volume,
-    VIO_STR                      filename,
-    nc_type                     file_nc_data_type,
-    VIO_BOOL                     file_signed_flag,
-    VIO_Real                        file_voxel_min,
-    VIO_Real                        file_voxel_max,
-    VIO_STR                      original_filename,
-    VIO_STR                      history,
-    minc_output_options         *options )
-
+VIOAPI  void  set_volume_cache_compressed_bytes(
+    VIO_Volume    volume,
+    size_t        max_bytes )
 {
-    volume->cache.output_filename = create_string( filename );
-    volume->cache.file_nc_data_type = file_nc_data_type;
-    volume->cache.file_signed_flag = file_signed_flag;
-    volume->cache.file_voxel_min = file_voxel_min;
-    volume->cache.file_voxel_max = file_voxel_max;
-    volume->cache.original_filename = create_string( original_filename );
-    volume->cache.history = create_string( history );
-    copy_minc_output_options( options, &volume->cache.options );
+    int                      s;
+    VIO_volume_cache_struct  *cache;
+
+    if( !volume->is_cached_volume )
+        return;
+
+    cache = &volume->cache;
+
+    delete_cache_blocks( cache, volume, FALSE );
+
+    cache->max_compressed_bytes = max_bytes;
+
+    for_less( s, 0, cache->n_shards )
+        cache->shards[s].max_compressed_bytes = max_bytes /
+                                                (size_t) cache->n_shards;
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : open_cache_volume_input_file
-@INPUT      : cache
-              volume
-              filename
-              options
+@NAME       : set_volume_cache_prefetch_blocks
+@INPUT      : volume
+              n_blocks
 @OUTPUT     :
 @RETURNS    :
-@DESCRIPTION: Opens the volume file for reading into the cache as needed.
+@DESCRIPTION: Sets the number of blocks read ahead for this volume, if it is
+              a cached volume.  Zero turns read-ahead off.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Sep. 1, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-VIOAPI  void  open_cache_volume_input_file(
-    VIO_volume_cache_struct   *cache,
-    VIO_Volume                volume,
-    VIO_STR                filename,
-    minc_input_options    *options )
+VIOAPI  void  set_volume_cache_prefetch_blocks(
+    VIO_Volume    volume,
+    int           n_blocks )
 {
-    cache->input_filename = create_string( filename );
+    if( !volume->is_cached_volume )
+        return;
 
-#ifdef HAVE_MINC1
-    cache->minc_file = initialize_minc_input( filename, volume, options );
-#elif defined  HAVE_MINC2
-    cache->minc_file = initialize_minc2_input( filename, volume, options );
-#endif
+    stop_cache_prefetching( &volume->cache );
 
-    cache->must_read_blocks_before_use = TRUE;
+    volume->cache.prefetch_blocks = MAX( n_blocks, 0 );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : open_cache_volume_output_file
-@INPUT      : cache
-              volume
+@NAME       : set_volume_cache_eviction_policy
+@INPUT      : volume
+              policy
 @OUTPUT     :
 @RETURNS    :
-@DESCRIPTION: Opens a volume file for reading and writing cache blocks.
+@DESCRIPTION: Changes the eviction policy of the cache of this volume, if it
+              is a cached volume.  This flushes the cache.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
-@CREATED    : Sep. 1, 1995    David MacDonald
+@CREATED    :
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-static  VIO_Status  open_cache_volume_output_file(
-    VIO_volume_cache_struct   *cache,
-    VIO_Volume                volume )
+VIOAPI  void  set_volume_cache_eviction_policy(
+    VIO_Volume                 volume,
+    VIO_Cache_eviction_policy  policy )
 {
-    VIO_Status  status=VIO_ERROR;
-    int         dim, n_dims;
-    int         out_sizes[VIO_MAX_DIMENSIONS];
-    int         vol_sizes[VIO_MAX_DIMENSIONS];
-    VIO_Real    min_value, max_value;
-    Minc_file   out_minc_file=NULL;
-    VIO_STR     *vol_dim_names=NULL;
-    VIO_STR     *out_dim_names=NULL, output_filename;
+    if( !volume->is_cached_volume )
+        return;
 
-    n_dims = get_volume_n_dimensions( volume );
+    delete_cache_blocks( &volume->cache, volume, FALSE );
 
-    /*--- check if the output filename has been set */
+    volume->cache.eviction_policy = policy;
+}
 
-    if( string_length( cache->output_filename ) == 0 )
-    {
-        cache->writing_to_temp_file = TRUE;
-        output_filename = get_temporary_filename();
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_volume_cache_prefetch_stats
+@INPUT      : volume
+@OUTPUT     : n_prefetched
+              n_useful
+@RETURNS    :
+@DESCRIPTION: Passes back the number of blocks read ahead since the cache
+              was allocated, and how many of those were used before being
+              evicted.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
 
-        cache->file_nc_data_type = get_volume_nc_data_type( volume,
-                                          &cache->file_signed_flag );
-        get_volume_voxel_range( volume, &cache->file_voxel_min,
-                                &cache->file_voxel_max );
+VIOAPI  void  get_volume_cache_prefetch_stats(
+    VIO_Volume    volume,
+    long          *n_prefetched,
+    long          *n_useful )
+{
+    int                      s;
+    VIO_volume_cache_struct  *cache;
 
-        ALLOC( out_dim_names, n_dims );
+    *n_prefetched = 0;
+    *n_useful = 0;
 
-        vol_dim_names = get_volume_dimension_names( volume );
-        get_volume_sizes( volume, vol_sizes );
+    if( !volume->is_cached_volume )
+        return;
 
-        for_less( dim, 0, n_dims )
-        {
-            out_dim_names[dim] = create_string( vol_dim_names[dim] );
-            out_sizes[dim] = vol_sizes[dim];
-        }
+    cache = &volume->cache;
+
+    LOCK_CACHE( cache->shared->prefetch_lock );
+    *n_prefetched = cache->shared->n_prefetched;
+    UNLOCK_CACHE( cache->shared->prefetch_lock );
+
+    for_less( s, 0, cache->n_shards )
+    {
+        LOCK_CACHE( cache->shards[s].lock );
+        *n_useful += cache->shards[s].n_useful_prefetches;
+        UNLOCK_CACHE( cache->shards[s].lock );
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_volume_cache_stats
+@INPUT      : volume
+@OUTPUT     : stats
+@RETURNS    :
+@DESCRIPTION: Passes back the counts of block hits, hits on the block
+              accessed just before, misses, evictions, blocks written back,
+              blocks read ahead and used, the number of bytes read from the
+              file, the time spent reading and writing blocks, and the
+              blocks found in the compressed tier, since the cache was
+              allocated or the statistics last reset, as well as the bytes
+              currently held by the compressed tier.  All are
+              zero for a volume which is not cached.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  get_volume_cache_stats(
+    VIO_Volume               volume,
+    VIO_volume_cache_stats   *stats )
+{
+    int                      s;
+    VIO_volume_cache_struct  *cache;
+    VIO_cache_shard_struct   *shard;
+
+    stats->n_hits = 0;
+    stats->n_previous_block_hits = 0;
+    stats->n_misses = 0;
+    stats->n_evictions = 0;
+    stats->n_dirty_writes = 0;
+    stats->n_prefetched = 0;
+    stats->n_useful_prefetches = 0;
+    stats->n_bytes_read = 0;
+    stats->io_seconds = 0.0;
+    stats->n_compressed_hits = 0;
+    stats->n_compressed_bytes = 0;
+
+    if( !volume->is_cached_volume )
+        return;
+
+    cache = &volume->cache;
+
+    for_less( s, 0, cache->n_shards )
+    {
+        shard = &cache->shards[s];
+
+        LOCK_CACHE( shard->lock );
+        stats->n_hits += shard->n_hits;
+        stats->n_previous_block_hits += shard->n_previous_block_hits;
+        stats->n_misses += shard->n_misses;
+        stats->n_evictions += shard->n_evictions;
+        stats->n_useful_prefetches += shard->n_useful_prefetches;
+        stats->n_compressed_hits += shard->n_compressed_hits;
+        stats->n_compressed_bytes += shard->compressed_bytes;
+        UNLOCK_CACHE( shard->lock );
+    }
+
+    LOCK_CACHE( cache->shared->io_lock );
+    stats->n_dirty_writes = cache->shared->n_dirty_writes;
+    stats->n_bytes_read = cache->shared->n_bytes_read;
+    stats->io_seconds = cache->shared->io_seconds;
+    UNLOCK_CACHE( cache->shared->io_lock );
+
+    LOCK_CACHE( cache->shared->prefetch_lock );
+    stats->n_prefetched = cache->shared->n_prefetched;
+    UNLOCK_CACHE( cache->shared->prefetch_lock );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : reset_volume_cache_stats
+@INPUT      : volume
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Sets the statistics of the cache of this volume back to zero.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  reset_volume_cache_stats(
+    VIO_Volume   volume )
+{
+    int                      s;
+    VIO_volume_cache_struct  *cache;
+    VIO_cache_shard_struct   *shard;
+
+    if( !volume->is_cached_volume )
+        return;
+
+    cache = &volume->cache;
+
+    for_less( s, 0, cache->n_shards )
+    {
+        shard = &cache->shards[s];
+
+        LOCK_CACHE( shard->lock );
+        shard->n_hits = 0;
+        shard->n_previous_block_hits = 0;
+        shard->n_misses = 0;
+        shard->n_evictions = 0;
+        shard->n_useful_prefetches = 0;
+        shard->n_compressed_hits = 0;
+        UNLOCK_CACHE( shard->lock );
+    }
+
+    LOCK_CACHE( cache->shared->io_lock );
+    cache->shared->n_dirty_writes = 0;
+    cache->shared->n_bytes_read = 0;
+    cache->shared->io_seconds = 0.0;
+    UNLOCK_CACHE( cache->shared->io_lock );
+
+    LOCK_CACHE( cache->shared->prefetch_lock );
+    cache->shared->n_prefetched = 0;
+    UNLOCK_CACHE( cache->shared->prefetch_lock );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_cache_output_volume_parameters
+@INPUT      : volume
+              filename
+              file_nc_data_type
+              file_signed_flag
+              file_voxel_min
+              file_voxel_max
+              original_filename  - if non-NULL copies auxiliary info from this
+              history
+              options
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Indicates that rather than using a temporary file for the
+              cached volume, read and write to this file with the associated
+              parameters (similar to output_modified_volume()).
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Nov.  4, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_cache_output_volume_parameters(
+    VIO_Volume                      volume,
+    VIO_STR                      filename,
+    nc_type                     file_nc_data_type,
+    VIO_BOOL                     file_signed_flag,
+    VIO_Real                        file_voxel_min,
+    VIO_Real                        file_voxel_max,
+    VIO_STR                      original_filename,
+    VIO_STR                      history,
+    minc_output_options         *options )
+
+{
+    volume->cache.output_filename = create_string( filename );
+    volume->cache.file_nc_data_type = file_nc_data_type;
+    volume->cache.file_signed_flag = file_signed_flag;
+    volume->cache.file_voxel_min = file_voxel_min;
+    volume->cache.file_voxel_max = file_voxel_max;
+    volume->cache.original_filename = create_string( original_filename );
+    volume->cache.history = create_string( history );
+    copy_minc_output_options( options, &volume->cache.options );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : open_cache_volume_input_file
+@INPUT      : cache
+              volume
+              filename
+              options
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Opens the volume file for reading into the cache as needed.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  open_cache_volume_input_file(
+    VIO_volume_cache_struct   *cache,
+    VIO_Volume                volume,
+    VIO_STR                filename,
+    minc_input_options    *options )
+{
+    Minc_file  minc_file;
+    int        block_sizes[VIO_MAX_DIMENSIONS];
+
+    cache->input_filename = create_string( filename );
+
+#ifdef HAVE_MINC1
+    if( options == NULL || !options->prefer_minc2_api )
+        minc_file = initialize_minc_input( filename, volume, options );
+    else
+#endif
+        minc_file = initialize_minc2_input( filename, volume, options );
+
+    cache->minc_file = minc_file;
+    cache->must_read_blocks_before_use = TRUE;
+
+    /*--- unless told otherwise, make each cache block one chunk of the
+          file, so that a block miss decompresses exactly one chunk */
+
+    if( minc_file != NULL && minc_file->using_minc2_api &&
+        block_sizes_follow_file_chunks() &&
+        get_minc2_chunk_block_sizes( cache, minc_file, block_sizes ) )
+    {
+        set_volume_cache_block_sizes( volume, block_sizes );
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : open_cache_volume_output_file
+@INPUT      : cache
+              volume
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Opens a volume file for reading and writing cache blocks.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_Status  open_cache_volume_output_file(
+    VIO_volume_cache_struct   *cache,
+    VIO_Volume                volume )
+{
+    VIO_Status  status=VIO_ERROR;
+    int         dim, n_dims;
+    int         out_sizes[VIO_MAX_DIMENSIONS];
+    int         vol_sizes[VIO_MAX_DIMENSIONS];
+    VIO_Real    min_value, max_value;
+    Minc_file   out_minc_file=NULL;
+    VIO_STR     *vol_dim_names=NULL;
+    VIO_STR     *out_dim_names=NULL, output_filename;
+
+    n_dims = get_volume_n_dimensions( volume );
+
+    /*--- check if the output filename has been set */
+
+    if( string_length( cache->output_filename ) == 0 )
+    {
+        cache->writing_to_temp_file = TRUE;
+        output_filename = get_temporary_filename();
+
+        cache->file_nc_data_type = get_volume_nc_data_type( volume,
+                                          &cache->file_signed_flag );
+        get_volume_voxel_range( volume, &cache->file_voxel_min,
+                                &cache->file_voxel_max );
+
+        ALLOC( out_dim_names, n_dims );
+
+        vol_dim_names = get_volume_dimension_names( volume );
+        get_volume_sizes( volume, vol_sizes );
+
+        for_less( dim, 0, n_dims )
+        {
+            out_dim_names[dim] = create_string( vol_dim_names[dim] );
+            out_sizes[dim] = vol_sizes[dim];
+        }
 
         delete_dimension_names( volume, vol_dim_names );
     }
@@ -930,7 +1987,8 @@ static  VIO_Status  open_cache_volume_output_file(
     /*--- open the file for writing */
 
 #ifdef HAVE_MINC1
-    out_minc_file = initialize_minc_output( output_filename,
+    if( !cache->options.prefer_minc2_api )
+        out_minc_file = initialize_minc_output( output_filename,
                                         n_dims, out_dim_names, out_sizes,
                                         cache->file_nc_data_type,
                                         cache->file_signed_flag,
@@ -938,8 +1996,9 @@ static  VIO_Status  open_cache_volume_output_file(
                                         cache->file_voxel_max,
                                         get_voxel_to_world_transform(volume),
                                         volume, &cache->options );
-#elif defined  HAVE_MINC2
-    out_minc_file = initialize_minc2_output( output_filename,
+    else
+#endif
+        out_minc_file = initialize_minc2_output( output_filename,
                                         n_dims, out_dim_names, out_sizes,
                                         cache->file_nc_data_type,
                                         cache->file_signed_flag,
@@ -947,7 +2006,7 @@ static  VIO_Status  open_cache_volume_output_file(
                                         cache->file_voxel_max,
                                         get_voxel_to_world_transform(volume),
                                         volume, &cache->options );
-#endif
+
     if( out_minc_file == NULL )
         return( VIO_ERROR );
 
@@ -965,10 +2024,11 @@ static  VIO_Status  open_cache_volume_output_file(
     if( string_length( cache->output_filename ) == 0 )
         remove_file( output_filename );
 
+    if( out_minc_file->using_minc2_api )
+        status = set_minc2_output_random_order( out_minc_file );
 #ifdef HAVE_MINC1
-    status = set_minc_output_random_order( out_minc_file );
-#elif defined  HAVE_MINC2
-    status = set_minc2_output_random_order( out_minc_file );
+    else
+        status = set_minc_output_random_order( out_minc_file );
 #endif
 
     if( status != VIO_OK )
@@ -979,13 +2039,13 @@ static  VIO_Status  open_cache_volume_output_file(
 
     if( cache->minc_file != NULL )
     {
+        if( out_minc_file->using_minc2_api )
+            (void) output_minc2_volume( out_minc_file );
 #ifdef HAVE_MINC1
-        (void) output_minc_volume( out_minc_file );
-        (void) close_minc_input( (Minc_file) cache->minc_file );
-#elif defined  HAVE_MINC2
-        (void) output_minc2_volume( out_minc_file );
-        (void) close_minc2_input( (Minc_file) cache->minc_file );
+        else
+            (void) output_minc_volume( out_minc_file );
 #endif
+        close_cache_input_file( (Minc_file) cache->minc_file );
 
         cache->must_read_blocks_before_use = TRUE;
     }
@@ -1005,7 +2065,7 @@ VIOAPI  void  cache_volume_range_has_changed(
     if( !volume->is_cached_volume )
         return;
 
-    if( volume->cache.minc_file == NULL && volume->cache.n_blocks == 0 )
+    if( volume->cache.minc_file == NULL )
         return;
 
     /* This message is not useful.
@@ -1079,49 +2139,509 @@ static  void  read_cache_block(
     int              file_start[VIO_MAX_DIMENSIONS];
     int              file_count[VIO_MAX_DIMENSIONS];
     void             *array_data_ptr;
+    size_t           n_bytes;
+    VIO_Real         start_time;
 
     minc_file = (Minc_file) cache->minc_file;
 
     get_volume_sizes( volume, sizes );
 
-    for_less( dim, 0, minc_file->n_file_dimensions )
+    n_bytes = (size_t) get_type_size( get_multidim_data_type(&block->array) );
+
+    for_less( dim, 0, minc_file->n_file_dimensions )
+    {
+        ind = minc_file->to_volume_index[dim];
+        if( ind >= 0 )
+        {
+            file_start[dim] = cache->file_offset[dim] + block_start[ind];
+            file_count[dim] = MIN( sizes[ind] - file_start[dim],
+                                   cache->block_sizes[ind] );
+            n_bytes *= (size_t) file_count[dim];
+        }
+        else
+        {
+            file_start[dim] = cache->file_offset[dim];
+            file_count[dim] = 0;
+        }
+    }
+
+    n_dims = cache->n_dimensions;
+    GET_MULTIDIM_PTR( array_data_ptr, block->array, 0, 0, 0, 0, 0 );
+
+    LOCK_CACHE( cache->shared->io_lock );
+
+    start_time = current_realtime_seconds();
+
+    if( minc_file->using_minc2_api )
+    {
+        (void) input_minc2_hyperslab( minc_file,
+                                      get_multidim_data_type(&block->array),
+                                      n_dims, cache->block_sizes,
+                                      array_data_ptr,
+                                      minc_file->to_volume_index,
+                                      file_start, file_count );
+    }
+#ifdef HAVE_MINC1
+    else
+    {
+        (void) input_minc_hyperslab( minc_file,
+                                     get_multidim_data_type(&block->array),
+                                     n_dims, cache->block_sizes,
+                                     array_data_ptr,
+                                     minc_file->to_volume_index,
+                                     file_start, file_count );
+    }
+#endif
+
+    cache->shared->n_bytes_read += n_bytes;
+    cache->shared->io_seconds += current_realtime_seconds() - start_time;
+
+    UNLOCK_CACHE( cache->shared->io_lock );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_block_table_entry
+@INPUT      : shard
+              block_index
+@OUTPUT     :
+@RETURNS    : pointer to the block table entry
+@DESCRIPTION: Returns the entry of the shard's block table for the given
+              block, whose block is NULL if the block is not in the cache,
+              and whose compressed block is NULL if it is not in the
+              compressed tier.
+              Allocates the page of the table if needed.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_cache_table_entry  *get_block_table_entry(
+    VIO_cache_shard_struct   *shard,
+    long                     block_index )
+{
+    size_t                  entry, page_index, page_size;
+    VIO_cache_table_entry   *page;
+
+    entry = (size_t) block_index >> shard->shard_shift;
+    page_index = entry >> shard->page_shift;
+    page_size = (size_t) 1 << shard->page_shift;
+
+    page = shard->block_table[page_index];
+
+    if( page == NULL )
+    {
+        ALLOC( page, page_size );
+        for_less( entry, 0, page_size )
+        {
+            page[entry].block = NULL;
+            page[entry].compressed = NULL;
+        }
+        shard->block_table[page_index] = page;
+        entry = (size_t) block_index >> shard->shard_shift;
+    }
+
+    return( &page[entry & (page_size - 1)] );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : remove_cache_block_from_list
+@INPUT      : shard
+              block
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Removes a block from the used or probation list it is on.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  remove_cache_block_from_list(
+    VIO_cache_shard_struct   *shard,
+    VIO_cache_block_struct   *block )
+{
+    VIO_cache_block_struct   **head, **tail;
+
+    if( block->probation_flag )
+    {
+        head = &shard->probation_head;
+        tail = &shard->probation_tail;
+        --shard->n_probation;
+    }
+    else
+    {
+        head = &shard->head;
+        tail = &shard->tail;
+    }
+
+    if( block->prev_used == NULL )
+        *head = block->next_used;
+    else
+        block->prev_used->next_used = block->next_used;
+
+    if( block->next_used == NULL )
+        *tail = block->prev_used;
+    else
+        block->next_used->prev_used = block->prev_used;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : insert_cache_block_in_list
+@INPUT      : shard
+              block
+              probation   - TRUE for the probation list
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Places a block at the head of the used or probation list.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  insert_cache_block_in_list(
+    VIO_cache_shard_struct   *shard,
+    VIO_cache_block_struct   *block,
+    VIO_BOOL                 probation )
+{
+    VIO_cache_block_struct   **head, **tail;
+
+    block->probation_flag = (VIO_SCHAR) probation;
+
+    if( probation )
+    {
+        head = &shard->probation_head;
+        tail = &shard->probation_tail;
+        ++shard->n_probation;
+    }
+    else
+    {
+        head = &shard->head;
+        tail = &shard->tail;
+    }
+
+    block->prev_used = NULL;
+    block->next_used = *head;
+
+    if( *head == NULL )
+        *tail = block;
+    else
+        (*head)->prev_used = block;
+
+    *head = block;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : choose_cache_block_to_evict
+@INPUT      : cache
+              shard
+@OUTPUT     :
+@RETURNS    : block to evict
+@DESCRIPTION: Picks the block of a full shard to evict, according to the
+              eviction policy of the cache.
+@METHOD     : LRU takes the tail of the used list.  CLOCK sweeps from the
+              tail, giving each referenced block a second chance by moving
+              it back to the head.  2Q takes the oldest probation block while
+              probation holds more than a quarter of the shard, and the
+              least recently used block otherwise.
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_cache_block_struct  *choose_cache_block_to_evict(
+    VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard )
+{
+    VIO_cache_block_struct  *block;
+
+    switch( cache->eviction_policy )
+    {
+    case CLOCK_CACHE_EVICTION:
+        while( shard->tail->referenced_flag && shard->tail != shard->head )
+        {
+            block = shard->tail;
+            block->referenced_flag = FALSE;
+            remove_cache_block_from_list( shard, block );
+            insert_cache_block_in_list( shard, block, FALSE );
+        }
+        block = shard->tail;
+        break;
+
+    case TWO_QUEUE_CACHE_EVICTION:
+        if( shard->tail == NULL ||
+            (shard->probation_tail != NULL &&
+             4 * shard->n_probation > shard->max_blocks) )
+            block = shard->probation_tail;
+        else
+            block = shard->tail;
+        break;
+
+    case LRU_CACHE_EVICTION:
+    default:
+        block = shard->tail;
+        break;
+    }
+
+    return( block );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : remove_compressed_block
+@INPUT      : shard
+              compressed
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Takes a block out of the compressed tier of a shard and frees
+              it.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  remove_compressed_block(
+    VIO_cache_shard_struct       *shard,
+    VIO_compressed_block_struct  *compressed )
+{
+    get_block_table_entry( shard, compressed->block_index )->compressed = NULL;
+
+    if( compressed->prev_used == NULL )
+        shard->compressed_head = compressed->next_used;
+    else
+        compressed->prev_used->next_used = compressed->next_used;
+
+    if( compressed->next_used == NULL )
+        shard->compressed_tail = compressed->prev_used;
+    else
+        compressed->next_used->prev_used = compressed->prev_used;
+
+    shard->compressed_bytes -= compressed->n_bytes;
+
+    FREE( compressed->data );
+    FREE( compressed );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_compressed_blocks
+@INPUT      : shard
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Empties the compressed tier of a shard.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  delete_compressed_blocks(
+    VIO_cache_shard_struct   *shard )
+{
+    while( shard->compressed_head != NULL )
+        remove_compressed_block( shard, shard->compressed_head );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : store_compressed_block
+@INPUT      : cache
+              shard
+              block
+              entry    - block table entry of the block
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Places a compressed copy of a clean block being evicted in the
+              compressed tier, evicting the least recently stored blocks of
+              the tier to make room.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  store_compressed_block(
+    VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard,
+    VIO_cache_block_struct   *block,
+    VIO_cache_table_entry    *entry )
+{
+    VIO_compressed_block_struct  *compressed;
+    unsigned char                *voxels, *source;
+    size_t                       n_voxels, type_size, n_bytes, v, b;
+    VIO_BOOL                     is_compressed;
+
+    type_size = (size_t) get_type_size( get_multidim_data_type(&block->array) );
+    n_voxels = cache->total_block_size;
+    n_bytes = n_voxels * type_size;
+
+    if( n_bytes > shard->max_compressed_bytes || n_bytes > (size_t) UINT_MAX )
+        return;
+
+    GET_MULTIDIM_PTR( voxels, block->array, 0, 0, 0, 0, 0 );
+
+    if( !shard->streams_initialized )
+    {
+        shard->deflater.zalloc = Z_NULL;
+        shard->deflater.zfree = Z_NULL;
+        shard->deflater.opaque = Z_NULL;
+        shard->inflater.zalloc = Z_NULL;
+        shard->inflater.zfree = Z_NULL;
+        shard->inflater.opaque = Z_NULL;
+        shard->inflater.next_in = Z_NULL;
+        shard->inflater.avail_in = 0;
+
+        if( deflateInit2( &shard->deflater, 1, Z_DEFLATED, 15, 8,
+                          Z_RLE ) != Z_OK )
+            return;
+
+        if( inflateInit( &shard->inflater ) != Z_OK )
+        {
+            (void) deflateEnd( &shard->deflater );
+            return;
+        }
+
+        ALLOC( shard->shuffled, n_bytes );
+        ALLOC( shard->packed, n_bytes );
+        shard->streams_initialized = TRUE;
+    }
+
+    /*--- gather byte b of every voxel together */
+
+    if( type_size > 1 )
+    {
+        for_less( v, 0, n_voxels )
+            for_less( b, 0, type_size )
+                shard->shuffled[b * n_voxels + v] = voxels[v * type_size + b];
+        source = shard->shuffled;
+    }
+    else
+        source = voxels;
+
+    /*--- deflate into a buffer the size of the block, keeping the block
+          as it is if it does not fit */
+
+    (void) deflateReset( &shard->deflater );
+    shard->deflater.next_in = source;
+    shard->deflater.avail_in = (uInt) n_bytes;
+    shard->deflater.next_out = shard->packed;
+    shard->deflater.avail_out = (uInt) n_bytes;
+
+    is_compressed = deflate( &shard->deflater, Z_FINISH ) == Z_STREAM_END;
+
+    if( is_compressed )
+    {
+        n_bytes = (size_t) shard->deflater.total_out;
+        source = shard->packed;
+    }
+    else
+        source = voxels;
+
+    /*--- make room in the tier */
+
+    while( shard->compressed_tail != NULL &&
+           shard->compressed_bytes + n_bytes > shard->max_compressed_bytes )
+        remove_compressed_block( shard, shard->compressed_tail );
+
+    ALLOC( compressed, 1 );
+    ALLOC( compressed->data, n_bytes );
+    (void) memcpy( compressed->data, source, n_bytes );
+
+    compressed->block_index = block->block_index;
+    compressed->is_compressed = is_compressed;
+    compressed->n_bytes = n_bytes;
+
+    compressed->prev_used = NULL;
+    compressed->next_used = shard->compressed_head;
+    if( shard->compressed_head == NULL )
+        shard->compressed_tail = compressed;
+    else
+        shard->compressed_head->prev_used = compressed;
+    shard->compressed_head = compressed;
+
+    shard->compressed_bytes += n_bytes;
+    entry->compressed = compressed;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : restore_compressed_block
+@INPUT      : cache
+              shard
+              entry    - block table entry of the block
+@OUTPUT     : block
+@RETURNS    :
+@DESCRIPTION: Fills a block from its copy in the compressed tier, and takes
+              the copy out of the tier.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  restore_compressed_block(
+    VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard,
+    VIO_cache_block_struct   *block,
+    VIO_cache_table_entry    *entry )
+{
+    VIO_compressed_block_struct  *compressed;
+    unsigned char                *voxels;
+    size_t                       n_voxels, type_size, n_bytes, v, b;
+
+    compressed = entry->compressed;
+
+    type_size = (size_t) get_type_size( get_multidim_data_type(&block->array) );
+    n_voxels = cache->total_block_size;
+    n_bytes = n_voxels * type_size;
+
+    GET_MULTIDIM_PTR( voxels, block->array, 0, 0, 0, 0, 0 );
+
+    if( !compressed->is_compressed )
+        (void) memcpy( voxels, compressed->data, n_bytes );
+    else
     {
-        ind = minc_file->to_volume_index[dim];
-        if( ind >= 0 )
+        (void) inflateReset( &shard->inflater );
+        shard->inflater.next_in = compressed->data;
+        shard->inflater.avail_in = (uInt) compressed->n_bytes;
+        shard->inflater.next_out = (type_size > 1) ? shard->shuffled : voxels;
+        shard->inflater.avail_out = (uInt) n_bytes;
+
+        if( inflate( &shard->inflater, Z_FINISH ) != Z_STREAM_END )
         {
-            file_start[dim] = cache->file_offset[dim] + block_start[ind];
-            file_count[dim] = MIN( sizes[ind] - file_start[dim],
-                                   cache->block_sizes[ind] );
+            handle_internal_error( "restore_compressed_block" );
         }
-        else
+
+        if( type_size > 1 )
         {
-            file_start[dim] = cache->file_offset[dim];
-            file_count[dim] = 0;
+            for_less( v, 0, n_voxels )
+                for_less( b, 0, type_size )
+                    voxels[v * type_size + b] =
+                                     shard->shuffled[b * n_voxels + v];
         }
     }
 
-    n_dims = cache->n_dimensions;
-    GET_MULTIDIM_PTR( array_data_ptr, block->array, 0, 0, 0, 0, 0 );
+    ++shard->n_compressed_hits;
 
-#ifdef HAVE_MINC1
-    input_minc_hyperslab( (Minc_file) cache->minc_file,
-                                 get_multidim_data_type(&block->array),
-                                 n_dims, cache->block_sizes, array_data_ptr,
-                                 minc_file->to_volume_index,
-                                 file_start, file_count );
-#elif defined HAVE_MINC2
-    /*TODO: call minc2 api ?*/
-#endif
+    remove_compressed_block( shard, compressed );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : appropriate_a_cache_block
 @INPUT      : cache
+              shard
               volume
 @OUTPUT     : block
 @RETURNS    :
-@DESCRIPTION: Finds an available cache block, either by allocating one, or
-              stealing the least recently used one.
+@DESCRIPTION: Finds an available cache block for the shard, either by
+              allocating one, or stealing the one chosen by the eviction
+              policy.  The block is not on any list on return.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -1131,96 +2651,75 @@ static  void  read_cache_block(
 
 static  VIO_cache_block_struct  *appropriate_a_cache_block(
     VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard,
     VIO_Volume               volume )
 {
     VIO_cache_block_struct  *block;
+    VIO_cache_table_entry   *entry;
+    int                     block_size;
 
     /*--- if can allocate more blocks, do so */
 
-    if( cache->n_blocks < cache->max_blocks )
+    if( shard->n_blocks < shard->max_blocks )
     {
         ALLOC( block, 1 );
 
-        create_multidim_array( &block->array, 1, &cache->total_block_size,
+        block_size = (int) cache->total_block_size;
+        create_multidim_array( &block->array, 1, &block_size,
                                get_volume_data_type(volume) );
 
-        ++cache->n_blocks;
+        ++shard->n_blocks;
     }
-    else  /*--- otherwise, steal the least-recently used block */
+    else  /*--- otherwise, steal a block */
     {
-        block = cache->tail;
+        block = choose_cache_block_to_evict( cache, shard );
 
         if( block->modified_flag )
             write_cache_block( cache, volume, block );
 
+        ++shard->n_evictions;
+
         /*--- remove from used list */
 
-        if( block->prev_used == NULL )
-            cache->head = block->next_used;
-        else
-            block->prev_used->next_used = block->next_used;
+        remove_cache_block_from_list( shard, block );
 
-        if( block->next_used == NULL )
-            cache->tail = block->prev_used;
-        else
-            block->next_used->prev_used = block->prev_used;
+        /*--- remove from block table, keeping a compressed copy if there
+              is a second tier */
+
+        entry = get_block_table_entry( shard, block->block_index );
+        entry->block = NULL;
 
-        /*--- remove from hash table */
+        if( shard->max_compressed_bytes > 0 )
+            store_compressed_block( cache, shard, block, entry );
 
-        *block->prev_hash = block->next_hash;
-        if( block->next_hash != NULL )
-            block->next_hash->prev_hash = block->prev_hash;
+        if( block == shard->previous_block )
+        {
+            shard->previous_block = NULL;
+            shard->previous_block_index = -1;
+        }
     }
 
     block->modified_flag = FALSE;
+    block->prefetched_flag = FALSE;
+    block->referenced_flag = FALSE;
 
     return( block );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : hash_block_index
-@INPUT      : key
-              table_size
-@OUTPUT     :
-@RETURNS    : hash address
-@DESCRIPTION: Hashes a block index key into a table index, using
-              multiplicative hashing.
-@METHOD     :
-@GLOBALS    :
-@CALLS      :
-@CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   :
----------------------------------------------------------------------------- */
-
-static  int  hash_block_index(
-    int  key,
-    int  table_size )
-{
-    int    index;
-    VIO_Real   v;
-
-    v = (VIO_Real) key * HASH_FUNCTION_CONSTANT;
-
-    index = (int) (( v - (VIO_Real) ((int) v)) * (VIO_Real) table_size);
-
-    return( index );
-}
-
-/* ----------------------------- MNI Header -----------------------------------
-@NAME       : get_cache_block_for_voxel
-@INPUT      : volume
+@NAME       : get_cache_block_index
+@INPUT      : cache
               x
               y
               z
               t
               v
 @OUTPUT     : offset
-@RETURNS    : pointer to cache block
-@DESCRIPTION: Finds the cache block corresponding to a given voxel, and
-              modifies the voxel indices to be block indices.  This function
-              gets called for every set or get voxel value, so it must be
-              efficient.  On return, offset contains the integer offset
-              of the voxel within the cache block.
+@RETURNS    : index of the cache block
+@DESCRIPTION: Finds the index of the cache block containing a given voxel.
+              On return, offset contains the integer offset of the voxel
+              within the cache block.  This only reads tables which do not
+              change while the cache is in use, so needs no lock.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -1228,8 +2727,8 @@ static  int  hash_block_index(
 @MODIFIED   :
 ---------------------------------------------------------------------------- */
 
-static  VIO_cache_block_struct  *get_cache_block_for_voxel(
-    VIO_Volume   volume,
+static  long  get_cache_block_index(
+    VIO_volume_cache_struct  *cache,
     int      x,
     int      y,
     int      z,
@@ -1237,17 +2736,10 @@ static  VIO_cache_block_struct  *get_cache_block_for_voxel(
     int      v,
     int      *offset )
 {
-    VIO_cache_block_struct   *block;
     VIO_cache_lookup_struct  *lookup0, *lookup1, *lookup2, *lookup3, *lookup4;
-    int                  block_index;
-    int                  block_start[VIO_MAX_DIMENSIONS];
-    int                  n_dims, hash_index;
-    VIO_volume_cache_struct  *cache;
+    long                     block_index;
 
-    cache = &volume->cache;
-    n_dims = cache->n_dimensions;
-
-    switch( n_dims )
+    switch( cache->n_dimensions )
     {
     case 1:
         lookup0 = &cache->lookup[0][x];
@@ -1292,6 +2784,7 @@ static  VIO_cache_block_struct  *get_cache_block_for_voxel(
         break;
 
     case 5:
+    default:
         lookup0 = &cache->lookup[0][x];
         lookup1 = &cache->lookup[1][y];
         lookup2 = &cache->lookup[2][z];
@@ -1310,118 +2803,395 @@ static  VIO_cache_block_struct  *get_cache_block_for_voxel(
         break;
     }
 
-    /*--- if this is the same as the last access, just return the last
-          block accessed */
+    return( block_index );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_cache_shard
+@INPUT      : cache
+              block_index
+@OUTPUT     :
+@RETURNS    : shard holding the block
+@DESCRIPTION: Returns the shard responsible for a block.  Neighbouring blocks
+              go to different shards, so that threads working on nearby
+              parts of the volume rarely wait for each other.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_cache_shard_struct  *get_cache_shard(
+    VIO_volume_cache_struct  *cache,
+    long                     block_index )
+{
+    return( &cache->shards[block_index & (long) (cache->n_shards - 1)] );
+}
 
-    if( block_index == cache->previous_block_index )
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : load_cache_block
+@INPUT      : cache
+              shard
+              volume
+              block_index
+              entry
+@OUTPUT     :
+@RETURNS    : pointer to cache block
+@DESCRIPTION: Brings a block which is not in the cache into the shard,
+              reading it from the file if needed, and places it in the
+              block table entry and on the used or probation list.  The
+              caller must hold the lock of the shard.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_cache_block_struct  *load_cache_block(
+    VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard,
+    VIO_Volume               volume,
+    long                     block_index,
+    VIO_cache_table_entry    *entry )
+{
+    VIO_cache_block_struct   *block;
+    int                      block_start[VIO_MAX_DIMENSIONS];
+
+    /*--- find a block to use */
+
+    block = appropriate_a_cache_block( cache, shard, volume );
+    block->block_index = block_index;
+
+    /*--- initialize the block from its compressed copy if there is one,
+          which evicting a block above may have dropped, otherwise from
+          the file if needed */
+
+    if( entry->compressed != NULL )
+        restore_compressed_block( cache, shard, block, entry );
+    else if( cache->must_read_blocks_before_use )
     {
-#ifdef  CACHE_DEBUGGING
-        record_cache_prev_hit( cache );
-#endif
-        return( cache->previous_block );
+        get_block_start( cache, block_index, block_start );
+        read_cache_block( cache, volume, block, block_start );
     }
 
-    /*--- search the hash table for the block index */
+    /*--- insert the block in the block table */
+
+    entry->block = block;
+
+    /*--- insert the block at the head of the used list, or of the
+          probation list for 2Q */
+
+    insert_cache_block_in_list( shard, block,
+                     cache->eviction_policy == TWO_QUEUE_CACHE_EVICTION );
+
+    return( block );
+}
+
+#ifdef HAVE_PTHREAD
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : prefetch_cache_blocks
+@INPUT      : data   - the cache
+@OUTPUT     :
+@RETURNS    : NULL
+@DESCRIPTION: Body of the prefetch thread.  Reads the queued blocks into
+              the cache, until asked to stop.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  *prefetch_cache_blocks(
+    void   *data )
+{
+    VIO_volume_cache_struct  *cache;
+    VIO_cache_shared_struct  *shared;
+    VIO_cache_shard_struct   *shard;
+    VIO_cache_block_struct   *block;
+    VIO_cache_table_entry    *entry;
+    long                     block_index;
 
-    hash_index = hash_block_index( block_index, cache->hash_table_size );
+    cache = (VIO_volume_cache_struct *) data;
+    shared = cache->shared;
 
-    block = cache->hash_table[hash_index];
+    LOCK_CACHE( shared->prefetch_lock );
 
-    while( block != NULL && block->block_index != block_index )
+    for( ;; )
     {
-        block = block->next_hash;
+        while( !shared->prefetch_stopping &&
+               shared->queue_start >= shared->n_queued )
+        {
+            pthread_cond_wait( &shared->prefetch_wanted,
+                               &shared->prefetch_lock );
+        }
+
+        if( shared->prefetch_stopping )
+            break;
+
+        block_index = shared->prefetch_queue[shared->queue_start];
+        ++shared->queue_start;
+
+        UNLOCK_CACHE( shared->prefetch_lock );
+
+        shard = get_cache_shard( cache, block_index );
+
+        LOCK_CACHE( shard->lock );
+
+        entry = get_block_table_entry( shard, block_index );
+        block = NULL;
+
+        if( entry->block == NULL && cache->must_read_blocks_before_use )
+        {
+            block = load_cache_block( cache, shard, shared->volume,
+                                      block_index, entry );
+            block->prefetched_flag = TRUE;
+        }
+
+        UNLOCK_CACHE( shard->lock );
+
+        LOCK_CACHE( shared->prefetch_lock );
+
+        if( block != NULL )
+            ++shared->n_prefetched;
     }
 
-    /*--- check if it was found in the hash table */
+    UNLOCK_CACHE( shared->prefetch_lock );
+
+    return( NULL );
+}
 
-    if( block == NULL )
-    {
-#ifdef  CACHE_DEBUGGING
-        record_cache_no_hit( cache );
 #endif
 
-        /*--- find a block to use */
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : record_cache_block_access
+@INPUT      : cache
+              block_index
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Records a block that had to be read, or that was read ahead
+              and is now used.  If the last three such blocks are a
+              constant stride apart, the next prefetch_blocks blocks along
+              that stride are queued for the prefetch thread, replacing
+              any older requests.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  record_cache_block_access(
+    VIO_volume_cache_struct  *cache,
+    long                     block_index )
+{
+#ifdef HAVE_PTHREAD
+    VIO_cache_shared_struct  *shared;
+    long                     stride, next;
+    int                      n_wanted;
+
+    shared = cache->shared;
+
+    LOCK_CACHE( shared->prefetch_lock );
+
+    stride = block_index - shared->last_miss;
+
+    if( shared->last_miss >= 0 && stride != 0 &&
+        stride == shared->last_stride )
+        ++shared->n_strided_misses;
+    else
+        shared->n_strided_misses = 0;
+
+    shared->last_stride = stride;
+    shared->last_miss = block_index;
 
-        block = appropriate_a_cache_block( cache, volume );
-        block->block_index = block_index;
+    if( shared->n_strided_misses > 0 && !shared->prefetch_stopping )
+    {
+        /*--- do not read so far ahead that the blocks are evicted again
+              before being used */
 
-        /*--- check if the block must be initialized from a file */
+        n_wanted = cache->prefetch_blocks;
+        if( (size_t) n_wanted > cache->max_blocks / 2 )
+            n_wanted = (int) (cache->max_blocks / 2);
 
-        if( cache->must_read_blocks_before_use )
+        if( n_wanted > shared->queue_size )
         {
-            get_block_start( cache, block_index, block_start );
-            read_cache_block( cache, volume, block, block_start );
+            SET_ARRAY_SIZE( shared->prefetch_queue, shared->queue_size,
+                            n_wanted, 1 );
+            shared->queue_size = n_wanted;
         }
 
-        /*--- insert the block in cache hash table */
+        shared->queue_start = 0;
+        shared->n_queued = 0;
 
-        block->next_hash = cache->hash_table[hash_index];
-        if( block->next_hash != NULL )
-            block->next_hash->prev_hash = &block->next_hash;
-        block->prev_hash = &cache->hash_table[hash_index];
-        *block->prev_hash = block;
+        next = block_index + stride;
+        while( shared->n_queued < n_wanted && next >= 0 &&
+               next < (long) cache->n_volume_blocks )
+        {
+            shared->prefetch_queue[shared->n_queued] = next;
+            ++shared->n_queued;
+            next += stride;
+        }
 
-        /*--- insert the block at the head of the used list */
+        if( shared->n_queued > 0 )
+        {
+            if( !shared->prefetch_thread_running )
+            {
+                shared->prefetch_thread_running =
+                        pthread_create( &shared->prefetch_thread, NULL,
+                                        prefetch_cache_blocks, cache ) == 0;
+            }
+
+            pthread_cond_signal( &shared->prefetch_wanted );
+        }
+    }
 
-        block->prev_used = NULL;
-        block->next_used = cache->head;
+    UNLOCK_CACHE( shared->prefetch_lock );
+#endif
+}
 
-        if( cache->head == NULL )
-            cache->tail = block;
-        else
-            cache->head->prev_used = block;
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : stop_cache_prefetching
+@INPUT      : cache
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Stops the prefetch thread, if any, dropping the queued
+              blocks.  Must not be called while holding a shard lock.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  stop_cache_prefetching(
+    VIO_volume_cache_struct   *cache )
+{
+#ifdef HAVE_PTHREAD
+    VIO_cache_shared_struct  *shared;
+
+    shared = cache->shared;
+
+    if( shared == NULL || !shared->prefetch_thread_running )
+        return;
+
+    LOCK_CACHE( shared->prefetch_lock );
+    shared->prefetch_stopping = TRUE;
+    pthread_cond_signal( &shared->prefetch_wanted );
+    UNLOCK_CACHE( shared->prefetch_lock );
+
+    (void) pthread_join( shared->prefetch_thread, NULL );
+
+    shared->prefetch_thread_running = FALSE;
+    shared->prefetch_stopping = FALSE;
+    shared->queue_start = 0;
+    shared->n_queued = 0;
+    shared->last_miss = -1;
+    shared->n_strided_misses = 0;
+#endif
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_cache_block
+@INPUT      : cache
+              shard
+              volume
+              block_index
+@OUTPUT     :
+@RETURNS    : pointer to cache block
+@DESCRIPTION: Finds the cache block with the given index, reading it in if
+              it is not in the cache.  This gets called for every set or get
+              voxel value, so it must be efficient.  The caller must hold
+              the lock of the shard, and keep it while using the block.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  VIO_cache_block_struct  *get_cache_block(
+    VIO_volume_cache_struct  *cache,
+    VIO_cache_shard_struct   *shard,
+    VIO_Volume               volume,
+    long                     block_index )
+{
+    VIO_cache_block_struct   *block;
+    VIO_cache_table_entry    *entry;
+
+    /*--- if this is the same as the last access, just return the last
+          block accessed */
 
-        cache->head = block;
+    if( block_index == shard->previous_block_index )
+    {
+#ifdef  CACHE_DEBUGGING
+        record_cache_prev_hit( cache );
+#endif
+        ++shard->n_previous_block_hits;
+        return( shard->previous_block );
     }
-    else   /*--- block was found in hash table */
+
+    /*--- look up the block index in the block table */
+
+    entry = get_block_table_entry( shard, block_index );
+
+    block = entry->block;
+
+    if( block == NULL )
     {
 #ifdef  CACHE_DEBUGGING
-        record_cache_hit( cache );
+        record_cache_no_hit( cache );
 #endif
 
-        /*--- move block to head of used list */
+        ++shard->n_misses;
 
-        if( block != cache->head )
-        {
-            block->prev_used->next_used = block->next_used;
-            if( block->next_used != NULL )
-                block->next_used->prev_used = block->prev_used;
-            else
-                cache->tail = block->prev_used;
+        block = load_cache_block( cache, shard, volume, block_index, entry );
+        block->referenced_flag = TRUE;
 
-            cache->head->prev_used = block;
-            block->prev_used = NULL;
-            block->next_used = cache->head;
-            cache->head = block;
-        }
+        if( cache->prefetch_blocks > 0 && cache->must_read_blocks_before_use )
+            record_cache_block_access( cache, block_index );
+    }
+    else   /*--- block was found in the block table */
+    {
+#ifdef  CACHE_DEBUGGING
+        record_cache_hit( cache );
+#endif
+        ++shard->n_hits;
 
-        /*--- move block to beginning of hash chain, so if next access to
-              this block, we will save some time */
+        /*--- the first use of a block read ahead counts like a miss for
+              detecting the access pattern, so that reading ahead goes on */
 
-        if( cache->hash_table[hash_index] != block )
+        if( block->prefetched_flag )
         {
-            /*--- remove it from where it is */
+            block->prefetched_flag = FALSE;
+            ++shard->n_useful_prefetches;
 
-            *block->prev_hash = block->next_hash;
-            if( block->next_hash != NULL )
-                block->next_hash->prev_hash = block->prev_hash;
+            if( cache->prefetch_blocks > 0 )
+                record_cache_block_access( cache, block_index );
+        }
 
-            /*--- place it at the front of the list */
+        /*--- CLOCK only marks the block as used, while LRU and 2Q move it
+              to the head of the used list, which for 2Q takes a block on
+              probation out of it */
 
-            block->next_hash = cache->hash_table[hash_index];
-            if( block->next_hash != NULL )
-                block->next_hash->prev_hash = &block->next_hash;
-            block->prev_hash = &cache->hash_table[hash_index];
-            *block->prev_hash = block;
+        if( cache->eviction_policy == CLOCK_CACHE_EVICTION )
+            block->referenced_flag = TRUE;
+        else if( block != shard->head )
+        {
+            remove_cache_block_from_list( shard, block );
+            insert_cache_block_in_list( shard, block, FALSE );
         }
     }
 
     /*--- record so if next access is to same block, we save some time */
 
-    cache->previous_block = block;
-    cache->previous_block_index = block_index;
+    shard->previous_block = block;
+    shard->previous_block_index = block_index;
 
-    return( cache->previous_block );
+    return( block );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -1435,6 +3205,7 @@ static  VIO_cache_block_struct  *get_cache_block_for_voxel(
 @OUTPUT     :
 @RETURNS    : voxel value
 @DESCRIPTION: Finds the voxel value for the given voxel in a cached volume.
+              May be called from several threads at once.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -1450,20 +3221,64 @@ VIOAPI  VIO_Real  get_cached_volume_voxel(
     int      t,
     int      v )
 {
-    int                  offset;
+    int                      offset;
+    long                     block_index;
     VIO_Real                 value;
+    VIO_volume_cache_struct  *cache;
+    VIO_cache_shard_struct   *shard;
     VIO_cache_block_struct   *block;
 
-    if( volume->cache.minc_file == NULL )
+    cache = &volume->cache;
+
+    if( cache->minc_file == NULL )
         return( get_volume_voxel_min( volume ) );
 
-    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset );
+    block_index = get_cache_block_index( cache, x, y, z, t, v, &offset );
+    shard = get_cache_shard( cache, block_index );
+
+    LOCK_CACHE( shard->lock );
+
+    block = get_cache_block( cache, shard, volume, block_index );
 
     GET_MULTIDIM_1D( value, (VIO_Real), block->array, offset );
 
+    UNLOCK_CACHE( shard->lock );
+
     return( value );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : lock_cache_shards
+@INPUT      : cache
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Takes the locks of all the shards, in order, so that no other
+              thread can use the cache until unlock_cache_shards() is called.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  lock_cache_shards(
+    VIO_volume_cache_struct  *cache )
+{
+    int   s;
+
+    for_less( s, 0, cache->n_shards )
+        LOCK_CACHE( cache->shards[s].lock );
+}
+
+static  void  unlock_cache_shards(
+    VIO_volume_cache_struct  *cache )
+{
+    int   s;
+
+    for_down( s, cache->n_shards - 1, 0 )
+        UNLOCK_CACHE( cache->shards[s].lock );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : set_cached_volume_voxel
 @INPUT      : volume
@@ -1476,6 +3291,7 @@ VIOAPI  VIO_Real  get_cached_volume_voxel(
 @OUTPUT     :
 @RETURNS    :
 @DESCRIPTION: Sets the voxel value for the given voxel in a cached volume.
+              May be called from several threads at once.
 @METHOD     :
 @GLOBALS    :
 @CALLS      :
@@ -1492,20 +3308,43 @@ VIOAPI  void  set_cached_volume_voxel(
     int      v,
     VIO_Real     value )
 {
-    int                  offset;
+    int                      offset;
+    long                     block_index;
+    VIO_volume_cache_struct  *cache;
+    VIO_cache_shard_struct   *shard;
     VIO_cache_block_struct   *block;
 
-    if( !volume->cache.output_file_is_open )
+    cache = &volume->cache;
+
+    /*--- the first modification moves the volume to an output file, which
+          reads the whole volume through the cache, so stop other threads
+          from using the cache meanwhile */
+
+    if( !cache->output_file_is_open )
     {
-        (void) open_cache_volume_output_file( &volume->cache, volume );
-        volume->cache.output_file_is_open = TRUE;
+        lock_cache_shards( cache );
+
+        if( !cache->output_file_is_open )
+        {
+            (void) open_cache_volume_output_file( cache, volume );
+            cache->output_file_is_open = TRUE;
+        }
+
+        unlock_cache_shards( cache );
     }
 
-    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset );
+    block_index = get_cache_block_index( cache, x, y, z, t, v, &offset );
+    shard = get_cache_shard( cache, block_index );
+
+    LOCK_CACHE( shard->lock );
+
+    block = get_cache_block( cache, shard, volume, block_index );
 
     block->modified_flag = TRUE;
 
     SET_MULTIDIM_1D( block->array, offset, value );
+
+    UNLOCK_CACHE( shard->lock );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -33,6 +33,9 @@ static  VIO_STR  default_dimension_names[VIO_MAX_DIMENSIONS][VIO_MAX_DIMENSIONS]
     { "", "", MIzspace, MIyspace, MIxspace }
 };
 
+static  void  update_world_matrices(
+    VIO_Volume  volume );
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_default_dim_names
 @INPUT      : n_dimensions
@@ -210,12 +213,18 @@ VIOAPI   VIO_Volume   create_volume(
 
     create_empty_multidim_array( &volume->array, n_dimensions, VIO_NO_DATA_TYPE );
 
+    volume->bspline_coefficient_type = VIO_NO_DATA_TYPE;
+    volume->bspline_coefficients_uptodate = FALSE;
+    create_empty_multidim_array( &volume->bspline_coefficients, n_dimensions,
+                                 VIO_NO_DATA_TYPE );
+
     set_volume_type( volume, nc_data_type, signed_flag, voxel_min, voxel_max );
     set_volume_sizes( volume, sizes );
 
     make_identity_transform( &identity );
     create_linear_transform( &volume->voxel_to_world_transform, &identity );
     volume->voxel_to_world_transform_uptodate = TRUE;
+    update_world_matrices( volume );
 
     volume->coordinate_system_name = create_string( MI_UNKNOWN_SPACE );
 
@@ -609,12 +618,13 @@ VIOAPI  VIO_BOOL  is_an_rgb_volume(
 VIOAPI  void  alloc_volume_data(
     VIO_Volume   volume )
 {
-#ifdef HAVE_MINC1
     unsigned long   data_size;
 
     data_size = (unsigned long) get_volume_total_n_voxels( volume ) *
                 (unsigned long) get_type_size( get_volume_data_type( volume ) );
 
+    volume->bspline_coefficients_uptodate = FALSE;
+
 	if( get_n_bytes_cache_threshold() >= 0 &&
         data_size > (unsigned long) get_n_bytes_cache_threshold() )
     {
@@ -623,12 +633,9 @@ VIOAPI  void  alloc_volume_data(
     }
     else
     {
-#endif /*HAVE_MINC1*/
         volume->is_cached_volume = FALSE;
         alloc_multidim_array( &volume->array );
-#ifdef HAVE_MINC1
     }
-#endif /*HAVE_MINC1*/
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -647,12 +654,8 @@ VIOAPI  void  alloc_volume_data(
 VIOAPI  VIO_BOOL  volume_is_alloced(
     VIO_Volume   volume )
 {
-#ifdef HAVE_MINC1
     return  ( volume->is_cached_volume && volume_cache_is_alloced( &volume->cache )) ||
             (!volume->is_cached_volume && multidim_array_is_alloced( &volume->array )) ;
-#else
-    return  multidim_array_is_alloced( &volume->array ) ;
-#endif
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -671,13 +674,14 @@ VIOAPI  VIO_BOOL  volume_is_alloced(
 VIOAPI  void  free_volume_data(
     VIO_Volume   volume )
 {
-#ifdef HAVE_MINC1
     if( volume->is_cached_volume )
         delete_volume_cache( &volume->cache, volume );
-    else
-#endif
-      if( volume_is_alloced( volume ) )
+    else if( volume_is_alloced( volume ) )
         delete_multidim_array( &volume->array );
+
+    if( multidim_array_is_alloced( &volume->bspline_coefficients ) )
+        delete_multidim_array( &volume->bspline_coefficients );
+    volume->bspline_coefficients_uptodate = FALSE;
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -842,6 +846,55 @@ VIOAPI  size_t  get_volume_total_n_voxels(
     return( n );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : update_world_matrices
+@INPUT      : volume
+@OUTPUT     :
+@RETURNS    :
+@DESCRIPTION: Copies the volume's voxel to world transform and its inverse
+              into plain matrices, which the coordinate conversions apply
+              directly, if the transform is affine.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+static  void  update_world_matrices(
+    VIO_Volume  volume )
+{
+    int            i, j;
+    VIO_Transform  *forward, *inverse;
+
+    volume->world_matrices_valid = FALSE;
+
+    if( get_transform_type( &volume->voxel_to_world_transform ) != LINEAR )
+        return;
+
+    forward = get_linear_transform_ptr( &volume->voxel_to_world_transform );
+    inverse = get_inverse_linear_transform_ptr(
+                                        &volume->voxel_to_world_transform );
+
+    /*--- a projective transform needs the division by w */
+
+    for_less( i, 0, 4 )
+    {
+        if( Transform_elem(*forward,3,i) != (i == 3 ? 1.0 : 0.0) ||
+            Transform_elem(*inverse,3,i) != (i == 3 ? 1.0 : 0.0) )
+            return;
+    }
+
+    for_less( i, 0, 4 )
+    for_less( j, 0, 4 )
+    {
+        volume->voxel_to_world_matrix[i][j] = Transform_elem(*forward,i,j);
+        volume->world_to_voxel_matrix[i][j] = Transform_elem(*inverse,i,j);
+    }
+
+    volume->world_matrices_valid = TRUE;
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : assign_voxel_to_world_transform
 @INPUT      : volume
@@ -864,6 +917,8 @@ static  void  assign_voxel_to_world_transform(
     delete_general_transform( &volume->voxel_to_world_transform );
 
     volume->voxel_to_world_transform = *transform;
+
+    update_world_matrices( volume );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -2034,9 +2089,21 @@ VIOAPI  void  convert_voxel_to_world(
 
     /* apply linear transform */
 
-    general_transform_point( &volume->voxel_to_world_transform,
-                             xyz[VIO_X], xyz[VIO_Y], xyz[VIO_Z],
-                             x_world, y_world, z_world );
+    if( volume->world_matrices_valid )
+    {
+        VIO_Real  (*m)[4] = volume->voxel_to_world_matrix;
+
+        *x_world = m[0][0] * xyz[VIO_X] + m[0][1] * xyz[VIO_Y] +
+                   m[0][2] * xyz[VIO_Z] + m[0][3];
+        *y_world = m[1][0] * xyz[VIO_X] + m[1][1] * xyz[VIO_Y] +
+                   m[1][2] * xyz[VIO_Z] + m[1][3];
+        *z_world = m[2][0] * xyz[VIO_X] + m[2][1] * xyz[VIO_Y] +
+                   m[2][2] * xyz[VIO_Z] + m[2][3];
+    }
+    else
+        general_transform_point( &volume->voxel_to_world_transform,
+                                 xyz[VIO_X], xyz[VIO_Y], xyz[VIO_Z],
+                                 x_world, y_world, z_world );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -2222,9 +2289,21 @@ VIOAPI  void  convert_world_to_voxel(
 
     check_recompute_world_transform( volume );
 
-    general_inverse_transform_point( &volume->voxel_to_world_transform,
-                                     x_world, y_world, z_world,
-                                     &xyz[VIO_X], &xyz[VIO_Y], &xyz[VIO_Z] );
+    if( volume->world_matrices_valid )
+    {
+        VIO_Real  (*m)[4] = volume->world_to_voxel_matrix;
+
+        xyz[VIO_X] = m[0][0] * x_world + m[0][1] * y_world +
+                     m[0][2] * z_world + m[0][3];
+        xyz[VIO_Y] = m[1][0] * x_world + m[1][1] * y_world +
+                     m[1][2] * z_world + m[1][3];
+        xyz[VIO_Z] = m[2][0] * x_world + m[2][1] * y_world +
+                     m[2][2] * z_world + m[2][3];
+    }
+    else
+        general_inverse_transform_point( &volume->voxel_to_world_transform,
+                                         x_world, y_world, z_world,
+                                         &xyz[VIO_X], &xyz[VIO_Y], &xyz[VIO_Z] );
 
     reorder_xyz_to_voxel( volume, xyz, voxel );
 }
@@ -2272,6 +2351,124 @@ VIOAPI  void  convert_3D_world_to_voxel(
     *voxel3 = voxel[VIO_Z];
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : convert_voxel_to_world_points
+@INPUT      : volume
+              n_points
+              voxels
+@OUTPUT     : world
+@RETURNS    :
+@DESCRIPTION: Converts many voxel positions to world coordinates, giving the
+              same results as convert_voxel_to_world() on each.  If the
+              volume has 3 spatial axes and an affine transform, the cached
+              matrix is applied in one loop over the points.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  convert_voxel_to_world_points(
+    VIO_Volume   volume,
+    int          n_points,
+    VIO_Real     voxels[][VIO_MAX_DIMENSIONS],
+    VIO_Real     world[][VIO_N_DIMENSIONS] )
+{
+    int        p, a0, a1, a2;
+    VIO_Real   (*m)[4], x, y, z;
+
+    check_recompute_world_transform( volume );
+
+    a0 = volume->spatial_axes[VIO_X];
+    a1 = volume->spatial_axes[VIO_Y];
+    a2 = volume->spatial_axes[VIO_Z];
+
+    if( !volume->world_matrices_valid || a0 < 0 || a1 < 0 || a2 < 0 )
+    {
+        for_less( p, 0, n_points )
+        {
+            convert_voxel_to_world( volume, voxels[p], &world[p][VIO_X],
+                                    &world[p][VIO_Y], &world[p][VIO_Z] );
+        }
+        return;
+    }
+
+    m = volume->voxel_to_world_matrix;
+
+    for_less( p, 0, n_points )
+    {
+        x = voxels[p][a0];
+        y = voxels[p][a1];
+        z = voxels[p][a2];
+
+        world[p][VIO_X] = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+        world[p][VIO_Y] = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+        world[p][VIO_Z] = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+    }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : convert_world_to_voxel_points
+@INPUT      : volume
+              n_points
+              world
+@OUTPUT     : voxels
+@RETURNS    :
+@DESCRIPTION: Converts many world positions to voxel coordinates, giving the
+              same results as convert_world_to_voxel() on each.  If the
+              volume has 3 spatial axes and an affine transform, the cached
+              inverse matrix is applied in one loop over the points.
+@METHOD     :
+@GLOBALS    :
+@CALLS      :
+@CREATED    :
+@MODIFIED   :
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  convert_world_to_voxel_points(
+    VIO_Volume   volume,
+    int          n_points,
+    VIO_Real     world[][VIO_N_DIMENSIONS],
+    VIO_Real     voxels[][VIO_MAX_DIMENSIONS] )
+{
+    int        p, d, n_dims, a0, a1, a2;
+    VIO_Real   (*m)[4], x, y, z;
+
+    check_recompute_world_transform( volume );
+
+    a0 = volume->spatial_axes[VIO_X];
+    a1 = volume->spatial_axes[VIO_Y];
+    a2 = volume->spatial_axes[VIO_Z];
+
+    if( !volume->world_matrices_valid || a0 < 0 || a1 < 0 || a2 < 0 )
+    {
+        for_less( p, 0, n_points )
+        {
+            convert_world_to_voxel( volume, world[p][VIO_X], world[p][VIO_Y],
+                                    world[p][VIO_Z], voxels[p] );
+        }
+        return;
+    }
+
+    m = volume->world_to_voxel_matrix;
+    n_dims = get_volume_n_dimensions( volume );
+
+    for_less( p, 0, n_points )
+    {
+        x = world[p][VIO_X];
+        y = world[p][VIO_Y];
+        z = world[p][VIO_Z];
+
+        for_less( d, 0, n_dims )
+            voxels[p][d] = 0.0;
+
+        voxels[p][a0] = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+        voxels[p][a1] = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+        voxels[p][a2] = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+    }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_volume_voxel_min
 @INPUT      : volume
@@ -2398,10 +2595,8 @@ VIOAPI  void  set_volume_voxel_range(
 
     if( volume->real_range_set )
         set_volume_real_range( volume, real_min, real_max );
-#ifdef HAVE_MINC1
     else
         cache_volume_range_has_changed( volume );
-#endif
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -2550,10 +2745,8 @@ VIOAPI  void  set_volume_real_range(
         volume->real_range_set = TRUE;
     }
 
-#ifdef HAVE_MINC1
     if( volume->is_cached_volume )
         cache_volume_range_has_changed( volume );
-#endif
 }
 
 /* ----------------------------- MNI Header -----------------------------------